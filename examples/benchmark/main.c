@@ -0,0 +1,427 @@
+#include "alchemy/window.h"
+#include "alchemy/input.h"
+#include "alchemy/renderer/renderer.h"
+#include "alchemy/util/job.h"
+#include "alchemy/util/profile.h"
+#include "alchemy/util/str.h"
+#include "alchemy/util/time.h"
+
+#define SPRITE_COUNT 5000
+#define FRAMES_PER_MODE 120
+#define TEXTURE_SIZE 32
+#define TEXTURE_LAYERS 4
+#define TEXT_BENCHMARK_CHARS 10000
+#define TEXT_BENCHMARK_ITERATIONS 100
+#define JOB_BENCHMARK_COUNT (1 << 20)
+#define JOB_BENCHMARK_ITERATIONS 20
+#define ASYNC_LOADS_IN_FLIGHT 8
+#define ASYNC_LOAD_TEXTURE "textures/dvd.png"
+
+typedef enum SpriteBenchmarkMode
+{
+    SPRITE_BENCHMARK_UNBATCHED,
+    SPRITE_BENCHMARK_BATCHED,
+    SPRITE_BENCHMARK_BATCHED_ARRAY,
+    SPRITE_BENCHMARK_STATIC_FULL,
+    SPRITE_BENCHMARK_STATIC_DAMAGE,
+    SPRITE_BENCHMARK_RECORDING_THREAD,
+    SPRITE_BENCHMARK_ASYNC_LOADS,
+    SPRITE_BENCHMARK_COUNT
+} SpriteBenchmarkMode;
+
+global char* sprite_benchmark_mode_names[] =
+{
+    "unbatched",
+    "batched",
+    "batched (texture array)",
+    "static, full redraw",
+    "static, damage tracked",
+    "batched, recording thread",
+    "batched, async loads"
+};
+
+// NOTE(lucas): Deterministic so that every run draws the same scene
+internal f32 benchmark_random(u32* state)
+{
+    *state = *state*1664525u + 1013904223u;
+    f32 result = (f32)(*state >> 8) / (f32)(1 << 24);
+    return result;
+}
+
+// Checkerboard tinted by layer so that each texture array layer is distinguishable
+internal void fill_checkerboard(ubyte* pixels, int layer)
+{
+    for (int y = 0; y < TEXTURE_SIZE; ++y)
+    {
+        for (int x = 0; x < TEXTURE_SIZE; ++x)
+        {
+            ubyte* p = pixels + 4*(y*TEXTURE_SIZE + x);
+            ubyte on = (((x / 8) + (y / 8)) & 1) ? 255 : 96;
+            p[0] = (layer == 1 || layer == 3) ? 64 : on;
+            p[1] = (layer == 2 || layer == 3) ? 64 : on;
+            p[2] = (layer == 1) ? on : 192;
+            p[3] = 255;
+        }
+    }
+}
+
+// NOTE(lucas): The first measurement fills the font's metrics tables from FreeType. Later measurements are table walks.
+internal void benchmark_text_measurement(void)
+{
+    Font font = font_load_from_file("fonts/matrix_book.ttf");
+
+    persist u8 chars[TEXT_BENCHMARK_CHARS];
+    char* pangram = "The quick brown fox jumps over the lazy dog. AVATAR Wavy Type 0123456789! ";
+    u32 pangram_len = (u32)str_len(pangram);
+    for (u32 i = 0; i < TEXT_BENCHMARK_CHARS; ++i)
+        chars[i] = (u8)pangram[i % pangram_len];
+    s8 string = {chars, TEXT_BENCHMARK_CHARS};
+
+    u64 start = time_ticks();
+    Text text = text_init(string, &font, v2_zero(), 24);
+    f64 cold_ms = time_ticks_to_ms(time_ticks() - start);
+
+    f32 width = 0.0f;
+    start = time_ticks();
+    for (u32 i = 0; i < TEXT_BENCHMARK_ITERATIONS; ++i)
+        width += text_get_width(&text);
+    f64 warm_ms = time_ticks_to_ms(time_ticks() - start) / (f64)TEXT_BENCHMARK_ITERATIONS;
+
+    log_info("text_get_width (%u chars): cold %.3f ms, warm %.3f ms (%.1f chars/ms), width %.1f px",
+             TEXT_BENCHMARK_CHARS, cold_ms, warm_ms, (f64)TEXT_BENCHMARK_CHARS / warm_ms,
+             width / (f32)TEXT_BENCHMARK_ITERATIONS);
+}
+
+typedef struct JobBenchmarkData
+{
+    v2* positions;
+    f32* rotations;
+    v2* corners;
+} JobBenchmarkData;
+
+// NOTE(lucas): Rotates a quad's corners about its center, like the sprite batcher does for every sprite
+internal void job_benchmark_transform(void* data, u32 start, u32 end)
+{
+    JobBenchmarkData* benchmark = (JobBenchmarkData*)data;
+    for (u32 i = start; i < end; ++i)
+    {
+        v2 center = benchmark->positions[i];
+        f32 c = cos_f32(benchmark->rotations[i]);
+        f32 s = sin_f32(benchmark->rotations[i]);
+        v2 offsets[] = {{-8.0f, -8.0f}, {8.0f, -8.0f}, {8.0f, 8.0f}, {-8.0f, 8.0f}};
+        for (u32 j = 0; j < countof(offsets); ++j)
+        {
+            v2 offset = offsets[j];
+            benchmark->corners[4*i + j] = v2(center.x + offset.x*c - offset.y*s, center.y + offset.x*s + offset.y*c);
+        }
+    }
+}
+
+// NOTE(lucas): Runs the same parallel for with 1 worker up to one worker per logical processor
+internal void benchmark_job_scaling(void)
+{
+    u32 max_workers = thread_hardware_count();
+    if (max_workers > JOB_MAX_WORKERS)
+        max_workers = JOB_MAX_WORKERS;
+
+    MemoryArena arena = memory_arena_alloc(JOB_BENCHMARK_COUNT*(sizeof(v2) + sizeof(f32) + 4*sizeof(v2)));
+    JobBenchmarkData data = {0};
+    data.positions = push_array(&arena, JOB_BENCHMARK_COUNT, v2);
+    data.rotations = push_array(&arena, JOB_BENCHMARK_COUNT, f32);
+    data.corners = push_array(&arena, 4*JOB_BENCHMARK_COUNT, v2);
+
+    u32 rng = 1;
+    for (u32 i = 0; i < JOB_BENCHMARK_COUNT; ++i)
+    {
+        data.positions[i] = v2(1280.0f*benchmark_random(&rng), 720.0f*benchmark_random(&rng));
+        data.rotations[i] = 6.28318f*benchmark_random(&rng);
+    }
+
+    MemoryArena job_arena = memory_arena_alloc(max_workers*JOB_QUEUE_SIZE*sizeof(Job));
+    persist JobSystem jobs;
+    f64 single_worker_ms = 0.0;
+    for (u32 worker_count = 1; worker_count <= max_workers;)
+    {
+        memory_arena_clear(&job_arena);
+        job_system_init(&jobs, worker_count, &job_arena);
+
+        u64 start = time_ticks();
+        for (u32 i = 0; i < JOB_BENCHMARK_ITERATIONS; ++i)
+            job_parallel_for(&jobs, JOB_BENCHMARK_COUNT, 0, job_benchmark_transform, &data);
+        f64 ms = time_ticks_to_ms(time_ticks() - start) / (f64)JOB_BENCHMARK_ITERATIONS;
+
+        u64 stolen = 0;
+        for (u32 i = 0; i < worker_count; ++i)
+            stolen += jobs.workers[i].jobs_stolen;
+        job_system_shutdown(&jobs);
+
+        if (worker_count == 1)
+            single_worker_ms = ms;
+        log_info("job_parallel_for (%u quads) with %2u workers: %8.3f ms, %5.2fx speedup, %llu steals",
+                 JOB_BENCHMARK_COUNT, worker_count, ms, single_worker_ms / ms, stolen);
+
+        if (worker_count == max_workers)
+            break;
+        worker_count = (2*worker_count < max_workers) ? 2*worker_count : max_workers;
+    }
+}
+
+typedef struct SpriteRecordingData
+{
+    Renderer* renderer;
+    Sprite* sprites;
+    u32 count;
+    u32 frame;
+} SpriteRecordingData;
+
+// NOTE(lucas): Only draw_sprite runs on the recording thread, see renderer_thread_begin
+internal void sprite_recording_thread(void* data)
+{
+    SpriteRecordingData* recording = (SpriteRecordingData*)data;
+    renderer_thread_begin(recording->renderer, 0, 0);
+    for (u32 i = 0; i < recording->count; ++i)
+    {
+        Sprite sprite = recording->sprites[i];
+        sprite.rotation += (f32)recording->frame;
+        draw_sprite(recording->renderer, sprite);
+    }
+    renderer_thread_end(recording->renderer);
+}
+
+/* NOTE(lucas):
+ *
+ *     benchmark [--profile <trace file>]
+ *
+ * With --profile, the CPU profiler records the whole run and exports a Chrome trace when the window is closed.
+ */
+int main(int argc, char** argv)
+{
+    const char* profile_filename = NULL;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (str_eq(argv[i], "--profile") && i + 1 < argc)
+            profile_filename = argv[++i];
+    }
+    if (profile_filename)
+        profile_init(0);
+
+    int initial_window_width = 1280;
+    int initial_window_height = 720;
+
+    benchmark_text_measurement();
+    benchmark_job_scaling();
+
+    Window* window = window_create("Benchmark", initial_window_width, initial_window_height);
+
+    Input input = {0};
+    Renderer renderer = renderer_init(window, initial_window_width, initial_window_height, MEGABYTES(4));
+    renderer.config.gpu_profiling = true;
+    renderer.clear_color = (v4){0.1f, 0.1f, 0.1f, 1.0f};
+    renderer_threads_init(&renderer, 1, MEGABYTES(4));
+
+    // NOTE(lucas): Decode jobs are submitted by renderer_render, so the job system is initialized on this thread
+    u32 worker_count = thread_hardware_count();
+    if (worker_count > JOB_MAX_WORKERS)
+        worker_count = JOB_MAX_WORKERS;
+    MemoryArena job_arena = memory_arena_alloc(worker_count*JOB_QUEUE_SIZE*sizeof(Job));
+    persist JobSystem jobs;
+    job_system_init(&jobs, worker_count, &job_arena);
+    texture_loader_init(&renderer, &jobs, 0);
+    TextureLoadHandle async_loads[ASYNC_LOADS_IN_FLIGHT] = {0};
+    b32 async_load_failed = false;
+
+    // NOTE(lucas): Texture uploads are queued until the next render, so the texture keeps its own pixels
+    persist ubyte texture_pixels[TEXTURE_SIZE*TEXTURE_SIZE*4];
+    fill_checkerboard(texture_pixels, 0);
+    Texture texture = texture_load_from_memory(&renderer, TEXTURE_SIZE, TEXTURE_SIZE, 4, texture_pixels);
+
+    persist ubyte layer_pixels[TEXTURE_LAYERS][TEXTURE_SIZE*TEXTURE_SIZE*4];
+
+    Texture texture_array = texture_array_init(&renderer, TEXTURE_SIZE, TEXTURE_SIZE, TEXTURE_LAYERS);
+    for (int layer = 0; layer < TEXTURE_LAYERS; ++layer)
+    {
+        fill_checkerboard(layer_pixels[layer], layer);
+        texture_array_set_layer(&renderer, &texture_array, layer, 4, layer_pixels[layer]);
+    }
+
+    persist Sprite sprites[SPRITE_COUNT];
+    u32 rng = 1;
+    for (u32 i = 0; i < SPRITE_COUNT; ++i)
+    {
+        Sprite* sprite = sprites + i;
+        *sprite = sprite_init(&texture);
+        sprite->position = v2(benchmark_random(&rng)*(f32)initial_window_width,
+                              benchmark_random(&rng)*(f32)initial_window_height);
+        sprite->size = v2_full(8.0f + 24.0f*benchmark_random(&rng));
+        sprite->rotation = 360.0f*benchmark_random(&rng);
+        sprite->color = (v4){0.5f + 0.5f*benchmark_random(&rng), 0.5f + 0.5f*benchmark_random(&rng), 1.0f, 1.0f};
+        sprite->layer = i % TEXTURE_LAYERS;
+    }
+
+    SpriteBenchmarkMode mode = SPRITE_BENCHMARK_UNBATCHED;
+    u32 frame = 0;
+    u64 render_ticks = 0;
+    u64 frame_ticks = 0;
+    u32 draw_calls = 0;
+    u64 dirty_pixels = 0;
+    u32 target_allocations = 0;
+    f32 gpu_pass_ms[GPUPass_Count] = {0};
+    u32 gpu_frames = 0;
+    u64 upload_bytes = 0;
+    u32 textures_loaded = 0;
+
+    while(window->open)
+    {
+        input_process(window, &input);
+
+        u64 frame_start = time_ticks();
+
+        // NOTE(lucas): The static modes draw the same sprites every frame plus one small moving quad,
+        // so they measure how much damage tracking saves when almost nothing changes
+        b32 static_scene = (mode == SPRITE_BENCHMARK_STATIC_FULL || mode == SPRITE_BENCHMARK_STATIC_DAMAGE);
+        renderer.config.damage_tracking = (mode == SPRITE_BENCHMARK_STATIC_DAMAGE);
+
+        renderer_viewport(&renderer, rect_min_dim(v2_zero(), v2((f32)window->width, (f32)window->height)));
+        renderer_new_frame(&renderer, window);
+        renderer.config.batching = (mode != SPRITE_BENCHMARK_UNBATCHED);
+
+        Texture* sprite_texture = (mode == SPRITE_BENCHMARK_BATCHED_ARRAY) ? &texture_array : &texture;
+
+        // NOTE(lucas): The second half of the sprites is recorded on another thread while the main thread records the
+        // first half. The thread is created and joined every frame, so its startup cost is part of the frame time.
+        u32 main_thread_sprites = SPRITE_COUNT;
+        Thread recording_thread = {0};
+        SpriteRecordingData recording = {0};
+        if (mode == SPRITE_BENCHMARK_RECORDING_THREAD)
+        {
+            main_thread_sprites = SPRITE_COUNT / 2;
+            recording.renderer = &renderer;
+            recording.sprites = sprites + main_thread_sprites;
+            recording.count = SPRITE_COUNT - main_thread_sprites;
+            recording.frame = frame;
+            if (!thread_create(&recording_thread, sprite_recording_thread, &recording))
+                main_thread_sprites = SPRITE_COUNT;
+        }
+
+        for (u32 i = 0; i < main_thread_sprites; ++i)
+        {
+            Sprite sprite = sprites[i];
+            sprite.texture = sprite_texture;
+            if (!static_scene)
+                sprite.rotation += (f32)frame;
+            draw_sprite(&renderer, sprite);
+        }
+        if (main_thread_sprites < SPRITE_COUNT)
+            thread_join(&recording_thread);
+
+        // NOTE(lucas): Keeps the same file loading in every slot. Loaded textures are freed as soon as they complete,
+        // since only the decode and upload cost is measured. Loads still in flight when the mode ends finish during the
+        // next mode.
+        if (mode == SPRITE_BENCHMARK_ASYNC_LOADS)
+        {
+            for (u32 i = 0; i < ASYNC_LOADS_IN_FLIGHT; ++i)
+            {
+                TextureLoadStatus status = texture_load_status(&renderer, async_loads[i]);
+                if (status == TEXTURE_LOAD_COMPLETE || status == TEXTURE_LOAD_FAILED)
+                {
+                    if (status == TEXTURE_LOAD_COMPLETE)
+                        texture_free(&renderer, texture_load_get(&renderer, async_loads[i]));
+                    else
+                        async_load_failed = true;
+                    texture_load_release(&renderer, async_loads[i]);
+                    status = TEXTURE_LOAD_INVALID;
+                }
+
+                if (status == TEXTURE_LOAD_INVALID && !async_load_failed)
+                    async_loads[i] = texture_load_async(&renderer, ASYNC_LOAD_TEXTURE);
+            }
+        }
+
+        if (static_scene)
+        {
+            v2 position = v2(4.0f*(f32)frame, 0.5f*(f32)window->height);
+            draw_quad(&renderer, position, v2_full(32.0f), (v4){1.0f, 0.3f, 0.2f, 1.0f}, 0.0f);
+        }
+
+        u64 start = time_ticks();
+        renderer_render(&renderer);
+        render_ticks += time_ticks() - start;
+        dirty_pixels += renderer.stats.damage_dirty_pixels;
+        target_allocations += renderer.stats.render_target_allocations;
+        upload_bytes += renderer.stats.texture_upload_bytes;
+        textures_loaded += renderer.stats.textures_loaded;
+
+        // NOTE(lucas): GPU times arrive a few frames late, so the first ones of a mode may belong to the previous mode
+        if (renderer.gpu_profiler.latest_updated)
+        {
+            GPUFrameTimes gpu_times = renderer_gpu_times(&renderer);
+            for (u32 i = 0; i < GPUPass_Count; ++i)
+                gpu_pass_ms[i] += gpu_times.pass_ms[i];
+            ++gpu_frames;
+        }
+
+        // NOTE(lucas): The unbatched path issues one draw per sprite, which is not counted by the sprite batcher
+        if (mode == SPRITE_BENCHMARK_UNBATCHED)
+            draw_calls += SPRITE_COUNT;
+        else
+            draw_calls += renderer.stats.sprite_draw_calls;
+
+        window_render(window);
+        frame_ticks += time_ticks() - frame_start;
+
+        if (++frame == FRAMES_PER_MODE)
+        {
+            // NOTE(lucas): GL work is queued, so the whole frame including the swap is timed as well as the render call
+            f64 ms = time_ticks_to_ms(render_ticks) / (f64)FRAMES_PER_MODE;
+            f64 frame_ms = time_ticks_to_ms(frame_ticks) / (f64)FRAMES_PER_MODE;
+            log_info("%-24s %8.3f ms/frame (%8.3f ms with swap)  %10.1f sprites/ms  %6u draw calls/frame",
+                     sprite_benchmark_mode_names[mode], ms, frame_ms, (f64)SPRITE_COUNT / ms,
+                     draw_calls / FRAMES_PER_MODE);
+
+            // NOTE(lucas): Should stay at 0 unless the window was resized during the run
+            log_info("%-24s %8u render target allocations", "", target_allocations);
+
+            for (u32 i = 0; gpu_frames && i < GPUPass_Count; ++i)
+                log_info("%-24s %8.3f ms/frame GPU %s", "", gpu_pass_ms[i] / (f32)gpu_frames, gpu_pass_name(i));
+
+            if (mode == SPRITE_BENCHMARK_STATIC_DAMAGE)
+            {
+                f64 viewport_pixels = (f64)window->width*(f64)window->height;
+                log_info("%-24s %8.2f%% of the viewport redrawn per frame", "",
+                         100.0*(f64)dirty_pixels / ((f64)FRAMES_PER_MODE*viewport_pixels));
+            }
+
+            if (mode == SPRITE_BENCHMARK_ASYNC_LOADS)
+            {
+                log_info("%-24s %8.3f MB/frame uploaded, %6.2f textures/frame loaded", "",
+                         (f64)upload_bytes / (f64)(FRAMES_PER_MODE*MEGABYTES(1)),
+                         (f64)textures_loaded / (f64)FRAMES_PER_MODE);
+            }
+
+            mode = (mode + 1) % SPRITE_BENCHMARK_COUNT;
+            frame = 0;
+            render_ticks = 0;
+            frame_ticks = 0;
+            draw_calls = 0;
+            dirty_pixels = 0;
+            target_allocations = 0;
+            upload_bytes = 0;
+            textures_loaded = 0;
+            gpu_frames = 0;
+            for (u32 i = 0; i < GPUPass_Count; ++i)
+                gpu_pass_ms[i] = 0.0f;
+        }
+    }
+
+    texture_free(&renderer, &texture_array);
+    renderer_delete(&renderer);
+    job_system_shutdown(&jobs);
+
+    if (profile_filename)
+    {
+        profile_export_chrome_trace(profile_filename);
+        profile_shutdown();
+    }
+
+    return 0;
+}
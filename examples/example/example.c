@@ -149,7 +149,7 @@ internal void example_state_init(ExampleState* state, GameMemory* memory, Input*
     state->sword_cursor = cursor_load_from_file("cursors/sword.ani");
 
     // nuklear example
-    ui_state_init(renderer, state->matrix_font, 14, &state->permanent_arena);
+    ui_state_init(renderer, state->matrix_font, 14, UI_BACKEND_RENDER_COMMANDS, &state->permanent_arena);
     UIState* ui_state = &renderer->ui_state;
     ui_state->keyboard = &input->keyboard;
     ui_state->mouse = &input->mouse;
@@ -18,6 +18,8 @@ int main(void)
     GameMemory memory = game_memory_init(MEGABYTES(4), MEGABYTES(4));
     Renderer renderer = renderer_init(window, window->width, window->height, MEGABYTES(4));
     renderer.clear_color = (v4){0.10f, 0.18f, 0.24f, 1.0f};
+    renderer.config.batching = true;
+    renderer.config.sdf_shapes = true;
     Input input = {0};
 
     GameCode game = game_code_load("example.dll");
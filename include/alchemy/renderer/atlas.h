@@ -0,0 +1,80 @@
+#pragma once
+
+#include "alchemy/renderer/sprite.h"
+#include "alchemy/renderer/texture.h"
+#include "alchemy/util/math.h"
+#include "alchemy/util/memory.h"
+#include "alchemy/util/types.h"
+
+#define ATLAS_MAX_PAGES 16
+
+/* NOTE(lucas): Small images are packed into large RGBA8 (or R8) pages with a skyline packer so that sprites and UI images
+ * from the same page share a GL texture and can be batched together. Images are inserted incrementally. Individual
+ * regions cannot be freed; instead, a whole page is evicted at once. When every page is full, the least recently
+ * used page is evicted to make room. Regions remember the generation of their page, so stale regions can be detected
+ * with atlas_region_valid and re-inserted.
+ */
+
+// A horizontal segment of the skyline: the top of everything packed in [x, x + width)
+typedef struct AtlasSkylineNode
+{
+    i32 x;
+    i32 y;
+    i32 width;
+} AtlasSkylineNode;
+
+typedef struct AtlasPage
+{
+    Texture texture;
+    ubyte* pixels;    // Copy of the page's texels, which queued uploads read from
+
+    AtlasSkylineNode* nodes;
+    u32 node_count;
+
+    u32 generation;   // Incremented every time the page is evicted
+    u32 region_count; // Regions packed since the last eviction
+    u64 last_used;    // Atlas tick of the last insert or touch, used to pick a page to evict
+} AtlasPage;
+
+typedef struct AtlasRegion
+{
+    Texture* texture; // Texture of the page the region lives in
+    rect uv;          // Normalized texture coordinates of the region within the page
+    i32 x, y;         // Position of the region within the page in pixels
+    i32 width, height;
+
+    u32 page;
+    u32 generation;
+} AtlasRegion;
+
+typedef struct TextureAtlas
+{
+    AtlasPage pages[ATLAS_MAX_PAGES];
+    u32 page_count;
+    u32 max_pages;
+
+    i32 page_size;
+    i32 channels; // 1 for R8 pages (e.g. glyphs), otherwise 4 for RGBA8 pages
+    i32 padding; // Empty texels between regions so linear filtering doesn't bleed between neighbours
+
+    u64 tick;
+    u32 evictions;
+} TextureAtlas;
+
+// NOTE(lucas): Pages come from the renderer's texture pool. Their storage, clears and inserted regions are copied into
+// the page's pixels and queued, and uploaded at the next render, so the atlas never calls GL itself. Every page keeps
+// page_size*page_size*channels bytes of pixels in the arena.
+// IMPORTANT: The arena must live as long as the atlas.
+void atlas_init(TextureAtlas* atlas, i32 page_size, u32 max_pages, i32 channels, MemoryArena* arena);
+void atlas_delete(Renderer* renderer, TextureAtlas* atlas);
+
+// Returns a region with a NULL texture if the image can never fit in a page. The data is copied, so it can be freed
+// right away.
+AtlasRegion atlas_insert(Renderer* renderer, TextureAtlas* atlas, int width, int height, int channels, ubyte* data);
+AtlasRegion atlas_load_from_file(Renderer* renderer, TextureAtlas* atlas, const char* filename);
+
+b32 atlas_region_valid(TextureAtlas* atlas, AtlasRegion* region);
+void atlas_touch(TextureAtlas* atlas, AtlasRegion* region);
+void atlas_evict_page(Renderer* renderer, TextureAtlas* atlas, u32 page);
+
+Sprite sprite_from_atlas(AtlasRegion* region);
@@ -0,0 +1,166 @@
+#pragma once
+
+#include "alchemy/renderer/font.h"
+#include "alchemy/renderer/texture.h"
+#include "alchemy/renderer/ui.h"
+#include "alchemy/util/math.h"
+#include "alchemy/util/types.h"
+
+typedef struct Renderer Renderer;
+
+#define RENDER_CAPTURE_MAGIC 0x50434C41       // "ALCP"
+#define RENDER_CAPTURE_FRAME_MAGIC 0x4D415246 // "FRAM"
+
+// IMPORTANT: Commands are stored as their in-memory structs, so bump the version whenever a command struct changes
+#define RENDER_CAPTURE_VERSION 1
+
+/* NOTE(lucas): Capture file layout. Everything is little endian, and each section is padded to a multiple of 16 bytes.
+ *
+ *     RenderCaptureHeader
+ *     For each frame:
+ *         RenderCaptureFrameHeader
+ *         Commands, exactly as they were in the command buffer after the UI and other threads' commands were added
+ *         Text string bytes
+ *         RenderCaptureTexture[texture_count]
+ *         RenderCaptureFont[font_count]
+ *         RenderCaptureUIDraw[ui_draw_count]
+ *         UI vertex bytes
+ *         UI element bytes
+ *
+ * Pointers in commands are replaced with references into the frame's tables. Sprite textures become an index into
+ * the texture table plus one, text fonts become an index into the font table plus one, and text strings become a byte
+ * offset into the string bytes. A reference of zero means the pointer was NULL.
+ *
+ * Textures are captured by identity (GL name, size, channels, and layers), not by contents. Fonts are captured by
+ * family name. Replaying substitutes textures and fonts provided by the caller.
+ */
+
+typedef struct RenderCaptureHeader
+{
+    u32 magic;
+    u32 version;
+    u32 pointer_bytes; // sizeof(void*) of the program that wrote the capture
+    u32 frame_count;   // Written when the capture ends, 0 if it never ended
+} RenderCaptureHeader;
+
+// Renderer settings that change how a frame is drawn, so a replay can use the same ones
+typedef enum RenderCaptureFlag
+{
+    RenderCaptureFlag_Batching          = 1 << 0,
+    RenderCaptureFlag_DamageTracking    = 1 << 1,
+    RenderCaptureFlag_DynamicResolution = 1 << 2,
+} RenderCaptureFlag;
+
+typedef struct RenderCaptureFrameHeader
+{
+    u32 magic;
+    u32 command_count;
+    u32 command_bytes;
+    u32 string_bytes;
+    u32 texture_count;
+    u32 font_count;
+    u32 ui_draw_count;
+    u32 ui_vertex_bytes;
+    u32 ui_element_bytes;
+    i32 window_width;
+    i32 window_height;
+    u32 flags; // RenderCaptureFlag
+    i32 msaa_level;
+    f32 resolution_scale; // Dynamic resolution scale the frame was drawn at, 1 if dynamic resolution was off
+    u32 unused_[2];
+    rect viewport;
+    v4 clear_color;
+} RenderCaptureFrameHeader;
+
+typedef struct RenderCaptureTexture
+{
+    u32 id;
+    i32 width;
+    i32 height;
+    i32 channels;
+    i32 layers;
+} RenderCaptureTexture;
+
+typedef struct RenderCaptureFont
+{
+    u32 sdf;
+    u32 sdf_px;
+    char family[56];
+} RenderCaptureFont;
+
+typedef struct RenderCaptureUIDraw
+{
+    rect clip;
+    u32 texture; // Index into the texture table plus one
+    u32 element_count;
+} RenderCaptureUIDraw;
+
+typedef struct RenderCapture
+{
+    // NOTE(lucas): Frames are written by renderer_render while a capture is running
+    void* file;
+    u32 frame_count;
+    u32 frames_left; // 0 captures until render_capture_end
+
+    // NOTE(lucas): While a captured frame is replayed, its UI buffers replace the UI state's until the frame is rendered
+    b32 replaying;
+    void* ui_vertices;
+    void* ui_elements;
+    UIDrawCommand* ui_draws;
+    u32 ui_draw_count;
+} RenderCapture;
+
+// A frame of a loaded capture. Pointers point into the capture's memory.
+typedef struct RenderCaptureFrame
+{
+    RenderCaptureFrameHeader* header;
+    u8* commands;
+    u8* strings;
+    RenderCaptureTexture* textures;
+    RenderCaptureFont* fonts;
+    RenderCaptureUIDraw* ui_draws;
+    u8* ui_vertices;
+    u8* ui_elements;
+} RenderCaptureFrame;
+
+typedef struct RenderCaptureFile
+{
+    u8* data;
+    size bytes;
+    RenderCaptureFrame* frames;
+    u32 frame_count;
+} RenderCaptureFile;
+
+// What to draw in place of captured textures and fonts when replaying
+typedef struct RenderCaptureResources
+{
+    u32* texture_ids;         // Captured GL names
+    Texture** textures;       // Texture drawn in place of each captured name
+    u32 texture_count;
+    Texture* missing_texture; // Drawn for names that are not in the table. May be NULL.
+    Font* font;               // Drawn in place of every captured font
+} RenderCaptureResources;
+
+// Captures the next frame_count frames rendered, or every frame until render_capture_end if frame_count is 0
+b32 render_capture_begin(Renderer* renderer, const char* filename, u32 frame_count);
+void render_capture_end(Renderer* renderer);
+b32 render_capture_active(Renderer* renderer);
+
+// Called by renderer_render once the command buffer is complete
+void render_capture_frame(Renderer* renderer);
+
+// Loads and validates a whole capture file
+b32 render_capture_load(RenderCaptureFile* capture, const char* filename);
+void render_capture_free(RenderCaptureFile* capture);
+
+// Collects every distinct texture referenced by the capture, so that stand-ins can be created before replaying.
+// Returns the number of textures, which may be more than max_textures.
+u32 render_capture_textures(RenderCaptureFile* capture, RenderCaptureTexture* textures, u32 max_textures);
+
+// Fills the command buffer with a captured frame. Call between renderer_new_frame and renderer_render. The renderer's
+// viewport and the settings in the frame's flags should be set from the frame header before renderer_new_frame, since
+// that is when render targets are sized. The frame's UI is drawn in place of the current UI.
+void render_capture_replay(Renderer* renderer, RenderCaptureFrame* frame, RenderCaptureResources* resources);
+
+// Called by renderer_render once a replayed frame has been drawn. Puts the UI state's own buffers back.
+void render_capture_replay_end(Renderer* renderer);
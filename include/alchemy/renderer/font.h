@@ -1,5 +1,6 @@
 #pragma once
 
+#include "alchemy/renderer/atlas.h"
 #include "alchemy/util/math.h"
 #include "alchemy/util/memory.h"
 #include "alchemy/util/str.h"
@@ -8,15 +9,121 @@
 #include <ft2build.h>
 #include FT_FREETYPE_H
 
+// NOTE(lucas): FT_RENDER_MODE_SDF was added in FreeType 2.11
+#if (FREETYPE_MAJOR > 2) || (FREETYPE_MAJOR == 2 && FREETYPE_MINOR >= 11)
+    #define FONT_SDF_SUPPORTED 1
+#else
+    #define FONT_SDF_SUPPORTED 0
+#endif
+
+#define FONT_SDF_DEFAULT_PX 48
+#define FONT_SDF_SPREAD 8 // Distance in pixels at the reference size covered by the distance field on each side of an edge
+
 typedef struct Renderer Renderer;
 typedef struct RenderCommandText RenderCommandText;
 
-// NOTE(lucas): For now, there will be a font renderer for each different font
+#define FONT_METRICS_MAX_SIZES 16
+#define FONT_METRICS_MAX_GLYPHS 512     // Per pixel size. Must be a power of two.
+#define FONT_METRICS_MAX_KERNING 2048   // Per pixel size. Must be a power of two.
+
+typedef struct GlyphMetrics
+{
+    u32 codepoint;
+    u32 glyph_index;
+    f32 advance;
+    f32 bearing_x; // Offset from the pen position to the left edge of the glyph
+    f32 bearing_y; // Offset from the baseline to the top edge of the glyph
+    f32 width;     // Size of the glyph's bitmap
+    f32 height;
+    b32 used;
+} GlyphMetrics;
+
+typedef struct KerningPair
+{
+    u32 left;  // Glyph indices
+    u32 right;
+    f32 kerning;
+    b32 used;
+} KerningPair;
+
+typedef struct FontSizeMetrics
+{
+    u32 px;
+    u32 px_width;       // Width the face was set to, resolved from the face if the default width was asked for
+    b32 default_width;  // Whether px_width is the face's default width for px
+    f32 line_height;
+    u64 last_used;
+
+    // NOTE(lucas): Open addressed tables, filled lazily. A slot that is not used is empty.
+    GlyphMetrics* glyphs;
+    u32 glyph_count;
+    KerningPair* kerning;
+    u32 kerning_count;
+} FontSizeMetrics;
+
+/* NOTE(lucas): Glyph metrics and kerning are looked up from FreeType once per pixel size and width and then served
+ * from tables, so measuring text is a table walk. When every size slot is taken, the least recently used size is reused.
+ */
+typedef struct FontMetrics
+{
+    FontSizeMetrics sizes[FONT_METRICS_MAX_SIZES];
+    u32 size_count;
+    u32 last_size; // Index of the most recently used size, checked first
+    u64 tick;
+    b32 has_kerning;
+} FontMetrics;
+
+/* NOTE(lucas): For now, there will be a font renderer for each different font
+ * Copies of a font share its metrics.
+ *
+ * SDF fonts rasterize each glyph once as a signed distance field at a reference size and draw it scaled to any size.
+ * Their text is also measured at the reference size and scaled, so changing the size of SDF text never touches FreeType.
+ */
 typedef struct Font
 {
     FT_Face face;
+    FontMetrics* metrics;
+
+    b32 sdf;
+    u32 sdf_px; // Reference size glyphs are rasterized at
 } Font;
 
+#define GLYPH_CACHE_MAX_ENTRIES 4096 // Must be a power of two
+#define GLYPH_ATLAS_PAGE_SIZE 1024
+#define GLYPH_ATLAS_MAX_PAGES 4
+#define TEXT_BATCH_MAX_GLYPHS 4096
+
+typedef struct GlyphKey
+{
+    FT_Face face;
+    u32 px;
+    u32 px_width;
+    u32 glyph_index;
+    b32 sdf;
+} GlyphKey;
+
+typedef struct Glyph
+{
+    GlyphKey key;
+    AtlasRegion region; // Zero sized for glyphs without a bitmap, such as spaces
+    f32 left;           // Offset from the pen position to the left edge of the bitmap
+    f32 top;            // Offset from the baseline to the top edge of the bitmap
+} Glyph;
+
+/* NOTE(lucas): Glyphs are rasterized once per (font, pixel size, glyph index) into R8 atlas pages and drawn from there.
+ * When the atlas is full, its least recently used page is evicted, and glyphs that lived there are rasterized again
+ * the next time they are drawn. There must be at least two pages so the page the current string is drawing from is
+ * never the one evicted.
+ */
+typedef struct GlyphCache
+{
+    // NOTE(lucas): Open addressed table. A glyph with a NULL face is an empty slot.
+    Glyph* glyphs;
+    u32 glyph_count;
+
+    TextureAtlas atlas;
+} GlyphCache;
+
 typedef struct Text
 {
     Font* font;
@@ -64,17 +171,100 @@ typedef struct TextArea
     Text text;
 } TextArea;
 
+#define TEXT_LAYOUT_CACHE_MAX_ENTRIES 64
+
+// A word or a run of whitespace placed on a line of a text area
+typedef struct TextRun
+{
+    u32 offset; // Byte offset of the run in the string
+    u32 len;
+    f32 x;      // Offset from the left edge of the text area, including horizontal alignment
+    f32 width;
+    b32 is_space;
+} TextRun;
+
+typedef struct TextLine
+{
+    u32 offset; // Byte offset of the start of the line in the string
+    u32 first_run;
+    u32 run_count;
+    f32 width;   // Width without trailing whitespace
+    b32 wrapped; // The line ran out of room, as opposed to ending at a newline or the end of the text
+} TextLine;
+
+// NOTE(lucas): Only the inputs that affect line breaking and horizontal placement. The position and height of the
+// bounds and the vertical alignment are applied when the layout is drawn.
+typedef struct TextLayoutKey
+{
+    FT_Face face;
+    b32 sdf;
+    u32 px;
+    u32 px_width;
+    f32 width;
+    TextAreaStyle style;
+    TextAlignmentHoriz horiz_alignment;
+} TextLayoutKey;
+
+typedef struct TextLayout
+{
+    TextLayoutKey key;
+    u32 hash; // Hash of the laid out string
+    size len;
+    u64 last_used;
+
+    u8* string; // Copy of the laid out string, compared on hash matches
+    u32 string_capacity;
+
+    TextRun* runs;
+    u32 run_count;
+    u32 run_capacity;
+
+    TextLine* lines;
+    u32 line_count;
+    u32 line_capacity;
+} TextLayout;
+
+/* NOTE(lucas): Text area layouts are cached by the hash of their string along with their layout key, so an unchanged
+ * text area is drawn straight from its runs without measuring anything. When a string is an extension of a cached
+ * string with the same key (e.g. a log that was appended to), only its last line is laid out again.
+ */
+typedef struct TextLayoutCache
+{
+    TextLayout layouts[TEXT_LAYOUT_CACHE_MAX_ENTRIES];
+    u32 layout_count;
+    u64 tick;
+} TextLayoutCache;
+
 Font font_load_from_file(const char* filename);
+// Switch a font to SDF rendering. Returns false if the FreeType version does not support SDF rendering.
+b32 font_enable_sdf(Font* font, u32 reference_px);
+
+// A px_width of 0 uses the face's default width for px. Asking for that width explicitly finds the same size.
+FontSizeMetrics* font_metrics_get_size(Font* font, u32 px, u32 px_width);
+// NOTE(lucas): The returned pointer is only valid until the next lookup
+GlyphMetrics* font_metrics_get_glyph(Font* font, FontSizeMetrics* size_metrics, u32 codepoint);
+f32 font_metrics_get_kerning(Font* font, FontSizeMetrics* size_metrics, u32 left_glyph, u32 right_glyph);
+// Fill the glyph metrics for every character in the charset ahead of time so later measurement doesn't touch FreeType.
+// Kerning pairs grow quadratically with the charset, so they are still filled lazily.
+void font_metrics_prewarm(Font* font, u32 px, s8 charset);
 
 Text text_init(s8 string, Font* font, v2 position, u32 px);
+// Same as text_init, but uses an already known string width instead of measuring the string.
+Text text_init_with_width(s8 string, Font* font, v2 position, u32 px, f32 string_width);
 void text_set_size_px(Text* text, u32 px);
 void text_scale(Text* text, f32 factor);
 
 f32 text_get_width(Text* text);
 
+void glyph_cache_init(GlyphCache* cache, MemoryArena* arena);
+void glyph_cache_delete(Renderer* renderer, GlyphCache* cache);
+
 void output_text(Renderer* renderer, RenderCommandText* cmd);
 
 TextArea text_area_init(Renderer* renderer, rect bounds, s8 str, Font* font, u32 text_size_px);
 void text_area_scale(TextArea* text_area, f32 factor);
 
 void draw_text_area(Renderer* renderer, TextArea* text_area);
+
+TextLayout* text_layout_get(Renderer* renderer, TextArea* text_area);
+void text_layout_cache_delete(TextLayoutCache* cache);
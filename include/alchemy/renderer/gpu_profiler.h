@@ -0,0 +1,77 @@
+#pragma once
+
+#include "alchemy/util/types.h"
+
+#define GPU_PROFILER_FRAMES 3               // Frames in flight before a frame's queries are read back
+#define GPU_PROFILER_MAX_SCOPES 512         // Per frame
+#define GPU_PROFILER_MAX_COMMAND_TYPES 32
+#define GPU_SCOPE_NONE 0xFFFFFFFF
+
+/* NOTE(lucas): Scopes are timed with a pair of GL_TIMESTAMP queries rather than GL_TIME_ELAPSED, since elapsed time
+ * queries can't be nested and the frame scope contains every other one. Each frame writes its own set of queries, and
+ * a frame's results are only read when its slot comes around again GPU_PROFILER_FRAMES frames later. If the results
+ * still aren't available then, the frame is dropped instead of waiting on the GPU.
+ */
+
+typedef enum GPUPass
+{
+    GPUPass_Frame,    // All of renderer_render
+    GPUPass_Uploads,  // Queued and asynchronous texture uploads
+    GPUPass_Shapes,   // Lines, triangles, quads, circles, and rings
+    GPUPass_Sprites,
+    GPUPass_Text,
+    GPUPass_UI,       // UI draws and the UI render cache
+    GPUPass_Resolve,  // MSAA resolve
+    GPUPass_Final,    // Drawing the offscreen framebuffer to the window
+    GPUPass_Count
+} GPUPass;
+
+typedef struct GPUScope
+{
+    u32 pass;
+    u32 command_type; // GPU_SCOPE_NONE unless command types are being profiled
+    b32 ended;        // Scopes that were never ended are skipped when reading back
+} GPUScope;
+
+typedef struct GPUProfilerFrame
+{
+    u32 queries[2*GPU_PROFILER_MAX_SCOPES]; // Begin and end timestamp of each scope
+    GPUScope scopes[GPU_PROFILER_MAX_SCOPES];
+    u32 scope_count;
+    u32 last_query; // End query of the scope that ended last, or 0 if none did
+    u64 frame;
+    b32 pending; // Queries were written and have not been read back yet
+} GPUProfilerFrame;
+
+// Per-frame breakdown. Scopes of the same pass or command type are summed.
+typedef struct GPUFrameTimes
+{
+    u64 frame; // Frame the times were measured in, counted by gpu_profiler_begin_frame
+    f32 pass_ms[GPUPass_Count];
+    f32 command_ms[GPU_PROFILER_MAX_COMMAND_TYPES]; // Indexed by RenderCommandType
+    u32 scope_count;
+} GPUFrameTimes;
+
+typedef struct GPUProfiler
+{
+    GPUProfilerFrame frames[GPU_PROFILER_FRAMES];
+    u32 current;
+    u64 frame;
+    b32 initialized;
+    b32 recording;
+
+    GPUFrameTimes latest; // Most recent frame that was read back
+    b32 latest_updated;   // True if latest changed at the last gpu_profiler_begin_frame
+    u32 dropped_frames;   // Frames whose results were not ready in time
+    u32 dropped_scopes;   // Scopes that did not fit in a frame
+} GPUProfiler;
+
+// Must be called with a current GL context. Queries are created on the first call that records.
+void gpu_profiler_begin_frame(GPUProfiler* profiler, b32 record);
+void gpu_profiler_delete(GPUProfiler* profiler);
+
+// Returns GPU_SCOPE_NONE if the profiler is not recording or the frame is out of scopes
+u32 gpu_profiler_begin(GPUProfiler* profiler, GPUPass pass, u32 command_type);
+void gpu_profiler_end(GPUProfiler* profiler, u32 scope);
+
+const char* gpu_pass_name(GPUPass pass);
@@ -1,7 +1,9 @@
 #pragma once
 
 #include "alchemy/window.h"
+#include "alchemy/renderer/capture.h"
 #include "alchemy/renderer/font.h"
+#include "alchemy/renderer/gpu_profiler.h"
 #include "alchemy/renderer/shader.h"
 #include "alchemy/renderer/sprite.h"
 #include "alchemy/renderer/texture.h"
@@ -28,9 +30,229 @@ typedef struct RendererConfig
 {
     b32 wireframe_mode;
     u32 circle_line_segments;
+
+    // NOTE(lucas): Curved shapes pick their segment count from their radius so that no point on the drawn edge is more
+    // than circle_max_error pixels from the true curve. Setting the error to 0 always uses circle_line_segments.
+    f32 circle_max_error;
+    u32 circle_min_segments;
+    u32 circle_max_segments;
     int msaa_level;
+
+    // NOTE(lucas): When batching is enabled, lines, triangles, quads, and gradients are transformed on the CPU
+    // and collected into one vertex buffer. The batch is only drawn when the shader, texture, or scissor changes.
+    // Off by default.
+    b32 batching;
+
+    // NOTE(lucas): When SDF shapes are enabled, circles, sectors, rings, and all outlines are drawn analytically
+    // by the shape shader as instanced quads instead of being tessellated. Rounded quads always use the shape shader.
+    // Off by default.
+    b32 sdf_shapes;
+
+    // NOTE(lucas): When damage tracking is enabled, each command's bounds are diffed against the previous frame's
+    // commands, and only the region that changed is cleared, drawn, and resolved. The rest of the framebuffer keeps
+    // last frame's contents. This only pays off for mostly static scenes. Commands are compared by value, so if a
+    // texture's contents change without any command changing, call renderer_invalidate_damage.
+    b32 damage_tracking;
+
+    // NOTE(lucas): When dynamic resolution is enabled, the frame is drawn into part of the offscreen framebuffer at a
+    // scale picked from recent frame times, and the final pass stretches it over the viewport. The scale stays between
+    // resolution_scale_min and resolution_scale_max and aims to keep frames under target_frame_ms.
+    b32 dynamic_resolution;
+    f32 target_frame_ms;
+    f32 resolution_scale_min;
+    f32 resolution_scale_max;
+
+    // NOTE(lucas): When GPU profiling is enabled, each pass of renderer_render is timed with timestamp queries and the
+    // results are read back a few frames later with renderer_gpu_times. Profiling commands also times each run of
+    // commands of the same type. Batches are drawn when they are flushed, so their time goes to the type that was last
+    // added to them. GPU frame times are passed on to dynamic resolution.
+    b32 gpu_profiling;
+    b32 gpu_profile_commands;
 } RendererConfig;
 
+// NOTE(lucas): Batched vertices use the same layout as the poly shader: position (2) and color (4)
+#define RENDER_BATCH_VERTEX_FLOATS 6
+
+typedef struct RenderBatch
+{
+    f32* vertices;
+    u32* indices;
+    u32 vertex_count;
+    u32 index_count;
+    u32 max_vertices;
+    u32 max_indices;
+
+    // Number of render commands collected into the current batch
+    u32 command_count;
+} RenderBatch;
+
+// NOTE(lucas): Must match the shape kinds in res/shaders/shape.fs
+typedef enum ShapeKind
+{
+    SHAPE_CIRCLE = 0,
+    SHAPE_ARC,
+    SHAPE_ROUNDED_RECT,
+    SHAPE_TRIANGLE
+} ShapeKind;
+
+/* NOTE(lucas): Per-instance data for the shape shader. Each shape is drawn as a quad centered on the shape and
+ * rotated about its center, and the fragment shader evaluates the shape's signed distance in that local space.
+ * params by kind:
+ *     circle:       radius
+ *     arc:          outer radius, inner radius, span in radians (arcs start at angle 0 and are rotated into place)
+ *     rounded rect: corner radius
+ *     triangle:     a (xy), b (zw), and c in params_ext, relative to center
+ * A thickness of 0 fills the shape. Otherwise, only an outline of that thickness inside the edge is drawn.
+ */
+typedef struct ShapeInstance
+{
+    v2 center;
+    v2 half_size;
+    v4 color;
+    v4 params;
+    v2 params_ext;
+    f32 rotation;  // Radians
+    f32 thickness;
+    f32 kind;
+    f32 unused_[3];
+} ShapeInstance;
+
+typedef struct ShapeBatch
+{
+    ShapeInstance* instances;
+    u32 count;
+    u32 max_count;
+} ShapeBatch;
+
+/* NOTE(lucas): Circles, sectors, rings, and ring outlines are tessellated once in unit space and kept in a static
+ * vertex/index buffer. Meshes always start at angle 0 and cover the arc's span, so drawing one is just a lookup,
+ * a model transform that scales and rotates it into place, and a draw of its index range.
+ * Spans and radius ratios are quantized so that animated shapes do not flood the cache with near-duplicates.
+ * The cache is reset if it runs out of room.
+ */
+#define TESSELLATION_CACHE_MAX_MESHES 512 // Must be a power of two
+#define TESSELLATION_CACHE_MAX_VERTICES (64*1024)
+#define TESSELLATION_CACHE_MAX_INDICES (192*1024)
+#define TESSELLATION_SPAN_STEPS 100.0f    // Steps per degree
+#define TESSELLATION_RATIO_STEPS 1024.0f  // Steps per unit radius
+
+typedef enum TessellationMeshType
+{
+    TESSELLATION_MESH_CIRCLE = 1,
+    TESSELLATION_MESH_SECTOR,
+    TESSELLATION_MESH_RING,
+    TESSELLATION_MESH_RING_OUTLINE
+} TessellationMeshType;
+
+typedef struct TessellationKey
+{
+    TessellationMeshType type;
+    u32 segs;
+    u32 span;  // Quantized arc span
+    u32 k0;    // Quantized radius ratios, meaning depends on mesh type
+    u32 k1;
+} TessellationKey;
+
+typedef struct TessellationMesh
+{
+    TessellationKey key;
+    u32 base_vertex;
+    u32 first_index;
+    u32 index_count;
+} TessellationMesh;
+
+typedef struct TessellationCache
+{
+    // NOTE(lucas): Open addressed table. A mesh with a zero key type is an empty slot.
+    TessellationMesh meshes[TESSELLATION_CACHE_MAX_MESHES];
+    u32 mesh_count;
+    u32 vertex_count;
+    u32 index_count;
+} TessellationCache;
+
+/* NOTE(lucas): Stream buffers hold all per-frame vertex and index data. The buffer is split into regions,
+ * and each frame writes into the next region. A fence is placed when the renderer is done with a region,
+ * and the region is not written again until the GPU has passed that fence.
+ * If persistent mapping is supported, the buffer is mapped once for its whole lifetime. Otherwise, each upload maps
+ * its range unsynchronized, and a region that is still in use by the GPU is orphaned instead of waited on.
+ */
+#define STREAM_BUFFER_REGIONS 3
+
+typedef struct StreamBuffer
+{
+    u32 id;
+    size region_bytes;
+    u32 region;   // Region currently being written
+    size offset;  // Write offset from the start of the buffer
+    u8* mapped;   // Base pointer if the buffer is persistently mapped, otherwise NULL
+    void* fences[STREAM_BUFFER_REGIONS];
+
+    size frame_bytes; // Number of bytes uploaded during the current frame
+    u32 orphan_count;
+} StreamBuffer;
+
+// NOTE(lucas): Per-frame data shared by all shaders that declare the Frame uniform block. Laid out as std140.
+typedef struct FrameUniforms
+{
+    m4 projection;
+} FrameUniforms;
+
+// NOTE(lucas): Stats are reset in renderer_new_frame, so they are valid after renderer_render returns.
+typedef struct RendererStats
+{
+    u32 batch_draw_calls;  // Number of draw calls issued by the batcher
+    u32 batched_commands;  // Number of commands that went through the batcher
+    u32 draws_merged;      // Number of draw calls saved by merging commands into batches
+
+    size vertex_upload_bytes; // Bytes written to the vertex stream this frame
+    size index_upload_bytes;  // Bytes written to the index stream this frame
+
+    u32 tessellation_hits;    // Curved shapes drawn from an already cached mesh
+    u32 tessellation_misses;  // Curved shapes that had to be tessellated
+    u32 tessellated_vertices;        // Vertices drawn by tessellated curved shapes
+    u32 tessellation_vertices_saved; // Vertices saved by adaptive segment counts versus circle_line_segments
+
+    u32 shape_draw_calls;     // Number of instanced draw calls issued by the shape pipeline
+    u32 shape_instances;      // Number of shapes drawn by the shape pipeline
+
+    u32 sprite_draw_calls;    // Number of draw calls issued by the sprite batcher
+    u32 sprites_batched;      // Number of sprites drawn by the sprite batcher
+
+    u32 glyph_cache_hits;     // Glyphs drawn from an already rasterized atlas region
+    u32 glyph_cache_misses;   // Glyphs that had to be rasterized
+    u32 text_draw_calls;      // Number of draw calls issued for text
+
+    u32 text_layout_hits;     // Text areas drawn from an unchanged cached layout
+    u32 text_layout_appends;  // Text areas whose cached layout was extended with appended text
+    u32 text_layout_misses;   // Text areas laid out from scratch
+
+    u32 ui_text_width_hits;   // Nuklear text width queries answered from the width cache
+    u32 ui_text_width_misses; // Nuklear text width queries that had to measure the string
+    u32 ui_draw_calls;        // Number of draw calls issued by the UI vertex buffer backend
+
+    u32 ui_cache_hits;            // 1 if the UI was composited from the render cache without drawing anything
+    u32 ui_cache_partial_redraws; // 1 if only the parts of the UI that changed were redrawn
+    u32 ui_cache_full_redraws;    // 1 if the whole UI was redrawn into the render cache
+    f32 ui_cache_saved_ms;        // Estimated CPU time saved by the render cache
+
+    u32 damage_dirty_pixels;  // Pixels cleared and redrawn this frame when damage tracking is enabled
+    u32 damage_full_redraws;  // 1 if damage tracking had to redraw the whole viewport
+
+    u32 thread_segments;      // Command segments recorded by other threads and merged into the command buffer
+    size thread_command_bytes; // Bytes of commands merged from other threads
+
+    size texture_upload_bytes; // Bytes of asynchronously loaded textures uploaded this frame
+    u32 textures_loaded;       // Asynchronous texture loads that completed this frame
+
+    u32 render_target_allocations; // Framebuffer attachments allocated this frame. 0 unless the viewport or MSAA changed.
+
+    f32 resolution_scale;     // Scale the frame was drawn at, 1 unless dynamic resolution is enabled
+    f32 resolution_cpu_ms;    // Last frame's CPU time as seen by the dynamic resolution controller
+    f32 resolution_gpu_ms;    // Last GPU time reported with renderer_report_gpu_time
+
+    GLStateStats gl_state;    // Binds issued and skipped by the GL state tracker
+} RendererStats;
+
 typedef enum RenderCommandType
 {
     RENDER_COMMAND_RenderCommandLine,
@@ -40,6 +262,7 @@ typedef enum RenderCommandType
     RENDER_COMMAND_RenderCommandQuad,
     RENDER_COMMAND_RenderCommandQuadOutline,
     RENDER_COMMAND_RenderCommandQuadGradient,
+    RENDER_COMMAND_RenderCommandQuadRounded,
     RENDER_COMMAND_RenderCommandCircle,
     RENDER_COMMAND_RenderCommandCircleOutline,
     RENDER_COMMAND_RenderCommandCircleSector,
@@ -48,6 +271,10 @@ typedef enum RenderCommandType
     RENDER_COMMAND_RenderCommandSprite,
     RENDER_COMMAND_RenderCommandText,
     RENDER_COMMAND_RenderCommandScissorTest,
+    RENDER_COMMAND_RenderCommandUI,
+    RENDER_COMMAND_RenderCommandUICacheBegin,
+    RENDER_COMMAND_RenderCommandUICacheComposite,
+    RENDER_COMMAND_COUNT
 } RenderCommandType;
 
 typedef struct RenderCommand
@@ -137,6 +364,18 @@ typedef struct RenderCommandQuadGradient
     f32 rotation;
 } RenderCommandQuadGradient;
 
+typedef struct RenderCommandQuadRounded
+{
+    RenderCommand header;
+    v2 position;
+    v2 origin;
+    v2 size;
+    v4 color;
+    f32 radius;
+    f32 thickness;
+    f32 rotation;
+} RenderCommandQuadRounded;
+
 typedef struct RenderCommandCircle
 {
     RenderCommand header;
@@ -211,6 +450,32 @@ typedef struct RenderCommandScissorTest
     v4 unused_;
 } RenderCommandScissorTest;
 
+// NOTE(lucas): Draws the vertices and draw commands converted by the UI vertex buffer backend, which live in the UI state
+typedef struct RenderCommandUI
+{
+    RenderCommand header;
+    u32 vertex_bytes;
+    u32 element_bytes;
+
+    // NOTE(lucas): Commands are packed back to back, so sizes are kept a multiple of 16 to keep v4 members aligned
+    u32 unused_;
+} RenderCommandUI;
+
+// NOTE(lucas): UI commands between the begin and composite commands are drawn into the UI render cache,
+// clipped to the region that changed
+typedef struct RenderCommandUICacheBegin
+{
+    RenderCommand header;
+    rect clip; // Bottom-left origin, like scissor tests
+    u32 unused_[3];
+} RenderCommandUICacheBegin;
+
+typedef struct RenderCommandUICacheComposite
+{
+    RenderCommand header;
+    u32 unused_[3];
+} RenderCommandUICacheComposite;
+
 typedef struct RenderCommandBuffer
 {
     size max_bytes;
@@ -218,11 +483,187 @@ typedef struct RenderCommandBuffer
     u8* base;
 } RenderCommandBuffer;
 
-typedef struct RenderID
+#define RENDER_MAX_THREADS 16
+#define RENDER_THREAD_MAX_SEGMENTS 1024
+
+/* NOTE(lucas): Worker threads record draws into their own command buffers between renderer_thread_begin and
+ * renderer_thread_end. Each begin/end pair is a segment with a sort key. At renderer_render, segments from every
+ * thread are appended to the main command buffer in order of key, then thread index, then recording order, so the
+ * result does not depend on thread timing as long as keys are unique. A layer can be put in the high bits of the key.
+ * Commands recorded directly on the main command buffer are drawn first, and the UI is drawn last.
+ *
+ * IMPORTANT: Only the draw_* calls are safe on worker threads. Text helpers such as text_init, text_get_width,
+ * text_area_init, and draw_text_area fill the font's metrics tables, set the FreeType face's size, and update the
+ * text layout cache and renderer stats, none of which are synchronized. Measure and lay out text on the main thread
+ * and pass the finished Text to draw_text on the worker.
+ */
+typedef struct RenderCommandSegment
 {
-    u32 id;
-    b32 used;
-} RenderID;
+    u64 key;
+    u32 thread;
+    u32 sequence;
+    size offset;
+    size bytes;
+} RenderCommandSegment;
+
+typedef struct RenderThreadBuffer
+{
+    RenderCommandBuffer command_buffer;
+    MemoryArena arena;         // Command buffer and segment storage
+    MemoryArena scratch_arena; // Strings copied by draw_text, cleared every frame
+
+    RenderCommandSegment* segments;
+    u32 segment_count;
+    volatile i64 recording; // Written by the recording thread and read by the main thread, so only use the atomics
+} RenderThreadBuffer;
+
+#define DAMAGE_MAX_RECORDS 16384
+
+// NOTE(lucas): Commands are identified by a hash of their contents. Bounds are in world coordinates and conservative.
+#define DAMAGE_NO_MATCH 0xFFFFFFFF
+
+typedef struct DamageRecord
+{
+    u64 hash;
+    rect bounds;
+    u32 order; // Submission index of the command
+} DamageRecord;
+
+typedef struct DamageTracker
+{
+    DamageRecord* records;      // This frame's commands, sorted by hash
+    DamageRecord* prev_records; // Last frame's commands, sorted by hash
+    u32 record_count;
+    u32 prev_record_count;
+
+    rect viewport;     // Viewport the previous frame was drawn with
+    b32 valid;         // False until a frame has been recorded, or after renderer_invalidate_damage
+
+    b32 active;        // Scissor tests are clipped to the dirty rect while the command buffer is drawn
+    rect dirty;        // Region redrawn this frame, bottom-left origin
+} DamageTracker;
+
+typedef enum RenderTargetID
+{
+    RenderTarget_Main,         // Scene target, multisampled when MSAA is enabled
+    RenderTarget_Intermediate, // MSAA resolve target
+    RenderTarget_UICache,      // UI render cache
+    RenderTarget_Count
+} RenderTargetID;
+
+typedef enum RenderTargetEventType
+{
+    RenderTargetEvent_Allocate,   // Attachments created or resized
+    RenderTargetEvent_Recreate,   // Color attachment replaced because it switched between multisampled and single-sampled
+} RenderTargetEventType;
+
+typedef struct RenderTargetEvent
+{
+    RenderTargetEventType type;
+    RenderTargetID target;
+    int width;
+    int height;
+    int samples;
+    u64 frame;
+} RenderTargetEvent;
+
+typedef void RenderTargetEventProc(void* data, RenderTargetEvent* event);
+
+#define RENDER_TARGET_MAX_EVENTS 64
+
+typedef struct RenderTargetState
+{
+    int width;
+    int height;
+    int samples;
+    u32 allocations; // Times the attachments have been allocated since the renderer was created
+} RenderTargetState;
+
+/* NOTE(lucas): Framebuffer attachments are only reallocated when the requested size or sample count differs from the
+ * one they were last allocated with, so a steady-state frame should show zero allocations. Every allocation is
+ * recorded as an event. The last RENDER_TARGET_MAX_EVENTS events are kept in a ring, and the callback, if set, is
+ * called for each one as it happens.
+ */
+typedef struct RenderTargetManager
+{
+    RenderTargetState targets[RenderTarget_Count];
+    u64 frame;
+
+    RenderTargetEvent events[RENDER_TARGET_MAX_EVENTS];
+    u64 event_count; // Total events recorded, the newest is at (event_count - 1) % RENDER_TARGET_MAX_EVENTS
+
+    RenderTargetEventProc* callback;
+    void* callback_data;
+} RenderTargetManager;
+
+#define DYNAMIC_RESOLUTION_HISTORY 16
+#define DYNAMIC_RESOLUTION_MAX_DECISIONS 64
+
+typedef struct DynamicResolutionDecision
+{
+    u64 frame;
+    f32 average_ms; // Average frame time over the history that led to the decision
+    f32 target_ms;
+    f32 old_scale;
+    f32 new_scale;
+} DynamicResolutionDecision;
+
+/* NOTE(lucas): A frame's time is the larger of its CPU time, from renderer_new_frame to the end of renderer_render, and
+ * the last GPU time reported with renderer_report_gpu_time. Time waiting on the swap is left out on purpose, since with
+ * vsync it would pin every frame at the refresh interval and the scale could never go back up.
+ * Rendered pixels scale with the square of the scale, so the scale is changed by the square root of the ratio between
+ * the target and the average frame time. Going up is limited to small steps so the scale does not oscillate. After a
+ * change, the history is cleared, so the next decision only sees frames drawn at the new scale.
+ */
+typedef struct DynamicResolution
+{
+    f32 scale;
+    v2 applied_scale; // Per axis ratio between the drawn size, rounded to whole pixels, and the viewport
+    b32 active;       // Scissor tests and the GL viewport are scaled while the frame is drawn
+
+    f32 history[DYNAMIC_RESOLUTION_HISTORY];
+    u32 history_count;
+    u64 frame_start;
+    f32 cpu_ms;
+    f32 gpu_ms;
+    b32 gpu_ms_profiled; // gpu_ms came from the GPU profiler rather than renderer_report_gpu_time
+    u64 frame;
+
+    DynamicResolutionDecision decisions[DYNAMIC_RESOLUTION_MAX_DECISIONS];
+    u64 decision_count; // Total decisions made, the newest is at (decision_count - 1) % DYNAMIC_RESOLUTION_MAX_DECISIONS
+} DynamicResolution;
+
+#define RENDERER_MAX_TEXTURES 1024
+#define RENDERER_MAX_TEXTURE_UPDATES 256
+#define TEXTURE_SLOT_NONE 0xFFFFFFFF
+
+/* NOTE(lucas): GL texture names are generated up front so that textures can be created without calling GL, e.g. from
+ * the game DLL. Uploads and deletions are queued and carried out by renderer_render, which only walks the queues.
+ * A deleted slot gets a fresh GL name and a new generation before it goes back on the free list.
+ */
+typedef struct TextureSlot
+{
+    u32 id;              // GL texture name
+    u32 generation;      // Incremented when the slot is freed, so stale handles can be detected
+    u32 next_free;       // Next slot on the free list, or TEXTURE_SLOT_NONE
+    b32 allocated;
+    b32 upload_pending;
+    Texture upload;      // Pixels to upload at the next render, or the size of the storage to create if there are none
+    i32 layers;          // Number of layers if the slot holds a texture array, otherwise 0
+} TextureSlot;
+
+// Copies the rect (x, y, width, height) of an image into a texture. Texel (x, y) of the image lands on texel (x, y)
+// of the texture, so regions of a larger image, such as an atlas page kept in memory, can be uploaded in place.
+typedef struct TextureUpdate
+{
+    TextureHandle handle;
+    i32 layer;      // Layer of a texture array, otherwise 0
+    i32 x, y;
+    i32 width, height;
+    i32 channels;   // Channels of the image
+    i32 row_length; // Width of the image in pixels
+    ubyte* pixels;
+} TextureUpdate;
 
 typedef enum ResourceType
 {
@@ -248,9 +689,15 @@ typedef struct Renderer
     RenderObject font_renderer;
     RenderObject framebuffer_renderer;
     RenderObject ui_renderer;
+    RenderObject batch_renderer;
+    RenderObject shape_renderer;
+    RenderObject sprite_batch_renderer;
 
     u32 poly_shader;
+    u32 sprite_array_shader;
+    u32 font_sdf_shader;
     u32 poly_border_shader;
+    u32 frame_ubo;
 
     UIState ui_state;
 
@@ -260,6 +707,22 @@ typedef struct Renderer
     // to the intermediate framebuffer.
     Framebuffer framebuffer;
     Framebuffer intermediate_framebuffer;
+    RenderTargetManager render_targets;
+    DynamicResolution resolution;
+    GPUProfiler gpu_profiler;
+    RenderCapture capture;
+
+    // NOTE(lucas): RGBA target the UI is drawn into when its render cache is enabled. Created on first use.
+    Framebuffer ui_cache_framebuffer;
+    b32 ui_cache_drawing; // Between UI cache begin and composite commands
+    rect ui_cache_clip;   // Scissor tests are clipped to this while drawing into the cache
+    u64 ui_cache_start;   // Ticks when drawing into the cache began
+
+    DamageTracker damage;
+    MemoryArena damage_arena;
+
+    RenderThreadBuffer thread_buffers[RENDER_MAX_THREADS];
+    u32 thread_count;
 
     rect viewport;
     int window_width;
@@ -267,25 +730,65 @@ typedef struct Renderer
     v4 clear_color;
 
     RendererConfig config;
+    RendererStats stats;
     MemoryArena command_buffer_arena;
     MemoryArena scratch_arena;
 
-    RenderID tex_ids[1024];
-    Texture textures_to_generate[1024];
-    u32 tex_index;
+    RenderBatch batch;
+    ShapeBatch shape_batch;
+    SpriteBatch sprite_batch;
+    MemoryArena batch_arena;
+
+    TessellationCache tessellation_cache;
+    GlyphCache glyph_cache;
+    TextLayoutCache text_layout_cache;
+    MemoryArena cache_arena; // Storage for caches that live as long as the renderer
+
+    StreamBuffer vertex_stream;
+    StreamBuffer index_stream;
+
+    // NOTE(lucas): Staging for asynchronous texture uploads, bound as a pixel unpack buffer. Created by texture_loader_init.
+    StreamBuffer upload_stream;
+    TextureLoader texture_loader;
+
+    TextureSlot texture_slots[RENDERER_MAX_TEXTURES];
+    u32 texture_free_head;
+    u32 pending_uploads[RENDERER_MAX_TEXTURES];
+    u32 pending_upload_count;
+    u32 pending_frees[RENDERER_MAX_TEXTURES];
+    u32 pending_free_count;
+    TextureUpdate* pending_updates; // RENDERER_MAX_TEXTURE_UPDATES, allocated from the cache arena
+    u32 pending_update_count;
 } Renderer;
 
 void opengl_init(Window* window);
 
+// Returns NULL if the function is not supported by the current context
+void* opengl_get_proc_address(const char* name);
+
 Renderer renderer_init(Window* window, int viewport_width, int viewport_height, size command_buffer_size);
 void renderer_delete(Renderer* renderer);
 
 void renderer_new_frame(Renderer* renderer, Window* window);
 void renderer_render(Renderer* renderer);
 
+// Size of a command in the command buffer, which is also where the next command starts
+size render_command_size(RenderCommandType type);
+
+// NOTE(lucas): Allocates a command buffer for each of thread_count recording threads. Call once from the main thread.
+void renderer_threads_init(Renderer* renderer, u32 thread_count, size command_buffer_bytes);
+
+// Draws issued on the calling thread between begin and end are recorded into the buffer of thread_index.
+// A thread index may only be used by one thread at a time. Text helpers must stay on the main thread, see above.
+void renderer_thread_begin(Renderer* renderer, u32 thread_index, u64 sort_key);
+void renderer_thread_end(Renderer* renderer);
+
 void renderer_viewport(Renderer* renderer, rect viewport);
 void renderer_clear(v4 color);
 
+// Forces the next frame to be fully redrawn when damage tracking is enabled
+void renderer_invalidate_damage(Renderer* renderer);
+
 // TODO(lucas): Add additional functions that take in origins, and consider taking rotation out of the default functions
 void draw_line(Renderer* renderer, v2 start, v2 end, v4 color, f32 thickness, f32 rotation);
 
@@ -294,12 +797,14 @@ void draw_triangle(Renderer* renderer, v2 a, v2 b, v2 c, v4 color, f32 rotation)
 void draw_triangle_outline(Renderer* renderer, v2 a, v2 b, v2 c, v4 color, f32 rotation, f32 thickness);
 void draw_triangle_gradient(Renderer* renderer, v2 a, v2 b, v2 c, v4 color_a, v4 color_b, v4 color_c, f32 rotation);
 
-// TODO(lucas): Rounded edges option
 // TODO(lucas): Add functions to take in rect instead of position/size or start/end
 void draw_quad(Renderer* renderer, v2 position, v2 size, v4 color, f32 rotation);
 void draw_quad_outline(Renderer* renderer, v2 position, v2 size, v4 color, f32 rotation, f32 thickness);
 void draw_quad_gradient(Renderer* renderer, v2 position, v2 size, v4 color_bl, v4 color_br, v4 color_tr, v4 color_tl,
                         f32 rotation);
+void draw_quad_rounded(Renderer* renderer, v2 position, v2 size, v4 color, f32 radius, f32 rotation);
+void draw_quad_rounded_outline(Renderer* renderer, v2 position, v2 size, v4 color, f32 radius, f32 rotation,
+                               f32 thickness);
 
 void draw_circle(Renderer* renderer, v2 center, f32 radius, v4 color);
 void draw_circle_outline(Renderer* renderer, v2 center, f32 radius, v4 color, f32 thickness);
@@ -316,9 +821,53 @@ void draw_sprite(Renderer* renderer, Sprite sprite);
 void draw_text(Renderer* renderer, Text text);
 
 void draw_scissor_test(Renderer* renderer, rect clip);
+// Draw the vertices converted by the UI vertex buffer backend. Called by ui_render.
+void draw_ui(Renderer* renderer, u32 vertex_bytes, u32 element_bytes);
+// Redirect the UI commands that follow into the UI render cache, clearing and clipping to the given region.
+void draw_ui_cache_begin(Renderer* renderer, rect clip);
+// Draw the UI render cache over the frame. Ends drawing into the cache if it was begun.
+void draw_ui_cache_composite(Renderer* renderer);
+
+// Called for every render target allocation event. Pass NULL to remove the callback.
+void renderer_render_target_callback(Renderer* renderer, RenderTargetEventProc* callback, void* data);
+
+// Returns the number of events copied, newest last. At most RENDER_TARGET_MAX_EVENTS are kept.
+u32 renderer_render_target_events(Renderer* renderer, RenderTargetEvent* events, u32 max_events);
+
+// Latest GPU times read back by the profiler. The frame is a few frames old, and all zero until profiling is enabled.
+GPUFrameTimes renderer_gpu_times(Renderer* renderer);
+
+// Frame time measured on the GPU, e.g. with timer queries. Used by dynamic resolution along with the CPU frame time.
+void renderer_report_gpu_time(Renderer* renderer, f32 gpu_ms);
+
+// Returns the number of decisions copied, newest last. At most DYNAMIC_RESOLUTION_MAX_DECISIONS are kept.
+u32 renderer_resolution_decisions(Renderer* renderer, DynamicResolutionDecision* decisions, u32 max_decisions);
+
+// Returns a handle with a zero generation if every slot is in use
+TextureHandle renderer_texture_alloc(Renderer* renderer);
+void renderer_texture_free(Renderer* renderer, TextureHandle handle);
+b32 renderer_texture_valid(Renderer* renderer, TextureHandle handle);
+
+// GL texture name of the slot, or 0 for a stale handle
+u32 renderer_texture_id(Renderer* renderer, TextureHandle handle);
+
+// Queues the texture's pixels to be uploaded at the next render. Uploading again before then replaces the pixels.
+// The pixels must stay valid until renderer_render.
+void renderer_texture_upload(Renderer* renderer, TextureHandle handle, Texture texture);
+
+// Queues immutable storage with linear filtering and clamped edges to be created at the next render. The texture is a
+// texture array if layers is not 0. Storage has 1 (R8) or 4 (RGBA8) channels and starts out undefined.
+void renderer_texture_storage(Renderer* renderer, TextureHandle handle, int width, int height, int layers,
+                              int channels);
+
+// Queues part of an image to be copied into a texture created with renderer_texture_storage at the next render.
+// The pixels must stay valid until renderer_render. Updates of the same layer from the same image are merged into
+// their bounding rect, so the whole rect is read from the image when it is uploaded.
+void renderer_texture_update(Renderer* renderer, TextureUpdate update);
 
-u32 renderer_next_tex_id(Renderer* renderer);
-void renderer_push_texture(Renderer* renderer, Texture texture);
+// Carries out queued uploads and updates right away, e.g. for glyphs rasterized while commands are executed.
+// Only call from the thread that owns the GL context.
+void renderer_texture_flush(Renderer* renderer);
 
 inline v4 color_red(void)         {return (v4){1.0f, 0.0f, 0.0f, 1.0f};}
 inline v4 color_green(void)       {return (v4){0.0f, 1.0f, 0.0f, 1.0f};}
@@ -358,3 +907,7 @@ inline v4 linear1_to_srgb255(v4 c)
 
 
 void vertex_layout_set(u32 index, int size, u32 stride, const void* ptr);
+StreamBuffer stream_buffer_init(size region_bytes);
+void stream_buffer_delete(StreamBuffer* stream);
+size stream_buffer_push(StreamBuffer* stream, void* data, size bytes, size alignment);
+void stream_buffer_end_frame(StreamBuffer* stream);
@@ -4,10 +4,61 @@
 
 typedef struct Renderer Renderer;
 
+// NOTE(lucas): Uniform locations are looked up once when a shader is initialized and kept in a table per program
+#define SHADER_MAX_PROGRAMS 32
+#define SHADER_MAX_UNIFORMS 64 // Must be a power of two
+#define SHADER_MAX_UNIFORM_NAME_LEN 64
+
+// NOTE(lucas): Shaders that declare a "Frame" uniform block have it bound to this binding point
+#define SHADER_FRAME_BLOCK_BINDING 0
+
+typedef struct ShaderUniform
+{
+    u32 hash;
+    i32 location;
+    char name[SHADER_MAX_UNIFORM_NAME_LEN];
+} ShaderUniform;
+
+typedef struct ShaderUniformTable
+{
+    u32 program;
+    u32 count;
+    ShaderUniform uniforms[SHADER_MAX_UNIFORMS];
+} ShaderUniformTable;
+
+/* NOTE(lucas): All program, VAO, buffer, and texture binds go through the GL state tracker, which skips binds that
+ * would not change anything. Element array buffer binds are VAO state, so they are always issued.
+ * Deleting a GL object must also forget it, since GL may hand the same name out again.
+ * If code outside of the renderer touches GL state, call gl_state_reset.
+ */
+typedef struct GLStateStats
+{
+    u32 binds_issued;
+    u32 binds_skipped;
+    u32 uniform_cache_hits;   // Uniform locations found in the table
+    u32 uniform_cache_misses; // Uniform locations that fell back to glGetUniformLocation
+} GLStateStats;
+
+void gl_state_reset(void);
+GLStateStats gl_state_stats(void);
+void gl_state_stats_reset(void);
+
+void gl_use_program(u32 program);
+void gl_bind_vertex_array(u32 vao);
+void gl_bind_buffer(u32 target, u32 buffer);
+void gl_active_texture(u32 unit);
+void gl_bind_texture(u32 target, u32 texture);
+
+void gl_forget_program(u32 program);
+void gl_forget_vertex_array(u32 vao);
+void gl_forget_buffer(u32 buffer);
+void gl_forget_texture(u32 texture);
+
 u32 shader_init(Renderer* renderer, const char* vert_shader_path, const char* frag_shader_path);
 void shader_bind(u32 id);
 void shader_unbind();
 void shader_delete(u32 id);
+i32 shader_uniform_location(u32 shader, const char* name);
 
 // Wrapper functions to set uniforms
 void shader_set_i32(u32 shader, const char* name, i32 value);
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "alchemy/util/math.h"
 #include "alchemy/util/types.h"
 
 typedef struct Texture Texture;
@@ -13,7 +14,29 @@ typedef struct Sprite
     v2 position;
     v2 size;
     f32 rotation; // Rotation in degrees
+    u32 layer;    // Layer to sample if the texture is a texture array
+    rect uv;      // Normalized sub-rectangle of the texture to draw, e.g. a region of an atlas page
 } Sprite;
 
+// NOTE(lucas): Batched sprite vertices: position (2), texture coordinates (2), color (4), and texture array layer (1)
+#define SPRITE_BATCH_VERTEX_FLOATS 9
+
+/* NOTE(lucas): Consecutive sprites that share a texture are transformed on the CPU and drawn with a single call.
+ * Sprites in different layers of the same texture array share a texture, so they batch together as well.
+ * The batch is flushed when the texture changes, when it is full, or when a non-sprite command is output.
+ */
+typedef struct SpriteBatch
+{
+    f32* vertices;
+    u32 sprite_count;
+    u32 max_sprites;
+
+    u32 texture;
+    b32 texture_is_array;
+} SpriteBatch;
+
 Sprite sprite_init(Texture* tex);
-void output_sprite(Renderer* renderer, RenderCommandSprite* cmd);
\ No newline at end of file
+void output_sprite(Renderer* renderer, RenderCommandSprite* cmd);
+
+void sprite_batch_push(Renderer* renderer, Sprite* sprite);
+void sprite_batch_flush(Renderer* renderer);
\ No newline at end of file
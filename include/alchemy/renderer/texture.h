@@ -1,16 +1,25 @@
 #pragma once
 
+#include "alchemy/util/job.h"
 #include "alchemy/util/types.h"
 
 typedef struct Renderer Renderer;
 typedef struct MemoryArena MemoryArena;
 
+typedef struct TextureHandle
+{
+    u32 index;
+    u32 generation; // Never 0 for a valid handle
+} TextureHandle;
+
 typedef struct Texture
 {
     u32 id;
+    TextureHandle handle; // Slot in the renderer's texture pool if created with texture_load_*, otherwise zero
     i32 channels;
     v2 size;
     ubyte* data;
+    i32 layers; // Number of layers if the texture is a texture array, otherwise 0
 } Texture;
 
 Texture texture_generate(int samples);
@@ -21,7 +30,93 @@ Texture load_any_texture_from_file(const char* filename);
 Texture texture_load_from_file(const char* filename, Renderer* renderer, MemoryArena* arena);
 Texture texture_load_from_memory(Renderer* renderer, int width, int height, int samples, ubyte* data);
 
+// NOTE(lucas): Texture arrays live in the renderer's texture pool, so their storage and layers are queued and
+// uploaded at the next render like other textures. Layer pixels must stay valid until then. Every layer has the same
+// size and is stored as RGBA8. Free texture arrays with texture_free.
+Texture texture_array_init(Renderer* renderer, int width, int height, int layers);
+void texture_array_set_layer(Renderer* renderer, Texture* array, int layer, int channels, ubyte* data);
+
+#define TEXTURE_LOADER_MAX_LOADS 256
+#define TEXTURE_LOADER_MAX_FILENAME_LEN 260
+
+/* NOTE(lucas): Asynchronous texture loading. texture_load_async returns a handle immediately and queues the file, and
+ * the next renderer_render submits a job to decode it. Submitting from the render thread rather than the caller keeps
+ * texture_load_async free of job system calls, so the game DLL can use it. Once decoded, the render thread uploads the
+ * pixels a few rows at a time through the upload stream, which is used as a pixel unpack buffer, and never uploads
+ * more than the frame budget in one frame. Textures use immutable storage with a sized internal format in a slot of
+ * the texture pool, and are only usable once their status is TEXTURE_LOAD_COMPLETE.
+ */
+typedef enum TextureLoadStatus
+{
+    TEXTURE_LOAD_INVALID = 0, // Unused slot or stale handle
+    TEXTURE_LOAD_QUEUED,      // Waiting for renderer_render to submit the decode job
+    TEXTURE_LOAD_DECODING,
+    TEXTURE_LOAD_DECODED,
+    TEXTURE_LOAD_UPLOADING,
+    TEXTURE_LOAD_COMPLETE,
+    TEXTURE_LOAD_FAILED,
+} TextureLoadStatus;
+
+typedef struct TextureLoadHandle
+{
+    u32 index;
+    u32 generation;
+} TextureLoadHandle;
+
+typedef struct TextureLoad
+{
+    volatile i64 status; // TextureLoadStatus, written by the decoding worker
+    u32 generation;      // Incremented every time the slot is released
+
+    char filename[TEXTURE_LOADER_MAX_FILENAME_LEN];
+    Texture texture;
+
+    // Decoded pixels, owned by the load until the upload finishes
+    void* file_data;     // File contents if the pixels point into them (BMP), otherwise NULL
+    ubyte* pixels;
+    size row_bytes;      // Rows of BMPs are padded to 4 bytes, rows decoded by stb_image are tightly packed
+    int unpack_alignment;
+    int rows_uploaded;
+} TextureLoad;
+
+typedef struct TextureLoader
+{
+    JobSystem* jobs;
+    MemoryArena arena;   // Load table storage, allocated by texture_loader_init
+    TextureLoad* loads;  // TEXTURE_LOADER_MAX_LOADS of them
+    size frame_budget;   // Bytes uploaded per frame at most, except that at least one row is uploaded every frame
+
+    JobCounter decodes;  // Decode jobs still running
+
+    size frame_bytes;    // Bytes uploaded this frame
+    u32 frame_completed; // Loads completed this frame
+} TextureLoader;
+
+// NOTE(lucas): Must be called from the render thread before any asynchronous loads. The job system must be
+// initialized on the render thread, since decode jobs are submitted from renderer_render, and must outlive the renderer.
+void texture_loader_init(Renderer* renderer, JobSystem* jobs, size frame_budget);
+void texture_loader_delete(Renderer* renderer);
+
+// Returns a handle with a zero generation if every load slot is in use
+TextureLoadHandle texture_load_async(Renderer* renderer, const char* filename);
+TextureLoadStatus texture_load_status(Renderer* renderer, TextureLoadHandle handle);
+
+// Returns NULL until the load is complete
+Texture* texture_load_get(Renderer* renderer, TextureLoadHandle handle);
+
+// Frees the load slot once the load has completed or failed. The texture itself is not deleted, free it with
+// texture_free once it is no longer drawn.
+void texture_load_release(Renderer* renderer, TextureLoadHandle handle);
+
+// Submits queued decodes and uploads decoded textures within the frame budget. Called by renderer_render.
+void texture_loader_upload(Renderer* renderer);
+
 void texture_bind_id(u32 id, int samples);
 void texture_bind(Texture* tex, int samples);
 void texture_unbind(int samples);
+
+// Only for textures created outside the texture pool, such as framebuffer textures
 void texture_delete(Texture* tex);
+
+// Deletes a texture created with texture_load_* at the next render. Pixel data is not freed.
+void texture_free(Renderer* renderer, Texture* tex);
@@ -5,15 +5,138 @@
 #define NK_INCLUDE_STANDARD_VARARGS
 #define NK_INCLUDE_DEFAULT_ALLOCATOR
 #define NK_KEYSTATE_BASED_INPUT
+#define NK_INCLUDE_VERTEX_BUFFER_OUTPUT // Must match lib/nuklear/nuklear.c
+#define NK_ZERO_COMMAND_MEMORY          // Padding in commands is zeroed so commands can be hashed
 #include <nuklear/nuklear.h>
 
 #include "alchemy/input.h"
+#include "alchemy/renderer/atlas.h"
 #include "alchemy/renderer/font.h"
 #include "alchemy/renderer/texture.h"
 
 typedef struct Renderer Renderer;
 
 #define NK_ALCHEMY_TEXT_MAX 256
+#define UI_TEXT_WIDTH_CACHE_SIZE 4096 // Must be a power of two
+#define UI_TEXT_WIDTH_CACHE_STRING_BYTES KILOBYTES(64)
+
+/* NOTE(lucas): Nuklear asks for the width of the same strings many times per widget per frame, and measuring a
+ * string means walking every glyph through the font metrics. Widths are cached across frames keyed by font, height,
+ * and the string, which is found by its hash and then compared byte for byte with a copy kept by the cache. The table
+ * is cleared when it gets too full, when the copies run out of room, or when the UI font changes.
+ */
+typedef struct UITextWidth
+{
+    FT_Face face; // NULL if the slot is empty
+    b32 sdf;
+    f32 height;
+    u32 hash;
+    int len;
+    u32 offset;   // Start of the string's copy in the cache's strings
+    f32 width;
+} UITextWidth;
+
+typedef struct UITextWidthCache
+{
+    UITextWidth* entries;
+    u32 count;
+    u8* strings;  // UI_TEXT_WIDTH_CACHE_STRING_BYTES
+    u32 strings_used;
+
+    // Reset every frame in ui_new_frame
+    u32 hits;
+    u32 misses;
+} UITextWidthCache;
+
+typedef enum UIBackend
+{
+    UI_BACKEND_RENDER_COMMANDS = 0, // Every nuklear command is translated into engine draw calls
+    UI_BACKEND_VERTEX_BUFFER,       // nk_convert builds one vertex and element buffer that is drawn in a few draw calls
+} UIBackend;
+
+#define UI_FONT_ATLAS_PAGE_SIZE 1024
+#define UI_FONT_MAX_GLYPHS 2048 // Must be a power of two
+#define UI_MAX_DRAW_COMMANDS 1024
+
+typedef struct UIGlyph
+{
+    FT_Face face; // NULL if the slot is empty
+    u32 px;
+    u32 codepoint;
+    AtlasRegion region; // Zero sized for glyphs without a bitmap, such as spaces
+    f32 left;           // Offset from the pen position to the left edge of the bitmap
+    f32 top;            // Offset from the baseline to the top edge of the bitmap
+} UIGlyph;
+
+/* NOTE(lucas): The vertex buffer backend draws text and untextured shapes from a single RGBA page that holds white
+ * glyphs with coverage in alpha along with a few opaque white texels, so most of the UI shares one texture.
+ * When the page fills up it is evicted and every glyph is rasterized again. Glyphs converted earlier in that frame
+ * point at the old contents, so they are wrong for one frame.
+ */
+typedef struct UIFontAtlas
+{
+    // NOTE(lucas): Open addressed table keyed by (face, px, codepoint)
+    UIGlyph* glyphs;
+    u32 glyph_count;
+
+    TextureAtlas atlas;
+    AtlasRegion white;
+    u32 evictions; // Atlas evictions that have been handled
+    Renderer* renderer; // Owns the atlas pages and the scratch arena glyphs are converted in
+} UIFontAtlas;
+
+typedef struct UIDrawCommand
+{
+    Texture* texture;
+    rect clip; // Top-left origin in window coordinates
+    u32 element_count;
+} UIDrawCommand;
+
+#define UI_CACHE_MAX_WINDOWS 64
+
+typedef struct UICacheWindow
+{
+    u32 name;       // nk_window::name, or 0 for the cursor overlay
+    u64 hash;       // Hash of every command drawn by the window and its popup
+    rect bounds;    // Window and popup bounds, top-left origin
+    b32 always_dirty; // Custom commands may draw anything, so their window is always redrawn
+} UICacheWindow;
+
+/* NOTE(lucas): When the render cache is enabled, the UI is drawn into an offscreen texture and composited over the
+ * frame. Every frame, the commands of each nuklear window are hashed and compared with the previous frame. If no
+ * window changed, the texture is composited as is and nothing is drawn. Otherwise, only the bounds of the windows
+ * that changed, moved, appeared, or disappeared are cleared and redrawn.
+ * Images are hashed by handle, so if the contents of a texture shown in the UI change, call
+ * ui_invalidate_render_cache.
+ */
+typedef struct UIRenderCache
+{
+    b32 enabled;
+    b32 valid; // The offscreen texture holds the previous frame's UI
+    int width, height;
+
+    UICacheWindow windows[UI_CACHE_MAX_WINDOWS];
+    u32 window_count;
+
+    // NOTE(lucas): CPU time only. The time saved by a frame is estimated from the cost of the last full redraw.
+    b32 full_redraw;    // This frame redraws the whole UI
+    f32 translate_ms;   // Time spent translating nuklear commands this frame
+    f32 full_redraw_ms; // Translate and output time of the last full redraw
+
+    // This frame
+    u32 hits;
+    u32 partial_redraws;
+    u32 full_redraws;
+    f32 saved_ms;
+} UIRenderCache;
+
+// Stored in nk_user_font::userdata
+typedef struct UIFont
+{
+    Font font;
+    UITextWidthCache* width_cache;
+    UIFontAtlas* font_atlas; // NULL unless the vertex buffer backend is used
+} UIFont;
 
 // TODO(lucas): Remove some things like window width/height and input from this struct
 typedef struct UIState
@@ -21,6 +144,18 @@ typedef struct UIState
     int width, height;
     struct nk_context ctx;
     struct nk_user_font user_font;
+    UITextWidthCache text_width_cache;
+
+    UIBackend backend;
+    // NOTE(lucas): Only used by the vertex buffer backend
+    UIFontAtlas font_atlas;
+    struct nk_buffer draw_commands;
+    void* vertices;
+    void* elements;
+    UIDrawCommand* draws;
+    u32 draw_count;
+
+    UIRenderCache render_cache;
     u32 text[NK_ALCHEMY_TEXT_MAX];
     int text_len;
 
@@ -30,10 +165,21 @@ typedef struct UIState
 
 // TODO(lucas): Make default font and default font size
 // IMPORTANT: Note that the arena used should live for the lifetime of the UI.
-void ui_state_init(Renderer* renderer, Font font, u32 font_size, MemoryArena* arena);
+// NOTE(lucas): ui_state_init makes no GL calls, so it can run in the game DLL. The vertex buffer backend's font atlas
+// page is created and uploaded at the next render, and the arena also holds a copy of its texels
+// (UI_FONT_ATLAS_PAGE_SIZE^2 RGBA texels). The atlas keeps the renderer pointer, so the renderer must not move.
+void ui_state_init(Renderer* renderer, Font font, u32 font_size, UIBackend backend, MemoryArena* arena);
 void ui_state_delete(UIState* state);
+// Replaces the font used by nuklear and invalidates cached text widths.
+void ui_set_font(Renderer* renderer, Font font, u32 font_size, MemoryArena* arena);
+
+void ui_enable_render_cache(Renderer* renderer, b32 enabled);
+void ui_invalidate_render_cache(Renderer* renderer);
 
 void ui_new_frame(Renderer* renderer, u32 window_width, u32 window_height);
 void ui_render(Renderer* renderer, enum nk_anti_aliasing aa);
 
 void ui_draw_text_area(Renderer* renderer, TextArea* text_area, v2 offset);
+
+// Image for nuklear widgets that draws an atlas region. Atlas pages must be at most 65535 pixels wide.
+struct nk_image ui_image_from_atlas(AtlasRegion* region);
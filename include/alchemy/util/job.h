@@ -0,0 +1,87 @@
+#pragma once
+
+#include "alchemy/util/memory.h"
+#include "alchemy/util/thread.h"
+#include "alchemy/util/types.h"
+
+#define JOB_MAX_WORKERS 64
+#define JOB_QUEUE_SIZE 4096 // Per worker. Must be a power of two.
+
+/* NOTE(lucas): Fixed pool of workers, each with a lock-free work-stealing deque (Chase-Lev). Worker 0 is the thread
+ * that called job_system_init, which runs jobs while it waits on a counter. Jobs push to the back of their own
+ * worker's deque and pop from the back, while idle workers steal from the front of other workers' deques. Idle workers
+ * spin for a while and then sleep on a semaphore until new jobs arrive.
+ *
+ * IMPORTANT: Jobs may only be submitted from the thread that called job_system_init or from inside jobs.
+ */
+
+typedef void JobProc(void* data);
+typedef void JobRangeProc(void* data, u32 start, u32 end);
+
+// NOTE(lucas): Counts jobs that have been submitted with the counter and have not finished yet
+typedef struct JobCounter
+{
+    volatile i64 value;
+} JobCounter;
+
+typedef struct Job
+{
+    JobProc* proc;
+    JobRangeProc* range_proc;
+    void* data;
+    JobCounter* counter;
+
+    // Index range for parallel for jobs. Ranges larger than batch_size are split in half before running.
+    u32 start;
+    u32 end;
+    u32 batch_size;
+} Job;
+
+typedef struct JobQueue
+{
+    volatile i64 top;    // Stolen from by other workers
+    u8 unused_[56];      // Keeps top and bottom on separate cache lines
+    volatile i64 bottom; // Pushed and popped by the owner
+    Job* jobs;
+} JobQueue;
+
+typedef struct JobWorker
+{
+    struct JobSystem* system;
+    JobQueue queue;
+    Thread thread;
+    u32 index;
+    u32 rng;
+
+    u64 jobs_run;
+    u64 jobs_stolen;
+} JobWorker;
+
+typedef struct JobSystem
+{
+    JobWorker workers[JOB_MAX_WORKERS];
+    u32 worker_count;
+
+    Semaphore wake;
+    volatile i64 queued;   // Jobs pushed but not yet taken
+    volatile i64 sleeping; // Workers waiting on the wake semaphore
+    volatile i64 running;  // Cleared to stop the workers
+} JobSystem;
+
+// A worker count of 0 uses one worker per logical processor. The calling thread counts as worker 0.
+void job_system_init(JobSystem* jobs, u32 worker_count, MemoryArena* arena);
+void job_system_shutdown(JobSystem* jobs);
+
+// Index of the worker running on the calling thread, or 0 for the thread that initialized the job system
+u32 job_worker_index(void);
+
+// The counter may be NULL. If the queue is full, the job is run immediately instead.
+void job_run(JobSystem* jobs, JobProc* proc, void* data, JobCounter* counter);
+
+// Runs other jobs until every job submitted with the counter has finished
+void job_wait(JobSystem* jobs, JobCounter* counter);
+b32 job_counter_done(JobCounter* counter);
+
+// Calls proc over [0, count) in ranges of at most batch_size and returns once every range has run.
+// A batch size of 0 picks one that gives each worker a few ranges.
+void job_parallel_for(JobSystem* jobs, u32 count, u32 batch_size, JobRangeProc* proc, void* data);
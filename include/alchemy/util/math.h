@@ -45,6 +45,26 @@ inline i32 ceil_f32(f32 value)
     return result;
 }
 
+inline i32 floor_f32(f32 value)
+{
+    i32 result = (i32)value;
+    if (value != (f32)result && value < 0.0f)
+        --result;
+    return result;
+}
+
+inline f32 min_f32(f32 a, f32 b)
+{
+    f32 result = (a < b) ? a : b;
+    return result;
+}
+
+inline f32 max_f32(f32 a, f32 b)
+{
+    f32 result = (a > b) ? a : b;
+    return result;
+}
+
 inline f32 abs_f32(f32 x)
 {
     f32 result = fabsf(x);
@@ -151,6 +171,19 @@ inline v2 v2_neg(v2 v)
     return result;
 }
 
+// Component-wise minimum and maximum
+inline v2 v2_min(v2 a, v2 b)
+{
+    v2 result = {min_f32(a.x, b.x), min_f32(a.y, b.y)};
+    return result;
+}
+
+inline v2 v2_max(v2 a, v2 b)
+{
+    v2 result = {max_f32(a.x, b.x), max_f32(a.y, b.y)};
+    return result;
+}
+
 inline v2 v2_abs(v2 v)
 {
     v2 result = v2(abs_f32(v.x), abs_f32(v.y));
@@ -391,6 +424,15 @@ inline m4 m4_scale(m4 m, v3 v)
     return result;
 }
 
+// Transform a 2D point (z = 0, w = 1) by a 4x4 matrix. Matrices are column-major.
+inline v2 m4_transform_v2(m4 m, v2 v)
+{
+    v2 result = {0};
+    result.x = m.raw[0][0]*v.x + m.raw[1][0]*v.y + m.raw[3][0];
+    result.y = m.raw[0][1]*v.x + m.raw[1][1]*v.y + m.raw[3][1];
+    return result;
+}
+
 /* rect */
 inline rect rect_min_max(v2 min, v2 max)
 {
@@ -445,6 +487,35 @@ inline rect rect_zero(void)
     return r;
 }
 
+inline b32 rect_eq(rect a, rect b)
+{
+    b32 result = (a.x == b.x && a.y == b.y && a.width == b.width && a.height == b.height);
+    return result;
+}
+
+// Smallest rect containing both rects. Empty rects are ignored.
+inline rect rect_union(rect a, rect b)
+{
+    if (a.width <= 0.0f || a.height <= 0.0f)
+        return b;
+    if (b.width <= 0.0f || b.height <= 0.0f)
+        return a;
+
+    v2 min = v2_min(a.position, b.position);
+    v2 max = v2_max(v2_add(a.position, a.size), v2_add(b.position, b.size));
+    rect result = rect_min_max(min, max);
+    return result;
+}
+
+// Overlap of two rects. The result has zero size if they do not overlap.
+inline rect rect_intersect(rect a, rect b)
+{
+    v2 min = v2_max(a.position, b.position);
+    v2 max = v2_max(min, v2_min(v2_add(a.position, a.size), v2_add(b.position, b.size)));
+    rect result = rect_min_max(min, max);
+    return result;
+}
+
 // NOTE(lucas): Rects are non-inclusive of the max value.
 // This allows two rects to perfectly abut and comparison
 // will always result in being inside only one rect and not the other.
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "alchemy/util/types.h"
+
+#define PROFILE_MAX_THREADS 64
+#define PROFILE_DEFAULT_EVENTS_PER_THREAD 65536 // Must be a power of two
+#define PROFILE_MAX_DEPTH 64                    // Deepest nesting of zones that can be exported
+
+/* NOTE(lucas): Instrumented CPU profiler. Zones record a begin and an end event with a time_ticks timestamp into a
+ * ring buffer owned by the calling thread, so recording takes no locks. Each thread's ring is allocated the first time
+ * it records, and once it wraps, the oldest events are overwritten. Zone names must be string literals or otherwise
+ * outlive the profiler, since only the pointer is stored.
+ *
+ * Recording costs one branch when the profiler is disabled, and all the macros compile to nothing when
+ * ALCHEMY_PROFILE_DISABLED is defined. State is global to the module it is linked into, so a game DLL has its own.
+ *
+ * IMPORTANT: profile_export_chrome_trace reads every thread's ring and profile_shutdown frees them, so call them when
+ * no other thread is recording, e.g. between frames once all jobs are done. Threads claim a new ring if the profiler
+ * is initialized again after a shutdown.
+ */
+
+typedef enum ProfileEventType
+{
+    ProfileEvent_Begin,
+    ProfileEvent_End,
+} ProfileEventType;
+
+typedef struct ProfileEvent
+{
+    u64 ticks;
+    const char* name;
+    ProfileEventType type;
+} ProfileEvent;
+
+typedef struct ProfileThread
+{
+    ProfileEvent* events;
+    volatile i64 event_count; // Total events recorded, only written by the owning thread
+    const char* name;
+    u32 index;
+} ProfileThread;
+
+// An event count of 0 uses PROFILE_DEFAULT_EVENTS_PER_THREAD. The calling thread is named "Main".
+void profile_init(u32 events_per_thread);
+void profile_shutdown(void);
+void profile_set_enabled(b32 enabled);
+b32 profile_enabled(void);
+
+void profile_begin(const char* name);
+void profile_end(void);
+
+// Frame boundaries, called by renderer_new_frame and renderer_render. Frames are recorded as zones on their thread.
+void profile_frame_begin(void);
+void profile_frame_end(void);
+u64 profile_frame_index(void);
+f64 profile_last_frame_ms(void);
+
+// Name shown for the calling thread in exported traces. The name is only stored until the thread first records, so
+// threads can be named before profile_init.
+void profile_thread_name(const char* name);
+
+// Writes every event still in the rings in the Chrome trace event JSON format, which Perfetto can also open.
+// Zones whose begin or end was overwritten are left out.
+b32 profile_export_chrome_trace(const char* filename);
+
+#ifdef ALCHEMY_PROFILE_DISABLED
+    #define PROFILE_BEGIN(name)
+    #define PROFILE_END()
+    #define PROFILE_SCOPE(name)
+#else
+    #define PROFILE_BEGIN(name) profile_begin(name)
+    #define PROFILE_END() profile_end()
+
+    // Profiles the statement or block that follows. Leaving the block with return, break, or goto skips the end of
+    // the zone, so use PROFILE_BEGIN and PROFILE_END around code that does.
+    #define PROFILE_SCOPE(name) \
+        for (int profile_scope_ = (profile_begin(name), 0); !profile_scope_; profile_scope_ = (profile_end(), 1))
+#endif
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "alchemy/util/types.h"
+
+#if _MSC_VER
+    #include <intrin.h>
+#endif
+
+typedef void ThreadProc(void* data);
+
+// NOTE(lucas): The thread struct is read by the new thread when it starts, so it must stay valid while the thread runs
+typedef struct Thread
+{
+    void* handle;
+    ThreadProc* proc;
+    void* data;
+} Thread;
+
+// NOTE(lucas): Counting semaphore. The platform object is allocated by semaphore_init.
+typedef struct Semaphore
+{
+    void* handle;
+} Semaphore;
+
+b32 thread_create(Thread* thread, ThreadProc* proc, void* data);
+void thread_join(Thread* thread);
+void thread_yield(void);
+
+// Number of logical processors
+u32 thread_hardware_count(void);
+
+void semaphore_init(Semaphore* semaphore, u32 initial_count);
+void semaphore_delete(Semaphore* semaphore);
+void semaphore_signal(Semaphore* semaphore, u32 count);
+void semaphore_wait(Semaphore* semaphore);
+
+/* Atomics. Every operation is sequentially consistent. */
+#if _MSC_VER
+internal inline i64 atomic_load_i64(volatile i64* value)
+{
+    i64 result = *value;
+    _ReadWriteBarrier();
+    return result;
+}
+
+internal inline void atomic_store_i64(volatile i64* value, i64 new_value)
+{
+    _InterlockedExchange64(value, new_value);
+}
+
+// Returns the value after the addition
+internal inline i64 atomic_add_i64(volatile i64* value, i64 addend)
+{
+    i64 result = _InterlockedExchangeAdd64(value, addend) + addend;
+    return result;
+}
+
+internal inline b32 atomic_compare_exchange_i64(volatile i64* value, i64 expected, i64 desired)
+{
+    b32 result = (_InterlockedCompareExchange64(value, desired, expected) == expected);
+    return result;
+}
+
+internal inline void atomic_fence(void)
+{
+    _mm_mfence();
+}
+#else
+internal inline i64 atomic_load_i64(volatile i64* value)
+{
+    i64 result = __atomic_load_n(value, __ATOMIC_SEQ_CST);
+    return result;
+}
+
+internal inline void atomic_store_i64(volatile i64* value, i64 new_value)
+{
+    __atomic_store_n(value, new_value, __ATOMIC_SEQ_CST);
+}
+
+// Returns the value after the addition
+internal inline i64 atomic_add_i64(volatile i64* value, i64 addend)
+{
+    i64 result = __atomic_add_fetch(value, addend, __ATOMIC_SEQ_CST);
+    return result;
+}
+
+internal inline b32 atomic_compare_exchange_i64(volatile i64* value, i64 expected, i64 desired)
+{
+    b32 result = __atomic_compare_exchange_n(value, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return result;
+}
+
+internal inline void atomic_fence(void)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+#endif
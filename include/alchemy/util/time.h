@@ -40,3 +40,8 @@ void stopwatch_stop(Stopwatch* stopwatch);
 void stopwatch_reset(Stopwatch* stopwatch);
 
 LocalTime get_local_time(void);
+
+// NOTE(lucas): High resolution monotonic clock for measuring elapsed time. Tick length is platform dependent.
+u64 time_ticks(void);
+u64 time_ticks_per_second(void);
+f64 time_ticks_to_ms(u64 ticks);
@@ -23,6 +23,13 @@
 #define persist  static
 #define global   static
 
+// NOTE(lucas): Globals with one instance per thread
+#ifdef _MSC_VER
+    #define thread_global static __declspec(thread)
+#else
+    #define thread_global static __thread
+#endif
+
 #define true  1
 #define false 0
 
@@ -25,6 +25,8 @@ typedef struct Window
 Window* window_create(const char* title, int width, int height);
 void window_render(Window* window);
 
+// NOTE(lucas): A hidden window still has a GL context, so it can be rendered to without being shown
+void window_set_visible(Window* window, b32 visible);
 void window_set_min_size(Window* window, int min_width, int min_height);
 void window_set_max_size(Window* window, int max_width, int max_height);
 
@@ -3,6 +3,8 @@
 #define NK_INCLUDE_STANDARD_VARARGS
 #define NK_INCLUDE_DEFAULT_ALLOCATOR
 #define NK_KEYSTATE_BASED_INPUT
+#define NK_INCLUDE_VERTEX_BUFFER_OUTPUT
+#define NK_ZERO_COMMAND_MEMORY
 #define NK_IMPLEMENTATION
 #pragma warning(push, 0)
 #pragma warning(disable: 4701)
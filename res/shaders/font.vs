@@ -4,7 +4,11 @@ layout (location = 1) in vec2 a_tex_coords;
 
 out vec2 tex_coords;
 
-uniform mat4 projection;
+// NOTE(lucas): Must match FrameUniforms in renderer.h
+layout (std140) uniform Frame
+{
+    mat4 projection;
+};
 
 void main()
 {
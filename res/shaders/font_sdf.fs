@@ -0,0 +1,16 @@
+#version 330 core
+in vec2 tex_coords;
+out vec4 color;
+
+uniform sampler2D text;
+uniform vec4 text_color;
+
+void main()
+{
+    // NOTE(lucas): Distances are packed so that 0.5 is the glyph's edge and larger values are inside.
+    // Smoothing over the screen space rate of change keeps edges about one pixel wide at any scale.
+    float distance = texture(text, tex_coords).r;
+    float width = fwidth(distance);
+    float alpha = smoothstep(0.5 - width, 0.5 + width, distance);
+    color = vec4(text_color.rgb, text_color.a * alpha);
+}
@@ -3,9 +3,12 @@
 in vec2 tex_coords;
 uniform sampler2D screen_texture;
 
+// Texture coordinates of the center of the last texel that was drawn to
+uniform vec2 tex_max;
+
 out vec4 frag_color;
 
 void main()
 {
-    frag_color = texture(screen_texture, tex_coords);
+    frag_color = texture(screen_texture, min(tex_coords, tex_max));
 }
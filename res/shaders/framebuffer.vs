@@ -5,8 +5,11 @@ layout (location = 1) in vec2 a_tex_coords;
 
 out vec2 tex_coords;
 
+// Fraction of the texture that was drawn to, less than 1 with dynamic resolution
+uniform vec2 tex_scale;
+
 void main()
 {
-    tex_coords = a_tex_coords;
+    tex_coords = a_tex_coords*tex_scale;
     gl_Position = vec4(a_pos.x, a_pos.y, 0.0, 1.0);
 }
@@ -3,7 +3,11 @@ layout (location = 0) in vec2 a_pos;
 layout (location = 1) in vec4 a_color;
 
 uniform mat4 model;
-uniform mat4 projection;
+// NOTE(lucas): Must match FrameUniforms in renderer.h
+layout (std140) uniform Frame
+{
+    mat4 projection;
+};
 
 out vec4 vert_color;
 
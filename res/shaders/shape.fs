@@ -0,0 +1,94 @@
+#version 330 core
+out vec4 frag_color;
+
+in vec2 local_pos;
+flat in vec2 half_size;
+flat in vec4 shape_color;
+flat in vec4 params;
+flat in vec2 params_ext;
+flat in float thickness;
+flat in int kind;
+
+// NOTE(lucas): Must match ShapeKind in renderer.h
+const int SHAPE_CIRCLE       = 0;
+const int SHAPE_ARC          = 1;
+const int SHAPE_ROUNDED_RECT = 2;
+const int SHAPE_TRIANGLE     = 3;
+
+const float PI = 3.14159265;
+
+float sd_circle(vec2 p, float r)
+{
+    return length(p) - r;
+}
+
+float sd_rounded_rect(vec2 p, vec2 b, float r)
+{
+    vec2 q = abs(p) - b + r;
+    return length(max(q, 0.0)) + min(max(q.x, q.y), 0.0) - r;
+}
+
+// Infinite wedge that starts at angle 0 and sweeps toward +y through span
+float sd_wedge(vec2 p, float span)
+{
+    if (span >= 2.0*PI)
+        return -1e20;
+
+    // Rotate so the wedge is symmetric about the +y axis
+    float half_span = 0.5*span;
+    float a = 0.5*PI - half_span;
+    vec2 q = vec2(cos(a)*p.x - sin(a)*p.y, sin(a)*p.x + cos(a)*p.y);
+    q.x = abs(q.x);
+
+    vec2 c = vec2(sin(half_span), cos(half_span));
+    float m = length(q - c*max(dot(q, c), 0.0));
+    return m*sign(c.y*q.x - c.x*q.y);
+}
+
+float sd_arc(vec2 p, float outer_radius, float inner_radius, float span)
+{
+    float d = abs(length(p) - 0.5*(outer_radius + inner_radius)) - 0.5*(outer_radius - inner_radius);
+    return max(d, sd_wedge(p, span));
+}
+
+float sd_triangle(vec2 p, vec2 p0, vec2 p1, vec2 p2)
+{
+    vec2 e0 = p1 - p0;
+    vec2 e1 = p2 - p1;
+    vec2 e2 = p0 - p2;
+    vec2 v0 = p - p0;
+    vec2 v1 = p - p1;
+    vec2 v2 = p - p2;
+    vec2 pq0 = v0 - e0*clamp(dot(v0, e0)/dot(e0, e0), 0.0, 1.0);
+    vec2 pq1 = v1 - e1*clamp(dot(v1, e1)/dot(e1, e1), 0.0, 1.0);
+    vec2 pq2 = v2 - e2*clamp(dot(v2, e2)/dot(e2, e2), 0.0, 1.0);
+    float s = sign(e0.x*e2.y - e0.y*e2.x);
+    vec2 d = min(min(vec2(dot(pq0, pq0), s*(v0.x*e0.y - v0.y*e0.x)),
+                     vec2(dot(pq1, pq1), s*(v1.x*e1.y - v1.y*e1.x))),
+                     vec2(dot(pq2, pq2), s*(v2.x*e2.y - v2.y*e2.x)));
+    return -sqrt(d.x)*sign(d.y);
+}
+
+void main()
+{
+    float d = 0.0;
+    if (kind == SHAPE_CIRCLE)
+        d = sd_circle(local_pos, params.x);
+    else if (kind == SHAPE_ARC)
+        d = sd_arc(local_pos, params.x, params.y, params.z);
+    else if (kind == SHAPE_ROUNDED_RECT)
+        d = sd_rounded_rect(local_pos, half_size, params.x);
+    else if (kind == SHAPE_TRIANGLE)
+        d = sd_triangle(local_pos, params.xy, params.zw, params_ext);
+
+    // NOTE(lucas): Outlines are drawn inside the shape's edge
+    if (thickness > 0.0)
+        d = abs(d + 0.5*thickness) - 0.5*thickness;
+
+    float aa_width = max(fwidth(d), 1e-4);
+    float alpha = clamp(0.5 - d/aa_width, 0.0, 1.0);
+    if (alpha <= 0.0)
+        discard;
+
+    frag_color = vec4(shape_color.rgb, shape_color.a*alpha);
+}
@@ -0,0 +1,42 @@
+#version 330 core
+layout (location = 0) in vec2 a_pos;        // Unit quad corner in [-1, 1]
+layout (location = 1) in vec4 a_rect;       // Center (xy) and half size (zw)
+layout (location = 2) in vec4 a_color;
+layout (location = 3) in vec4 a_params;
+layout (location = 4) in vec4 a_params_ext; // Extra params (xy), rotation (z), and thickness (w)
+layout (location = 5) in float a_kind;
+
+// NOTE(lucas): Must match FrameUniforms in renderer.h
+layout (std140) uniform Frame
+{
+    mat4 projection;
+};
+
+out vec2 local_pos;
+flat out vec2 half_size;
+flat out vec4 shape_color;
+flat out vec4 params;
+flat out vec2 params_ext;
+flat out float thickness;
+flat out int kind;
+
+// Pad the quad so that the anti-aliased edge is not clipped
+const float aa_padding = 2.0;
+
+void main()
+{
+    local_pos = a_pos*(a_rect.zw + aa_padding);
+
+    float c = cos(a_params_ext.z);
+    float s = sin(a_params_ext.z);
+    vec2 world_pos = a_rect.xy + vec2(c*local_pos.x - s*local_pos.y, s*local_pos.x + c*local_pos.y);
+
+    half_size = a_rect.zw;
+    shape_color = a_color;
+    params = a_params;
+    params_ext = a_params_ext.xy;
+    thickness = a_params_ext.w;
+    kind = int(a_kind);
+
+    gl_Position = projection * vec4(world_pos, 0.0, 1.0);
+}
@@ -5,10 +5,15 @@ layout (location = 1) in vec2 a_tex_coords;
 out vec2 tex_coords;
 
 uniform mat4 model;
-uniform mat4 projection;
+uniform vec4 uv_rect; // Offset (xy) and scale (zw) of the sub-rectangle of the texture to sample
+// NOTE(lucas): Must match FrameUniforms in renderer.h
+layout (std140) uniform Frame
+{
+    mat4 projection;
+};
 
 void main()
 {
-    tex_coords = a_tex_coords;
+    tex_coords = uv_rect.xy + a_tex_coords*uv_rect.zw;
     gl_Position = projection * model * vec4(a_pos, 0.0, 1.0);
 }
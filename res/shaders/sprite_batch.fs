@@ -0,0 +1,13 @@
+#version 330 core
+out vec4 frag_color;
+
+in vec2 tex_coords;
+in vec4 color;
+flat in float layer;
+
+uniform sampler2D image;
+
+void main()
+{
+    frag_color = texture(image, tex_coords) * color;
+}
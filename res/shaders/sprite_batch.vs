@@ -0,0 +1,24 @@
+#version 330 core
+layout (location = 0) in vec2 a_pos;
+layout (location = 1) in vec2 a_tex_coords;
+layout (location = 2) in vec4 a_color;
+layout (location = 3) in float a_layer;
+
+out vec2 tex_coords;
+out vec4 color;
+flat out float layer;
+
+// NOTE(lucas): Must match FrameUniforms in renderer.h
+layout (std140) uniform Frame
+{
+    mat4 projection;
+};
+
+void main()
+{
+    tex_coords = a_tex_coords;
+    color = a_color;
+    layer = a_layer;
+    // NOTE(lucas): Sprite vertices are already transformed to world space on the CPU
+    gl_Position = projection * vec4(a_pos, 0.0, 1.0);
+}
@@ -11,5 +11,6 @@ out vec4 out_color;
 
 void main()
 {
-   out_color = frag_color * texture(tex, frag_uv.st);
+   // Nuklear puts v = 0 at the top of an image, but textures are loaded bottom-up
+   out_color = frag_color * texture(tex, vec2(frag_uv.s, 1.0 - frag_uv.t));
 }
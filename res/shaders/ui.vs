@@ -2,9 +2,9 @@
 
 uniform mat4 projection;
 
-in vec2 position;
-in vec2 tex_coord;
-in vec4 color;
+layout (location = 0) in vec2 position;
+layout (location = 1) in vec2 tex_coord;
+layout (location = 2) in vec4 color;
 
 out vec2 frag_uv;
 out vec4 frag_color;
@@ -0,0 +1,115 @@
+#include "alchemy/util/thread.h"
+#include "alchemy/util/log.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// NOTE(lucas): Unnamed POSIX semaphores are not available everywhere, so semaphores are built on a mutex and condition
+typedef struct PosixSemaphore
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    u32 count;
+} PosixSemaphore;
+
+internal void* posix_thread_proc(void* param)
+{
+    Thread* thread = (Thread*)param;
+    thread->proc(thread->data);
+    return NULL;
+}
+
+b32 thread_create(Thread* thread, ThreadProc* proc, void* data)
+{
+    thread->proc = proc;
+    thread->data = data;
+    thread->handle = NULL;
+
+    pthread_t* handle = (pthread_t*)malloc(sizeof(pthread_t));
+    if (!handle)
+        return false;
+
+    int error = pthread_create(handle, NULL, posix_thread_proc, thread);
+    if (error)
+    {
+        log_error("Failed to create thread: %d", error);
+        free(handle);
+        return false;
+    }
+
+    thread->handle = handle;
+    return true;
+}
+
+void thread_join(Thread* thread)
+{
+    pthread_t* handle = (pthread_t*)thread->handle;
+    if (!handle)
+        return;
+    pthread_join(*handle, NULL);
+    free(handle);
+    thread->handle = NULL;
+}
+
+void thread_yield(void)
+{
+    sched_yield();
+}
+
+u32 thread_hardware_count(void)
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    u32 result = (count > 0) ? (u32)count : 1;
+    return result;
+}
+
+void semaphore_init(Semaphore* semaphore, u32 initial_count)
+{
+    PosixSemaphore* posix_semaphore = (PosixSemaphore*)malloc(sizeof(PosixSemaphore));
+    semaphore->handle = posix_semaphore;
+    if (!posix_semaphore)
+    {
+        log_error("Failed to create semaphore");
+        return;
+    }
+
+    pthread_mutex_init(&posix_semaphore->mutex, NULL);
+    pthread_cond_init(&posix_semaphore->cond, NULL);
+    posix_semaphore->count = initial_count;
+}
+
+void semaphore_delete(Semaphore* semaphore)
+{
+    PosixSemaphore* posix_semaphore = (PosixSemaphore*)semaphore->handle;
+    if (!posix_semaphore)
+        return;
+
+    pthread_cond_destroy(&posix_semaphore->cond);
+    pthread_mutex_destroy(&posix_semaphore->mutex);
+    free(posix_semaphore);
+    semaphore->handle = NULL;
+}
+
+void semaphore_signal(Semaphore* semaphore, u32 count)
+{
+    PosixSemaphore* posix_semaphore = (PosixSemaphore*)semaphore->handle;
+    pthread_mutex_lock(&posix_semaphore->mutex);
+    posix_semaphore->count += count;
+    if (count == 1)
+        pthread_cond_signal(&posix_semaphore->cond);
+    else
+        pthread_cond_broadcast(&posix_semaphore->cond);
+    pthread_mutex_unlock(&posix_semaphore->mutex);
+}
+
+void semaphore_wait(Semaphore* semaphore)
+{
+    PosixSemaphore* posix_semaphore = (PosixSemaphore*)semaphore->handle;
+    pthread_mutex_lock(&posix_semaphore->mutex);
+    while (!posix_semaphore->count)
+        pthread_cond_wait(&posix_semaphore->cond, &posix_semaphore->mutex);
+    --posix_semaphore->count;
+    pthread_mutex_unlock(&posix_semaphore->mutex);
+}
@@ -104,3 +104,14 @@ void opengl_init(Window* window)
 
     ReleaseDC(window->ptr, window_dc);
 }
+
+void* opengl_get_proc_address(const char* name)
+{
+    void* result = (void*)wglGetProcAddress(name);
+
+    // NOTE(lucas): Some drivers return small integers instead of NULL on failure
+    if (result == (void*)0x1 || result == (void*)0x2 || result == (void*)0x3 || result == (void*)-1)
+        result = NULL;
+
+    return result;
+}
@@ -1,4 +1,5 @@
 #include "alchemy/state.h"
+#include "alchemy/util/profile.h"
 #include "alchemy/util/str.h"
 
 #include <windows.h>
@@ -110,11 +111,13 @@ void game_code_update(GameCode* game_code)
 
     if (CompareFileTime(&new_dll_write_time, &dll_last_write_time) != 0)
     {
+        PROFILE_BEGIN("game_code_reload");
         char* dll_filename = win32_filename_from_full_path(game_code->dll_full_path);
 
         game_code_unload(game_code);
         *game_code = game_code_load(dll_filename);
         game_code->replay_buffer = replay_buffer;
+        PROFILE_END();
     }
 
 #endif
@@ -0,0 +1,70 @@
+#include "alchemy/util/thread.h"
+#include "alchemy/util/log.h"
+
+#include <windows.h>
+
+internal DWORD WINAPI win32_thread_proc(LPVOID param)
+{
+    Thread* thread = (Thread*)param;
+    thread->proc(thread->data);
+    return 0;
+}
+
+b32 thread_create(Thread* thread, ThreadProc* proc, void* data)
+{
+    thread->proc = proc;
+    thread->data = data;
+    thread->handle = CreateThread(NULL, 0, win32_thread_proc, thread, 0, NULL);
+    if (!thread->handle)
+    {
+        log_error("Failed to create thread: %lu", GetLastError());
+        return false;
+    }
+    return true;
+}
+
+void thread_join(Thread* thread)
+{
+    if (!thread->handle)
+        return;
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+    thread->handle = NULL;
+}
+
+void thread_yield(void)
+{
+    SwitchToThread();
+}
+
+u32 thread_hardware_count(void)
+{
+    SYSTEM_INFO info = {0};
+    GetSystemInfo(&info);
+    u32 result = (u32)info.dwNumberOfProcessors;
+    return result;
+}
+
+void semaphore_init(Semaphore* semaphore, u32 initial_count)
+{
+    semaphore->handle = CreateSemaphoreA(NULL, (LONG)initial_count, LONG_MAX, NULL);
+    if (!semaphore->handle)
+        log_error("Failed to create semaphore: %lu", GetLastError());
+}
+
+void semaphore_delete(Semaphore* semaphore)
+{
+    if (semaphore->handle)
+        CloseHandle(semaphore->handle);
+    semaphore->handle = NULL;
+}
+
+void semaphore_signal(Semaphore* semaphore, u32 count)
+{
+    ReleaseSemaphore(semaphore->handle, (LONG)count, NULL);
+}
+
+void semaphore_wait(Semaphore* semaphore)
+{
+    WaitForSingleObject(semaphore->handle, INFINITE);
+}
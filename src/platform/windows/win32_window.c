@@ -190,6 +190,11 @@ void window_render(Window* window)
     ReleaseDC(window->ptr, device_context);
 }
 
+void window_set_visible(Window* window, b32 visible)
+{
+    ShowWindow(window->ptr, visible ? SW_SHOW : SW_HIDE);
+}
+
 void window_set_min_size(Window* window, int min_width, int min_height)
 {
     window->min_width = min_width;
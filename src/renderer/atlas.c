@@ -0,0 +1,326 @@
+#include "alchemy/renderer/atlas.h"
+#include "alchemy/renderer/renderer.h"
+#include "alchemy/util/log.h"
+
+#include <stb_image/stb_image.h>
+
+#include <string.h> // memcpy
+
+// Queue the rect of the page's pixels to be uploaded at the next render
+internal void atlas_page_upload(Renderer* renderer, TextureAtlas* atlas, AtlasPage* page, i32 x, i32 y,
+                                i32 width, i32 height)
+{
+    TextureUpdate update = {0};
+    update.handle = page->texture.handle;
+    update.x = x;
+    update.y = y;
+    update.width = width;
+    update.height = height;
+    update.channels = atlas->channels;
+    update.row_length = atlas->page_size;
+    update.pixels = page->pixels;
+    renderer_texture_update(renderer, update);
+}
+
+internal void atlas_page_clear(Renderer* renderer, TextureAtlas* atlas, AtlasPage* page)
+{
+    // NOTE(lucas): Padding texels must be transparent, and texture storage starts out undefined
+    zero_size_((size)atlas->page_size*atlas->page_size*atlas->channels, page->pixels);
+    atlas_page_upload(renderer, atlas, page, 0, 0, atlas->page_size, atlas->page_size);
+
+    page->nodes[0] = (AtlasSkylineNode){0, 0, atlas->page_size};
+    page->node_count = 1;
+    page->region_count = 0;
+}
+
+internal AtlasPage* atlas_page_add(Renderer* renderer, TextureAtlas* atlas)
+{
+    AtlasPage* page = atlas->pages + atlas->page_count++;
+
+    page->texture = (Texture){0};
+    page->texture.handle = renderer_texture_alloc(renderer);
+    page->texture.id = renderer_texture_id(renderer, page->texture.handle);
+    page->texture.size = v2_full((f32)atlas->page_size);
+    page->texture.channels = atlas->channels;
+    renderer_texture_storage(renderer, page->texture.handle, atlas->page_size, atlas->page_size, 0, atlas->channels);
+
+    atlas_page_clear(renderer, atlas, page);
+    return page;
+}
+
+void atlas_init(TextureAtlas* atlas, i32 page_size, u32 max_pages, i32 channels, MemoryArena* arena)
+{
+    ASSERTF(max_pages > 0 && max_pages <= ATLAS_MAX_PAGES, "Atlas page count must be between 1 and %d", ATLAS_MAX_PAGES);
+    ASSERTF(channels == 1 || channels == 4, "Atlas pages must have 1 or 4 channels, not %d", channels);
+
+    *atlas = (TextureAtlas){0};
+    atlas->page_size = page_size;
+    atlas->max_pages = max_pages;
+    atlas->channels = channels;
+    atlas->padding = 1;
+
+    // NOTE(lucas): Every skyline node is at least one texel wide, so a page never needs more nodes than its width
+    for (u32 i = 0; i < max_pages; ++i)
+    {
+        atlas->pages[i].nodes = push_array(arena, page_size, AtlasSkylineNode);
+        atlas->pages[i].pixels = push_array(arena, (size)page_size*page_size*channels, ubyte);
+    }
+}
+
+void atlas_delete(Renderer* renderer, TextureAtlas* atlas)
+{
+    for (u32 i = 0; i < atlas->page_count; ++i)
+        texture_free(renderer, &atlas->pages[i].texture);
+    atlas->page_count = 0;
+}
+
+// Find the lowest y a rect of the given width can be placed at when its left edge is at the start of a skyline node.
+// Returns -1 if it doesn't fit.
+internal i32 atlas_skyline_fit(TextureAtlas* atlas, AtlasPage* page, u32 index, i32 width, i32 height)
+{
+    i32 x = page->nodes[index].x;
+    if (x + width > atlas->page_size)
+        return -1;
+
+    i32 y = 0;
+    i32 remaining = width;
+    for (u32 i = index; remaining > 0; ++i)
+    {
+        AtlasSkylineNode* node = page->nodes + i;
+        if (node->y > y)
+            y = node->y;
+        if (y + height > atlas->page_size)
+            return -1;
+        remaining -= node->width;
+    }
+
+    return y;
+}
+
+// NOTE(lucas): Bottom-left heuristic: choose the position with the lowest top edge, breaking ties by the narrower
+// node to keep gaps small
+internal b32 atlas_page_find(TextureAtlas* atlas, AtlasPage* page, i32 width, i32 height,
+                             u32* best_index, i32* best_x, i32* best_y)
+{
+    i32 best_top = atlas->page_size + 1;
+    i32 best_width = atlas->page_size + 1;
+    b32 found = false;
+
+    for (u32 i = 0; i < page->node_count; ++i)
+    {
+        i32 y = atlas_skyline_fit(atlas, page, i, width, height);
+        if (y < 0)
+            continue;
+
+        AtlasSkylineNode* node = page->nodes + i;
+        i32 top = y + height;
+        if (top < best_top || (top == best_top && node->width < best_width))
+        {
+            best_top = top;
+            best_width = node->width;
+            *best_index = i;
+            *best_x = node->x;
+            *best_y = y;
+            found = true;
+        }
+    }
+
+    return found;
+}
+
+internal void atlas_skyline_add(AtlasPage* page, u32 index, i32 x, i32 y, i32 width, i32 height)
+{
+    // Insert the new level
+    for (u32 i = page->node_count; i > index; --i)
+        page->nodes[i] = page->nodes[i-1];
+    page->nodes[index] = (AtlasSkylineNode){x, y + height, width};
+    ++page->node_count;
+
+    // Shrink or remove the nodes the new level now covers
+    for (u32 i = index + 1; i < page->node_count;)
+    {
+        AtlasSkylineNode* prev = page->nodes + i - 1;
+        AtlasSkylineNode* node = page->nodes + i;
+        i32 prev_end = prev->x + prev->width;
+        if (node->x >= prev_end)
+            break;
+
+        i32 shrink = prev_end - node->x;
+        node->x += shrink;
+        node->width -= shrink;
+        if (node->width > 0)
+            break;
+
+        for (u32 j = i; j + 1 < page->node_count; ++j)
+            page->nodes[j] = page->nodes[j+1];
+        --page->node_count;
+    }
+
+    // Merge neighbouring nodes at the same height
+    for (u32 i = 0; i + 1 < page->node_count;)
+    {
+        AtlasSkylineNode* node = page->nodes + i;
+        AtlasSkylineNode* next = page->nodes + i + 1;
+        if (node->y == next->y)
+        {
+            node->width += next->width;
+            for (u32 j = i + 1; j + 1 < page->node_count; ++j)
+                page->nodes[j] = page->nodes[j+1];
+            --page->node_count;
+        }
+        else
+        {
+            ++i;
+        }
+    }
+}
+
+internal u32 atlas_least_recently_used_page(TextureAtlas* atlas)
+{
+    u32 result = 0;
+    for (u32 i = 1; i < atlas->page_count; ++i)
+    {
+        if (atlas->pages[i].last_used < atlas->pages[result].last_used)
+            result = i;
+    }
+    return result;
+}
+
+void atlas_evict_page(Renderer* renderer, TextureAtlas* atlas, u32 page)
+{
+    ASSERTF(page < atlas->page_count, "Atlas page %u out of range", page);
+
+    AtlasPage* p = atlas->pages + page;
+    ++p->generation;
+    atlas_page_clear(renderer, atlas, p);
+    ++atlas->evictions;
+}
+
+AtlasRegion atlas_insert(Renderer* renderer, TextureAtlas* atlas, int width, int height, int channels, ubyte* data)
+{
+    ASSERTF(channels >= 1 && channels <= 4, "Unsupported number of channels (%d)", channels);
+
+    AtlasRegion region = {0};
+
+    i32 padded_width = width + 2*atlas->padding;
+    i32 padded_height = height + 2*atlas->padding;
+    if (padded_width > atlas->page_size || padded_height > atlas->page_size)
+    {
+        log_warn("Image (%dx%d) is too large for atlas pages (%d)", width, height, atlas->page_size);
+        return region;
+    }
+
+    u32 page_index = 0;
+    u32 node_index = 0;
+    i32 x = 0;
+    i32 y = 0;
+    b32 found = false;
+    for (; page_index < atlas->page_count; ++page_index)
+    {
+        found = atlas_page_find(atlas, atlas->pages + page_index, padded_width, padded_height, &node_index, &x, &y);
+        if (found)
+            break;
+    }
+
+    if (!found)
+    {
+        if (atlas->page_count < atlas->max_pages)
+        {
+            page_index = atlas->page_count;
+            atlas_page_add(renderer, atlas);
+        }
+        else
+        {
+            page_index = atlas_least_recently_used_page(atlas);
+            log_debug("Atlas full, evicting page %u", page_index);
+            atlas_evict_page(renderer, atlas, page_index);
+        }
+
+        // NOTE(lucas): An empty page always fits the image since its size was checked above
+        found = atlas_page_find(atlas, atlas->pages + page_index, padded_width, padded_height, &node_index, &x, &y);
+        ASSERT(found, "Image does not fit in an empty atlas page");
+    }
+
+    AtlasPage* page = atlas->pages + page_index;
+    atlas_skyline_add(page, node_index, x, y, padded_width, padded_height);
+    ++page->region_count;
+    page->last_used = ++atlas->tick;
+
+    region.texture = &page->texture;
+    region.x = x + atlas->padding;
+    region.y = y + atlas->padding;
+    region.width = width;
+    region.height = height;
+    region.page = page_index;
+    region.generation = page->generation;
+
+    f32 inv_size = 1.0f / (f32)atlas->page_size;
+    region.uv = rect_min_dim(v2((f32)region.x*inv_size, (f32)region.y*inv_size),
+                             v2((f32)width*inv_size, (f32)height*inv_size));
+
+    // NOTE(lucas): Rows are tightly packed. Missing channels are filled in the way GL would: green and blue with 0,
+    // and alpha with 255.
+    for (int row = 0; row < height; ++row)
+    {
+        ubyte* src = data + (size)row*width*channels;
+        ubyte* dest = page->pixels + ((size)(region.y + row)*atlas->page_size + region.x)*atlas->channels;
+        if (channels == atlas->channels)
+        {
+            memcpy(dest, src, (size)width*channels);
+            continue;
+        }
+
+        for (int col = 0; col < width; ++col)
+        {
+            for (int c = 0; c < atlas->channels; ++c)
+            {
+                ubyte value = (c == 3) ? 0xFF : 0;
+                if (c < channels)
+                    value = src[col*channels + c];
+                dest[col*atlas->channels + c] = value;
+            }
+        }
+    }
+    atlas_page_upload(renderer, atlas, page, region.x, region.y, width, height);
+
+    return region;
+}
+
+AtlasRegion atlas_load_from_file(Renderer* renderer, TextureAtlas* atlas, const char* filename)
+{
+    AtlasRegion region = {0};
+
+    Texture image = load_any_texture_from_file(filename);
+    if (!image.data)
+    {
+        log_error("Failed to load image %s", filename);
+        return region;
+    }
+
+    region = atlas_insert(renderer, atlas, (int)image.size.x, (int)image.size.y, image.channels, image.data);
+    stbi_image_free(image.data);
+
+    return region;
+}
+
+b32 atlas_region_valid(TextureAtlas* atlas, AtlasRegion* region)
+{
+    b32 result = (region->texture && region->page < atlas->page_count &&
+                  atlas->pages[region->page].generation == region->generation);
+    return result;
+}
+
+// Mark the region's page as recently used so that it is not the first to be evicted
+void atlas_touch(TextureAtlas* atlas, AtlasRegion* region)
+{
+    if (atlas_region_valid(atlas, region))
+        atlas->pages[region->page].last_used = ++atlas->tick;
+}
+
+Sprite sprite_from_atlas(AtlasRegion* region)
+{
+    Sprite sprite = sprite_init(region->texture);
+    sprite.size = v2((f32)region->width, (f32)region->height);
+    sprite.uv = region->uv;
+    return sprite;
+}
@@ -0,0 +1,628 @@
+#include "alchemy/renderer/capture.h"
+#include "alchemy/renderer/renderer.h"
+#include "alchemy/util/log.h"
+#include "alchemy/util/memory.h"
+#include "alchemy/util/profile.h"
+
+#include <stddef.h> // offsetof
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> // memcpy, strncpy
+
+// NOTE(lucas): Every section starts on a 16 byte boundary so loaded commands and tables can be used in place
+#define RENDER_CAPTURE_ALIGN 16
+#define RENDER_CAPTURE_MAX_TEXTURES 1024 // Per frame
+#define RENDER_CAPTURE_MAX_FONTS 64      // Per frame
+
+internal size capture_align(size bytes)
+{
+    size result = (bytes + (RENDER_CAPTURE_ALIGN - 1)) & ~(size)(RENDER_CAPTURE_ALIGN - 1);
+    return result;
+}
+
+internal void capture_write_padding(FILE* file, size bytes)
+{
+    persist u8 padding[RENDER_CAPTURE_ALIGN];
+    size padding_bytes = capture_align(bytes) - bytes;
+    if (padding_bytes)
+        fwrite(padding, 1, padding_bytes, file);
+}
+
+internal void capture_write(FILE* file, void* data, size bytes)
+{
+    if (bytes)
+        fwrite(data, 1, bytes, file);
+    capture_write_padding(file, bytes);
+}
+
+typedef struct CaptureTables
+{
+    RenderCaptureTexture* textures;
+    u32 texture_count;
+    Font** fonts;
+    u32 font_count;
+    b32 overflowed;
+} CaptureTables;
+
+// Returns the texture's index in the table plus one, or 0 for NULL
+internal u32 capture_texture_ref(CaptureTables* tables, Texture* texture)
+{
+    if (!texture)
+        return 0;
+
+    for (u32 i = 0; i < tables->texture_count; ++i)
+    {
+        if (tables->textures[i].id == texture->id)
+            return i + 1;
+    }
+
+    if (tables->texture_count == RENDER_CAPTURE_MAX_TEXTURES)
+    {
+        tables->overflowed = true;
+        return 0;
+    }
+
+    RenderCaptureTexture* entry = tables->textures + tables->texture_count++;
+    entry->id = texture->id;
+    entry->width = (i32)texture->size.x;
+    entry->height = (i32)texture->size.y;
+    entry->channels = texture->channels;
+    entry->layers = texture->layers;
+    return tables->texture_count;
+}
+
+// Returns the font's index in the table plus one, or 0 for NULL
+internal u32 capture_font_ref(CaptureTables* tables, Font* font)
+{
+    if (!font)
+        return 0;
+
+    for (u32 i = 0; i < tables->font_count; ++i)
+    {
+        if (tables->fonts[i] == font)
+            return i + 1;
+    }
+
+    if (tables->font_count == RENDER_CAPTURE_MAX_FONTS)
+    {
+        tables->overflowed = true;
+        return 0;
+    }
+
+    tables->fonts[tables->font_count++] = font;
+    return tables->font_count;
+}
+
+b32 render_capture_begin(Renderer* renderer, const char* filename, u32 frame_count)
+{
+    RenderCapture* capture = &renderer->capture;
+    if (capture->file)
+    {
+        log_warn("A render capture is already running, not starting %s", filename);
+        return false;
+    }
+
+    FILE* file = fopen(filename, "wb");
+    if (!file)
+    {
+        log_error("Failed to open %s to capture frames", filename);
+        return false;
+    }
+
+    RenderCaptureHeader header = {0};
+    header.magic = RENDER_CAPTURE_MAGIC;
+    header.version = RENDER_CAPTURE_VERSION;
+    header.pointer_bytes = (u32)sizeof(void*);
+    fwrite(&header, sizeof(header), 1, file);
+
+    capture->file = file;
+    capture->frame_count = 0;
+    capture->frames_left = frame_count;
+    log_info("Capturing %s%u frames to %s", frame_count ? "" : "until stopped, ", frame_count, filename);
+    return true;
+}
+
+void render_capture_end(Renderer* renderer)
+{
+    RenderCapture* capture = &renderer->capture;
+    FILE* file = (FILE*)capture->file;
+    if (!file)
+        return;
+
+    fseek(file, offsetof(RenderCaptureHeader, frame_count), SEEK_SET);
+    fwrite(&capture->frame_count, sizeof(capture->frame_count), 1, file);
+    fclose(file);
+
+    log_info("Captured %u frames", capture->frame_count);
+    capture->file = NULL;
+    capture->frames_left = 0;
+}
+
+b32 render_capture_active(Renderer* renderer)
+{
+    b32 result = (renderer->capture.file != NULL);
+    return result;
+}
+
+void render_capture_frame(Renderer* renderer)
+{
+    RenderCapture* capture = &renderer->capture;
+    FILE* file = (FILE*)capture->file;
+    if (!file)
+        return;
+
+    PROFILE_BEGIN("render_capture_frame");
+    MemoryArena* arena = &renderer->scratch_arena;
+    RenderCommandBuffer* buffer = &renderer->command_buffer;
+    UIState* ui = &renderer->ui_state;
+
+    CaptureTables tables = {0};
+    tables.textures = push_array(arena, RENDER_CAPTURE_MAX_TEXTURES, RenderCaptureTexture);
+    tables.fonts = push_array(arena, RENDER_CAPTURE_MAX_FONTS, Font*);
+
+    RenderCaptureFrameHeader header = {0};
+    header.magic = RENDER_CAPTURE_FRAME_MAGIC;
+    header.command_bytes = (u32)buffer->bytes;
+    header.window_width = renderer->window_width;
+    header.window_height = renderer->window_height;
+    header.viewport = renderer->viewport;
+    header.clear_color = renderer->clear_color;
+    header.msaa_level = renderer->config.msaa_level;
+    header.resolution_scale = renderer->config.dynamic_resolution ? renderer->resolution.scale : 1.0f;
+    if (renderer->config.batching)
+        header.flags |= RenderCaptureFlag_Batching;
+    if (renderer->config.damage_tracking)
+        header.flags |= RenderCaptureFlag_DamageTracking;
+    if (renderer->config.dynamic_resolution)
+        header.flags |= RenderCaptureFlag_DynamicResolution;
+
+    // NOTE(lucas): First pass builds the tables and sizes the strings so the header can be written up front
+    b32 has_ui = false;
+    for (size at = 0; at < buffer->bytes;)
+    {
+        RenderCommand* command = (RenderCommand*)(buffer->base + at);
+        switch (command->type)
+        {
+            case RENDER_COMMAND_RenderCommandSprite:
+            {
+                RenderCommandSprite* cmd = (RenderCommandSprite*)command;
+                capture_texture_ref(&tables, cmd->sprite.texture);
+            } break;
+
+            case RENDER_COMMAND_RenderCommandText:
+            {
+                RenderCommandText* cmd = (RenderCommandText*)command;
+                capture_font_ref(&tables, cmd->text.font);
+                header.string_bytes += (u32)cmd->text.string.len;
+            } break;
+
+            // NOTE(lucas): There is one UI command per frame, and it draws every UI draw command
+            case RENDER_COMMAND_RenderCommandUI:
+            {
+                RenderCommandUI* cmd = (RenderCommandUI*)command;
+                header.ui_vertex_bytes = cmd->vertex_bytes;
+                header.ui_element_bytes = cmd->element_bytes;
+                has_ui = true;
+            } break;
+
+            default: break;
+        }
+
+        at += render_command_size(command->type);
+        ++header.command_count;
+    }
+
+    RenderCaptureUIDraw* ui_draws = 0;
+    if (has_ui)
+    {
+        header.ui_draw_count = ui->draw_count;
+        ui_draws = push_array(arena, ui->draw_count, RenderCaptureUIDraw);
+        for (u32 i = 0; i < ui->draw_count; ++i)
+        {
+            UIDrawCommand* draw = ui->draws + i;
+            ui_draws[i].clip = draw->clip;
+            ui_draws[i].texture = capture_texture_ref(&tables, draw->texture);
+            ui_draws[i].element_count = draw->element_count;
+        }
+    }
+
+    header.texture_count = tables.texture_count;
+    header.font_count = tables.font_count;
+    if (tables.overflowed)
+        log_warn("Frame %u uses too many textures or fonts to capture, some will be missing", capture->frame_count);
+
+    fwrite(&header, sizeof(header), 1, file);
+
+    // NOTE(lucas): Commands are written one at a time since the buffer can be larger than the scratch arena.
+    // Every command is a multiple of 16 bytes, so the commands need no padding.
+    u32 string_offset = 0;
+    for (size at = 0; at < buffer->bytes;)
+    {
+        RenderCommand* command = (RenderCommand*)(buffer->base + at);
+        size bytes = render_command_size(command->type);
+        switch (command->type)
+        {
+            case RENDER_COMMAND_RenderCommandSprite:
+            {
+                RenderCommandSprite cmd = *(RenderCommandSprite*)command;
+                cmd.sprite.texture = (Texture*)(usize)capture_texture_ref(&tables, cmd.sprite.texture);
+                fwrite(&cmd, sizeof(cmd), 1, file);
+            } break;
+
+            case RENDER_COMMAND_RenderCommandText:
+            {
+                RenderCommandText cmd = *(RenderCommandText*)command;
+                cmd.text.font = (Font*)(usize)capture_font_ref(&tables, cmd.text.font);
+                cmd.text.string.data = (u8*)(usize)string_offset;
+                string_offset += (u32)cmd.text.string.len;
+                fwrite(&cmd, sizeof(cmd), 1, file);
+            } break;
+
+            default:
+            {
+                fwrite(command, bytes, 1, file);
+            } break;
+        }
+        at += bytes;
+    }
+
+    for (size at = 0; at < buffer->bytes;)
+    {
+        RenderCommand* command = (RenderCommand*)(buffer->base + at);
+        if (command->type == RENDER_COMMAND_RenderCommandText)
+        {
+            RenderCommandText* cmd = (RenderCommandText*)command;
+            if (cmd->text.string.len)
+                fwrite(cmd->text.string.data, 1, cmd->text.string.len, file);
+        }
+        at += render_command_size(command->type);
+    }
+    capture_write_padding(file, header.string_bytes);
+
+    capture_write(file, tables.textures, tables.texture_count*sizeof(RenderCaptureTexture));
+
+    RenderCaptureFont* fonts = push_array(arena, tables.font_count, RenderCaptureFont);
+    for (u32 i = 0; i < tables.font_count; ++i)
+    {
+        Font* font = tables.fonts[i];
+        RenderCaptureFont* entry = fonts + i;
+        memset(entry, 0, sizeof(*entry));
+        entry->sdf = font->sdf;
+        entry->sdf_px = font->sdf_px;
+        if (font->face && font->face->family_name)
+            strncpy(entry->family, font->face->family_name, sizeof(entry->family) - 1);
+    }
+    capture_write(file, fonts, tables.font_count*sizeof(RenderCaptureFont));
+
+    capture_write(file, ui_draws, header.ui_draw_count*sizeof(RenderCaptureUIDraw));
+    capture_write(file, header.ui_vertex_bytes ? ui->vertices : 0, header.ui_vertex_bytes);
+    capture_write(file, header.ui_element_bytes ? ui->elements : 0, header.ui_element_bytes);
+
+    memory_arena_pop(arena, tables.font_count*sizeof(RenderCaptureFont));
+    memory_arena_pop(arena, header.ui_draw_count*sizeof(RenderCaptureUIDraw));
+    memory_arena_pop(arena, RENDER_CAPTURE_MAX_FONTS*sizeof(Font*));
+    memory_arena_pop(arena, RENDER_CAPTURE_MAX_TEXTURES*sizeof(RenderCaptureTexture));
+
+    ++capture->frame_count;
+    if (capture->frames_left && --capture->frames_left == 0)
+        render_capture_end(renderer);
+    PROFILE_END();
+}
+
+// Returns NULL if the section runs past the end of the file
+internal u8* capture_section(u8* data, size bytes, size* at, size section_bytes)
+{
+    size aligned = capture_align(section_bytes);
+    if (section_bytes < 0 || aligned > bytes - *at)
+        return NULL;
+
+    u8* result = data + *at;
+    *at += aligned;
+    return result;
+}
+
+// NOTE(lucas): Checks every size and reference so that replaying a loaded frame never reads outside of the file
+internal b32 capture_frame_parse(u8* data, size bytes, size* at, RenderCaptureFrame* frame)
+{
+    RenderCaptureFrame result = {0};
+    result.header = (RenderCaptureFrameHeader*)capture_section(data, bytes, at, sizeof(RenderCaptureFrameHeader));
+    if (!result.header || result.header->magic != RENDER_CAPTURE_FRAME_MAGIC)
+        return false;
+
+    // NOTE(lucas): The comparisons are written so that NaNs fail them
+    RenderCaptureFrameHeader* header = result.header;
+    if (header->window_width <= 0 || header->window_height <= 0 || !(header->viewport.width > 0.0f) ||
+        !(header->viewport.height > 0.0f) || !(header->resolution_scale > 0.0f && header->resolution_scale <= 1.0f))
+        return false;
+
+    result.commands = capture_section(data, bytes, at, header->command_bytes);
+    result.strings = capture_section(data, bytes, at, header->string_bytes);
+    result.textures = (RenderCaptureTexture*)capture_section(data, bytes, at,
+                                                             (size)header->texture_count*sizeof(RenderCaptureTexture));
+    result.fonts = (RenderCaptureFont*)capture_section(data, bytes, at,
+                                                       (size)header->font_count*sizeof(RenderCaptureFont));
+    result.ui_draws = (RenderCaptureUIDraw*)capture_section(data, bytes, at,
+                                                            (size)header->ui_draw_count*sizeof(RenderCaptureUIDraw));
+    result.ui_vertices = capture_section(data, bytes, at, header->ui_vertex_bytes);
+    result.ui_elements = capture_section(data, bytes, at, header->ui_element_bytes);
+    if (!result.commands || !result.strings || !result.textures || !result.fonts || !result.ui_draws ||
+        !result.ui_vertices || !result.ui_elements)
+        return false;
+
+    u32 command_count = 0;
+    u32 ui_command_count = 0;
+    u32 ui_element_bytes = 0; // Elements drawn by the UI command
+    size command_at = 0;
+    while (command_at < header->command_bytes)
+    {
+        RenderCommand* command = (RenderCommand*)(result.commands + command_at);
+        if ((u32)command->type >= RENDER_COMMAND_COUNT)
+            return false;
+
+        size command_bytes = render_command_size(command->type);
+        if (command_bytes > header->command_bytes - command_at)
+            return false;
+
+        if (command->type == RENDER_COMMAND_RenderCommandSprite)
+        {
+            RenderCommandSprite* cmd = (RenderCommandSprite*)command;
+            if ((usize)cmd->sprite.texture > header->texture_count)
+                return false;
+        }
+        else if (command->type == RENDER_COMMAND_RenderCommandText)
+        {
+            RenderCommandText* cmd = (RenderCommandText*)command;
+            usize offset = (usize)cmd->text.string.data;
+            if ((usize)cmd->text.font > header->font_count || cmd->text.string.len < 0 ||
+                offset > header->string_bytes || (usize)cmd->text.string.len > header->string_bytes - offset)
+                return false;
+        }
+        else if (command->type == RENDER_COMMAND_RenderCommandUI)
+        {
+            // NOTE(lucas): The UI command draws the frame's one UI vertex and element buffer
+            RenderCommandUI* cmd = (RenderCommandUI*)command;
+            if (++ui_command_count > 1 || cmd->vertex_bytes > header->ui_vertex_bytes ||
+                cmd->element_bytes > header->ui_element_bytes)
+                return false;
+            ui_element_bytes = cmd->element_bytes;
+        }
+
+        command_at += command_bytes;
+        ++command_count;
+    }
+    if (command_count != header->command_count)
+        return false;
+
+    usize element_count = 0;
+    for (u32 i = 0; i < header->ui_draw_count; ++i)
+    {
+        if (result.ui_draws[i].texture > header->texture_count)
+            return false;
+        element_count += result.ui_draws[i].element_count;
+    }
+    if (element_count*sizeof(nk_draw_index) > ui_element_bytes)
+        return false;
+
+    if (frame)
+        *frame = result;
+    return true;
+}
+
+b32 render_capture_load(RenderCaptureFile* capture, const char* filename)
+{
+    *capture = (RenderCaptureFile){0};
+
+    FILE* file = fopen(filename, "rb");
+    if (!file)
+    {
+        log_error("Failed to open capture %s", filename);
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    size bytes = (size)ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    u8* data = (bytes > 0) ? (u8*)malloc(bytes) : NULL;
+    b32 read = data && (fread(data, 1, bytes, file) == (usize)bytes);
+    fclose(file);
+    if (!read)
+    {
+        log_error("Failed to read capture %s", filename);
+        free(data);
+        return false;
+    }
+
+    RenderCaptureHeader* header = (RenderCaptureHeader*)data;
+    if (bytes < (size)sizeof(*header) || header->magic != RENDER_CAPTURE_MAGIC)
+    {
+        log_error("%s is not a render capture", filename);
+        free(data);
+        return false;
+    }
+    if (header->version != RENDER_CAPTURE_VERSION || header->pointer_bytes != sizeof(void*))
+    {
+        log_error("%s is a version %u capture from a %u-bit build, expected version %u from a %u-bit build",
+                  filename, header->version, 8*header->pointer_bytes, RENDER_CAPTURE_VERSION, 8*(u32)sizeof(void*));
+        free(data);
+        return false;
+    }
+
+    // NOTE(lucas): A capture that was never ended has no frame count, so frames are counted until the first one
+    // that is cut off
+    u32 frame_count = 0;
+    for (size at = sizeof(*header); capture_frame_parse(data, bytes, &at, NULL);)
+        ++frame_count;
+
+    if (header->frame_count && header->frame_count != frame_count)
+        log_warn("%s should have %u frames but %u are valid", filename, header->frame_count, frame_count);
+    if (!frame_count)
+    {
+        log_error("%s has no valid frames", filename);
+        free(data);
+        return false;
+    }
+
+    capture->frames = (RenderCaptureFrame*)malloc(frame_count*sizeof(RenderCaptureFrame));
+    if (!capture->frames)
+    {
+        free(data);
+        return false;
+    }
+
+    size at = sizeof(*header);
+    for (u32 i = 0; i < frame_count; ++i)
+        capture_frame_parse(data, bytes, &at, capture->frames + i);
+
+    capture->data = data;
+    capture->bytes = bytes;
+    capture->frame_count = frame_count;
+    log_info("Loaded %u frames from %s", frame_count, filename);
+    return true;
+}
+
+void render_capture_free(RenderCaptureFile* capture)
+{
+    free(capture->frames);
+    free(capture->data);
+    *capture = (RenderCaptureFile){0};
+}
+
+u32 render_capture_textures(RenderCaptureFile* capture, RenderCaptureTexture* textures, u32 max_textures)
+{
+    u32 count = 0;
+    for (u32 frame_index = 0; frame_index < capture->frame_count; ++frame_index)
+    {
+        RenderCaptureFrame* frame = capture->frames + frame_index;
+        for (u32 i = 0; i < frame->header->texture_count; ++i)
+        {
+            RenderCaptureTexture* texture = frame->textures + i;
+            b32 found = false;
+            for (u32 j = 0; j < count && j < max_textures && !found; ++j)
+                found = (textures[j].id == texture->id);
+
+            if (!found)
+            {
+                if (count < max_textures)
+                    textures[count] = *texture;
+                ++count;
+            }
+        }
+    }
+    return count;
+}
+
+internal Texture* capture_texture_resolve(Texture** textures, u32 ref)
+{
+    Texture* result = ref ? textures[ref - 1] : NULL;
+    return result;
+}
+
+void render_capture_replay(Renderer* renderer, RenderCaptureFrame* frame, RenderCaptureResources* resources)
+{
+    PROFILE_BEGIN("render_capture_replay");
+    RenderCaptureFrameHeader* header = frame->header;
+    RenderCommandBuffer* buffer = &renderer->command_buffer;
+    MemoryArena* arena = &renderer->scratch_arena;
+
+    if (buffer->bytes + header->command_bytes >= buffer->max_bytes)
+    {
+        log_error("A captured frame needs %u bytes of commands, but the command buffer only has %lld left",
+                  header->command_bytes, (long long)(buffer->max_bytes - buffer->bytes));
+        PROFILE_END();
+        return;
+    }
+
+    // NOTE(lucas): The capture was taken after the UI set the viewport to the window, which is what the frame
+    // is replayed with
+    renderer->window_width = header->window_width;
+    renderer->window_height = header->window_height;
+    renderer->clear_color = header->clear_color;
+    renderer_viewport(renderer, header->viewport);
+
+    // NOTE(lucas): Textures the caller has no stand-in for are drawn with the missing texture
+    Texture** textures = push_array(arena, header->texture_count, Texture*);
+    for (u32 i = 0; i < header->texture_count; ++i)
+    {
+        textures[i] = resources->missing_texture;
+        for (u32 j = 0; j < resources->texture_count; ++j)
+        {
+            if (resources->texture_ids[j] == frame->textures[i].id)
+            {
+                textures[i] = resources->textures[j];
+                break;
+            }
+        }
+    }
+
+    u8* commands = buffer->base + buffer->bytes;
+    memcpy(commands, frame->commands, header->command_bytes);
+    buffer->bytes += header->command_bytes;
+
+    for (size at = 0; at < header->command_bytes;)
+    {
+        RenderCommand* command = (RenderCommand*)(commands + at);
+        switch (command->type)
+        {
+            case RENDER_COMMAND_RenderCommandSprite:
+            {
+                RenderCommandSprite* cmd = (RenderCommandSprite*)command;
+                u32 ref = (u32)(usize)cmd->sprite.texture;
+                cmd->sprite.texture = capture_texture_resolve(textures, ref);
+            } break;
+
+            case RENDER_COMMAND_RenderCommandText:
+            {
+                RenderCommandText* cmd = (RenderCommandText*)command;
+                cmd->text.font = cmd->text.font ? resources->font : NULL;
+                cmd->text.string.data = frame->strings + (usize)cmd->text.string.data;
+            } break;
+
+            default: break;
+        }
+        at += render_command_size(command->type);
+    }
+
+    // NOTE(lucas): The UI shader's projection comes from the UI state's size
+    UIState* ui = &renderer->ui_state;
+    ui->width = header->window_width;
+    ui->height = header->window_height;
+
+    UIDrawCommand* draws = push_array(arena, header->ui_draw_count, UIDrawCommand);
+    for (u32 i = 0; i < header->ui_draw_count; ++i)
+    {
+        RenderCaptureUIDraw* draw = frame->ui_draws + i;
+        draws[i].clip = draw->clip;
+        draws[i].texture = capture_texture_resolve(textures, draw->texture);
+        draws[i].element_count = draw->element_count;
+    }
+
+    RenderCapture* capture = &renderer->capture;
+    if (!capture->replaying)
+    {
+        capture->ui_vertices = ui->vertices;
+        capture->ui_elements = ui->elements;
+        capture->ui_draws = ui->draws;
+        capture->ui_draw_count = ui->draw_count;
+    }
+    capture->replaying = true;
+    ui->vertices = frame->ui_vertices;
+    ui->elements = frame->ui_elements;
+    ui->draws = draws;
+    ui->draw_count = header->ui_draw_count;
+    PROFILE_END();
+}
+
+void render_capture_replay_end(Renderer* renderer)
+{
+    RenderCapture* capture = &renderer->capture;
+    if (!capture->replaying)
+        return;
+
+    UIState* ui = &renderer->ui_state;
+    ui->vertices = capture->ui_vertices;
+    ui->elements = capture->ui_elements;
+    ui->draws = capture->ui_draws;
+    ui->draw_count = capture->ui_draw_count;
+    capture->replaying = false;
+}
@@ -2,15 +2,20 @@
 #include "alchemy/renderer/renderer.h"
 #include "alchemy/util/math.h"
 #include "alchemy/util/memory.h"
+#include "alchemy/util/profile.h"
 #include "alchemy/util/str.h"
 #include "alchemy/util/types.h"
 
 #include <glad/glad.h>
+#include <stdlib.h>
+#include <string.h> // memcmp, memcpy
+#include FT_MODULE_H
 
 // TODO(lucas): Almost all FreeType functions return an error. Check each of these.
 
 Font font_load_from_file(const char* filename)
 {
+    PROFILE_BEGIN("font_load_from_file");
     Font font = {0};
     FT_Library ft;
 
@@ -20,43 +25,268 @@ Font font_load_from_file(const char* filename)
     if (FT_New_Face(ft, filename, 0, &font.face))
         log_error("FreeType2 error: Failed to open font %s", filename);
 
+    // NOTE(lucas): Like the FreeType library and face, the metrics tables live for the rest of the program
+    size size_bytes = FONT_METRICS_MAX_GLYPHS*sizeof(GlyphMetrics) + FONT_METRICS_MAX_KERNING*sizeof(KerningPair);
+    MemoryArena arena = memory_arena_alloc(sizeof(FontMetrics) + FONT_METRICS_MAX_SIZES*size_bytes);
+    font.metrics = push_struct(&arena, FontMetrics);
+    zero_struct(*font.metrics);
+    for (u32 i = 0; i < FONT_METRICS_MAX_SIZES; ++i)
+    {
+        FontSizeMetrics* size_metrics = font.metrics->sizes + i;
+        size_metrics->glyphs = push_array(&arena, FONT_METRICS_MAX_GLYPHS, GlyphMetrics);
+        size_metrics->kerning = push_array(&arena, FONT_METRICS_MAX_KERNING, KerningPair);
+    }
+    font.metrics->has_kerning = font.face && FT_HAS_KERNING(font.face);
+
+    PROFILE_END();
     return font;
 }
 
-// NOTE(lucas): Determine width of string in pixels
+b32 font_enable_sdf(Font* font, u32 reference_px)
+{
+#if FONT_SDF_SUPPORTED
+    // NOTE(lucas): Both the outline (sdf) and bitmap (bsdf) renderers need the wider spread
+    FT_Int spread = FONT_SDF_SPREAD;
+    FT_Library library = font->face->glyph->library;
+    FT_Property_Set(library, "sdf", "spread", &spread);
+    FT_Property_Set(library, "bsdf", "spread", &spread);
+
+    font->sdf = true;
+    font->sdf_px = reference_px;
+    return true;
+#else
+    log_warn("FreeType %d.%d does not support SDF rendering. Falling back to bitmap glyphs.", FREETYPE_MAJOR, FREETYPE_MINOR);
+    return false;
+#endif
+}
+
+internal void font_metrics_size_init(Font* font, FontSizeMetrics* size_metrics, u32 px, u32 px_width)
+{
+    FT_Face face = font->face;
+
+    zero_array(size_metrics->glyphs, FONT_METRICS_MAX_GLYPHS, GlyphMetrics);
+    zero_array(size_metrics->kerning, FONT_METRICS_MAX_KERNING, KerningPair);
+    size_metrics->glyph_count = 0;
+    size_metrics->kerning_count = 0;
+
+    size_metrics->px = px;
+    FT_Set_Pixel_Sizes(face, px_width, px);
+    size_metrics->px_width = px_width ? px_width : FT_MulFix(face->units_per_EM, face->size->metrics.x_scale) / 64;
+    size_metrics->default_width = !px_width;
+    size_metrics->line_height = (f32)face->size->metrics.height/64;
+}
+
+internal b32 font_size_metrics_match(FontSizeMetrics* size_metrics, u32 px, u32 px_width)
+{
+    b32 result = (size_metrics->px == px &&
+                  (px_width ? size_metrics->px_width == px_width : size_metrics->default_width));
+    return result;
+}
+
+FontSizeMetrics* font_metrics_get_size(Font* font, u32 px, u32 px_width)
+{
+    FontMetrics* metrics = font->metrics;
+    ASSERT(metrics, "Font has no metrics. Fonts must be loaded with font_load_from_file.");
+
+    FontSizeMetrics* result = metrics->sizes + metrics->last_size;
+    if (!metrics->size_count || !font_size_metrics_match(result, px, px_width))
+    {
+        result = 0;
+        for (u32 i = 0; i < metrics->size_count; ++i)
+        {
+            if (font_size_metrics_match(metrics->sizes + i, px, px_width))
+            {
+                result = metrics->sizes + i;
+                metrics->last_size = i;
+                break;
+            }
+        }
+    }
+
+    if (!result)
+    {
+        u32 index = 0;
+        if (metrics->size_count < FONT_METRICS_MAX_SIZES)
+        {
+            index = metrics->size_count++;
+        }
+        else
+        {
+            // Reuse the least recently used size
+            for (u32 i = 1; i < FONT_METRICS_MAX_SIZES; ++i)
+            {
+                if (metrics->sizes[i].last_used < metrics->sizes[index].last_used)
+                    index = i;
+            }
+        }
+
+        result = metrics->sizes + index;
+        metrics->last_size = index;
+        font_metrics_size_init(font, result, px, px_width);
+    }
+
+    result->last_used = ++metrics->tick;
+    return result;
+}
+
+// NOTE(lucas): Tables are kept at most 3/4 full so probes stay short. A full table is cleared and refilled lazily.
+GlyphMetrics* font_metrics_get_glyph(Font* font, FontSizeMetrics* size_metrics, u32 codepoint)
+{
+    u32 mask = FONT_METRICS_MAX_GLYPHS - 1;
+    u32 slot = (codepoint*2654435761u) & mask;
+    while (size_metrics->glyphs[slot].used)
+    {
+        GlyphMetrics* glyph = size_metrics->glyphs + slot;
+        if (glyph->codepoint == codepoint)
+            return glyph;
+        slot = (slot + 1) & mask;
+    }
+
+    if (size_metrics->glyph_count >= 3*FONT_METRICS_MAX_GLYPHS/4)
+    {
+        zero_array(size_metrics->glyphs, FONT_METRICS_MAX_GLYPHS, GlyphMetrics);
+        size_metrics->glyph_count = 0;
+        slot = (codepoint*2654435761u) & mask;
+    }
+
+    FT_Face face = font->face;
+    FT_Set_Pixel_Sizes(face, size_metrics->px_width, size_metrics->px);
+
+    GlyphMetrics* glyph = size_metrics->glyphs + slot;
+    *glyph = (GlyphMetrics){0};
+    glyph->codepoint = codepoint;
+    glyph->glyph_index = FT_Get_Char_Index(face, codepoint);
+    glyph->used = true;
+    ++size_metrics->glyph_count;
+
+    if (FT_Load_Glyph(face, glyph->glyph_index, FT_LOAD_NO_BITMAP))
+    {
+        u8 c[5] = {0};
+        utf8_from_codepoint(c, codepoint);
+        log_error("FreeType2 error: Failed to load character %s (codepoint %u)", c, codepoint);
+        if (utf8_get_num_bytes(*c) == 4)
+            log_debug("4-byte UTF-8 characters may fail to display in the terminal.");
+        return glyph;
+    }
+
+    FT_Glyph_Metrics* ft_metrics = &face->glyph->metrics;
+    glyph->advance   = (f32)(face->glyph->advance.x/64);
+    glyph->bearing_x = (f32)ft_metrics->horiBearingX/64;
+    glyph->bearing_y = (f32)ft_metrics->horiBearingY/64;
+    glyph->width     = (f32)ft_metrics->width/64;
+    glyph->height    = (f32)ft_metrics->height/64;
+
+    return glyph;
+}
+
+f32 font_metrics_get_kerning(Font* font, FontSizeMetrics* size_metrics, u32 left_glyph, u32 right_glyph)
+{
+    if (!font->metrics->has_kerning || !left_glyph || !right_glyph)
+        return 0.0f;
+
+    u32 mask = FONT_METRICS_MAX_KERNING - 1;
+    u32 hash = (left_glyph*2654435761u) ^ (right_glyph*2246822519u);
+    u32 slot = hash & mask;
+    while (size_metrics->kerning[slot].used)
+    {
+        KerningPair* pair = size_metrics->kerning + slot;
+        if (pair->left == left_glyph && pair->right == right_glyph)
+            return pair->kerning;
+        slot = (slot + 1) & mask;
+    }
+
+    if (size_metrics->kerning_count >= 3*FONT_METRICS_MAX_KERNING/4)
+    {
+        zero_array(size_metrics->kerning, FONT_METRICS_MAX_KERNING, KerningPair);
+        size_metrics->kerning_count = 0;
+        slot = hash & mask;
+    }
+
+    FT_Face face = font->face;
+    FT_Set_Pixel_Sizes(face, size_metrics->px_width, size_metrics->px);
+    FT_Vector delta = {0};
+    FT_Get_Kerning(face, left_glyph, right_glyph, FT_KERNING_DEFAULT, &delta);
+
+    KerningPair* pair = size_metrics->kerning + slot;
+    pair->left = left_glyph;
+    pair->right = right_glyph;
+    pair->kerning = (f32)delta.x/64;
+    pair->used = true;
+    ++size_metrics->kerning_count;
+
+    return pair->kerning;
+}
+
+void font_metrics_prewarm(Font* font, u32 px, s8 charset)
+{
+    FontSizeMetrics* size_metrics = font_metrics_get_size(font, px, 0);
+    for (size i = 0; i < charset.len; ++i)
+    {
+        u8* c = charset.data + i;
+        font_metrics_get_glyph(font, size_metrics, utf8_get_codepoint(c));
+        i += utf8_get_num_bytes(*c)-1;
+    }
+}
+
+// NOTE(lucas): SDF fonts are measured at their reference size and scaled, so any pixel size is free. Their glyphs are
+// always drawn at the reference width, so px_width only applies to bitmap fonts. A px_width of 0 is the default width.
+internal FontSizeMetrics* text_size_metrics(Font* font, u32 px, u32 px_width, f32* scale)
+{
+    FontSizeMetrics* result = 0;
+    if (font->sdf)
+    {
+        result = font_metrics_get_size(font, font->sdf_px, 0);
+        *scale = (f32)px / (f32)font->sdf_px;
+    }
+    else
+    {
+        result = font_metrics_get_size(font, px, px_width);
+        *scale = 1.0f;
+    }
+    return result;
+}
+
+// NOTE(lucas): Determine width of string in pixels, including kerning
 f32 text_get_width(Text* text)
 {
     f32 result = 0.0f;
 
-    FT_Set_Pixel_Sizes(text->font->face, text->px_width, text->px);
-    FT_GlyphSlot glyph = text->font->face->glyph;
+    Font* font = text->font;
+    f32 scale = 1.0f;
+    FontSizeMetrics* size_metrics = text_size_metrics(font, text->px, text->px_width, &scale);
+    u32 previous_glyph_index = 0;
 
     for (size i = 0; i < text->string.len; ++i)
     {
-        u32 charcode = utf8_get_codepoint(text->string.data + i);
-        if (FT_Load_Char(text->font->face, charcode, FT_LOAD_NO_BITMAP))
-        {
-            u8 c[5] = {0};
-            utf8_from_codepoint(c, charcode);
-            log_error("FreeType2 error: Failed to load character %s (codepoint %u)", c, charcode);
-            if (utf8_get_num_bytes(*c) == 4)
-                log_debug("4-byte UTF-8 characters may fail to display in the terminal.");
-        }
+        u8* c = text->string.data + i;
+        u32 charcode = utf8_get_codepoint(c);
+        i += utf8_get_num_bytes(*c)-1;
+
+        GlyphMetrics* glyph = font_metrics_get_glyph(font, size_metrics, charcode);
+        u32 glyph_index = glyph->glyph_index;
+        f32 advance = glyph->advance;
 
-        result += text->font->face->glyph->advance.x/64;
+        result += font_metrics_get_kerning(font, size_metrics, previous_glyph_index, glyph_index) + advance;
+        previous_glyph_index = glyph_index;
     }
 
+    result *= scale;
     return result;
 }
 
-void text_set_size_px(Text* text, u32 px)
+internal void text_set_size_px_without_width(Text* text, u32 px)
 {
     text->px = px;
-    FT_Set_Pixel_Sizes(text->font->face, 0, text->px);
-    text->px_width = FT_MulFix(text->font->face->units_per_EM, text->font->face->size->metrics.x_scale) / 64;
+    f32 scale = 1.0f;
+    FontSizeMetrics* size_metrics = text_size_metrics(text->font, px, 0, &scale);
+    text->px_width = (u32)((f32)size_metrics->px_width*scale + 0.5f);
+    text->line_height = size_metrics->line_height*scale;
+}
 
+void text_set_size_px(Text* text, u32 px)
+{
+    text_set_size_px_without_width(text, px);
     text->string_width = text_get_width(text);
-    text->line_height = (f32)text->font->face->size->metrics.height/64;
 }
 
 void text_scale(Text* text, f32 factor)
@@ -79,25 +309,197 @@ Text text_init(s8 string, Font* font, v2 position, u32 px)
     return text;
 }
 
+Text text_init_with_width(s8 string, Font* font, v2 position, u32 px, f32 string_width)
+{
+    Text text = {0};
+
+    text.string = string;
+    text.font = font;
+    text.position = position;
+    text.color = color_black();
+
+    text_set_size_px_without_width(&text, px);
+    text.string_width = string_width;
+
+    return text;
+}
+
+internal u32 glyph_key_hash(GlyphKey key)
+{
+    // NOTE(lucas): FNV-1a over the key fields
+    u64 face = (u64)(usize)key.face;
+    u32 fields[] = {(u32)face, (u32)(face >> 32), key.px, key.px_width, key.glyph_index, (u32)key.sdf};
+    u32 hash = 2166136261u;
+    for (u32 i = 0; i < countof(fields); ++i)
+    {
+        hash ^= fields[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+internal b32 glyph_key_eq(GlyphKey a, GlyphKey b)
+{
+    b32 result = (a.face == b.face && a.px == b.px && a.px_width == b.px_width && a.glyph_index == b.glyph_index &&
+                  a.sdf == b.sdf);
+    return result;
+}
+
+void glyph_cache_init(GlyphCache* cache, MemoryArena* arena)
+{
+    cache->glyphs = push_array(arena, GLYPH_CACHE_MAX_ENTRIES, Glyph);
+    zero_array(cache->glyphs, GLYPH_CACHE_MAX_ENTRIES, Glyph);
+    cache->glyph_count = 0;
+    atlas_init(&cache->atlas, GLYPH_ATLAS_PAGE_SIZE, GLYPH_ATLAS_MAX_PAGES, 1, arena);
+}
+
+void glyph_cache_delete(Renderer* renderer, GlyphCache* cache)
+{
+    atlas_delete(renderer, &cache->atlas);
+}
+
+// NOTE(lucas): The table is kept at most 3/4 full so probes stay short
+internal b32 glyph_cache_full(GlyphCache* cache)
+{
+    b32 result = (cache->glyph_count >= 3*GLYPH_CACHE_MAX_ENTRIES/4);
+    return result;
+}
+
+// Forget every glyph. Their atlas space is reclaimed by evicting every page.
+internal void glyph_cache_clear(Renderer* renderer, GlyphCache* cache)
+{
+    zero_array(cache->glyphs, GLYPH_CACHE_MAX_ENTRIES, Glyph);
+    cache->glyph_count = 0;
+    for (u32 i = 0; i < cache->atlas.page_count; ++i)
+        atlas_evict_page(renderer, &cache->atlas, i);
+}
+
+internal void glyph_rasterize(Renderer* renderer, GlyphCache* cache, Glyph* glyph)
+{
+    FT_Face face = glyph->key.face;
+    glyph->region = (AtlasRegion){0};
+
+    FT_Set_Pixel_Sizes(face, glyph->key.px_width, glyph->key.px);
+
+    FT_Int32 load_flags = glyph->key.sdf ? FT_LOAD_DEFAULT : FT_LOAD_RENDER;
+    if (FT_Load_Glyph(face, glyph->key.glyph_index, load_flags))
+    {
+        log_error("FreeType2 error: Failed to load glyph index %u", glyph->key.glyph_index);
+        return;
+    }
+
+#if FONT_SDF_SUPPORTED
+    if (glyph->key.sdf && FT_Render_Glyph(face->glyph, FT_RENDER_MODE_SDF))
+    {
+        log_error("FreeType2 error: Failed to render SDF for glyph index %u", glyph->key.glyph_index);
+        return;
+    }
+#endif
+
+    FT_GlyphSlot slot = face->glyph;
+    glyph->left = (f32)slot->bitmap_left;
+    glyph->top = (f32)slot->bitmap_top;
+
+    if (slot->bitmap.width && slot->bitmap.rows)
+    {
+        glyph->region = atlas_insert(renderer, &cache->atlas, slot->bitmap.width, slot->bitmap.rows, 1,
+                                     slot->bitmap.buffer);
+    }
+}
+
+internal Glyph* glyph_cache_get(Renderer* renderer, GlyphKey key)
+{
+    GlyphCache* cache = &renderer->glyph_cache;
+
+    u32 mask = GLYPH_CACHE_MAX_ENTRIES - 1;
+    u32 slot = glyph_key_hash(key) & mask;
+    while (cache->glyphs[slot].key.face)
+    {
+        Glyph* glyph = cache->glyphs + slot;
+        if (glyph_key_eq(glyph->key, key))
+        {
+            // NOTE(lucas): Glyphs without a bitmap have no atlas region that could have been evicted
+            if (!glyph->region.texture)
+            {
+                ++renderer->stats.glyph_cache_hits;
+            }
+            else if (atlas_region_valid(&cache->atlas, &glyph->region))
+            {
+                atlas_touch(&cache->atlas, &glyph->region);
+                ++renderer->stats.glyph_cache_hits;
+            }
+            else
+            {
+                // The glyph's page was evicted, so rasterize it again
+                glyph_rasterize(renderer, cache, glyph);
+                ++renderer->stats.glyph_cache_misses;
+            }
+            return glyph;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    ASSERT(cache->glyph_count < GLYPH_CACHE_MAX_ENTRIES - 1, "Glyph cache overflow");
+    Glyph* glyph = cache->glyphs + slot;
+    glyph->key = key;
+    glyph_rasterize(renderer, cache, glyph);
+    ++cache->glyph_count;
+    ++renderer->stats.glyph_cache_misses;
+
+    return glyph;
+}
+
+typedef struct TextBatch
+{
+    f32* vertices;
+    u32 glyph_count;
+    u32 max_glyphs;
+    u32 texture;
+} TextBatch;
+
+internal void text_batch_flush(Renderer* renderer, TextBatch* batch)
+{
+    if (!batch->glyph_count)
+        return;
+
+    size vertex_bytes = 4*sizeof(f32);
+    size bytes = 4*batch->glyph_count*vertex_bytes;
+    size offset = stream_buffer_push(&renderer->vertex_stream, batch->vertices, bytes, vertex_bytes);
+
+    // NOTE(lucas): Glyphs rasterized since the last flush are still queued
+    renderer_texture_flush(renderer);
+    texture_bind_id(batch->texture, 0);
+    glDrawElementsBaseVertex(GL_TRIANGLES, 6*batch->glyph_count, GL_UNSIGNED_INT, 0, (GLint)(offset / vertex_bytes));
+    ++renderer->stats.text_draw_calls;
+
+    batch->glyph_count = 0;
+}
+
 void output_text(Renderer* renderer, RenderCommandText* cmd)
 {
     Text text = cmd->text;
-    
-    // Set font size in pixels
-    FT_Set_Pixel_Sizes(text.font->face, text.px_width, text.px);
+    GlyphCache* cache = &renderer->glyph_cache;
+
+    // NOTE(lucas): FreeType is only used on metrics and glyph cache misses, which set the face's size themselves
     FT_Face face = text.font->face;
-    FT_GlyphSlot glyph = face->glyph;
-    FT_Bool use_kerning = FT_HAS_KERNING(text.font->face);
-    FT_UInt glyph_index = 0;
-    FT_UInt previous_glyph_index = 0;
+    f32 scale = 1.0f;
+    FontSizeMetrics* size_metrics = text_size_metrics(text.font, text.px, text.px_width, &scale);
+    u32 previous_glyph_index = 0;
 
-    shader_set_v4(renderer->font_renderer.shader, "text_color", text.color);
-    glBindVertexArray(renderer->font_renderer.vao);
+    // NOTE(lucas): SDF glyphs are cached at the reference size, bitmap glyphs at the size they are drawn at
+    b32 sdf = text.font->sdf;
+    u32 glyph_px = sdf ? size_metrics->px : text.px;
+    u32 glyph_px_width = sdf ? size_metrics->px_width : text.px_width;
 
-    // NOTE(lucas): By default, OpenGL requires that textures are aligned on 4-byte boundaries,
-    // but we need 1-byte alignment for grayscale glyph bitmaps
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    Texture texture = texture_generate(0);
+    u32 shader = sdf ? renderer->font_sdf_shader : renderer->font_renderer.shader;
+    shader_set_v4(shader, "text_color", text.color);
+    gl_bind_vertex_array(renderer->font_renderer.vao);
+
+    // NOTE(lucas): Glyph quads for the whole string are gathered and drawn together. The batch is only flushed early
+    // when the next glyph lives on a different atlas page or the batch is full.
+    TextBatch batch = {0};
+    batch.max_glyphs = (text.string.len < TEXT_BATCH_MAX_GLYPHS) ? (u32)text.string.len : TEXT_BATCH_MAX_GLYPHS;
+    batch.vertices = push_array(&renderer->scratch_arena, 16*batch.max_glyphs, f32);
 
     f32 x = text.position.x;
     f32 y = text.position.y;
@@ -110,57 +512,53 @@ void output_text(Renderer* renderer, RenderCommandText* cmd)
         u32 charcode = utf8_get_codepoint(c);
         int num_bytes = utf8_get_num_bytes(*c);
         i += num_bytes-1;
-        glyph_index = FT_Get_Char_Index(face, charcode);
 
-        // When appropriate, retrieve kerning information and advance cursor
-        if (use_kerning && previous_glyph_index && glyph_index)
-        {
-            FT_Vector delta;
-            FT_Get_Kerning(face, previous_glyph_index, glyph_index, FT_KERNING_DEFAULT, &delta);
-            x += (f32)delta.x/64;
-        }
+        GlyphMetrics* metrics = font_metrics_get_glyph(text.font, size_metrics, charcode);
+        u32 glyph_index = metrics->glyph_index;
+        f32 advance = metrics->advance*scale;
 
+        x += font_metrics_get_kerning(text.font, size_metrics, previous_glyph_index, glyph_index)*scale;
         previous_glyph_index = glyph_index;
 
-        if (FT_Load_Glyph(face, glyph_index, FT_LOAD_RENDER))
+        // NOTE(lucas): Clearing the cache evicts every atlas page, so pending glyphs must be drawn first
+        if (glyph_cache_full(cache))
         {
-            u8 err[5] = {0};
-            utf8_from_codepoint(err, charcode);
-            log_error("FreeType2 error: Failed to load character %c (codepoint: %u, glyph index: %u)", err, charcode, glyph_index);
-            if (utf8_get_num_bytes(*err) == 4)
-                log_debug("4-byte UTF-8 characters may fail to display in the terminal.");
+            text_batch_flush(renderer, &batch);
+            glyph_cache_clear(renderer, cache);
         }
 
-        // TODO(lucas): Only do texture generation once when the font is loaded.
-        glTexImage2D(GL_TEXTURE_2D,
-                     0,
-                     GL_RED,
-                     glyph->bitmap.width,
-                     glyph->bitmap.rows,
-                     0,
-                     GL_RED,
-                     GL_UNSIGNED_BYTE,
-                     glyph->bitmap.buffer);
-
-        f32 x2 = x + (f32)glyph->bitmap_left;
-        f32 y2 = y - (f32)glyph->bitmap_top;
-        f32 w = (f32)glyph->bitmap.width;
-        f32 h = (f32)glyph->bitmap.rows;
-
-        f32 vertices[] =
+        GlyphKey key = {face, glyph_px, glyph_px_width, glyph_index, sdf};
+        Glyph* glyph = glyph_cache_get(renderer, key);
+
+        AtlasRegion* region = &glyph->region;
+        if (region->texture)
         {
-            x2 + w, y2, 1.0f, 0.0f,
-            x2 + w, y2 + h, 1.0f, 1.0f,
-            x2,     y2 + h, 0.0f, 1.0f,
-            x2,     y2, 0.0f, 0.0f,
-        };
+            if (batch.glyph_count && (batch.texture != region->texture->id || batch.glyph_count >= batch.max_glyphs))
+                text_batch_flush(renderer, &batch);
+            batch.texture = region->texture->id;
 
-        // TODO(lucas): Update with glBufferSubData?
-        // Update VBO memory
-        glBindBuffer(GL_ARRAY_BUFFER, renderer->font_renderer.vbo);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_DYNAMIC_DRAW);
+            f32 x2 = x + glyph->left*scale;
+            f32 y2 = y - glyph->top*scale;
+            f32 w = (f32)region->width*scale;
+            f32 h = (f32)region->height*scale;
 
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+            f32 u0 = region->uv.x;
+            f32 v0 = region->uv.y;
+            f32 u1 = region->uv.x + region->uv.width;
+            f32 v1 = region->uv.y + region->uv.height;
+
+            f32 vertices[] =
+            {
+                x2 + w, y2,     u1, v0,
+                x2 + w, y2 + h, u1, v1,
+                x2,     y2 + h, u0, v1,
+                x2,     y2,     u0, v0,
+            };
+
+            f32* dest = batch.vertices + 16*batch.glyph_count++;
+            for (u32 v = 0; v < countof(vertices); ++v)
+                dest[v] = vertices[v];
+        }
 
         // Advance cursor for next glyph
         if ((*c == '\r') && (*(c+1) == '\n'))
@@ -176,260 +574,335 @@ void output_text(Renderer* renderer, RenderCommandText* cmd)
             x = text.position.x;
         }
         else
-            x += glyph->advance.x/64;
+            x += advance;
     }
 
-    glBindVertexArray(0);
-    texture_unbind(0);
-    texture_delete(&texture);
+    text_batch_flush(renderer, &batch);
+    memory_arena_pop(&renderer->scratch_arena, 16*batch.max_glyphs*sizeof(f32));
 }
 
-typedef struct TextNode TextNode;
-struct TextNode
+TextArea text_area_init(Renderer* renderer, rect bounds, s8 str, Font* font, u32 text_size_px)
 {
-    Text text;
-    TextNode* next;
-};
+    TextArea result = {0};
+    result.bounds = bounds;
+    v2 text_pos = {bounds.x, result.bounds.y + result.bounds.height - (f32)text_size_px};
+    result.text = text_init(str, font, text_pos, text_size_px);
+    return result;
+}
 
-typedef struct OverflowText
+void text_area_scale(TextArea* text_area, f32 factor)
 {
-    Text word;
-    Text space;
-} OverflowText;
+    text_area->bounds.size = v2_scale(text_area->bounds.size, factor);
+    text_scale(&text_area->text, factor);
+}
 
-typedef struct ParsedText
+internal f32 get_text_height(TextArea* text_area)
 {
-    f32 width;
-    f32 height;
-    TextNode* first_node;
-} ParsedText;
+    i32 lines_req = ceil_f32(text_area->text.string_width / text_area->bounds.width);
+    f32 text_height = (f32)(lines_req) * text_area->text.line_height;
+    return text_height;
+}
 
-#pragma optimize("", off)
-internal void parsed_text_push(ParsedText* parsed_text, Text* text, MemoryArena* arena)
+internal b32 text_in_bounds(TextArea* text_area)
 {
-    TextNode* new_node = push_struct(arena, TextNode);
-    new_node->text = *text;
-    new_node->next = 0;
-
-    TextNode* it = parsed_text->first_node;
-    if (!it)
-        parsed_text->first_node = new_node;
-    else
-    {
-        while (it->next)
-            it = it->next;
-        
-        it->next = new_node;
-    }
+    b32 result = text_area->text.position.y < text_area->bounds.position.y + text_area->bounds.height;
+    return result;
 }
-#pragma optimize("", on)
 
-internal b32 text_is_whitespace(Text text)
+internal u32 text_hash(u8* data, size len)
 {
-    b32 result = false;
-
-    for (size i = 0; i < text.string.len; ++i)
+    // NOTE(lucas): FNV-1a
+    u32 hash = 2166136261u;
+    for (size i = 0; i < len; ++i)
     {
-        if (!char_is_whitespace(text.string.data[i]))
-            break;
-
-        result = true;
+        hash ^= data[i];
+        hash *= 16777619u;
     }
-
-    return result;
+    return hash;
 }
 
-// TODO(lucas): Take another look at the tokenizer structure
-internal Text tokenizer_process_token(s8_iter* tokenizer, ParsedText* parsed_text, Text token, MemoryArena* arena)
+internal b32 text_layout_key_eq(TextLayoutKey a, TextLayoutKey b)
 {
-    Text result = token;
-
-    usize word_len = tokenizer->at - token.string.data;
-    result.string = s8_copyn(token.string, word_len, arena);
-    result.string_width = text_get_width(&result);
+    b32 result = (a.face == b.face && a.sdf == b.sdf && a.px == b.px && a.px_width == b.px_width &&
+                  a.width == b.width && a.style == b.style && a.horiz_alignment == b.horiz_alignment);
     return result;
 }
 
-#pragma optimize("", off)
-internal ParsedText parse_text(s8_iter* tokenizer, TextArea* text_area, OverflowText* overflow_text, MemoryArena* arena)
+// Grow a flat array so it can hold at least the needed number of elements.
+// NOTE(lucas): Layout arrays are heap allocated rather than pushed on an arena, since they grow with the text and are
+// reused by whichever string replaces their entry. They live until text_layout_cache_delete.
+internal void* text_layout_reserve(void* array, u32* capacity, u32 needed, size element_bytes)
 {
-    ParsedText parsed_text = {0};
-    Text token = text_area->text;
-    token.string.data = tokenizer->at;
+    if (needed <= *capacity)
+        return array;
 
-    int num_spaces = 0;
-    b32 line_overflowed = false;
+    u32 new_capacity = *capacity ? *capacity : 64;
+    while (new_capacity < needed)
+        new_capacity *= 2;
 
-    if (overflow_text->word.string.data)
-    {
-        parsed_text_push(&parsed_text, &overflow_text->word, arena);
-        parsed_text_push(&parsed_text, &overflow_text->space, arena);
-        parsed_text.width += overflow_text->word.string_width + overflow_text->space.string_width;
-        token.position.x = text_area->text.position.x + parsed_text.width;
-        ++num_spaces;
-    }
+    void* result = realloc(array, new_capacity*element_bytes);
+    ASSERT(result, "Failed to grow text layout");
+    *capacity = new_capacity;
+    return result;
+}
 
-    // NOTE(lucas): After overflow has been written, make sure to reset it again.
-    overflow_text->word = (Text){0};
-    overflow_text->space = (Text){0};
+internal void text_layout_push_run(TextLayout* layout, Text* text, u32 offset, u32 len, f32 x, b32 is_space)
+{
+    layout->runs = text_layout_reserve(layout->runs, &layout->run_capacity, layout->run_count + 1, sizeof(TextRun));
 
-    // NOTE(lucas): Break up into words. For now, keep punctuation with the word as one node.
-    b32 parsing = true;
-    while (parsing)
-    {
-        size len = tokenizer->at - token.string.data;
-        b32 final_token = (tokenizer->idx == token.string.len) || (tokenizer->at[0] == '\0');
-        if (char_is_whitespace(tokenizer->at[0]) || final_token)
-        {
-                Text word = tokenizer_process_token(tokenizer, &parsed_text, token, arena);
-                parsed_text.width += word.string_width;
-                token.string.data = tokenizer->at;
+    Text run_text = *text;
+    run_text.string = (s8){text->string.data + offset, len};
 
-                if (!final_token)
-                {
-                    while (tokenizer->at[0] && char_is_whitespace(tokenizer->at[0]))
-                        s8_iter_move(tokenizer, 1);
-                }
+    TextRun* run = layout->runs + layout->run_count++;
+    run->offset = offset;
+    run->len = len;
+    run->x = x;
+    run->width = text_get_width(&run_text);
+    run->is_space = is_space;
+}
 
-                Text space = tokenizer_process_token(tokenizer, &parsed_text, token, arena);
-                ++num_spaces;
-                parsed_text.width += space.string_width;
-                token.string.data = tokenizer->at;
+internal TextLine* text_layout_push_line(TextLayout* layout, u32 offset)
+{
+    layout->lines = text_layout_reserve(layout->lines, &layout->line_capacity, layout->line_count + 1, sizeof(TextLine));
 
-                if (parsed_text.width - space.string_width > text_area->bounds.width)
-                {
-                    line_overflowed = true;
-                    // NOTE(lucas): Parsing line will usually leave a word and space leftover.
-                    // If this is the case, they need to be added at the beginning
-                    // of the next line.
-                    parsed_text.height += text_area->text.line_height; 
-                    word.position.x = text_area->text.position.x;
-                    word.position.y += text_area->text.line_height;
-                    space.position.x = text_area->text.position.x + word.string_width;
-                    space.position.y += text_area->text.line_height;
-
-                    overflow_text->word = word;
-                    overflow_text->space = space;
-
-                    // NOTE(lucas): Number of spaces is overcounted by 2: space after final word and overflow space
-                    // Subtract back the width of the overflow word and 2 spaces to get the actual line width
-                    num_spaces -= 2;
-                    parsed_text.width -= (word.string_width + 2.0f*space.string_width);
-                    parsing = false;
-                }
-                else
-                {
-                    // Push new tokens onto parsed_text and put the string at the tokenizer position
-                    parsed_text_push(&parsed_text, &word, arena);
-                    parsed_text_push(&parsed_text, &space, arena);
-                    token.position.x = text_area->text.position.x + parsed_text.width;
-                }
+    TextLine* line = layout->lines + layout->line_count++;
+    *line = (TextLine){0};
+    line->offset = offset;
+    line->first_run = layout->run_count;
+    return line;
+}
 
-                // NOTE(lucas): End the line if the null terminator or newline is encountered.
-                // In the latter case, advance the tokenizer past the newline escapes
-                if (final_token)
-                    parsing = false;
-                else if (tokenizer->at[0] == '\n')
-                {
-                    s8_iter_move(tokenizer, 1);
-                    parsing = false;
-                }
-                else if (tokenizer->at[0] == '\r' && tokenizer->at[1] == '\n')
-                {
-                    s8_iter_move(tokenizer, 2);
-                    parsing = false;
-                }
-        }
-        else
-            s8_iter_move(tokenizer, 1);
-    }
+internal void text_layout_align_line(TextLayout* layout, TextLine* line, f32 max_width)
+{
+    f32 width_remaining = max_width - line->width;
+    TextRun* runs = layout->runs + line->first_run;
 
-    // TODO(lucas): Draw while aligning?
-    f32 width_remaining = text_area->bounds.width - parsed_text.width;
-    switch(text_area->horiz_alignment)
+    switch(layout->key.horiz_alignment)
     {
         case TEXT_ALIGN_HORIZ_JUSTIFIED:
         {
-            // Line is only justified if it does not overflow to another line
-            if (!line_overflowed)
+            // Line is only justified if it wrapped to another line
+            if (!line->wrapped)
                 break;
 
-            f32 width_per_space = width_remaining / (f32)num_spaces;
-            int count = 1;
+            // NOTE(lucas): Evenly distribute remaining width to all spaces between words, but not trailing spaces
+            u32 space_count = 0;
+            u32 last_word = 0;
+            for (u32 i = 0; i < line->run_count; ++i)
+            {
+                if (!runs[i].is_space)
+                    last_word = i;
+            }
+            for (u32 i = 0; i < last_word; ++i)
+                space_count += runs[i].is_space ? 1 : 0;
+            if (!space_count)
+                break;
 
-            // NOTE(lucas): Evenly distribute remaining width to all spaces except any trailing space.
-            // For each node, if it is a space, increase the position of the next node (if it exists)
-            for (TextNode* node = parsed_text.first_node; node; node = node->next)
+            f32 width_per_space = width_remaining / (f32)space_count;
+            f32 shift = 0.0f;
+            for (u32 i = 0; i < line->run_count; ++i)
             {
-                // TODO(lucas): Consider other whitespace
-                if ((node->text.string.data[0] == ' ') && node->next)
-                {
-                    node->next->text.position.x += width_per_space * (f32)count;
-                    ++count;
-                }
+                runs[i].x += shift;
+                if (runs[i].is_space && i < last_word)
+                    shift += width_per_space;
             }
         } break;
 
         case TEXT_ALIGN_HORIZ_RIGHT:
         {
-            // NOTE(lucas): Add all additional space to the leftmost (first) space by
-            // shifting each word over by the entire width remaining
-            for (TextNode* node = parsed_text.first_node; node; node = node->next)
-                node->text.position.x += width_remaining;
+            for (u32 i = 0; i < line->run_count; ++i)
+                runs[i].x += width_remaining;
         } break;
 
         case TEXT_ALIGN_HORIZ_CENTER:
         {
-            // NOTE(lucas): Divide all additional space between the leftmost (first) and rightmost (last) spaces by
-            // shifting each word over by half the width remaining.
-            for (TextNode* node = parsed_text.first_node; node; node = node->next)
-                node->text.position.x += 0.5f*width_remaining;
+            for (u32 i = 0; i < line->run_count; ++i)
+                runs[i].x += 0.5f*width_remaining;
         } break;
 
         // NOTE(lucas): Assume left-align and do nothing.
         default: break;
     }
-
-    return parsed_text;
 }
-#pragma optimize("", on)
 
-TextArea text_area_init(Renderer* renderer, rect bounds, s8 str, Font* font, u32 text_size_px)
+// Lay out the string from a byte offset onward. The offset must be the start of a line.
+internal void text_layout_build(TextLayout* layout, Text* text, f32 max_width, u32 offset)
 {
-    TextArea result = {0};
-    result.bounds = bounds;
-    v2 text_pos = {bounds.x, result.bounds.y + result.bounds.height - (f32)text_size_px};
-    result.text = text_init(str, font, text_pos, text_size_px);
-    return result;
-}
+    // NOTE(lucas): Layouts are built by draw_text_area, which the game calls from its DLL. Profiler state is per
+    // module and the DLL's profiler is never initialized, so this zone is only recorded when the engine itself lays
+    // out text, e.g. in the benchmark.
+    PROFILE_BEGIN("text_layout_build");
+    u8* data = text->string.data;
+    u32 len = (u32)text->string.len;
+
+    TextLine* line = text_layout_push_line(layout, offset);
+    f32 x = 0.0f;
+
+    u32 at = offset;
+    while (at < len && data[at])
+    {
+        u8 c = data[at];
+        b32 newline = (c == '\n') || (c == '\r' && at + 1 < len && data[at+1] == '\n');
+        if (newline)
+        {
+            at += (c == '\r') ? 2 : 1;
+            text_layout_align_line(layout, line, max_width);
+            line = text_layout_push_line(layout, at);
+            x = 0.0f;
+            continue;
+        }
 
-void text_area_scale(TextArea* text_area, f32 factor)
-{
-    text_area->bounds.size = v2_scale(text_area->bounds.size, factor);
-    text_scale(&text_area->text, factor);
+        b32 is_space = char_is_whitespace(c);
+        u32 start = at;
+        if (is_space)
+        {
+            while (at < len && char_is_whitespace(data[at]))
+                ++at;
+        }
+        else
+        {
+            while (at < len && data[at] && !char_is_whitespace(data[at]) && data[at] != '\n' && data[at] != '\r')
+                ++at;
+            // NOTE(lucas): A lone carriage return is kept with the word so the layout always makes progress
+            if (at == start)
+                ++at;
+        }
+
+        text_layout_push_run(layout, text, start, at - start, x, is_space);
+        TextRun* run = layout->runs + layout->run_count - 1;
+
+        // NOTE(lucas): A word that doesn't fit moves to the next line unless it is the first word on its line.
+        // Whitespace before it stays behind as trailing whitespace, which doesn't count toward the line's width.
+        if (!is_space && line->width > 0.0f && x + run->width > max_width)
+        {
+            --layout->run_count;
+            line->run_count = layout->run_count - line->first_run;
+            line->wrapped = true;
+            text_layout_align_line(layout, line, max_width);
+
+            line = text_layout_push_line(layout, start);
+            run->x = 0.0f;
+            ++layout->run_count;
+            x = 0.0f;
+        }
+
+        x += run->width;
+        line->run_count = layout->run_count - line->first_run;
+        if (!is_space)
+            line->width = x;
+    }
+
+    text_layout_align_line(layout, line, max_width);
+    PROFILE_END();
 }
 
-internal f32 get_text_height(TextArea* text_area)
+TextLayout* text_layout_get(Renderer* renderer, TextArea* text_area)
 {
-    i32 lines_req = ceil_f32(text_area->text.string_width / text_area->bounds.width);
-    f32 text_height = (f32)(lines_req) * text_area->text.line_height;
-    return text_height;
+    TextLayoutCache* cache = &renderer->text_layout_cache;
+    Text* text = &text_area->text;
+
+    TextLayoutKey key = {0};
+    key.face = text->font->face;
+    key.sdf = text->font->sdf;
+    key.px = text->px;
+    key.px_width = text->px_width;
+    key.width = text_area->bounds.width;
+    key.style = text_area->style;
+    key.horiz_alignment = text_area->horiz_alignment;
+
+    size len = text->string.len;
+    u32 hash = text_hash(text->string.data, len);
+
+    TextLayout* result = 0;
+    TextLayout* prefix = 0;
+    for (u32 i = 0; i < cache->layout_count; ++i)
+    {
+        TextLayout* layout = cache->layouts + i;
+        if (!text_layout_key_eq(layout->key, key))
+            continue;
+
+        // NOTE(lucas): The hash only rules strings out. Strings are often edited in place, so a match is only trusted
+        // once the bytes compare equal.
+        if (layout->len == len && layout->hash == hash && memcmp(layout->string, text->string.data, len) == 0)
+        {
+            result = layout;
+            break;
+        }
+
+        // NOTE(lucas): Prefer the longest cached prefix of the string
+        if (layout->len < len && (!prefix || layout->len > prefix->len) &&
+            text_hash(text->string.data, layout->len) == layout->hash &&
+            memcmp(layout->string, text->string.data, layout->len) == 0)
+        {
+            prefix = layout;
+        }
+    }
+
+    b32 hit = (result != 0);
+    if (hit)
+    {
+        ++renderer->stats.text_layout_hits;
+    }
+    else if (prefix && prefix->line_count)
+    {
+        // Lay out the last line of the cached prefix again, since appended text may continue it
+        ++renderer->stats.text_layout_appends;
+        result = prefix;
+        TextLine* last_line = result->lines + result->line_count - 1;
+        u32 offset = last_line->offset;
+        result->run_count = last_line->first_run;
+        --result->line_count;
+        text_layout_build(result, text, key.width, offset);
+    }
+    else
+    {
+        ++renderer->stats.text_layout_misses;
+        if (cache->layout_count < TEXT_LAYOUT_CACHE_MAX_ENTRIES)
+        {
+            result = cache->layouts + cache->layout_count++;
+        }
+        else
+        {
+            // Reuse the least recently used layout's arrays
+            result = cache->layouts;
+            for (u32 i = 1; i < TEXT_LAYOUT_CACHE_MAX_ENTRIES; ++i)
+            {
+                if (cache->layouts[i].last_used < result->last_used)
+                    result = cache->layouts + i;
+            }
+        }
+
+        result->key = key;
+        result->run_count = 0;
+        result->line_count = 0;
+        text_layout_build(result, text, key.width, 0);
+    }
+
+    if (!hit)
+    {
+        result->string = text_layout_reserve(result->string, &result->string_capacity, (u32)len, 1);
+        memcpy(result->string, text->string.data, len);
+    }
+    result->hash = hash;
+    result->len = len;
+    result->last_used = ++cache->tick;
+    return result;
 }
 
-internal b32 text_in_bounds(TextArea* text_area)
+void text_layout_cache_delete(TextLayoutCache* cache)
 {
-    b32 result = text_area->text.position.y < text_area->bounds.position.y + text_area->bounds.height;
-    return result;
+    for (u32 i = 0; i < cache->layout_count; ++i)
+    {
+        free(cache->layouts[i].runs);
+        free(cache->layouts[i].lines);
+        free(cache->layouts[i].string);
+    }
+    *cache = (TextLayoutCache){0};
 }
 
-#pragma optimize("", off)
 void draw_text_area(Renderer* renderer, TextArea* text_area)
 {
-    // NOTE(lucas): Parse and process the text in the text area,
-    // then reconstruct one Text object and render it.
-    s8_iter tokenizer = {0};
-    s8_iter test_tokenizer = {0};
-    tokenizer.at = test_tokenizer.at = text_area->text.string.data;
+    // NOTE(lucas): Pick the final text size, then draw the lines of the text area's cached layout
     text_area->text.position = text_area->bounds.position;
 
     // TODO(lucas): Text is not completely flush with the top of a text area unless only a fraction of the px
@@ -452,7 +925,7 @@ void draw_text_area(Renderer* renderer, TextArea* text_area)
         if (text_area->style & TEXT_AREA_WRAP)
         {
             text_height = get_text_height(text_area);
-            while (text_height > text_area->bounds.height)
+            while (text_height > text_area->bounds.height && text_area->text.px > 1)
             {
                 text_set_size_px(&text_area->text, text_area->text.px-1);
                 text_height = get_text_height(text_area);
@@ -460,10 +933,11 @@ void draw_text_area(Renderer* renderer, TextArea* text_area)
         }
         else
         {
-            // NOTE(lucas): Don't wrap but shrink text to fit.
+            // NOTE(lucas): Don't wrap but shrink text to fit. Every width is measured with its own metrics, so the width
+            // shrinks with px_width, but bounds narrower than a 1 px wide string can never be met.
             text_height = (f32)text_area->text.px;
             f32 text_width = text_get_width(&text_area->text);
-            while (text_width > text_area->bounds.width)
+            while (text_width > text_area->bounds.width && text_area->text.px_width > 1)
             {
                 --text_area->text.px_width;
                 text_width = text_get_width(&text_area->text);
@@ -503,14 +977,41 @@ void draw_text_area(Renderer* renderer, TextArea* text_area)
         default: break; 
     }
 
-    OverflowText overflow = {0};
-    while (tokenizer.at[0])
+    // NOTE(lucas): Only visible lines are drawn, so long scrolling text costs no more than the lines on screen
+    TextLayout* layout = text_layout_get(renderer, text_area);
+    for (u32 i = 0; i < layout->line_count; ++i)
     {
-        ParsedText parsed_text = parse_text(&tokenizer, text_area, &overflow, &renderer->scratch_arena);
-        for (TextNode* node = parsed_text.first_node; node; node = node->next)
+        TextLine* line = layout->lines + i;
+        TextRun* runs = layout->runs + line->first_run;
+        f32 y = text_area->text.position.y;
+
+        if (line->run_count)
         {
-            node->text.px = text_area->text.px;
-            draw_text(renderer, node->text);
+            if (layout->key.horiz_alignment == TEXT_ALIGN_HORIZ_JUSTIFIED && line->wrapped)
+            {
+                // Justified words are spaced individually
+                for (u32 j = 0; j < line->run_count; ++j)
+                {
+                    if (runs[j].is_space)
+                        continue;
+
+                    Text word = text_area->text;
+                    word.string = (s8){word.string.data + runs[j].offset, runs[j].len};
+                    word.position = v2(text_area->bounds.x + runs[j].x, y);
+                    word.string_width = runs[j].width;
+                    draw_text(renderer, word);
+                }
+            }
+            else
+            {
+                // Otherwise the runs of a line sit next to each other, so the line is drawn as one string
+                TextRun* last = runs + line->run_count - 1;
+                Text line_text = text_area->text;
+                line_text.string = (s8){line_text.string.data + runs[0].offset, last->offset + last->len - runs[0].offset};
+                line_text.position = v2(text_area->bounds.x + runs[0].x, y);
+                line_text.string_width = line->width;
+                draw_text(renderer, line_text);
+            }
         }
 
         text_area->text.position.y += text_area->text.line_height;
@@ -520,11 +1021,4 @@ void draw_text_area(Renderer* renderer, TextArea* text_area)
         if (!text_in_bounds(text_area))
             break;
     }
-
-    // NOTE(lucas): Draw the overflow text if there is any.
-    // Overflow text should only be drawn if the text area is shrink to fit or if there is room for the extra line.
-    if (overflow.word.string.data && ((text_area->style & TEXT_AREA_SHRINK_TO_FIT) || text_in_bounds(text_area)))
-        draw_text(renderer, overflow.word);
 }
-#pragma optimize("", on)
- 
\ No newline at end of file
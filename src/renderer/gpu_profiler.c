@@ -0,0 +1,137 @@
+#include "alchemy/renderer/gpu_profiler.h"
+#include "alchemy/util/log.h"
+
+#include <glad/glad.h>
+
+internal void gpu_profiler_read(GPUProfiler* profiler, GPUProfilerFrame* frame)
+{
+    // NOTE(lucas): Timestamps become available in the order they were written, so the last one stands for the frame.
+    // Scopes end in the reverse order they begin, so that is not the end of the scope with the highest index.
+    if (!frame->last_query)
+        return;
+
+    GLint available = 0;
+    glGetQueryObjectiv(frame->last_query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+    {
+        ++profiler->dropped_frames;
+        return;
+    }
+
+    GPUFrameTimes times = {0};
+    times.frame = frame->frame;
+    for (u32 i = 0; i < frame->scope_count; ++i)
+    {
+        GPUScope* scope = frame->scopes + i;
+        if (!scope->ended)
+            continue;
+
+        GLuint64 begin = 0;
+        GLuint64 end = 0;
+        glGetQueryObjectui64v(frame->queries[2*i], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(frame->queries[2*i + 1], GL_QUERY_RESULT, &end);
+        f32 ms = (end > begin) ? (f32)((f64)(end - begin) / 1000000.0) : 0.0f;
+
+        times.pass_ms[scope->pass] += ms;
+        if (scope->command_type < GPU_PROFILER_MAX_COMMAND_TYPES)
+            times.command_ms[scope->command_type] += ms;
+        ++times.scope_count;
+    }
+
+    profiler->latest = times;
+    profiler->latest_updated = true;
+}
+
+void gpu_profiler_begin_frame(GPUProfiler* profiler, b32 record)
+{
+    profiler->latest_updated = false;
+    if (!record)
+    {
+        // NOTE(lucas): Results from before profiling was turned off would be stale by the time it is turned back on
+        for (u32 i = 0; i < GPU_PROFILER_FRAMES; ++i)
+            profiler->frames[i].pending = false;
+        profiler->recording = false;
+        return;
+    }
+
+    if (!profiler->initialized)
+    {
+        for (u32 i = 0; i < GPU_PROFILER_FRAMES; ++i)
+            glGenQueries(2*GPU_PROFILER_MAX_SCOPES, profiler->frames[i].queries);
+        profiler->initialized = true;
+    }
+
+    profiler->current = (profiler->current + 1) % GPU_PROFILER_FRAMES;
+    GPUProfilerFrame* frame = profiler->frames + profiler->current;
+    if (frame->pending)
+        gpu_profiler_read(profiler, frame);
+
+    frame->scope_count = 0;
+    frame->last_query = 0;
+    frame->pending = false;
+    frame->frame = ++profiler->frame;
+    profiler->recording = true;
+}
+
+void gpu_profiler_delete(GPUProfiler* profiler)
+{
+    if (profiler->initialized)
+    {
+        for (u32 i = 0; i < GPU_PROFILER_FRAMES; ++i)
+            glDeleteQueries(2*GPU_PROFILER_MAX_SCOPES, profiler->frames[i].queries);
+    }
+    *profiler = (GPUProfiler){0};
+}
+
+u32 gpu_profiler_begin(GPUProfiler* profiler, GPUPass pass, u32 command_type)
+{
+    if (!profiler->recording)
+        return GPU_SCOPE_NONE;
+
+    GPUProfilerFrame* frame = profiler->frames + profiler->current;
+    if (frame->scope_count >= GPU_PROFILER_MAX_SCOPES)
+    {
+        ++profiler->dropped_scopes;
+        return GPU_SCOPE_NONE;
+    }
+
+    u32 index = frame->scope_count++;
+    GPUScope* scope = frame->scopes + index;
+    scope->pass = pass;
+    scope->command_type = command_type;
+    scope->ended = false;
+    frame->pending = true;
+
+    glQueryCounter(frame->queries[2*index], GL_TIMESTAMP);
+    return index;
+}
+
+void gpu_profiler_end(GPUProfiler* profiler, u32 scope)
+{
+    if (!profiler->recording || scope == GPU_SCOPE_NONE)
+        return;
+
+    GPUProfilerFrame* frame = profiler->frames + profiler->current;
+    ASSERT(scope < frame->scope_count, "GPU scope was not begun this frame");
+    glQueryCounter(frame->queries[2*scope + 1], GL_TIMESTAMP);
+    frame->scopes[scope].ended = true;
+    frame->last_query = frame->queries[2*scope + 1];
+}
+
+const char* gpu_pass_name(GPUPass pass)
+{
+    persist const char* names[] =
+    {
+        "Frame",
+        "Uploads",
+        "Shapes",
+        "Sprites",
+        "Text",
+        "UI",
+        "Resolve",
+        "Final",
+    };
+
+    const char* result = (pass < countof(names)) ? names[pass] : "Unknown";
+    return result;
+}
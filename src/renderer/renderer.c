@@ -2,19 +2,28 @@
 #include "alchemy/state.h" // MAX_FILEPATH_LEN
 #include "alchemy/util/math.h"
 #include "alchemy/util/memory.h"
+#include "alchemy/util/profile.h"
 #include "alchemy/util/str.h"
+#include "alchemy/util/thread.h"
+#include "alchemy/util/time.h"
 
 #include <glad/glad.h>
 #include <stb_image/stb_image.h>
 
+#include <stddef.h> // offsetof
+#include <stdlib.h> // qsort
+#include <string.h> // memcpy, memset
+
+// NOTE(lucas): Output functions leave their VAO bound, so consecutive draws with the same VAO skip the rebind.
+// VAOs are unbound once the frame has been rendered.
 internal void vao_bind(u32 vao)
 {
-    glBindVertexArray(vao);
+    gl_bind_vertex_array(vao);
 }
 
 internal void vao_unbind(void)
 {
-    glBindVertexArray(0);
+    gl_bind_vertex_array(0);
 }
 
 internal u32 vao_init(void)
@@ -30,7 +39,7 @@ internal u32 vbo_init(f32* vertices, size bytes)
 {
     u32 vbo;
     glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    gl_bind_buffer(GL_ARRAY_BUFFER, vbo);
     glBufferData(GL_ARRAY_BUFFER, bytes, vertices, GL_STATIC_DRAW);
 
     return vbo;
@@ -40,7 +49,7 @@ internal u32 vbo_init_empty(void)
 {
     u32 vbo;
     glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    gl_bind_buffer(GL_ARRAY_BUFFER, vbo);
 
     return vbo;
 }
@@ -49,7 +58,7 @@ internal u32 ibo_init(u32* indices, size bytes)
 {
     u32 ibo;
     glGenBuffers(1, &ibo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    gl_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, bytes, indices, GL_STATIC_DRAW);
 
     return ibo;
@@ -59,11 +68,186 @@ internal u32 ibo_init_empty(void)
 {
     u32 ibo;
     glGenBuffers(1, &ibo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    gl_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
 
     return ibo;
 }
 
+// NOTE(lucas): The GL 4.3 loader does not include buffer storage, so it is loaded by hand when available.
+#ifndef GL_MAP_PERSISTENT_BIT
+    #define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+    #define GL_MAP_COHERENT_BIT 0x0080
+#endif
+typedef void (APIENTRYP PFNGLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+global PFNGLBUFFERSTORAGEPROC gl_buffer_storage;
+
+internal b32 stream_buffer_persistent_supported(void)
+{
+    persist b32 checked = false;
+    if (!checked)
+    {
+        checked = true;
+
+        GLint major = 0;
+        GLint minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+
+        b32 has_extension = (major > 4) || (major == 4 && minor >= 4);
+        GLint num_extensions = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+        for (GLint i = 0; i < num_extensions && !has_extension; ++i)
+        {
+            char* ext = (char*)glGetStringi(GL_EXTENSIONS, i);
+            has_extension = str_eq(ext, "GL_ARB_buffer_storage");
+        }
+
+        if (has_extension)
+            gl_buffer_storage = (PFNGLBUFFERSTORAGEPROC)opengl_get_proc_address("glBufferStorage");
+    }
+
+    return gl_buffer_storage != NULL;
+}
+
+// NOTE(lucas): Uploads are done through the copy-write target so that binding a stream
+// never disturbs the element buffer binding of whichever VAO is currently bound.
+StreamBuffer stream_buffer_init(size region_bytes)
+{
+    StreamBuffer stream = {0};
+    stream.region_bytes = region_bytes;
+    size total_bytes = STREAM_BUFFER_REGIONS*region_bytes;
+
+    glGenBuffers(1, &stream.id);
+    gl_bind_buffer(GL_COPY_WRITE_BUFFER, stream.id);
+
+    if (stream_buffer_persistent_supported())
+    {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        gl_buffer_storage(GL_COPY_WRITE_BUFFER, total_bytes, NULL, flags);
+        stream.mapped = (u8*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, total_bytes, flags);
+    }
+
+    if (!stream.mapped)
+        glBufferData(GL_COPY_WRITE_BUFFER, total_bytes, NULL, GL_STREAM_DRAW);
+
+    gl_bind_buffer(GL_COPY_WRITE_BUFFER, 0);
+    return stream;
+}
+
+void stream_buffer_delete(StreamBuffer* stream)
+{
+    for (u32 i = 0; i < STREAM_BUFFER_REGIONS; ++i)
+    {
+        if (stream->fences[i])
+            glDeleteSync((GLsync)stream->fences[i]);
+    }
+
+    if (stream->mapped)
+    {
+        gl_bind_buffer(GL_COPY_WRITE_BUFFER, stream->id);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        gl_bind_buffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    gl_forget_buffer(stream->id);
+    glDeleteBuffers(1, &stream->id);
+    *stream = (StreamBuffer){0};
+}
+
+// NOTE(lucas): Throw away the buffer's storage and let the driver hand back fresh memory.
+// Draws that were already issued keep using the old storage.
+internal void stream_buffer_orphan(StreamBuffer* stream)
+{
+    gl_bind_buffer(GL_COPY_WRITE_BUFFER, stream->id);
+    glBufferData(GL_COPY_WRITE_BUFFER, STREAM_BUFFER_REGIONS*stream->region_bytes, NULL, GL_STREAM_DRAW);
+    gl_bind_buffer(GL_COPY_WRITE_BUFFER, 0);
+
+    for (u32 i = 0; i < STREAM_BUFFER_REGIONS; ++i)
+    {
+        if (stream->fences[i])
+            glDeleteSync((GLsync)stream->fences[i]);
+        stream->fences[i] = 0;
+    }
+
+    ++stream->orphan_count;
+}
+
+// Fence the region currently being written and move to the next one, making sure the GPU is done with it.
+internal void stream_buffer_next_region(StreamBuffer* stream)
+{
+    u32 region = stream->region;
+    if (stream->fences[region])
+        glDeleteSync((GLsync)stream->fences[region]);
+    stream->fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    region = (region + 1) % STREAM_BUFFER_REGIONS;
+    stream->region = region;
+    stream->offset = region*stream->region_bytes;
+
+    GLsync fence = (GLsync)stream->fences[region];
+    if (!fence)
+        return;
+
+    if (stream->mapped)
+    {
+        // NOTE(lucas): Persistent storage is immutable and cannot be orphaned, so wait on the GPU.
+        GLenum wait = glClientWaitSync(fence, 0, 0);
+        while (wait == GL_TIMEOUT_EXPIRED)
+            wait = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+    }
+    else if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+    {
+        stream_buffer_orphan(stream);
+        return;
+    }
+
+    glDeleteSync(fence);
+    stream->fences[region] = 0;
+}
+
+// NOTE(lucas): Copies data into the stream and returns its byte offset from the start of the buffer.
+// The offset is a multiple of alignment, so vertex data can be addressed with a base vertex.
+size stream_buffer_push(StreamBuffer* stream, void* data, size bytes, size alignment)
+{
+    ASSERT(bytes <= stream->region_bytes, "Stream buffer upload is larger than a region");
+
+    size offset = ((stream->offset + alignment - 1) / alignment) * alignment;
+    size region_end = (stream->region + 1)*stream->region_bytes;
+    if (offset + bytes > region_end)
+    {
+        stream_buffer_next_region(stream);
+        offset = ((stream->offset + alignment - 1) / alignment) * alignment;
+    }
+
+    if (stream->mapped)
+    {
+        memcpy(stream->mapped + offset, data, bytes);
+    }
+    else
+    {
+        gl_bind_buffer(GL_COPY_WRITE_BUFFER, stream->id);
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT;
+        void* dest = glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, bytes, flags);
+        if (dest)
+        {
+            memcpy(dest, data, bytes);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        }
+    }
+
+    stream->offset = offset + bytes;
+    stream->frame_bytes += bytes;
+    return offset;
+}
+
+void stream_buffer_end_frame(StreamBuffer* stream)
+{
+    stream_buffer_next_region(stream);
+    stream->frame_bytes = 0;
+}
+
 internal void fbo_bind(u32 fbo)
 {
     glBindFramebuffer(GL_FRAMEBUFFER, fbo);
@@ -167,10 +351,26 @@ internal RenderObject framebuffer_renderer_init(u32 shader)
     return framebuffer_renderer;
 }
 
-internal RenderObject ui_renderer_init(u32 shader)
+#define UI_VERTEX_BYTES (8*sizeof(f32))
+
+// NOTE(lucas): Only used by the UI vertex buffer backend. Vertices match the layout given to nk_convert in ui.c.
+// They are uploaded to the streams every frame like the batches.
+internal RenderObject ui_renderer_init(u32 shader, u32 vertex_stream, u32 index_stream)
 {
     RenderObject ui_renderer = {0};
     ui_renderer.shader = shader;
+    ui_renderer.vao = vao_init();
+
+    gl_bind_buffer(GL_ARRAY_BUFFER, vertex_stream);
+    gl_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, index_stream);
+
+    u32 stride = UI_VERTEX_BYTES;
+    vertex_layout_set(0, 2, stride, 0);
+    vertex_layout_set(1, 2, stride, (void*)(2*sizeof(f32)));
+    vertex_layout_set(2, 4, stride, (void*)(4*sizeof(f32)));
+
+    vao_bind(0);
+
     return ui_renderer;
 }
 
@@ -206,7 +406,9 @@ internal RenderObject sprite_renderer_init(u32 shader)
     return sprite_renderer;
 }
 
-internal RenderObject triangle_renderer_init(u32 shader)
+// NOTE(lucas): Render objects that draw per-frame geometry source their vertices (and possibly indices) from the
+// renderer's stream buffers. Their vbo/ibo are left as 0 since the streams are owned by the renderer.
+internal RenderObject triangle_renderer_init(u32 shader, u32 vertex_stream)
 {
     RenderObject triangle_renderer = {0};
     triangle_renderer.shader = shader;
@@ -217,7 +419,7 @@ internal RenderObject triangle_renderer_init(u32 shader)
     };
 
     triangle_renderer.vao = vao_init();
-    triangle_renderer.vbo = vbo_init_empty();
+    gl_bind_buffer(GL_ARRAY_BUFFER, vertex_stream);
     triangle_renderer.ibo = ibo_init(indices, sizeof(indices));
 
     vertex_layout_set(0, 2, 6*sizeof(f32), 0);
@@ -260,22 +462,38 @@ internal RenderObject quad_renderer_init(u32 shader)
     return quad_renderer;
 }
 
-internal RenderObject font_renderer_init(u32 shader)
+// NOTE(lucas): Quads drawn from a vertex stream all use the same index pattern, so the indices for
+// a full batch of quads are generated once up front and only vertices are streamed each frame
+internal u32 quad_ibo_init(Renderer* renderer, u32 max_quads)
+{
+    u32 index_count = 6*max_quads;
+    u32* indices = push_array(&renderer->scratch_arena, index_count, u32);
+    for (u32 i = 0; i < max_quads; ++i)
+    {
+        u32 first = 4*i;
+        u32* quad = indices + 6*i;
+        quad[0] = first;
+        quad[1] = first+1;
+        quad[2] = first+3;
+        quad[3] = first+1;
+        quad[4] = first+2;
+        quad[5] = first+3;
+    }
+
+    u32 ibo = ibo_init(indices, index_count*sizeof(u32));
+    memory_arena_pop(&renderer->scratch_arena, index_count*sizeof(u32));
+
+    return ibo;
+}
+
+internal RenderObject font_renderer_init(Renderer* renderer, u32 shader, u32 vertex_stream, u32 max_glyphs)
 {
     RenderObject font_renderer = {0};
     font_renderer.shader = shader;
 
-    // NOTE(lucas): While vertex buffer data changes a lot, the order in which indices are drawn
-    // does not. So, indices and index buffer can be defined here.
-    u32 indices[] = 
-    {
-      0, 1, 3,
-      1, 2, 3
-    };
-
     font_renderer.vao = vao_init();
-    font_renderer.vbo = vbo_init_empty();
-    font_renderer.ibo = ibo_init(indices, sizeof(indices));
+    gl_bind_buffer(GL_ARRAY_BUFFER, vertex_stream);
+    font_renderer.ibo = quad_ibo_init(renderer, max_glyphs);
 
     vertex_layout_set(0, 2, 4*sizeof(f32), 0);
     vertex_layout_set(1, 2, 4*sizeof(f32), (void*)(2*sizeof(f32)));
@@ -285,14 +503,18 @@ internal RenderObject font_renderer_init(u32 shader)
     return font_renderer;
 }
 
-internal RenderObject circle_renderer_init(u32 shader, u32 segs)
+// NOTE(lucas): The circle renderer's buffers hold the tessellation cache. They are allocated once and filled as
+// meshes are built.
+internal RenderObject circle_renderer_init(u32 shader)
 {
     RenderObject circle_renderer = {0};
     circle_renderer.shader = shader;
     circle_renderer.vao = vao_init();
 
     circle_renderer.vbo = vbo_init_empty();
+    glBufferData(GL_ARRAY_BUFFER, TESSELLATION_CACHE_MAX_VERTICES*6*sizeof(f32), NULL, GL_STATIC_DRAW);
     circle_renderer.ibo = ibo_init_empty();
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, TESSELLATION_CACHE_MAX_INDICES*sizeof(u32), NULL, GL_STATIC_DRAW);
 
     vertex_layout_set(0, 2, 6*sizeof(f32), 0);
     vertex_layout_set(1, 4, 6*sizeof(f32), (void*)(2*sizeof(f32)));
@@ -301,8 +523,105 @@ internal RenderObject circle_renderer_init(u32 shader, u32 segs)
     return circle_renderer;
 }
 
+internal RenderObject batch_renderer_init(u32 shader, u32 vertex_stream, u32 index_stream)
+{
+    RenderObject batch_renderer = {0};
+    batch_renderer.shader = shader;
+    batch_renderer.vao = vao_init();
+
+    gl_bind_buffer(GL_ARRAY_BUFFER, vertex_stream);
+    gl_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, index_stream);
+
+    vertex_layout_set(0, 2, RENDER_BATCH_VERTEX_FLOATS*sizeof(f32), 0);
+    vertex_layout_set(1, 4, RENDER_BATCH_VERTEX_FLOATS*sizeof(f32), (void*)(2*sizeof(f32)));
+    vao_bind(0);
+
+    return batch_renderer;
+}
+
+internal RenderObject sprite_batch_renderer_init(Renderer* renderer, u32 shader, u32 vertex_stream, u32 max_sprites)
+{
+    RenderObject sprite_batch_renderer = {0};
+    sprite_batch_renderer.shader = shader;
+
+    sprite_batch_renderer.vao = vao_init();
+    gl_bind_buffer(GL_ARRAY_BUFFER, vertex_stream);
+    sprite_batch_renderer.ibo = quad_ibo_init(renderer, max_sprites);
+
+    u32 stride = SPRITE_BATCH_VERTEX_FLOATS*sizeof(f32);
+    vertex_layout_set(0, 2, stride, 0);
+    vertex_layout_set(1, 2, stride, (void*)(2*sizeof(f32)));
+    vertex_layout_set(2, 4, stride, (void*)(4*sizeof(f32)));
+    vertex_layout_set(3, 1, stride, (void*)(8*sizeof(f32)));
+    vao_bind(0);
+
+    return sprite_batch_renderer;
+}
+
+internal SpriteBatch sprite_batch_alloc(MemoryArena* arena, u32 max_sprites)
+{
+    SpriteBatch batch = {0};
+    batch.vertices = push_array(arena, 4*max_sprites*SPRITE_BATCH_VERTEX_FLOATS, f32);
+    batch.max_sprites = max_sprites;
+    return batch;
+}
+
+internal RenderObject shape_renderer_init(u32 shader, u32 vertex_stream)
+{
+    RenderObject shape_renderer = {0};
+    shape_renderer.shader = shader;
+
+    f32 vertices[] =
+    {
+        -1.0f, -1.0f,
+         1.0f, -1.0f,
+         1.0f,  1.0f,
+        -1.0f,  1.0f
+    };
+
+    u32 indices[] =
+    {
+        0, 1, 3,
+        1, 2, 3
+    };
+
+    shape_renderer.vao = vao_init();
+    shape_renderer.vbo = vbo_init(vertices, sizeof(vertices));
+    shape_renderer.ibo = ibo_init(indices, sizeof(indices));
+    vertex_layout_set(0, 2, 2*sizeof(f32), 0);
+
+    // NOTE(lucas): Instance attributes are sourced from the vertex stream, and each draw selects its instances
+    // with a base instance
+    gl_bind_buffer(GL_ARRAY_BUFFER, vertex_stream);
+    u32 stride = sizeof(ShapeInstance);
+    vertex_layout_set(1, 4, stride, (void*)offsetof(ShapeInstance, center));
+    vertex_layout_set(2, 4, stride, (void*)offsetof(ShapeInstance, color));
+    vertex_layout_set(3, 4, stride, (void*)offsetof(ShapeInstance, params));
+    vertex_layout_set(4, 4, stride, (void*)offsetof(ShapeInstance, params_ext));
+    vertex_layout_set(5, 1, stride, (void*)offsetof(ShapeInstance, kind));
+    for (u32 i = 1; i <= 5; ++i)
+        glVertexAttribDivisor(i, 1);
+
+    vao_bind(0);
+
+    return shape_renderer;
+}
+
+internal RenderBatch render_batch_alloc(MemoryArena* arena, u32 max_vertices, u32 max_indices)
+{
+    RenderBatch batch = {0};
+    batch.vertices = push_array(arena, max_vertices*RENDER_BATCH_VERTEX_FLOATS, f32);
+    batch.indices = push_array(arena, max_indices, u32);
+    batch.max_vertices = max_vertices;
+    batch.max_indices = max_indices;
+    return batch;
+}
+
 internal void render_object_delete(RenderObject* render_object)
 {
+    gl_forget_vertex_array(render_object->vao);
+    gl_forget_buffer(render_object->vbo);
+    gl_forget_buffer(render_object->ibo);
     glDeleteVertexArrays(1, &render_object->vao);
     glDeleteBuffers(1, &render_object->vbo);
     glDeleteBuffers(1, &render_object->ibo);
@@ -409,12 +728,76 @@ internal void framebuffer_delete(Framebuffer* framebuffer)
     fbo_delete(&framebuffer->id);
 }
 
+internal void render_target_event(Renderer* renderer, RenderTargetEventType type, RenderTargetID target,
+                                  int width, int height, int samples)
+{
+    RenderTargetManager* manager = &renderer->render_targets;
+    RenderTargetState* state = manager->targets + target;
+    state->width = width;
+    state->height = height;
+    state->samples = samples;
+    ++state->allocations;
+
+    RenderTargetEvent* event = manager->events + (manager->event_count % RENDER_TARGET_MAX_EVENTS);
+    event->type = type;
+    event->target = target;
+    event->width = width;
+    event->height = height;
+    event->samples = samples;
+    event->frame = manager->frame;
+    ++manager->event_count;
+
+    ++renderer->stats.render_target_allocations;
+    log_debug("Render target %d allocated at %dx%d with %d samples", target, width, height, samples);
+
+    if (manager->callback)
+        manager->callback(manager->callback_data, event);
+}
+
+// NOTE(lucas): Returns true if the attachments were reallocated, in which case their contents are undefined
+internal b32 render_target_resize(Renderer* renderer, Framebuffer* framebuffer, RenderTargetID target,
+                                  int width, int height, int samples)
+{
+    RenderTargetState* state = renderer->render_targets.targets + target;
+    if (state->width == width && state->height == height && state->samples == samples)
+        return false;
+
+    // NOTE(lucas): Multisampled and single-sampled textures have different targets, so switching between them
+    // needs a new texture
+    RenderTargetEventType type = RenderTargetEvent_Allocate;
+    if ((state->samples > 0) != (samples > 0))
+    {
+        texture_delete(&framebuffer->texture);
+        framebuffer->texture = texture_generate(samples);
+        type = RenderTargetEvent_Recreate;
+    }
+
+    texture_fill_empty_data(&framebuffer->texture, width, height, samples);
+    framebuffer->texture.size = v2((f32)width, (f32)height);
+    if (type == RenderTargetEvent_Recreate)
+    {
+        fbo_bind(framebuffer->id);
+        framebuffer_attach_texture(framebuffer, framebuffer->texture, samples);
+        fbo_unbind();
+    }
+
+    if (framebuffer->rbo)
+    {
+        rbo_bind(framebuffer->rbo);
+        rbo_update(width, height, samples);
+        rbo_unbind();
+    }
+
+    render_target_event(renderer, type, target, width, height, samples);
+    return true;
+}
+
 internal void renderer_gen_texture(Texture tex)
 {
     if (!tex.data)
         return;
 
-    glBindTexture(GL_TEXTURE_2D, tex.id);
+    gl_bind_texture(GL_TEXTURE_2D, tex.id);
 
     // TODO(lucas): Make options configurable
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -437,9 +820,140 @@ internal void renderer_gen_texture(Texture tex)
     glGenerateMipmap(GL_TEXTURE_2D);
 }
 
+internal void renderer_gen_texture_storage(Texture tex)
+{
+    GLenum target = tex.layers ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+    GLenum internal_format = (tex.channels == 1) ? GL_R8 : GL_RGBA8;
+    gl_bind_texture(target, tex.id);
+    if (tex.layers)
+        glTexStorage3D(target, 1, internal_format, (int)tex.size.x, (int)tex.size.y, tex.layers);
+    else
+        glTexStorage2D(target, 1, internal_format, (int)tex.size.x, (int)tex.size.y);
+
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+internal TextureSlot* renderer_texture_slot(Renderer* renderer, TextureHandle handle);
+
+void renderer_texture_flush(Renderer* renderer)
+{
+    for (u32 i = 0; i < renderer->pending_upload_count; ++i)
+    {
+        TextureSlot* slot = renderer->texture_slots + renderer->pending_uploads[i];
+        if (!slot->upload_pending)
+            continue;
+
+        if (slot->upload.data)
+            renderer_gen_texture(slot->upload);
+        else
+            renderer_gen_texture_storage(slot->upload);
+        slot->upload_pending = false;
+        slot->upload = (Texture){0};
+    }
+    renderer->pending_upload_count = 0;
+
+    if (!renderer->pending_update_count)
+        return;
+
+    // NOTE(lucas): Updates read their rect straight out of the larger image
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (u32 i = 0; i < renderer->pending_update_count; ++i)
+    {
+        TextureUpdate* update = renderer->pending_updates + i;
+        TextureSlot* slot = renderer_texture_slot(renderer, update->handle);
+        if (!slot)
+            continue;
+
+        GLenum format = 0;
+        switch(update->channels)
+        {
+            case 1: format = GL_RED;  break;
+            case 2: format = GL_RG;   break;
+            case 3: format = GL_RGB;  break;
+            case 4: format = GL_RGBA; break;
+            default: break;
+        }
+
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, update->row_length);
+        glPixelStorei(GL_UNPACK_SKIP_PIXELS, update->x);
+        glPixelStorei(GL_UNPACK_SKIP_ROWS, update->y);
+        if (slot->layers)
+        {
+            gl_bind_texture(GL_TEXTURE_2D_ARRAY, slot->id);
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, update->x, update->y, update->layer, update->width, update->height,
+                            1, format, GL_UNSIGNED_BYTE, update->pixels);
+        }
+        else
+        {
+            gl_bind_texture(GL_TEXTURE_2D, slot->id);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, update->x, update->y, update->width, update->height, format,
+                            GL_UNSIGNED_BYTE, update->pixels);
+        }
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+    glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    renderer->pending_update_count = 0;
+}
+
+// NOTE(lucas): Deleted textures get a fresh GL name before their slots are reused, so a new texture can never pick up
+// the old one's storage or parameters. Frees are handled first, since they cancel pending uploads and updates.
+internal void renderer_texture_process_queues(Renderer* renderer)
+{
+    u32 free_count = renderer->pending_free_count;
+    if (free_count)
+    {
+        u32 texture_ids[RENDERER_MAX_TEXTURES];
+        for (u32 i = 0; i < free_count; ++i)
+        {
+            TextureSlot* slot = renderer->texture_slots + renderer->pending_frees[i];
+            texture_ids[i] = slot->id;
+            gl_forget_texture(slot->id);
+        }
+
+        glDeleteTextures(free_count, texture_ids);
+        glGenTextures(free_count, texture_ids);
+
+        for (u32 i = 0; i < free_count; ++i)
+        {
+            u32 index = renderer->pending_frees[i];
+            TextureSlot* slot = renderer->texture_slots + index;
+            slot->id = texture_ids[i];
+            slot->next_free = renderer->texture_free_head;
+            renderer->texture_free_head = index;
+        }
+        renderer->pending_free_count = 0;
+    }
+
+    renderer_texture_flush(renderer);
+}
+
+#define POLY_VERTEX_BYTES (6*sizeof(f32))
+
+// NOTE(lucas): Upload vertices in the poly layout (position, color) to the vertex stream and return the base vertex
+// that addresses them. The bound VAO must source its vertices from the vertex stream.
+internal GLint stream_push_vertices(Renderer* renderer, f32* vertices, size bytes, size vertex_bytes)
+{
+    size offset = stream_buffer_push(&renderer->vertex_stream, vertices, bytes, vertex_bytes);
+    GLint base_vertex = (GLint)(offset / vertex_bytes);
+    return base_vertex;
+}
+
+// Upload poly vertices and indices to the streams and draw them with the currently bound stream-backed VAO
+internal void stream_draw_poly(Renderer* renderer, f32* vertices, u32 n_verts, u32* indices, u32 n_indices)
+{
+    GLint base_vertex = stream_push_vertices(renderer, vertices, n_verts*POLY_VERTEX_BYTES, POLY_VERTEX_BYTES);
+    size index_offset = stream_buffer_push(&renderer->index_stream, indices, n_indices*sizeof(u32), sizeof(u32));
+    glDrawElementsBaseVertex(GL_TRIANGLES, n_indices, GL_UNSIGNED_INT, (void*)index_offset, base_vertex);
+}
+
 internal void output_quad(Renderer* renderer, RenderCommandQuad* cmd);
 
-internal void output_line(Renderer* renderer, RenderCommandLine* cmd)
+internal RenderCommandQuad line_to_quad(RenderCommandLine* cmd)
 {
     v2 delta = v2_sub(cmd->end, cmd->start);
 
@@ -464,35 +978,85 @@ internal void output_line(Renderer* renderer, RenderCommandLine* cmd)
     // white the additional rotation needs to be about the origin
     RenderCommandQuad quad_cmd = {RENDER_COMMAND_RenderCommandQuad, cmd->start, cmd->origin, size, cmd->color,
                                   glm_deg(initial_rotation) + cmd->rotation};
+    return quad_cmd;
+}
+
+internal void output_line(Renderer* renderer, RenderCommandLine* cmd)
+{
+    RenderCommandQuad quad_cmd = line_to_quad(cmd);
     output_quad(renderer, &quad_cmd);
 }
 
-internal void output_triangle(Renderer* renderer, RenderCommandTriangle* cmd)
+/* NOTE(lucas): Triangle vertices are normalized to the unit square spanned by their bounding box,
+ * and the model matrix scales them back up. This way, rotation about the origin works the same as for quads.
+ * The normalized vertices are written to norm in the order a, b, c.
+ */
+internal m4 triangle_model(v2 a, v2 b, v2 c, v2 origin, f32 rotation, v2* norm)
 {
     v2 min_point = v2_full(F32_MAX);
     v2 max_point = v2_full(-F32_MAX);
 
-    if (cmd->a.x < min_point.x) min_point.x = cmd->a.x;
-    if (cmd->b.x < min_point.x) min_point.x = cmd->b.x;
-    if (cmd->c.x < min_point.x) min_point.x = cmd->c.x;
+    if (a.x < min_point.x) min_point.x = a.x;
+    if (b.x < min_point.x) min_point.x = b.x;
+    if (c.x < min_point.x) min_point.x = c.x;
 
-    if (cmd->a.y < min_point.y) min_point.y = cmd->a.y;
-    if (cmd->b.y < min_point.y) min_point.y = cmd->b.y;
-    if (cmd->c.y < min_point.y) min_point.y = cmd->c.y;
+    if (a.y < min_point.y) min_point.y = a.y;
+    if (b.y < min_point.y) min_point.y = b.y;
+    if (c.y < min_point.y) min_point.y = c.y;
 
-    if (cmd->a.x > max_point.x) max_point.x = cmd->a.x;
-    if (cmd->b.x > max_point.x) max_point.x = cmd->b.x;
-    if (cmd->c.x > max_point.x) max_point.x = cmd->c.x;
+    if (a.x > max_point.x) max_point.x = a.x;
+    if (b.x > max_point.x) max_point.x = b.x;
+    if (c.x > max_point.x) max_point.x = c.x;
 
-    if (cmd->a.y > max_point.y) max_point.y = cmd->a.y; 
-    if (cmd->b.y > max_point.y) max_point.y = cmd->b.y; 
-    if (cmd->c.y > max_point.y) max_point.y = cmd->c.y; 
+    if (a.y > max_point.y) max_point.y = a.y;
+    if (b.y > max_point.y) max_point.y = b.y;
+    if (c.y > max_point.y) max_point.y = c.y;
 
     v2 scale = v2_sub(max_point, min_point);
 
-    v2 a_norm = {(cmd->a.x - min_point.x) / scale.x, (cmd->a.y - min_point.y) / scale.y};
-    v2 b_norm = {(cmd->b.x - min_point.x) / scale.x, (cmd->b.y - min_point.y) / scale.y};
-    v2 c_norm = {(cmd->c.x - min_point.x) / scale.x, (cmd->c.y - min_point.y) / scale.y};
+    norm[0] = v2((a.x - min_point.x) / scale.x, (a.y - min_point.y) / scale.y);
+    norm[1] = v2((b.x - min_point.x) / scale.x, (b.y - min_point.y) / scale.y);
+    norm[2] = v2((c.x - min_point.x) / scale.x, (c.y - min_point.y) / scale.y);
+
+    m4 model = m4_identity();
+    model = m4_translate(model, (v3){min_point.x, min_point.y, 0.0f});
+    v2 delta = v2_abs(v2_sub(origin, min_point));
+
+    if (rotation)
+    {
+        model = m4_translate(model, (v3){delta.x, delta.y, 0.0f});
+        model = m4_rotate(model, glm_rad(-rotation), (v3){0.0f, 0.0f, 1.0f});
+        model = m4_translate(model, (v3){-delta.x, -delta.y, 0.0f});
+    }
+
+    model = m4_scale(model, (v3){scale.x, scale.y, 1.0f});
+    return model;
+}
+
+internal m4 quad_model(v2 position, v2 origin, v2 size, f32 rotation)
+{
+    m4 model = m4_identity();
+    model = m4_translate(model, (v3){position.x, position.y, 0.0f});
+    v2 delta = v2_sub(origin, position);
+
+    if (rotation)
+    {
+        model = m4_translate(model, (v3){delta.x, delta.y, 0.0f});
+        model = m4_rotate(model, glm_rad(-rotation), (v3){0.0f, 0.0f, 1.0f});
+        model = m4_translate(model, (v3){-delta.x, -delta.y, 0.0f});
+    }
+
+    model = m4_scale(model, (v3){(f32)size.x, (f32)size.y, 1.0f});
+    return model;
+}
+
+internal void output_triangle(Renderer* renderer, RenderCommandTriangle* cmd)
+{
+    v2 norm[3];
+    m4 model = triangle_model(cmd->a, cmd->b, cmd->c, cmd->origin, cmd->rotation, norm);
+    v2 a_norm = norm[0];
+    v2 b_norm = norm[1];
+    v2 c_norm = norm[2];
 
     // TODO(lucas): Current triangle being drawn should go off the screen to the left.
     // Should this go from 0 to 1?
@@ -505,28 +1069,12 @@ internal void output_triangle(Renderer* renderer, RenderCommandTriangle* cmd)
     };
 
     vao_bind(renderer->triangle_renderer.vao);
-
-    glBindBuffer(GL_ARRAY_BUFFER, renderer->triangle_renderer.vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-    m4 model = m4_identity();
-    model = m4_translate(model, (v3){min_point.x, min_point.y, 0.0f});
-    v2 delta = v2_abs(v2_sub(cmd->origin, min_point));
-
-    if (cmd->rotation)
-    {
-        model = m4_translate(model, (v3){delta.x, delta.y, 0.0f});
-        model = m4_rotate(model, glm_rad(-cmd->rotation), (v3){0.0f, 0.0f, 1.0f});
-        model = m4_translate(model, (v3){-delta.x, -delta.y, 0.0f});
-    }
-
-    model = m4_scale(model, (v3){scale.x, scale.y, 1.0f});
+    GLint base_vertex = stream_push_vertices(renderer, vertices, sizeof(vertices), POLY_VERTEX_BYTES);
 
     shader_set_m4(renderer->triangle_renderer.shader, "model", model, false);
     shader_set_v4(renderer->triangle_renderer.shader, "color", cmd->color);
 
-    glDrawElements(GL_TRIANGLES, 3, GL_UNSIGNED_INT, 0);
-    vao_bind(0);
+    glDrawElementsBaseVertex(GL_TRIANGLES, 3, GL_UNSIGNED_INT, 0, base_vertex);
 }
 
 internal void output_triangle_outline(Renderer* renderer, RenderCommandTriangleOutline* cmd)
@@ -572,58 +1120,17 @@ internal void output_triangle_outline(Renderer* renderer, RenderCommandTriangleO
     renderer->triangle_renderer.shader = renderer->poly_shader;
 }
 
-// TODO(lucas): Think about pulling out common code and default vertices for shape variants
 internal void output_triangle_gradient(Renderer* renderer, RenderCommandTriangleGradient* cmd)
 {
-    v2 min_point = v2_full(F32_MAX);
-    v2 max_point = v2_full(-F32_MAX);
-
-    if (cmd->a.x < min_point.x) min_point.x = cmd->a.x;
-    if (cmd->b.x < min_point.x) min_point.x = cmd->b.x;
-    if (cmd->c.x < min_point.x) min_point.x = cmd->c.x;
-
-    if (cmd->a.y < min_point.y) min_point.y = cmd->a.y;
-    if (cmd->b.y < min_point.y) min_point.y = cmd->b.y;
-    if (cmd->c.y < min_point.y) min_point.y = cmd->c.y;
-
-    if (cmd->a.x > max_point.x) max_point.x = cmd->a.x;
-    if (cmd->b.x > max_point.x) max_point.x = cmd->b.x;
-    if (cmd->c.x > max_point.x) max_point.x = cmd->c.x;
-
-    if (cmd->a.y > max_point.y) max_point.y = cmd->a.y; 
-    if (cmd->b.y > max_point.y) max_point.y = cmd->b.y; 
-    if (cmd->c.y > max_point.y) max_point.y = cmd->c.y; 
-
-    v2 scale = v2_sub(max_point, min_point);
-
-    v2 a_norm = {(cmd->a.x - min_point.x) / scale.x, (cmd->a.y - min_point.y) / scale.y};
-    v2 b_norm = {(cmd->b.x - min_point.x) / scale.x, (cmd->b.y - min_point.y) / scale.y};
-    v2 c_norm = {(cmd->c.x - min_point.x) / scale.x, (cmd->c.y - min_point.y) / scale.y};
-
-    m4 model = m4_identity();
-    model = m4_translate(model, (v3){min_point.x, min_point.y, 0.0f});
-    v2 delta = v2_abs(v2_sub(cmd->origin, min_point));
-
-    if (cmd->rotation)
-    {
-        model = m4_translate(model, (v3){delta.x, delta.y, 0.0f});
-        model = m4_rotate(model, glm_rad(-cmd->rotation), (v3){0.0f, 0.0f, 1.0f});
-        model = m4_translate(model, (v3){-delta.x, -delta.y, 0.0f});
-    }
-
-    model = m4_scale(model, (v3){scale.x, scale.y, 1.0f});
+    v2 norm[3];
+    m4 model = triangle_model(cmd->a, cmd->b, cmd->c, cmd->origin, cmd->rotation, norm);
+    v2 a_norm = norm[0];
+    v2 b_norm = norm[1];
+    v2 c_norm = norm[2];
 
     shader_set_m4(renderer->triangle_renderer.shader, "model", model, false);
     shader_set_v4(renderer->triangle_renderer.shader, "color", color_white());
 
-    f32 default_vertices[] =
-    {
-        // pos              // color
-        a_norm.x, a_norm.y, 1.0f, 1.0f, 1.0f, 1.0f, // bottom left
-        b_norm.x, b_norm.y, 1.0f, 1.0f, 1.0f, 1.0f, // bottom right
-        c_norm.x, c_norm.y, 1.0f, 1.0f, 1.0f, 1.0f  // top
-    };
-
     f32 gradient_vertices[] =
     {
         // pos              // color
@@ -633,34 +1140,19 @@ internal void output_triangle_gradient(Renderer* renderer, RenderCommandTriangle
     };
 
     vao_bind(renderer->triangle_renderer.vao);
-    glBindBuffer(GL_ARRAY_BUFFER, renderer->triangle_renderer.vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(gradient_vertices), gradient_vertices, GL_STATIC_DRAW);
-    glDrawElements(GL_TRIANGLES, 3, GL_UNSIGNED_INT, 0);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(default_vertices), default_vertices, GL_STATIC_DRAW);
-    vao_bind(0);    
+    GLint base_vertex = stream_push_vertices(renderer, gradient_vertices, sizeof(gradient_vertices), POLY_VERTEX_BYTES);
+    glDrawElementsBaseVertex(GL_TRIANGLES, 3, GL_UNSIGNED_INT, 0, base_vertex);
 }
 
 internal void output_quad(Renderer* renderer, RenderCommandQuad* cmd)
 {
-    m4 model = m4_identity();
-    model = m4_translate(model, (v3){cmd->position.x, cmd->position.y, 0.0f});
-    v2 delta = v2_sub(cmd->origin, cmd->position);
-
-    if (cmd->rotation)
-    {
-        model = m4_translate(model, (v3){delta.x, delta.y, 0.0f});
-        model = m4_rotate(model, glm_rad(-cmd->rotation), (v3){0.0f, 0.0f, 1.0f});
-        model = m4_translate(model, (v3){-delta.x, -delta.y, 0.0f});
-    }
-
-    model = m4_scale(model, (v3){(f32)cmd->size.x, (f32)cmd->size.y, 1.0f});
+    m4 model = quad_model(cmd->position, cmd->origin, cmd->size, cmd->rotation);
 
     shader_set_m4(renderer->quad_renderer.shader, "model", model, false);
     shader_set_v4(renderer->quad_renderer.shader, "color", cmd->color);
 
     vao_bind(renderer->quad_renderer.vao);
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-    vao_bind(0);
 }
 
 internal void output_quad_outline(Renderer* renderer, RenderCommandQuadOutline* cmd)
@@ -687,31 +1179,11 @@ internal void output_quad_outline(Renderer* renderer, RenderCommandQuadOutline*
 
 internal void output_quad_gradient(Renderer* renderer, RenderCommandQuadGradient* cmd)
 {
-    m4 model = m4_identity();
-    model = m4_translate(model, (v3){cmd->position.x, cmd->position.y, 0.0f});
-    v2 delta = v2_sub(cmd->origin, cmd->position);
-
-    if (cmd->rotation)
-    {
-        model = m4_translate(model, (v3){delta.x, delta.y, 0.0f});
-        model = m4_rotate(model, glm_rad(-cmd->rotation), (v3){0.0f, 0.0f, 1.0f});
-        model = m4_translate(model, (v3){-delta.x, -delta.y, 0.0f});
-    }
-
-    model = m4_scale(model, (v3){(f32)cmd->size.x, (f32)cmd->size.y, 1.0f});
+    m4 model = quad_model(cmd->position, cmd->origin, cmd->size, cmd->rotation);
 
     shader_set_m4(renderer->quad_renderer.shader, "model", model, false);
     shader_set_v4(renderer->quad_renderer.shader, "color", color_white());
 
-    f32 default_vertices[] =
-    {
-        // pos      // color
-        0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f, // bottom left
-        1.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f, // bottom right
-        1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, // top right
-        0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f  // top left
-    };
-
     f32 gradient_vertices[] =
     {
         // pos      // color
@@ -721,65 +1193,314 @@ internal void output_quad_gradient(Renderer* renderer, RenderCommandQuadGradient
         0.0f, 1.0f, cmd->color_tl.r, cmd->color_tl.g, cmd->color_tl.b, cmd->color_tl.a  // top left
     };
 
-    // TODO(lucas): Is there a better way to handle making sure vertex colors do not persist?
-    vao_bind(renderer->quad_renderer.vao);
-    glBindBuffer(GL_ARRAY_BUFFER, renderer->quad_renderer.vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(gradient_vertices), gradient_vertices, GL_STATIC_DRAW);
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(default_vertices), default_vertices, GL_STATIC_DRAW);
-    vao_bind(0);
+    u32 indices[] =
+    {
+        0, 1, 3,
+        1, 2, 3
+    };
+
+    // NOTE(lucas): The quad renderer's vertices are static, so gradients go through the streamed batch VAO
+    vao_bind(renderer->batch_renderer.vao);
+    stream_draw_poly(renderer, gradient_vertices, 4, indices, countof(indices));
 }
 
-internal void output_circle(Renderer* renderer, RenderCommandCircle* cmd)
+internal u32 tessellation_key_hash(TessellationKey key)
 {
-    m4 model = m4_identity();
-    model = m4_translate(model, (v3){cmd->center.x, cmd->center.y, 0.0f});
-    model = m4_scale(model, (v3){cmd->radius, cmd->radius, 1.0f});
+    // NOTE(lucas): FNV-1a over the key fields
+    u32 fields[] = {(u32)key.type, key.segs, key.span, key.k0, key.k1};
+    u32 hash = 2166136261u;
+    for (u32 i = 0; i < countof(fields); ++i)
+    {
+        hash ^= fields[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
 
-    shader_set_m4(renderer->circle_renderer.shader, "model", model, false);
-    shader_set_v4(renderer->circle_renderer.shader, "color", cmd->color);
+internal b32 tessellation_key_eq(TessellationKey a, TessellationKey b)
+{
+    b32 result = (a.type == b.type && a.segs == b.segs && a.span == b.span && a.k0 == b.k0 && a.k1 == b.k1);
+    return result;
+}
 
-    u32 segs = renderer->config.circle_line_segments;
-    u32 tris = segs - 2;
-    u32 n_verts = 6*segs;
-    u32 n_indices = 3*tris;
-    f32* vertices = push_array(&renderer->scratch_arena, n_verts, f32);
-    u32* indices = push_array(&renderer->scratch_arena, n_indices, u32);
+internal u32 tessellation_quantize(f32 value, f32 steps)
+{
+    u32 result = (u32)(value*steps + 0.5f);
+    return result;
+}
 
-    // Construct points from angles of tris
-    f32 angle_delta = 360.0f / segs;
-    u32 index = 0;
-    for (u32 i = 0; i < segs; ++i)
+internal void tessellation_cache_clear(TessellationCache* cache)
+{
+    memset(cache->meshes, 0, sizeof(cache->meshes));
+    cache->mesh_count = 0;
+    cache->vertex_count = 0;
+    cache->index_count = 0;
+}
+
+internal void tessellation_push_vertex(f32* vertices, u32* index, f32 x, f32 y)
+{
+    // NOTE(lucas): Vertex colors are white. The shape color comes from the color uniform.
+    vertices[(*index)++] = x;
+    vertices[(*index)++] = y;
+    vertices[(*index)++] = 1.0f;
+    vertices[(*index)++] = 1.0f;
+    vertices[(*index)++] = 1.0f;
+    vertices[(*index)++] = 1.0f;
+}
+
+// Build a band between two radii as a strip of quads, from angle 0 to span.
+internal void tessellation_push_band(f32* vertices, u32* vertex_index, u32* indices, u32* index_index,
+                                     u32 steps, f32 span, f32 k_in, f32 k_out)
+{
+    u32 first = *vertex_index / RENDER_BATCH_VERTEX_FLOATS;
+    f32 angle_delta = span / steps;
+    for (u32 i = 0; i <= steps; ++i)
     {
         f32 a = glm_rad(angle_delta*i);
-        vertices[index++] = cos_f32(a);
-        vertices[index++] = sin_f32(a);
+        f32 c = cos_f32(a);
+        f32 s = sin_f32(a);
+        tessellation_push_vertex(vertices, vertex_index, k_in*c, k_in*s);
+        tessellation_push_vertex(vertices, vertex_index, k_out*c, k_out*s);
+    }
 
-        vertices[index++] = cmd->color.r;
-        vertices[index++] = cmd->color.g;
-        vertices[index++] = cmd->color.b;
-        vertices[index++] = cmd->color.a;
+    for (u32 i = 0; i < 2*steps; ++i)
+    {
+        indices[(*index_index)++] = first + i;
+        indices[(*index_index)++] = first + i + 1;
+        indices[(*index_index)++] = first + i + 2;
     }
+}
 
-    // Construct tris using indices, where the first vertex is shared by all tris
-    index = 1;
-    for (u32 i = 0; i < n_indices; i += 3)
+// NOTE(lucas): Rings are built with half as many steps as there are segments, to match circles in triangle count
+internal u32 tessellation_ring_steps(u32 segs)
+{
+    u32 result = (segs > 1) ? segs/2 : 1;
+    return result;
+}
+
+internal void tessellation_mesh_size(TessellationMeshType type, u32 segs, u32* n_verts, u32* n_indices)
+{
+    u32 ring_steps = tessellation_ring_steps(segs);
+    switch (type)
     {
-        indices[i] = 0;
-        indices[i+1] = index++;
-        indices[i+2] = index;
+        case TESSELLATION_MESH_CIRCLE:       *n_verts = segs;             *n_indices = 3*(segs - 2);   break;
+        case TESSELLATION_MESH_SECTOR:       *n_verts = segs + 2;         *n_indices = 3*segs;         break;
+        case TESSELLATION_MESH_RING:         *n_verts = 2*(ring_steps+1); *n_indices = 6*ring_steps;   break;
+        case TESSELLATION_MESH_RING_OUTLINE: *n_verts = 4*(ring_steps+1); *n_indices = 12*ring_steps;  break;
+        default: ASSERT(false, "Unknown tessellation mesh type"); break;
     }
+}
 
-    vao_bind(renderer->circle_renderer.vao);
+/* NOTE(lucas): Pick the number of segments for an arc so that the gap between the true arc and its chords
+ * stays under config.circle_max_error pixels. A chord spanning angle t on radius r deviates from the arc by
+ * r*(1 - cos(t/2)), so the largest allowed step is t = 2*acos(1 - error/r).
+ * Shapes are specified in pixels, so radius is already the on-screen radius.
+ * The count is rounded up to a multiple of 4 so that similar sizes share cached meshes.
+ */
+internal u32 tessellation_segments(RendererConfig* config, f32 radius, f32 span)
+{
+    // NOTE(lucas): Meshes divide their span by the segment count, and a full circle needs at least a triangle
+    u32 min_segs = (abs_f32(span) >= 360.0f) ? 3 : 1;
+    if (config->circle_max_error <= 0.0f)
+        return (config->circle_line_segments > min_segs) ? config->circle_line_segments : min_segs;
 
-    glBindBuffer(GL_ARRAY_BUFFER, renderer->circle_renderer.vbo);
-    glBufferData(GL_ARRAY_BUFFER, n_verts*sizeof(f32), vertices, GL_STATIC_DRAW);
+    f32 max_step = 180.0f;
+    if (radius > config->circle_max_error)
+        max_step = glm_deg(2.0f*acos_f32(1.0f - config->circle_max_error/radius));
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, renderer->circle_renderer.ibo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, n_indices*sizeof(u32), indices, GL_STATIC_DRAW);
+    u32 segs = (u32)ceil_f32(abs_f32(span) / max_step);
+    segs = (segs + 3) & ~3u;
 
-    glDrawElements(GL_TRIANGLES, n_indices, GL_UNSIGNED_INT, 0);
-    vao_bind(0);
+    if (segs < config->circle_min_segments)
+        segs = config->circle_min_segments;
+    if (segs > config->circle_max_segments)
+        segs = config->circle_max_segments;
+    if (segs < min_segs)
+        segs = min_segs;
+
+    return segs;
+}
+
+// Track how many vertices the adaptive segment count saved compared to the fixed segment count
+internal void tessellation_count_saved(Renderer* renderer, TessellationMeshType type, u32 segs)
+{
+    u32 fixed_verts = 0;
+    u32 verts = 0;
+    u32 n_indices = 0;
+    tessellation_mesh_size(type, renderer->config.circle_line_segments, &fixed_verts, &n_indices);
+    tessellation_mesh_size(type, segs, &verts, &n_indices);
+
+    renderer->stats.tessellated_vertices += verts;
+    if (fixed_verts > verts)
+        renderer->stats.tessellation_vertices_saved += fixed_verts - verts;
+}
+
+// Tessellate a mesh in unit space and upload it to the end of the cache buffers
+internal TessellationMesh tessellation_build(Renderer* renderer, TessellationKey key)
+{
+    TessellationCache* cache = &renderer->tessellation_cache;
+
+    u32 segs = key.segs;
+    f32 span = (f32)key.span / TESSELLATION_SPAN_STEPS;
+    f32 k0 = (f32)key.k0 / TESSELLATION_RATIO_STEPS;
+    f32 k1 = (f32)key.k1 / TESSELLATION_RATIO_STEPS;
+    u32 ring_steps = tessellation_ring_steps(segs);
+
+    u32 n_verts = 0;
+    u32 n_indices = 0;
+    tessellation_mesh_size(key.type, segs, &n_verts, &n_indices);
+
+    if (cache->vertex_count + n_verts > TESSELLATION_CACHE_MAX_VERTICES ||
+        cache->index_count + n_indices > TESSELLATION_CACHE_MAX_INDICES ||
+        cache->mesh_count >= TESSELLATION_CACHE_MAX_MESHES/2)
+    {
+        log_debug("Tessellation cache full. Clearing %u meshes.", cache->mesh_count);
+        tessellation_cache_clear(cache);
+    }
+
+    f32* vertices = push_array(&renderer->scratch_arena, n_verts*RENDER_BATCH_VERTEX_FLOATS, f32);
+    u32* indices = push_array(&renderer->scratch_arena, n_indices, u32);
+    u32 vertex_index = 0;
+    u32 index_index = 0;
+
+    switch (key.type)
+    {
+        case TESSELLATION_MESH_CIRCLE:
+        {
+            f32 angle_delta = 360.0f / segs;
+            for (u32 i = 0; i < segs; ++i)
+            {
+                f32 a = glm_rad(angle_delta*i);
+                tessellation_push_vertex(vertices, &vertex_index, cos_f32(a), sin_f32(a));
+            }
+
+            // Construct tris using indices, where the first vertex is shared by all tris
+            for (u32 i = 1; i < segs - 1; ++i)
+            {
+                indices[index_index++] = 0;
+                indices[index_index++] = i;
+                indices[index_index++] = i + 1;
+            }
+        } break;
+
+        case TESSELLATION_MESH_SECTOR:
+        {
+            // NOTE(lucas): For drawing circle sectors, it is easiest for vertices to share the center of the circle.
+            tessellation_push_vertex(vertices, &vertex_index, 0.0f, 0.0f);
+
+            f32 angle_delta = span / segs;
+            for (u32 i = 0; i <= segs; ++i)
+            {
+                f32 a = glm_rad(angle_delta*i);
+                tessellation_push_vertex(vertices, &vertex_index, cos_f32(a), sin_f32(a));
+            }
+
+            for (u32 i = 1; i <= segs; ++i)
+            {
+                indices[index_index++] = 0;
+                indices[index_index++] = i;
+                indices[index_index++] = i + 1;
+            }
+        } break;
+
+        case TESSELLATION_MESH_RING:
+        {
+            tessellation_push_band(vertices, &vertex_index, indices, &index_index, ring_steps, span, k0, 1.0f);
+        } break;
+
+        case TESSELLATION_MESH_RING_OUTLINE:
+        {
+            // NOTE(lucas): k0 is the inner radius and k1 is the thickness.
+            // The arc sweeps along +y from the start angle, like the SDF ring shader.
+            tessellation_push_band(vertices, &vertex_index, indices, &index_index, ring_steps, span, k0, k0 + k1);
+            tessellation_push_band(vertices, &vertex_index, indices, &index_index, ring_steps, span, 1.0f - k1, 1.0f);
+        } break;
+
+        default: break;
+    }
+
+    TessellationMesh mesh = {0};
+    mesh.key = key;
+    mesh.base_vertex = cache->vertex_count;
+    mesh.first_index = cache->index_count;
+    mesh.index_count = index_index;
+
+    gl_bind_buffer(GL_ARRAY_BUFFER, renderer->circle_renderer.vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, mesh.base_vertex*RENDER_BATCH_VERTEX_FLOATS*sizeof(f32),
+                    n_verts*RENDER_BATCH_VERTEX_FLOATS*sizeof(f32), vertices);
+    gl_bind_buffer(GL_ARRAY_BUFFER, 0);
+
+    gl_bind_buffer(GL_COPY_WRITE_BUFFER, renderer->circle_renderer.ibo);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, mesh.first_index*sizeof(u32), index_index*sizeof(u32), indices);
+    gl_bind_buffer(GL_COPY_WRITE_BUFFER, 0);
+
+    cache->vertex_count += n_verts;
+    cache->index_count += index_index;
+
+    return mesh;
+}
+
+internal TessellationMesh tessellation_get(Renderer* renderer, TessellationKey key)
+{
+    TessellationCache* cache = &renderer->tessellation_cache;
+
+    u32 mask = TESSELLATION_CACHE_MAX_MESHES - 1;
+    u32 slot = tessellation_key_hash(key) & mask;
+    while (cache->meshes[slot].key.type)
+    {
+        if (tessellation_key_eq(cache->meshes[slot].key, key))
+        {
+            ++renderer->stats.tessellation_hits;
+            return cache->meshes[slot];
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    ++renderer->stats.tessellation_misses;
+    u32 mesh_count = cache->mesh_count;
+    TessellationMesh mesh = tessellation_build(renderer, key);
+
+    // NOTE(lucas): Building may have cleared the cache, which invalidates the probed slot
+    if (cache->mesh_count != mesh_count)
+        slot = tessellation_key_hash(key) & mask;
+    while (cache->meshes[slot].key.type)
+        slot = (slot + 1) & mask;
+
+    cache->meshes[slot] = mesh;
+    ++cache->mesh_count;
+
+    return mesh;
+}
+
+internal void tessellation_draw(Renderer* renderer, TessellationKey key, m4 model, v4 color)
+{
+    tessellation_count_saved(renderer, key.type, key.segs);
+    TessellationMesh mesh = tessellation_get(renderer, key);
+
+    shader_set_m4(renderer->circle_renderer.shader, "model", model, false);
+    shader_set_v4(renderer->circle_renderer.shader, "color", color);
+
+    vao_bind(renderer->circle_renderer.vao);
+    glDrawElementsBaseVertex(GL_TRIANGLES, mesh.index_count, GL_UNSIGNED_INT,
+                             (void*)(mesh.first_index*sizeof(u32)), mesh.base_vertex);
+}
+
+// NOTE(lucas): Meshes start at angle 0, so the start angle is folded into the rotation
+internal m4 arc_model(v2 center, f32 radius, f32 rotation)
+{
+    m4 model = m4_identity();
+    model = m4_translate(model, (v3){center.x, center.y, 0.0f});
+    model = m4_rotate(model, glm_rad(rotation), (v3){0.0f, 0.0f, 1.0f});
+    model = m4_scale(model, (v3){radius, radius, 1.0f});
+    return model;
+}
+
+internal void output_circle(Renderer* renderer, RenderCommandCircle* cmd)
+{
+    u32 segs = tessellation_segments(&renderer->config, cmd->radius, 360.0f);
+    TessellationKey key = {TESSELLATION_MESH_CIRCLE, segs};
+    m4 model = arc_model(cmd->center, cmd->radius, 0.0f);
+    tessellation_draw(renderer, key, model, cmd->color);
 }
 
 internal void output_circle_outline(Renderer* renderer, RenderCommandCircleOutline* cmd)
@@ -802,69 +1523,51 @@ internal void output_circle_outline(Renderer* renderer, RenderCommandCircleOutli
 
 internal void output_circle_sector(Renderer* renderer, RenderCommandCircleSector* cmd)
 {
-    m4 model = m4_identity();
-    model = m4_translate(model, (v3){cmd->center.x, cmd->center.y, 0.0f});
-    model = m4_rotate(model, glm_rad(cmd->rotation), (v3){0.0f, 0.0f, 1.0f});
-    model = m4_scale(model, (v3){cmd->radius, cmd->radius, 1.0f});
-
-    shader_set_m4(renderer->circle_renderer.shader, "model", model, false);
-    shader_set_v4(renderer->circle_renderer.shader, "color", cmd->color);
-
-    u32 segs = renderer->config.circle_line_segments;
-    u32 tris = segs;
-    u32 n_verts = 6*(segs + 2);
-    u32 n_indices = 3*tris;
-    f32* vertices = push_array(&renderer->scratch_arena, n_verts, f32);
-    u32* indices = push_array(&renderer->scratch_arena, n_indices, u32);
-
-    // NOTE(lucas): For drawing circle sectors, it is easiest for vertices to share the center of the circle.
-    vertices[0] = 0.0f;
-    vertices[1] = 0.0f;
-    vertices[2] = cmd->color.r;
-    vertices[3] = cmd->color.g;
-    vertices[4] = cmd->color.b;
-    vertices[5] = cmd->color.a;
-
-    // Construct points from angles of tris
-    f32 angle_delta = abs_f32(cmd->end_angle - cmd->start_angle) / segs;
-    u32 iterations = n_verts/2;
-    u32 index = 6;
-    for (u32 i = 0; i < iterations; ++i)
-    {
-        f32 a = glm_rad(cmd->start_angle + angle_delta*i);
-        vertices[index++] = cos_f32(a);
-        vertices[index++] = sin_f32(a);
-
-        vertices[index++] = cmd->color.r;
-        vertices[index++] = cmd->color.g;
-        vertices[index++] = cmd->color.b;
-        vertices[index++] = cmd->color.a;
-    }
+    f32 span = abs_f32(cmd->end_angle - cmd->start_angle);
+    u32 segs = tessellation_segments(&renderer->config, cmd->radius, span);
+    TessellationKey key = {TESSELLATION_MESH_SECTOR, segs,
+                           tessellation_quantize(span, TESSELLATION_SPAN_STEPS)};
+    m4 model = arc_model(cmd->center, cmd->radius, cmd->rotation + cmd->start_angle);
+    tessellation_draw(renderer, key, model, cmd->color);
+}
 
-    // Construct tris using indices, where the first vertex is shared by all tris
-    index = 1;
-    for (u32 i = 0; i < n_indices; i += 3)
+internal void output_ring(Renderer* renderer, RenderCommandRing* cmd)
+{
+    // NOTE(lucas): Outer radius must be positive and larger than inner radius
+    if (cmd->inner_radius > cmd->outer_radius)
     {
-        indices[i] = 0;
-        indices[i+1] = index++;
-        indices[i+2] = index;
+        f32 temp = cmd->inner_radius;
+        cmd->inner_radius = cmd->outer_radius;
+        cmd->outer_radius = temp;
     }
 
-    vao_bind(renderer->circle_renderer.vao);
-
-    glBindBuffer(GL_ARRAY_BUFFER, renderer->circle_renderer.vbo);
-    glBufferData(GL_ARRAY_BUFFER, n_verts*sizeof(f32), vertices, GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, renderer->circle_renderer.ibo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, n_indices*sizeof(u32), indices, GL_STATIC_DRAW);
+    if (cmd->outer_radius <= 0.0f)
+        cmd->outer_radius = 0.1f;
 
-    glDrawElements(GL_TRIANGLES, n_indices, GL_UNSIGNED_INT, 0);
-    vao_bind(0);
+    f32 span = abs_f32(cmd->end_angle - cmd->start_angle);
+    f32 k = cmd->inner_radius / cmd->outer_radius;
+    u32 segs = 2*tessellation_segments(&renderer->config, cmd->outer_radius, span);
+    TessellationKey key = {TESSELLATION_MESH_RING, segs,
+                           tessellation_quantize(span, TESSELLATION_SPAN_STEPS),
+                           tessellation_quantize(k, TESSELLATION_RATIO_STEPS)};
+    m4 model = arc_model(cmd->center, cmd->outer_radius, cmd->rotation + cmd->start_angle);
+    tessellation_draw(renderer, key, model, cmd->color);
+}
+
+/* NOTE(lucas): Cap lines of a ring outline, from the inner to the outer radius at angle degrees counter-clockwise
+ * about the center, the same way arc_model turns the mesh. quad_model turns quads the other way, so the rotation is
+ * negated.
+ */
+internal RenderCommandQuad ring_cap_quad(RenderCommandRingOutline* cmd, f32 angle)
+{
+    v2 position = v2(cmd->center.x + cmd->inner_radius, cmd->center.y);
+    v2 size = v2(cmd->outer_radius - cmd->inner_radius, cmd->thickness);
+    RenderCommandQuad result = {RENDER_COMMAND_RenderCommandQuad, position, cmd->center, size, cmd->color, -angle};
+    return result;
 }
 
-internal void output_ring(Renderer* renderer, RenderCommandRing* cmd)
+internal void output_ring_outline(Renderer* renderer, RenderCommandRingOutline* cmd)
 {
-    // NOTE(lucas): Outer radius must be positive and larger than inner radius
     if (cmd->inner_radius > cmd->outer_radius)
     {
         f32 temp = cmd->inner_radius;
@@ -875,183 +1578,449 @@ internal void output_ring(Renderer* renderer, RenderCommandRing* cmd)
     if (cmd->outer_radius <= 0.0f)
         cmd->outer_radius = 0.1f;
 
-    m4 model = m4_identity();
-    model = m4_translate(model, (v3){cmd->center.x, cmd->center.y, 0.0f});
-    model = m4_rotate(model, glm_rad(cmd->rotation), (v3){0.0f, 0.0f, 1.0f});
-    model = m4_scale(model, (v3){cmd->outer_radius, cmd->outer_radius, 1.0f});
-
-    shader_set_m4(renderer->circle_renderer.shader, "model", model, false);
-    shader_set_v4(renderer->circle_renderer.shader, "color", cmd->color);
+    f32 span = abs_f32(cmd->end_angle - cmd->start_angle);
+    f32 k_in = cmd->inner_radius / cmd->outer_radius;
+    f32 k_t = cmd->thickness / cmd->outer_radius;
+    u32 segs = 2*tessellation_segments(&renderer->config, cmd->outer_radius, span);
+    TessellationKey key = {TESSELLATION_MESH_RING_OUTLINE, segs,
+                           tessellation_quantize(span, TESSELLATION_SPAN_STEPS),
+                           tessellation_quantize(k_in, TESSELLATION_RATIO_STEPS),
+                           tessellation_quantize(k_t, TESSELLATION_RATIO_STEPS)};
 
-    u32 segs = renderer->config.circle_line_segments;
-    u32 tris = segs;
-    u32 n_verts = 6*(segs + 2);
-    u32 n_indices = 3*tris;
-    f32* vertices = push_array(&renderer->scratch_arena, n_verts, f32);
-    u32* indices = push_array(&renderer->scratch_arena, n_indices, u32);
+    f32 arc_start = cmd->rotation + cmd->start_angle;
+    m4 model = arc_model(cmd->center, cmd->outer_radius, arc_start);
+    tessellation_draw(renderer, key, model, cmd->color);
 
-    // Construct points from angles of tris
-    f32 angle_delta = abs_f32(cmd->end_angle - cmd->start_angle) / segs;
-    u32 index = 0;
-    u32 iterations = n_verts/2;
-    f32 k = cmd->inner_radius / cmd->outer_radius;
-    for (u32 i = 0; i < iterations; i += 2)
+    // NOTE(lucas): Draw cap lines
+    // TODO(lucas): Figure out how to properly include cap lines directly in vertex data?
+    // The mesh sweeps counter-clockwise from the start angle by the span, so the caps go where its ends land.
+    f32 cap_angles[] = {arc_start, arc_start + span};
+    for (u32 i = 0; i < countof(cap_angles); ++i)
     {
-        f32 a = glm_rad(cmd->start_angle + angle_delta*i);
-        vertices[index++] = k*cos_f32(a);
-        vertices[index++] = k*sin_f32(a);
+        RenderCommandQuad cap = ring_cap_quad(cmd, cap_angles[i]);
+
+#ifdef ALCHEMY_DEBUG
+        // NOTE(lucas): The outer end of the cap must meet the end of the arc it closes
+        f32 mesh_angle = rad_f32(cap_angles[i] - arc_start);
+        v2 arc_end = m4_transform_v2(model, v2(cos_f32(mesh_angle), sin_f32(mesh_angle)));
+        v2 cap_end = m4_transform_v2(quad_model(cap.position, cap.origin, cap.size, cap.rotation), v2(1.0f, 0.0f));
+        ASSERTF(v2_mag(v2_sub(arc_end, cap_end)) < 0.01f*cmd->outer_radius + 0.01f,
+                "Ring cap at %.1f degrees ends at (%.2f, %.2f), but the arc ends at (%.2f, %.2f)", cap_angles[i],
+                cap_end.x, cap_end.y, arc_end.x, arc_end.y);
+#endif
+
+        output_quad(renderer, &cap);
+    }
+}
+
+// NOTE(lucas): Rounds outward to whole pixels, so nothing that would be drawn at full resolution is clipped
+internal rect resolution_scale_rect(rect r, v2 scale)
+{
+    f32 x0 = (f32)(i32)(r.x*scale.x);
+    f32 y0 = (f32)(i32)(r.y*scale.y);
+    f32 x1 = (f32)ceil_f32((r.x + r.width)*scale.x);
+    f32 y1 = (f32)ceil_f32((r.y + r.height)*scale.y);
+    rect result = rect_min_dim(v2(x0, y0), v2(x1 - x0, y1 - y0));
+    return result;
+}
+
+internal void resolution_viewport_set(Renderer* renderer)
+{
+    rect viewport = renderer->viewport;
+    if (renderer->resolution.active)
+        viewport = resolution_scale_rect(viewport, renderer->resolution.applied_scale);
+    glViewport((int)viewport.x, (int)viewport.y, (int)viewport.width, (int)viewport.height);
+}
+
+internal void scissor_set(Renderer* renderer, rect clip)
+{
+    // NOTE(lucas): The UI cache is a separate target, so its clip region is redrawn in full regardless of damage
+    if (renderer->ui_cache_drawing)
+        clip = rect_intersect(clip, renderer->ui_cache_clip);
+    else if (renderer->damage.active)
+        clip = rect_intersect(clip, renderer->damage.dirty);
+
+    // NOTE(lucas): Clips are given at full resolution. The UI cache is always drawn at full resolution.
+    if (renderer->resolution.active && !renderer->ui_cache_drawing)
+        clip = resolution_scale_rect(clip, renderer->resolution.applied_scale);
+
+    glEnable(GL_SCISSOR_TEST);
+    glScissor((GLint)clip.x, (GLint)clip.y, (GLsizei)clip.width, (GLsizei)clip.height);
+}
+
+internal void output_scissor_test(Renderer* renderer, RenderCommandScissorTest* cmd)
+{
+    scissor_set(renderer, cmd->clip);
+}
+
+internal void output_ui(Renderer* renderer, RenderCommandUI* cmd)
+{
+    UIState* state = &renderer->ui_state;
+    RenderObject* ui_renderer = &renderer->ui_renderer;
+
+    // NOTE(lucas): Glyphs rasterized while the UI was converted to vertices are still queued
+    renderer_texture_flush(renderer);
 
-        vertices[index++] = cmd->color.r;
-        vertices[index++] = cmd->color.g;
-        vertices[index++] = cmd->color.b;
-        vertices[index++] = cmd->color.a;
+    shader_bind(ui_renderer->shader);
+    shader_set_i32(ui_renderer->shader, "tex", 0);
+    m4 projection = m4_ortho(0.0f, (f32)state->width, (f32)state->height, 0.0f, -1.0f, 1.0f);
+    shader_set_m4(ui_renderer->shader, "projection", projection, false);
 
-        vertices[index++] = cos_f32(a);
-        vertices[index++] = sin_f32(a);
+    vao_bind(ui_renderer->vao);
+    GLint base_vertex = stream_push_vertices(renderer, (f32*)state->vertices, cmd->vertex_bytes, UI_VERTEX_BYTES);
+    size offset = stream_buffer_push(&renderer->index_stream, state->elements, cmd->element_bytes,
+                                     sizeof(nk_draw_index));
 
-        vertices[index++] = cmd->color.r;
-        vertices[index++] = cmd->color.g;
-        vertices[index++] = cmd->color.b;
-        vertices[index++] = cmd->color.a;
+    // NOTE(lucas): The UI is drawn over everything else, so it neither writes nor tests the stencil buffer
+    glDisable(GL_STENCIL_TEST);
+
+    GLenum index_type = (sizeof(nk_draw_index) == 2) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    for (u32 i = 0; i < state->draw_count; ++i)
+    {
+        UIDrawCommand* draw = state->draws + i;
+        rect clip = draw->clip;
+        clip.y = (f32)renderer->window_height - (clip.y + clip.height);
+        clip.width = (clip.width > 0.0f) ? clip.width : 0.0f;
+        clip.height = (clip.height > 0.0f) ? clip.height : 0.0f;
+        scissor_set(renderer, clip);
+
+        texture_bind(draw->texture, 0);
+        glDrawElementsBaseVertex(GL_TRIANGLES, draw->element_count, index_type, (void*)offset, base_vertex);
+        offset += draw->element_count*sizeof(nk_draw_index);
+        ++renderer->stats.ui_draw_calls;
     }
 
-    index = 0;
-    for (u32 i = 0; i < n_indices; i += 3, ++index)
+    scissor_set(renderer, rect_min_dim(v2_zero(), v2((f32)renderer->window_width, (f32)renderer->window_height)));
+    glEnable(GL_STENCIL_TEST);
+}
+
+internal void output_ui_cache_begin(Renderer* renderer, RenderCommandUICacheBegin* cmd)
+{
+    Framebuffer* cache = &renderer->ui_cache_framebuffer;
+    int width = renderer->window_width;
+    int height = renderer->window_height;
+    if (!cache->id)
+        *cache = framebuffer_init(renderer->framebuffer_renderer.shader, width, height, 0, false);
+
+    // NOTE(lucas): Framebuffer textures are RGB, but the cache needs alpha to be composited over the frame
+    RenderTargetState* cache_state = renderer->render_targets.targets + RenderTarget_UICache;
+    if (cache_state->width != width || cache_state->height != height)
     {
-        indices[i] = index;
-        indices[i+1] = index+1;
-        indices[i+2] = index+2;
+        gl_bind_texture(GL_TEXTURE_2D, cache->texture.id);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        rbo_bind(cache->rbo);
+        rbo_update(width, height, 0);
+        rbo_unbind();
+        cache->texture.size = v2((f32)width, (f32)height);
+        render_target_event(renderer, RenderTargetEvent_Allocate, RenderTarget_UICache, width, height, 0);
     }
 
-    vao_bind(renderer->circle_renderer.vao);
+    renderer->ui_cache_start = time_ticks();
+    fbo_bind(cache->id);
+    if (renderer->resolution.active)
+        renderer_viewport(renderer, renderer->viewport);
 
-    glBindBuffer(GL_ARRAY_BUFFER, renderer->circle_renderer.vbo);
-    glBufferData(GL_ARRAY_BUFFER, n_verts*sizeof(f32), vertices, GL_STATIC_DRAW);
+    renderer->ui_cache_clip = cmd->clip;
+    renderer->ui_cache_drawing = true;
+    scissor_set(renderer, cmd->clip);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, renderer->circle_renderer.ibo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, n_indices*sizeof(u32), indices, GL_STATIC_DRAW);
+    f32 clear_color[4];
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, clear_color);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    glClearColor(clear_color[0], clear_color[1], clear_color[2], clear_color[3]);
 
-    glDrawElements(GL_TRIANGLES, n_indices, GL_UNSIGNED_INT, 0);
-    vao_bind(0);
+    // NOTE(lucas): Blending into a transparent target with straight alpha leaves premultiplied color in the cache
+    // and keeps its alpha correct, so it is composited with premultiplied blending.
+    glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
 }
 
-internal void output_ring_outline(Renderer* renderer, RenderCommandRingOutline* cmd)
+internal void output_ui_cache_composite(Renderer* renderer)
 {
-    if (cmd->inner_radius > cmd->outer_radius)
+    UIRenderCache* ui_cache = &renderer->ui_state.render_cache;
+    Framebuffer* cache = &renderer->ui_cache_framebuffer;
+    if (!cache->id)
+        return;
+
+    // NOTE(lucas): Batches were already flushed, since this command can't be batched
+    if (renderer->ui_cache_drawing)
     {
-        f32 temp = cmd->inner_radius;
-        cmd->inner_radius = cmd->outer_radius;
-        cmd->outer_radius = temp;
+        renderer->ui_cache_drawing = false;
+        fbo_bind(renderer->framebuffer.id);
+        resolution_viewport_set(renderer);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+        f32 redraw_ms = ui_cache->translate_ms + (f32)time_ticks_to_ms(time_ticks() - renderer->ui_cache_start);
+        if (ui_cache->full_redraw)
+            ui_cache->full_redraw_ms = redraw_ms;
+        else if (ui_cache->full_redraw_ms > redraw_ms)
+            ui_cache->saved_ms = ui_cache->full_redraw_ms - redraw_ms;
     }
 
-    if (cmd->outer_radius <= 0.0f)
-        cmd->outer_radius = 0.1f;
+    scissor_set(renderer, rect_min_dim(v2_zero(), v2((f32)renderer->window_width, (f32)renderer->window_height)));
+    glDisable(GL_STENCIL_TEST);
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
 
-    m4 model = m4_identity();
-    model = m4_translate(model, (v3){cmd->center.x, cmd->center.y, 0.0f});
-    model = m4_rotate(model, glm_rad(cmd->rotation), (v3){0.0f, 0.0f, 1.0f});
-    model = m4_scale(model, (v3){cmd->outer_radius, cmd->outer_radius, 1.0f});
+    shader_bind(renderer->framebuffer_renderer.shader);
+    shader_set_v2(renderer->framebuffer_renderer.shader, "tex_scale", v2(1.0f, 1.0f));
+    shader_set_v2(renderer->framebuffer_renderer.shader, "tex_max", v2(1.0f, 1.0f));
+    vao_bind(renderer->framebuffer_renderer.vao);
+    texture_bind(&cache->texture, 0);
+    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 
-    shader_set_m4(renderer->circle_renderer.shader, "model", model, false);
-    shader_set_v4(renderer->circle_renderer.shader, "color", cmd->color);
-
-    u32 segs = renderer->config.circle_line_segments;
-    // u32 tris = 2*segs + 14;
-    // u32 n_verts = 4*segs + 28;
-    u32 tris = 4*segs;
-    u32 n_verts = 24*segs;
-    u32 n_indices = 3*tris;
-    f32* vertices = push_array(&renderer->scratch_arena, n_verts, f32);
-    u32* indices = push_array(&renderer->scratch_arena, n_indices, u32);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glEnable(GL_STENCIL_TEST);
+}
 
-    // Construct points from angles of tris
-    f32 angle_delta = abs_f32(cmd->end_angle - cmd->start_angle) / segs;
-    u32 index = 0;
-    u32 iterations = n_verts/4 - 2;
-    f32 k_in = cmd->inner_radius / cmd->outer_radius;
-    f32 k_t = cmd->thickness / cmd->outer_radius;
+internal void render_batch_flush(Renderer* renderer)
+{
+    RenderBatch* batch = &renderer->batch;
+    if (!batch->index_count)
+        return;
 
-    // NOTE(lucas): inner edge
-    for (u32 i = 0; i <= segs; i += 2)
-    {
-        f32 a_deg = cmd->start_angle + angle_delta*i;
-        f32 a = glm_rad(a_deg);
-        vertices[index++] = k_in*cos_f32(a);
-        vertices[index++] = -k_in*sin_f32(a);
+    // NOTE(lucas): Batched vertices are already in world space and carry their own color
+    u32 shader = renderer->batch_renderer.shader;
+    shader_set_m4(shader, "model", m4_identity(), false);
+    shader_set_v4(shader, "color", color_white());
 
-        vertices[index++] = cmd->color.r;
-        vertices[index++] = cmd->color.g;
-        vertices[index++] = cmd->color.b;
-        vertices[index++] = cmd->color.a;
+    vao_bind(renderer->batch_renderer.vao);
+    stream_draw_poly(renderer, batch->vertices, batch->vertex_count, batch->indices, batch->index_count);
 
-        vertices[index++] = (k_in + k_t)*cos_f32(a);
-        vertices[index++] = -(k_in + k_t)*sin_f32(a);
+    ++renderer->stats.batch_draw_calls;
+    renderer->stats.draws_merged += batch->command_count - 1;
 
-        vertices[index++] = cmd->color.r;
-        vertices[index++] = cmd->color.g;
-        vertices[index++] = cmd->color.b;
-        vertices[index++] = cmd->color.a;
-    }
+    batch->vertex_count = 0;
+    batch->index_count = 0;
+    batch->command_count = 0;
+}
 
-    // NOTE(lucas): outer edge
-    for (u32 i = 0; i <= segs; i += 2)
-    {
-        f32 a_deg = cmd->end_angle - angle_delta*i;
-        f32 a = glm_rad(a_deg);
-        vertices[index++] = cos_f32(a);
-        vertices[index++] = -sin_f32(a);
+// NOTE(lucas): Make sure there is room in the batch for the given number of vertices and indices,
+// and flush if there is not. Returns the index of the first vertex that will be written.
+internal u32 render_batch_reserve(Renderer* renderer, u32 n_verts, u32 n_indices)
+{
+    RenderBatch* batch = &renderer->batch;
+    ASSERT(n_verts <= batch->max_vertices && n_indices <= batch->max_indices, "Render batch is too small");
 
-        vertices[index++] = cmd->color.r;
-        vertices[index++] = cmd->color.g;
-        vertices[index++] = cmd->color.b;
-        vertices[index++] = cmd->color.a;
+    if ((batch->vertex_count + n_verts > batch->max_vertices) || (batch->index_count + n_indices > batch->max_indices))
+        render_batch_flush(renderer);
 
-        vertices[index++] = (1.0f - k_t)*cos_f32(a);
-        vertices[index++] = -(1.0f - k_t)*sin_f32(a);
+    ++batch->command_count;
+    ++renderer->stats.batched_commands;
+    return batch->vertex_count;
+}
 
-        vertices[index++] = cmd->color.r;
-        vertices[index++] = cmd->color.g;
-        vertices[index++] = cmd->color.b;
-        vertices[index++] = cmd->color.a;
-    }
+internal void render_batch_push_vertex(RenderBatch* batch, v2 pos, v4 color)
+{
+    f32* v = batch->vertices + batch->vertex_count*RENDER_BATCH_VERTEX_FLOATS;
+    v[0] = pos.x;
+    v[1] = pos.y;
+    v[2] = color.r;
+    v[3] = color.g;
+    v[4] = color.b;
+    v[5] = color.a;
+    ++batch->vertex_count;
+}
+
+internal void render_batch_push_triangle(RenderBatch* batch, u32 a, u32 b, u32 c)
+{
+    batch->indices[batch->index_count++] = a;
+    batch->indices[batch->index_count++] = b;
+    batch->indices[batch->index_count++] = c;
+}
+
+internal void batch_triangle(Renderer* renderer, v2 a, v2 b, v2 c, v2 origin, f32 rotation,
+                             v4 color_a, v4 color_b, v4 color_c)
+{
+    v2 norm[3];
+    m4 model = triangle_model(a, b, c, origin, rotation, norm);
+
+    RenderBatch* batch = &renderer->batch;
+    u32 first = render_batch_reserve(renderer, 3, 3);
+    render_batch_push_vertex(batch, m4_transform_v2(model, norm[0]), color_a);
+    render_batch_push_vertex(batch, m4_transform_v2(model, norm[1]), color_b);
+    render_batch_push_vertex(batch, m4_transform_v2(model, norm[2]), color_c);
+    render_batch_push_triangle(batch, first, first+1, first+2);
+}
+
+internal void batch_quad(Renderer* renderer, v2 position, v2 origin, v2 size, f32 rotation,
+                         v4 color_bl, v4 color_br, v4 color_tr, v4 color_tl)
+{
+    m4 model = quad_model(position, origin, size, rotation);
+
+    RenderBatch* batch = &renderer->batch;
+    u32 first = render_batch_reserve(renderer, 4, 6);
+    render_batch_push_vertex(batch, m4_transform_v2(model, v2(0.0f, 0.0f)), color_bl);
+    render_batch_push_vertex(batch, m4_transform_v2(model, v2(1.0f, 0.0f)), color_br);
+    render_batch_push_vertex(batch, m4_transform_v2(model, v2(1.0f, 1.0f)), color_tr);
+    render_batch_push_vertex(batch, m4_transform_v2(model, v2(0.0f, 1.0f)), color_tl);
+    render_batch_push_triangle(batch, first, first+1, first+3);
+    render_batch_push_triangle(batch, first+1, first+2, first+3);
+}
+
+internal void batch_line(Renderer* renderer, RenderCommandLine* cmd)
+{
+    RenderCommandQuad quad = line_to_quad(cmd);
+    batch_quad(renderer, quad.position, quad.origin, quad.size, quad.rotation,
+               quad.color, quad.color, quad.color, quad.color);
+}
+
+internal ShapeBatch shape_batch_alloc(MemoryArena* arena, u32 max_count)
+{
+    ShapeBatch batch = {0};
+    batch.instances = push_array(arena, max_count, ShapeInstance);
+    batch.max_count = max_count;
+    return batch;
+}
 
-    index = 0;
-    for (u32 i = 0; i < n_indices; i += 3, ++index)
+internal void shape_batch_flush(Renderer* renderer)
+{
+    ShapeBatch* batch = &renderer->shape_batch;
+    if (!batch->count)
+        return;
+
+    size bytes = batch->count*sizeof(ShapeInstance);
+    size offset = stream_buffer_push(&renderer->vertex_stream, batch->instances, bytes, sizeof(ShapeInstance));
+    GLuint base_instance = (GLuint)(offset / sizeof(ShapeInstance));
+
+    shader_bind(renderer->shape_renderer.shader);
+    vao_bind(renderer->shape_renderer.vao);
+    glDrawElementsInstancedBaseInstance(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0, batch->count, base_instance);
+
+    ++renderer->stats.shape_draw_calls;
+    renderer->stats.shape_instances += batch->count;
+
+    batch->count = 0;
+}
+
+internal ShapeInstance* shape_batch_push(Renderer* renderer, ShapeKind kind, v4 color, f32 thickness)
+{
+    ShapeBatch* batch = &renderer->shape_batch;
+    if (batch->count >= batch->max_count)
+        shape_batch_flush(renderer);
+
+    ShapeInstance* instance = batch->instances + batch->count++;
+    *instance = (ShapeInstance){0};
+    instance->kind = (f32)kind;
+    instance->color = color;
+    instance->thickness = thickness;
+    return instance;
+}
+
+// Rotate point p about origin by angle in radians
+internal v2 rotate_about(v2 p, v2 origin, f32 angle)
+{
+    f32 c = cos_f32(angle);
+    f32 s = sin_f32(angle);
+    v2 d = v2_sub(p, origin);
+    v2 result = v2(origin.x + c*d.x - s*d.y, origin.y + s*d.x + c*d.y);
+    return result;
+}
+
+internal void shape_circle(Renderer* renderer, v2 center, f32 radius, v4 color, f32 thickness)
+{
+    ShapeInstance* shape = shape_batch_push(renderer, SHAPE_CIRCLE, color, thickness);
+    shape->center = center;
+    shape->half_size = v2_full(radius);
+    shape->params.x = radius;
+}
+
+// NOTE(lucas): Angles are in degrees, matching the draw functions
+internal void shape_arc(Renderer* renderer, v2 center, f32 outer_radius, f32 inner_radius, f32 start_angle,
+                        f32 end_angle, f32 rotation, v4 color, f32 thickness)
+{
+    if (inner_radius > outer_radius)
     {
-        indices[i] = index;
-        indices[i+1] = index+1;
-        indices[i+2] = index+2;
+        f32 temp = inner_radius;
+        inner_radius = outer_radius;
+        outer_radius = temp;
     }
 
-    vao_bind(renderer->circle_renderer.vao);
+    ShapeInstance* shape = shape_batch_push(renderer, SHAPE_ARC, color, thickness);
+    shape->center = center;
+    shape->half_size = v2_full(outer_radius);
+    shape->rotation = glm_rad(rotation + start_angle);
+    shape->params.x = outer_radius;
+    shape->params.y = inner_radius;
+    shape->params.z = glm_rad(abs_f32(end_angle - start_angle));
+}
+
+// NOTE(lucas): Quads rotate about their origin, so the center is rotated into place on the CPU
+internal void shape_rounded_rect(Renderer* renderer, v2 position, v2 origin, v2 size, f32 radius, f32 rotation,
+                                 v4 color, f32 thickness)
+{
+    v2 half_size = v2_scale(v2_abs(size), 0.5f);
+    f32 angle = glm_rad(-rotation);
+    v2 center = rotate_about(v2_add(position, v2_scale(size, 0.5f)), origin, angle);
 
-    glBindBuffer(GL_ARRAY_BUFFER, renderer->circle_renderer.vbo);
-    glBufferData(GL_ARRAY_BUFFER, n_verts*sizeof(f32), vertices, GL_STATIC_DRAW);
+    ShapeInstance* shape = shape_batch_push(renderer, SHAPE_ROUNDED_RECT, color, thickness);
+    shape->center = center;
+    shape->half_size = half_size;
+    shape->rotation = angle;
+    shape->params.x = clamp_f32(radius, 0.0f, (half_size.x < half_size.y) ? half_size.x : half_size.y);
+}
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, renderer->circle_renderer.ibo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, n_indices*sizeof(u32), indices, GL_STATIC_DRAW);
+internal void shape_triangle(Renderer* renderer, v2 a, v2 b, v2 c, v2 origin, f32 rotation, v4 color, f32 thickness)
+{
+    v2 min_point = v2(fminf(a.x, fminf(b.x, c.x)), fminf(a.y, fminf(b.y, c.y)));
+    v2 max_point = v2(fmaxf(a.x, fmaxf(b.x, c.x)), fmaxf(a.y, fmaxf(b.y, c.y)));
+    v2 half_size = v2_scale(v2_sub(max_point, min_point), 0.5f);
+    v2 local_center = v2_add(min_point, half_size);
+    f32 angle = glm_rad(-rotation);
 
-    glDrawElements(GL_TRIANGLES, n_indices, GL_UNSIGNED_INT, 0);
-    vao_bind(0);
+    ShapeInstance* shape = shape_batch_push(renderer, SHAPE_TRIANGLE, color, thickness);
+    shape->center = rotate_about(local_center, origin, angle);
+    shape->half_size = half_size;
+    shape->rotation = angle;
 
-    // NOTE(lucas): Draw cap lines
-    // TODO(lucas): Figure out how to properly include cap lines directly in vertex data?
-    v2 cap_start = {cmd->center.x + cmd->inner_radius, cmd->center.y};
-    v2 cap_end = {cmd->center.x + cmd->outer_radius, cmd->center.y};
+    v2 local_a = v2_sub(a, local_center);
+    v2 local_b = v2_sub(b, local_center);
+    shape->params = (v4){local_a.x, local_a.y, local_b.x, local_b.y};
+    shape->params_ext = v2_sub(c, local_center);
+}
 
-    RenderCommandLine start_cap = {RENDER_COMMAND_RenderCommandLine, cmd->color, cap_start, cap_end, cmd->center,
-                                   cmd->thickness, cmd->start_angle + cmd->rotation};
-    RenderCommandLine end_cap = {RENDER_COMMAND_RenderCommandLine, cmd->color, cap_start, cap_end, cmd->center,
-                                 cmd->thickness, cmd->end_angle + cmd->rotation};
+// NOTE(lucas): Poly batchable commands all use the poly shader with no texture and no stencil tricks.
+// Shape batchable commands are drawn by the shape shader. Any other command changes state,
+// so both batches must be flushed before it is output.
+internal b32 render_command_is_batchable(RenderCommandType type)
+{
+    b32 result = false;
+    switch (type)
+    {
+        case RENDER_COMMAND_RenderCommandLine:
+        case RENDER_COMMAND_RenderCommandTriangle:
+        case RENDER_COMMAND_RenderCommandTriangleGradient:
+        case RENDER_COMMAND_RenderCommandQuad:
+        case RENDER_COMMAND_RenderCommandQuadGradient:
+            result = true;
+            break;
 
-    output_line(renderer, &start_cap);
-    output_line(renderer, &end_cap);
+        default: break;
+    }
+    return result;
 }
 
-internal void output_scissor_test(Renderer* renderer, RenderCommandScissorTest* cmd)
+internal b32 render_command_is_shape(RendererConfig* config, RenderCommandType type)
 {
-    glEnable(GL_SCISSOR_TEST);
-    glScissor((GLint)cmd->clip.x, (GLint)cmd->clip.y, (GLsizei)cmd->clip.width, (GLsizei)cmd->clip.height);
+    b32 result = false;
+    switch (type)
+    {
+        case RENDER_COMMAND_RenderCommandQuadRounded:
+            result = true;
+            break;
+
+        case RENDER_COMMAND_RenderCommandTriangleOutline:
+        case RENDER_COMMAND_RenderCommandQuadOutline:
+        case RENDER_COMMAND_RenderCommandCircle:
+        case RENDER_COMMAND_RenderCommandCircleOutline:
+        case RENDER_COMMAND_RenderCommandCircleSector:
+        case RENDER_COMMAND_RenderCommandRing:
+        case RENDER_COMMAND_RenderCommandRingOutline:
+            result = config->sdf_shapes;
+            break;
+
+        default: break;
+    }
+    return result;
 }
 
 internal RenderCommandBuffer render_command_buffer_alloc(MemoryArena* arena, size max_bytes)
@@ -1068,6 +2037,25 @@ internal void render_command_buffer_clear(RenderCommandBuffer* command_buffer)
     command_buffer->bytes = 0;
 }
 
+internal GPUPass render_command_gpu_pass(RenderCommandType type)
+{
+    GPUPass result = GPUPass_Shapes;
+    switch (type)
+    {
+        case RENDER_COMMAND_RenderCommandSprite: result = GPUPass_Sprites; break;
+        case RENDER_COMMAND_RenderCommandText:   result = GPUPass_Text; break;
+
+        case RENDER_COMMAND_RenderCommandUI:
+        case RENDER_COMMAND_RenderCommandUICacheBegin:
+        case RENDER_COMMAND_RenderCommandUICacheComposite:
+            result = GPUPass_UI;
+            break;
+
+        default: break;
+    }
+    return result;
+}
+
 #define render_command_push(buffer, type) (type*)render_command_push_(buffer, sizeof(type), RENDER_COMMAND_##type)
 internal RenderCommand* render_command_push_(RenderCommandBuffer* command_buffer, size bytes, RenderCommandType type)
 {
@@ -1085,123 +2073,770 @@ internal RenderCommand* render_command_push_(RenderCommandBuffer* command_buffer
     return result;
 }
 
+// NOTE(lucas): Set between renderer_thread_begin and renderer_thread_end on the recording thread
+thread_global RenderThreadBuffer* render_thread_buffer;
+
+internal RenderCommandBuffer* renderer_command_buffer(Renderer* renderer)
+{
+    RenderCommandBuffer* result = render_thread_buffer ? &render_thread_buffer->command_buffer : &renderer->command_buffer;
+    return result;
+}
+
+internal MemoryArena* renderer_command_arena(Renderer* renderer)
+{
+    MemoryArena* result = render_thread_buffer ? &render_thread_buffer->scratch_arena : &renderer->scratch_arena;
+    return result;
+}
+
+internal int render_command_segment_compare(const void* a, const void* b)
+{
+    RenderCommandSegment* segment_a = (RenderCommandSegment*)a;
+    RenderCommandSegment* segment_b = (RenderCommandSegment*)b;
+    int result = 0;
+    if (segment_a->key != segment_b->key)
+        result = (segment_a->key < segment_b->key) ? -1 : 1;
+    else if (segment_a->thread != segment_b->thread)
+        result = (segment_a->thread < segment_b->thread) ? -1 : 1;
+    else if (segment_a->sequence != segment_b->sequence)
+        result = (segment_a->sequence < segment_b->sequence) ? -1 : 1;
+    return result;
+}
+
+// NOTE(lucas): Appends every recorded segment to the main command buffer in key order. The segments' commands
+// may point into their thread's scratch arena, which is only cleared once the frame has been drawn.
+internal void render_thread_buffers_merge(Renderer* renderer)
+{
+    u32 segment_count = 0;
+    for (u32 i = 0; i < renderer->thread_count; ++i)
+    {
+        ASSERTF(!atomic_load_i64(&renderer->thread_buffers[i].recording), "Thread %u is still recording commands", i);
+        segment_count += renderer->thread_buffers[i].segment_count;
+    }
+    if (!segment_count)
+        return;
+
+    RenderCommandSegment* segments = push_array(&renderer->scratch_arena, segment_count, RenderCommandSegment);
+    u32 segment_index = 0;
+    for (u32 i = 0; i < renderer->thread_count; ++i)
+    {
+        RenderThreadBuffer* thread_buffer = renderer->thread_buffers + i;
+        for (u32 j = 0; j < thread_buffer->segment_count; ++j)
+            segments[segment_index++] = thread_buffer->segments[j];
+    }
+    qsort(segments, segment_count, sizeof(RenderCommandSegment), render_command_segment_compare);
+
+    RenderCommandBuffer* command_buffer = &renderer->command_buffer;
+    for (u32 i = 0; i < segment_count; ++i)
+    {
+        RenderCommandSegment* segment = segments + i;
+        if (command_buffer->bytes + segment->bytes >= command_buffer->max_bytes)
+        {
+            INVALID_CODE_PATH();
+            break;
+        }
+
+        u8* src = renderer->thread_buffers[segment->thread].command_buffer.base + segment->offset;
+        memcpy(command_buffer->base + command_buffer->bytes, src, segment->bytes);
+        command_buffer->bytes += segment->bytes;
+        renderer->stats.thread_command_bytes += segment->bytes;
+    }
+    renderer->stats.thread_segments = segment_count;
+}
+
 internal void render_command_buffer_output(Renderer* renderer)
 {
+    PROFILE_BEGIN("render_command_buffer_output");
     RenderCommandBuffer* command_buffer = &renderer->command_buffer;
+    b32 batching = renderer->config.batching;
+    b32 sdf = renderer->config.sdf_shapes;
+
+    // NOTE(lucas): A GPU scope covers each run of commands of the same pass, or of the same type when profiling
+    // commands. Scissor tests don't draw anything, so they don't end a run.
+    GPUProfiler* profiler = &renderer->gpu_profiler;
+    b32 profile_commands = renderer->config.gpu_profile_commands;
+    u32 gpu_scope = GPU_SCOPE_NONE;
+    u32 gpu_run = GPU_SCOPE_NONE;
+
     for (size base_address = 0; base_address < command_buffer->bytes;)
     {
         // TODO(lucas): This can probably be collapsed into a macro
         RenderCommand* header = (RenderCommand*)(command_buffer->base + base_address);
+
+        // NOTE(lucas): Only one of the batches may hold commands at a time so that draw order is preserved
+        if (!batching || !render_command_is_batchable(header->type))
+            render_batch_flush(renderer);
+        if (!render_command_is_shape(&renderer->config, header->type))
+            shape_batch_flush(renderer);
+        if (!batching || header->type != RENDER_COMMAND_RenderCommandSprite)
+            sprite_batch_flush(renderer);
+
+        if (profiler->recording && header->type != RENDER_COMMAND_RenderCommandScissorTest)
+        {
+            GPUPass pass = render_command_gpu_pass(header->type);
+            u32 run = profile_commands ? (u32)header->type : (u32)pass;
+            if (run != gpu_run)
+            {
+                gpu_profiler_end(profiler, gpu_scope);
+                gpu_scope = gpu_profiler_begin(profiler, pass, profile_commands ? (u32)header->type : GPU_SCOPE_NONE);
+                gpu_run = run;
+            }
+        }
+
         switch(header->type)
         {
             case RENDER_COMMAND_RenderCommandLine:
             {
                 RenderCommandLine* cmd = (RenderCommandLine*)header;
-                output_line(renderer, cmd);
+                if (batching)
+                    batch_line(renderer, cmd);
+                else
+                    output_line(renderer, cmd);
                 base_address += sizeof(*cmd);
             } break;
 
             case RENDER_COMMAND_RenderCommandTriangle:
             {
                 RenderCommandTriangle* cmd = (RenderCommandTriangle*)header;
-                output_triangle(renderer, cmd);
+                if (batching)
+                    batch_triangle(renderer, cmd->a, cmd->b, cmd->c, cmd->origin, cmd->rotation,
+                                   cmd->color, cmd->color, cmd->color);
+                else
+                    output_triangle(renderer, cmd);
                 base_address += sizeof(*cmd);
             } break;
 
             case RENDER_COMMAND_RenderCommandTriangleOutline:
             {
                 RenderCommandTriangleOutline* cmd = (RenderCommandTriangleOutline*)header;
-                output_triangle_outline(renderer, cmd);
+                if (sdf)
+                    shape_triangle(renderer, cmd->a, cmd->b, cmd->c, cmd->origin, cmd->rotation, cmd->color,
+                                   cmd->thickness);
+                else
+                    output_triangle_outline(renderer, cmd);
                 base_address += sizeof(*cmd);
             } break;
 
             case RENDER_COMMAND_RenderCommandTriangleGradient:
             {
                 RenderCommandTriangleGradient* cmd = (RenderCommandTriangleGradient*)header;
-                output_triangle_gradient(renderer, cmd);
+                if (batching)
+                    batch_triangle(renderer, cmd->a, cmd->b, cmd->c, cmd->origin, cmd->rotation,
+                                   cmd->color_a, cmd->color_b, cmd->color_c);
+                else
+                    output_triangle_gradient(renderer, cmd);
                 base_address += sizeof(*cmd);
             } break;
 
             case RENDER_COMMAND_RenderCommandQuad:
             {
                 RenderCommandQuad* cmd = (RenderCommandQuad*)header;
-                output_quad(renderer, cmd);
+                if (batching)
+                    batch_quad(renderer, cmd->position, cmd->origin, cmd->size, cmd->rotation,
+                               cmd->color, cmd->color, cmd->color, cmd->color);
+                else
+                    output_quad(renderer, cmd);
                 base_address += sizeof(*cmd);
             } break;
 
             case RENDER_COMMAND_RenderCommandQuadOutline:
             {
                 RenderCommandQuadOutline* cmd = (RenderCommandQuadOutline*)header;
-                output_quad_outline(renderer, cmd);
+                if (sdf)
+                    shape_rounded_rect(renderer, cmd->position, cmd->origin, cmd->size, 0.0f, cmd->rotation,
+                                       cmd->color, cmd->thickness);
+                else
+                    output_quad_outline(renderer, cmd);
                 base_address += sizeof(*cmd);
             } break;
 
             case RENDER_COMMAND_RenderCommandQuadGradient:
             {
                 RenderCommandQuadGradient* cmd = (RenderCommandQuadGradient*)header;
-                output_quad_gradient(renderer, cmd);
+                if (batching)
+                    batch_quad(renderer, cmd->position, cmd->origin, cmd->size, cmd->rotation,
+                               cmd->color_bl, cmd->color_br, cmd->color_tr, cmd->color_tl);
+                else
+                    output_quad_gradient(renderer, cmd);
+                base_address += sizeof(*cmd);
+            } break;
+
+            case RENDER_COMMAND_RenderCommandQuadRounded:
+            {
+                RenderCommandQuadRounded* cmd = (RenderCommandQuadRounded*)header;
+                shape_rounded_rect(renderer, cmd->position, cmd->origin, cmd->size, cmd->radius, cmd->rotation,
+                                   cmd->color, cmd->thickness);
                 base_address += sizeof(*cmd);
             } break;
 
-            case RENDER_COMMAND_RenderCommandCircle:
-            {
-                RenderCommandCircle* cmd = (RenderCommandCircle*)header;
-                output_circle(renderer, cmd);
-                base_address += sizeof(*cmd);
-            } break;
+            case RENDER_COMMAND_RenderCommandCircle:
+            {
+                RenderCommandCircle* cmd = (RenderCommandCircle*)header;
+                if (sdf)
+                    shape_circle(renderer, cmd->center, cmd->radius, cmd->color, 0.0f);
+                else
+                    output_circle(renderer, cmd);
+                base_address += sizeof(*cmd);
+            } break;
+
+            case RENDER_COMMAND_RenderCommandCircleOutline:
+            {
+                RenderCommandCircleOutline* cmd = (RenderCommandCircleOutline*)header;
+                if (sdf)
+                    shape_circle(renderer, cmd->center, cmd->radius, cmd->color, cmd->thickness);
+                else
+                    output_circle_outline(renderer, cmd);
+                base_address += sizeof(*cmd);
+            } break;
+
+            case RENDER_COMMAND_RenderCommandCircleSector:
+            {
+                RenderCommandCircleSector* cmd = (RenderCommandCircleSector*)header;
+                if (sdf)
+                    shape_arc(renderer, cmd->center, cmd->radius, 0.0f, cmd->start_angle, cmd->end_angle,
+                              cmd->rotation, cmd->color, 0.0f);
+                else
+                    output_circle_sector(renderer, cmd);
+                base_address += sizeof(*cmd);
+            } break;
+
+            case RENDER_COMMAND_RenderCommandRing:
+            {
+                RenderCommandRing* cmd = (RenderCommandRing*)header;
+                if (sdf)
+                    shape_arc(renderer, cmd->center, cmd->outer_radius, cmd->inner_radius, cmd->start_angle,
+                              cmd->end_angle, cmd->rotation, cmd->color, 0.0f);
+                else
+                    output_ring(renderer, cmd);
+                base_address += sizeof(*cmd);
+            } break;
+
+            case RENDER_COMMAND_RenderCommandRingOutline:
+            {
+                RenderCommandRingOutline* cmd = (RenderCommandRingOutline*)header;
+
+                // NOTE(lucas): The SDF outline includes the end caps
+                if (sdf)
+                    shape_arc(renderer, cmd->center, cmd->outer_radius, cmd->inner_radius, cmd->start_angle,
+                              cmd->end_angle, cmd->rotation, cmd->color, cmd->thickness);
+                else
+                    output_ring_outline(renderer, cmd);
+                base_address += sizeof(*cmd);
+            } break;
+
+            case RENDER_COMMAND_RenderCommandSprite:
+            {
+                RenderCommandSprite* cmd = (RenderCommandSprite*)header;
+                if (batching)
+                    sprite_batch_push(renderer, &cmd->sprite);
+                else
+                    output_sprite(renderer, cmd);
+                base_address += sizeof(*cmd);
+            } break;
+
+            case RENDER_COMMAND_RenderCommandText:
+            {
+                RenderCommandText* cmd = (RenderCommandText*)header;
+                output_text(renderer, cmd);
+                base_address += sizeof(*cmd);
+            } break;
+
+            case RENDER_COMMAND_RenderCommandScissorTest:
+            {
+                RenderCommandScissorTest* cmd = (RenderCommandScissorTest*)header;
+                output_scissor_test(renderer, cmd);
+                base_address += sizeof(*cmd);
+            } break;
+
+            case RENDER_COMMAND_RenderCommandUI:
+            {
+                RenderCommandUI* cmd = (RenderCommandUI*)header;
+                output_ui(renderer, cmd);
+                base_address += sizeof(*cmd);
+            } break;
+
+            case RENDER_COMMAND_RenderCommandUICacheBegin:
+            {
+                RenderCommandUICacheBegin* cmd = (RenderCommandUICacheBegin*)header;
+                output_ui_cache_begin(renderer, cmd);
+                base_address += sizeof(*cmd);
+            } break;
+
+            case RENDER_COMMAND_RenderCommandUICacheComposite:
+            {
+                RenderCommandUICacheComposite* cmd = (RenderCommandUICacheComposite*)header;
+                output_ui_cache_composite(renderer);
+                base_address += sizeof(*cmd);
+            } break;
+
+            INVALID_DEFAULT_CASE();
+        }
+    }
+
+    render_batch_flush(renderer);
+    shape_batch_flush(renderer);
+    sprite_batch_flush(renderer);
+    gpu_profiler_end(profiler, gpu_scope);
+    PROFILE_END();
+}
+
+/* NOTE(lucas): Damage tracking. Every command gets a hash of its contents and conservative bounds. This frame's
+ * commands are sorted by hash and merged against last frame's, and the bounds of every command that only exists in
+ * one of the two frames are added to the dirty rect. Commands are hashed field by field, since struct copies leave
+ * padding bytes undefined, and strings and UI vertices are hashed by contents rather than by pointer.
+ */
+internal u64 damage_hash(u64 hash, const void* data, size bytes)
+{
+    const u8* at = (const u8*)data;
+    for (size i = 0; i < bytes; ++i)
+    {
+        hash ^= at[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+#define damage_hash_value(hash, value) damage_hash(hash, &(value), sizeof(value))
+
+internal rect damage_points_bounds(v2* points, u32 count, f32 pad)
+{
+    v2 min = v2_full(F32_MAX);
+    v2 max = v2_full(-F32_MAX);
+    for (u32 i = 0; i < count; ++i)
+    {
+        min = v2_min(min, points[i]);
+        max = v2_max(max, points[i]);
+    }
+    rect result = rect_min_max(v2_sub(min, v2_full(pad)), v2_add(max, v2_full(pad)));
+    return result;
+}
+
+// NOTE(lucas): However it is rotated, a rect stays inside the circle about the origin through its farthest corner
+internal rect damage_rotated_bounds(rect bounds, v2 origin, f32 rotation)
+{
+    if (rotation == 0.0f)
+        return bounds;
+
+    f32 dx = max_f32(abs_f32(bounds.x - origin.x), abs_f32(bounds.x + bounds.width - origin.x));
+    f32 dy = max_f32(abs_f32(bounds.y - origin.y), abs_f32(bounds.y + bounds.height - origin.y));
+    f32 radius = sqrt_f32(dx*dx + dy*dy);
+    rect result = rect_center_half_dim(origin, v2_full(radius));
+    return result;
+}
+
+// NOTE(lucas): Scissor clips are in bottom-left framebuffer coordinates. Flipping is its own inverse.
+internal rect damage_flip_rect(rect viewport, rect r)
+{
+    rect result = r;
+    result.y = 2.0f*viewport.y + viewport.height - (r.y + r.height);
+    return result;
+}
+
+// NOTE(lucas): UI rects have a top-left window origin. They are flipped into framebuffer coordinates the same way
+// output_ui flips its clips, and from there into the space of the other bounds.
+internal rect damage_ui_rect(Renderer* renderer, rect r)
+{
+    rect framebuffer = r;
+    framebuffer.y = (f32)renderer->window_height - (r.y + r.height);
+    rect result = damage_flip_rect(renderer->viewport, framebuffer);
+    return result;
+}
+
+size render_command_size(RenderCommandType type)
+{
+    size result = 0;
+    switch (type)
+    {
+        case RENDER_COMMAND_RenderCommandLine: result = sizeof(RenderCommandLine); break;
+        case RENDER_COMMAND_RenderCommandTriangle: result = sizeof(RenderCommandTriangle); break;
+        case RENDER_COMMAND_RenderCommandTriangleOutline: result = sizeof(RenderCommandTriangleOutline); break;
+        case RENDER_COMMAND_RenderCommandTriangleGradient: result = sizeof(RenderCommandTriangleGradient); break;
+        case RENDER_COMMAND_RenderCommandQuad: result = sizeof(RenderCommandQuad); break;
+        case RENDER_COMMAND_RenderCommandQuadOutline: result = sizeof(RenderCommandQuadOutline); break;
+        case RENDER_COMMAND_RenderCommandQuadGradient: result = sizeof(RenderCommandQuadGradient); break;
+        case RENDER_COMMAND_RenderCommandQuadRounded: result = sizeof(RenderCommandQuadRounded); break;
+        case RENDER_COMMAND_RenderCommandCircle: result = sizeof(RenderCommandCircle); break;
+        case RENDER_COMMAND_RenderCommandCircleOutline: result = sizeof(RenderCommandCircleOutline); break;
+        case RENDER_COMMAND_RenderCommandCircleSector: result = sizeof(RenderCommandCircleSector); break;
+        case RENDER_COMMAND_RenderCommandRing: result = sizeof(RenderCommandRing); break;
+        case RENDER_COMMAND_RenderCommandRingOutline: result = sizeof(RenderCommandRingOutline); break;
+        case RENDER_COMMAND_RenderCommandSprite: result = sizeof(RenderCommandSprite); break;
+        case RENDER_COMMAND_RenderCommandText: result = sizeof(RenderCommandText); break;
+        case RENDER_COMMAND_RenderCommandScissorTest: result = sizeof(RenderCommandScissorTest); break;
+        case RENDER_COMMAND_RenderCommandUI: result = sizeof(RenderCommandUI); break;
+        case RENDER_COMMAND_RenderCommandUICacheBegin: result = sizeof(RenderCommandUICacheBegin); break;
+        case RENDER_COMMAND_RenderCommandUICacheComposite: result = sizeof(RenderCommandUICacheComposite); break;
+        INVALID_DEFAULT_CASE();
+    }
+    return result;
+}
+
+internal DamageRecord damage_record(Renderer* renderer, RenderCommand* header)
+{
+    DamageRecord result = {0};
+    u64 hash = damage_hash_value(0xcbf29ce484222325ull, header->type);
+    rect bounds = {0};
+
+    switch (header->type)
+    {
+        case RENDER_COMMAND_RenderCommandLine:
+        {
+            // NOTE(lucas): Lines are rotated about the origin after being turned into a quad at the start point,
+            // so bound everything the quad could reach from the origin
+            RenderCommandLine* cmd = (RenderCommandLine*)header;
+            hash = damage_hash_value(hash, cmd->color);
+            hash = damage_hash_value(hash, cmd->start);
+            hash = damage_hash_value(hash, cmd->end);
+            hash = damage_hash_value(hash, cmd->origin);
+            hash = damage_hash_value(hash, cmd->thickness);
+            hash = damage_hash_value(hash, cmd->rotation);
+            f32 radius = v2_mag(v2_sub(cmd->start, cmd->origin)) + v2_mag(v2_sub(cmd->end, cmd->start)) + cmd->thickness;
+            bounds = rect_center_half_dim(cmd->origin, v2_full(radius));
+        } break;
+
+        case RENDER_COMMAND_RenderCommandTriangle:
+        {
+            RenderCommandTriangle* cmd = (RenderCommandTriangle*)header;
+            v2 points[] = {cmd->a, cmd->b, cmd->c};
+            hash = damage_hash_value(hash, points);
+            hash = damage_hash_value(hash, cmd->origin);
+            hash = damage_hash_value(hash, cmd->color);
+            hash = damage_hash_value(hash, cmd->rotation);
+            bounds = damage_rotated_bounds(damage_points_bounds(points, 3, 0.0f), cmd->origin, cmd->rotation);
+        } break;
+
+        case RENDER_COMMAND_RenderCommandTriangleOutline:
+        {
+            RenderCommandTriangleOutline* cmd = (RenderCommandTriangleOutline*)header;
+            v2 points[] = {cmd->a, cmd->b, cmd->c};
+            hash = damage_hash_value(hash, points);
+            hash = damage_hash_value(hash, cmd->origin);
+            hash = damage_hash_value(hash, cmd->color);
+            hash = damage_hash_value(hash, cmd->thickness);
+            hash = damage_hash_value(hash, cmd->rotation);
+            bounds = damage_points_bounds(points, 3, cmd->thickness);
+            bounds = damage_rotated_bounds(bounds, cmd->origin, cmd->rotation);
+        } break;
+
+        case RENDER_COMMAND_RenderCommandTriangleGradient:
+        {
+            RenderCommandTriangleGradient* cmd = (RenderCommandTriangleGradient*)header;
+            v2 points[] = {cmd->a, cmd->b, cmd->c};
+            hash = damage_hash_value(hash, points);
+            hash = damage_hash_value(hash, cmd->origin);
+            hash = damage_hash_value(hash, cmd->color_a);
+            hash = damage_hash_value(hash, cmd->color_b);
+            hash = damage_hash_value(hash, cmd->color_c);
+            hash = damage_hash_value(hash, cmd->rotation);
+            bounds = damage_rotated_bounds(damage_points_bounds(points, 3, 0.0f), cmd->origin, cmd->rotation);
+        } break;
+
+        case RENDER_COMMAND_RenderCommandQuad:
+        {
+            RenderCommandQuad* cmd = (RenderCommandQuad*)header;
+            hash = damage_hash_value(hash, cmd->position);
+            hash = damage_hash_value(hash, cmd->origin);
+            hash = damage_hash_value(hash, cmd->size);
+            hash = damage_hash_value(hash, cmd->color);
+            hash = damage_hash_value(hash, cmd->rotation);
+            bounds = damage_rotated_bounds(rect_min_dim(cmd->position, cmd->size), cmd->origin, cmd->rotation);
+        } break;
+
+        case RENDER_COMMAND_RenderCommandQuadOutline:
+        {
+            RenderCommandQuadOutline* cmd = (RenderCommandQuadOutline*)header;
+            hash = damage_hash_value(hash, cmd->position);
+            hash = damage_hash_value(hash, cmd->origin);
+            hash = damage_hash_value(hash, cmd->size);
+            hash = damage_hash_value(hash, cmd->color);
+            hash = damage_hash_value(hash, cmd->thickness);
+            hash = damage_hash_value(hash, cmd->rotation);
+            bounds = rect_min_dim(v2_sub(cmd->position, v2_full(cmd->thickness)),
+                                  v2_add(cmd->size, v2_full(2.0f*cmd->thickness)));
+            bounds = damage_rotated_bounds(bounds, cmd->origin, cmd->rotation);
+        } break;
+
+        case RENDER_COMMAND_RenderCommandQuadGradient:
+        {
+            RenderCommandQuadGradient* cmd = (RenderCommandQuadGradient*)header;
+            hash = damage_hash_value(hash, cmd->position);
+            hash = damage_hash_value(hash, cmd->origin);
+            hash = damage_hash_value(hash, cmd->size);
+            hash = damage_hash_value(hash, cmd->color_bl);
+            hash = damage_hash_value(hash, cmd->color_br);
+            hash = damage_hash_value(hash, cmd->color_tr);
+            hash = damage_hash_value(hash, cmd->color_tl);
+            hash = damage_hash_value(hash, cmd->rotation);
+            bounds = damage_rotated_bounds(rect_min_dim(cmd->position, cmd->size), cmd->origin, cmd->rotation);
+        } break;
+
+        case RENDER_COMMAND_RenderCommandQuadRounded:
+        {
+            RenderCommandQuadRounded* cmd = (RenderCommandQuadRounded*)header;
+            hash = damage_hash_value(hash, cmd->position);
+            hash = damage_hash_value(hash, cmd->origin);
+            hash = damage_hash_value(hash, cmd->size);
+            hash = damage_hash_value(hash, cmd->color);
+            hash = damage_hash_value(hash, cmd->radius);
+            hash = damage_hash_value(hash, cmd->thickness);
+            hash = damage_hash_value(hash, cmd->rotation);
+            bounds = rect_min_dim(v2_sub(cmd->position, v2_full(cmd->thickness)),
+                                  v2_add(cmd->size, v2_full(2.0f*cmd->thickness)));
+            bounds = damage_rotated_bounds(bounds, cmd->origin, cmd->rotation);
+        } break;
+
+        case RENDER_COMMAND_RenderCommandCircle:
+        {
+            RenderCommandCircle* cmd = (RenderCommandCircle*)header;
+            hash = damage_hash_value(hash, cmd->center);
+            hash = damage_hash_value(hash, cmd->color);
+            hash = damage_hash_value(hash, cmd->radius);
+            bounds = rect_center_half_dim(cmd->center, v2_full(cmd->radius));
+        } break;
+
+        case RENDER_COMMAND_RenderCommandCircleOutline:
+        {
+            RenderCommandCircleOutline* cmd = (RenderCommandCircleOutline*)header;
+            hash = damage_hash_value(hash, cmd->center);
+            hash = damage_hash_value(hash, cmd->color);
+            hash = damage_hash_value(hash, cmd->radius);
+            hash = damage_hash_value(hash, cmd->thickness);
+            bounds = rect_center_half_dim(cmd->center, v2_full(cmd->radius + cmd->thickness));
+        } break;
+
+        case RENDER_COMMAND_RenderCommandCircleSector:
+        {
+            RenderCommandCircleSector* cmd = (RenderCommandCircleSector*)header;
+            hash = damage_hash_value(hash, cmd->center);
+            hash = damage_hash_value(hash, cmd->color);
+            hash = damage_hash_value(hash, cmd->radius);
+            hash = damage_hash_value(hash, cmd->start_angle);
+            hash = damage_hash_value(hash, cmd->end_angle);
+            hash = damage_hash_value(hash, cmd->rotation);
+            bounds = rect_center_half_dim(cmd->center, v2_full(cmd->radius));
+        } break;
+
+        case RENDER_COMMAND_RenderCommandRing:
+        {
+            RenderCommandRing* cmd = (RenderCommandRing*)header;
+            hash = damage_hash_value(hash, cmd->center);
+            hash = damage_hash_value(hash, cmd->color);
+            hash = damage_hash_value(hash, cmd->outer_radius);
+            hash = damage_hash_value(hash, cmd->inner_radius);
+            hash = damage_hash_value(hash, cmd->start_angle);
+            hash = damage_hash_value(hash, cmd->end_angle);
+            hash = damage_hash_value(hash, cmd->rotation);
+            bounds = rect_center_half_dim(cmd->center, v2_full(cmd->outer_radius));
+        } break;
+
+        case RENDER_COMMAND_RenderCommandRingOutline:
+        {
+            RenderCommandRingOutline* cmd = (RenderCommandRingOutline*)header;
+            hash = damage_hash_value(hash, cmd->center);
+            hash = damage_hash_value(hash, cmd->color);
+            hash = damage_hash_value(hash, cmd->outer_radius);
+            hash = damage_hash_value(hash, cmd->inner_radius);
+            hash = damage_hash_value(hash, cmd->start_angle);
+            hash = damage_hash_value(hash, cmd->end_angle);
+            hash = damage_hash_value(hash, cmd->rotation);
+            hash = damage_hash_value(hash, cmd->thickness);
+            bounds = rect_center_half_dim(cmd->center, v2_full(cmd->outer_radius + cmd->thickness));
+        } break;
+
+        case RENDER_COMMAND_RenderCommandSprite:
+        {
+            RenderCommandSprite* cmd = (RenderCommandSprite*)header;
+            Sprite* sprite = &cmd->sprite;
+            hash = damage_hash_value(hash, sprite->texture);
+            hash = damage_hash_value(hash, sprite->color);
+            hash = damage_hash_value(hash, sprite->position);
+            hash = damage_hash_value(hash, sprite->size);
+            hash = damage_hash_value(hash, sprite->rotation);
+            hash = damage_hash_value(hash, sprite->layer);
+            hash = damage_hash_value(hash, sprite->uv);
+            v2 center = v2_add(sprite->position, v2_scale(sprite->size, 0.5f));
+            bounds = damage_rotated_bounds(rect_min_dim(sprite->position, sprite->size), center, sprite->rotation);
+        } break;
+
+        case RENDER_COMMAND_RenderCommandText:
+        {
+            // NOTE(lucas): Text is drawn from the baseline, and glyphs can overhang the measured width by a little
+            RenderCommandText* cmd = (RenderCommandText*)header;
+            Text* text = &cmd->text;
+            hash = damage_hash_value(hash, text->font);
+            hash = damage_hash_value(hash, text->position);
+            hash = damage_hash_value(hash, text->color);
+            hash = damage_hash_value(hash, text->px);
+            hash = damage_hash_value(hash, text->px_width);
+            hash = damage_hash_value(hash, text->line_height);
+            hash = damage_hash(hash, text->string.data, text->string.len);
+
+            u32 lines = 1;
+            for (size i = 0; i < text->string.len; ++i)
+            {
+                if (text->string.data[i] == '\n')
+                    ++lines;
+            }
+
+            f32 px = (f32)text->px;
+            f32 width = (text->string_width > 0.0f) ? text->string_width : (f32)text->string.len*px;
+            v2 min = v2(text->position.x - px, text->position.y - text->line_height - px);
+            v2 max = v2(text->position.x + width + px, text->position.y + (f32)lines*text->line_height + px);
+            bounds = rect_min_max(min, max);
+        } break;
+
+        case RENDER_COMMAND_RenderCommandScissorTest:
+        {
+            // NOTE(lucas): A changed clip changes what every following command shows inside the old and new clips
+            RenderCommandScissorTest* cmd = (RenderCommandScissorTest*)header;
+            hash = damage_hash_value(hash, cmd->clip);
+            bounds = damage_flip_rect(renderer->viewport, cmd->clip);
+        } break;
+
+        case RENDER_COMMAND_RenderCommandUI:
+        {
+            RenderCommandUI* cmd = (RenderCommandUI*)header;
+            UIState* state = &renderer->ui_state;
+            hash = damage_hash(hash, state->vertices, cmd->vertex_bytes);
+            hash = damage_hash(hash, state->elements, cmd->element_bytes);
+            for (u32 i = 0; i < state->draw_count; ++i)
+            {
+                UIDrawCommand* draw = state->draws + i;
+                hash = damage_hash_value(hash, draw->texture);
+                hash = damage_hash_value(hash, draw->clip);
+                hash = damage_hash_value(hash, draw->element_count);
+                bounds = rect_union(bounds, damage_ui_rect(renderer, draw->clip));
+            }
+        } break;
+
+        case RENDER_COMMAND_RenderCommandUICacheBegin:
+        {
+            RenderCommandUICacheBegin* cmd = (RenderCommandUICacheBegin*)header;
+            hash = damage_hash_value(hash, cmd->clip);
+            bounds = damage_ui_rect(renderer, cmd->clip);
+        } break;
+
+        // NOTE(lucas): The composited region is covered by the cache begin command of the frame that redrew it
+        case RENDER_COMMAND_RenderCommandUICacheComposite: break;
 
-            case RENDER_COMMAND_RenderCommandCircleOutline:
-            {
-                RenderCommandCircleOutline* cmd = (RenderCommandCircleOutline*)header;
-                output_circle_outline(renderer, cmd);
-                base_address += sizeof(*cmd);
-            } break;
+        INVALID_DEFAULT_CASE();
+    }
 
-            case RENDER_COMMAND_RenderCommandCircleSector:
-            {
-                RenderCommandCircleSector* cmd = (RenderCommandCircleSector*)header;
-                output_circle_sector(renderer, cmd);
-                base_address += sizeof(*cmd);
-            } break;
+    // NOTE(lucas): Pad the bounds for anti-aliasing and rounding to whole pixels
+    f32 pad = 2.0f;
+    if (bounds.width > 0.0f && bounds.height > 0.0f)
+        bounds = rect_min_dim(v2_sub(bounds.position, v2_full(pad)), v2_add(bounds.size, v2_full(2.0f*pad)));
 
-            case RENDER_COMMAND_RenderCommandRing:
-            {
-                RenderCommandRing* cmd = (RenderCommandRing*)header;
-                output_ring(renderer, cmd);
-                base_address += sizeof(*cmd);
-            } break;
+    result.hash = hash;
+    result.bounds = bounds;
+    return result;
+}
 
-            case RENDER_COMMAND_RenderCommandRingOutline:
-            {
-                RenderCommandRingOutline* cmd = (RenderCommandRingOutline*)header;
-                output_ring_outline(renderer, cmd);
-                base_address += sizeof(*cmd);
-            } break;
+// NOTE(lucas): Identical commands are ordered by submission, so they are matched up in order across frames
+internal int damage_record_compare(const void* a, const void* b)
+{
+    DamageRecord* record_a = (DamageRecord*)a;
+    DamageRecord* record_b = (DamageRecord*)b;
+    int result = (record_a->hash > record_b->hash) - (record_a->hash < record_b->hash);
+    if (!result)
+        result = (record_a->order > record_b->order) - (record_a->order < record_b->order);
+    return result;
+}
 
-            case RENDER_COMMAND_RenderCommandSprite:
-            {
-                RenderCommandSprite* cmd = (RenderCommandSprite*)header;
-                output_sprite(renderer, cmd);
-                base_address += sizeof(*cmd);
-            } break;
+/* NOTE(lucas): Computes the region of the framebuffer that has to be redrawn this frame, in bottom-left
+ * framebuffer coordinates. The whole viewport is redrawn on the first frame, after the viewport changes, when there
+ * are too many commands to track, or when commands that are in both frames were submitted in a different order.
+ */
+internal rect damage_compute(Renderer* renderer)
+{
+    DamageTracker* damage = &renderer->damage;
+    RenderCommandBuffer* command_buffer = &renderer->command_buffer;
+    rect viewport = renderer->viewport;
 
-            case RENDER_COMMAND_RenderCommandText:
-            {
-                RenderCommandText* cmd = (RenderCommandText*)header;
-                output_text(renderer, cmd);
-                base_address += sizeof(*cmd);
-            } break;
+    b32 overflow = false;
+    damage->record_count = 0;
+    for (size base_address = 0; base_address < command_buffer->bytes;)
+    {
+        RenderCommand* header = (RenderCommand*)(command_buffer->base + base_address);
+        base_address += render_command_size(header->type);
+
+        DamageRecord record = damage_record(renderer, header);
+        record.order = damage->record_count;
+        if (damage->record_count < DAMAGE_MAX_RECORDS)
+            damage->records[damage->record_count++] = record;
+        else
+            overflow = true;
+    }
 
-            case RENDER_COMMAND_RenderCommandScissorTest:
+    qsort(damage->records, damage->record_count, sizeof(DamageRecord), damage_record_compare);
+
+    b32 full_redraw = !damage->valid || overflow || !rect_eq(viewport, damage->viewport);
+    rect dirty = {0};
+    if (!full_redraw)
+    {
+        // NOTE(lucas): Submission index last frame of every unchanged command, indexed by its submission index this
+        // frame. Changed commands are already covered by the dirty rect, but if unchanged commands swapped places,
+        // whatever overlaps them is drawn in a different order.
+        u32* prev_order = push_array(&renderer->scratch_arena, damage->record_count, u32);
+        for (u32 i = 0; i < damage->record_count; ++i)
+            prev_order[i] = DAMAGE_NO_MATCH;
+
+        u32 i = 0;
+        u32 j = 0;
+        while (i < damage->record_count || j < damage->prev_record_count)
+        {
+            DamageRecord* current = (i < damage->record_count) ? damage->records + i : 0;
+            DamageRecord* prev = (j < damage->prev_record_count) ? damage->prev_records + j : 0;
+            if (current && prev && current->hash == prev->hash)
             {
-                RenderCommandScissorTest* cmd = (RenderCommandScissorTest*)header;
-                output_scissor_test(renderer, cmd);
-                base_address += sizeof(*cmd);
-            } break;
+                prev_order[current->order] = prev->order;
+                ++i;
+                ++j;
+            }
+            else if (current && (!prev || current->hash < prev->hash))
+            {
+                dirty = rect_union(dirty, current->bounds);
+                ++i;
+            }
+            else
+            {
+                dirty = rect_union(dirty, prev->bounds);
+                ++j;
+            }
+        }
 
-            INVALID_DEFAULT_CASE();
+        u32 last_order = 0;
+        b32 first = true;
+        for (u32 order = 0; order < damage->record_count && !full_redraw; ++order)
+        {
+            if (prev_order[order] == DAMAGE_NO_MATCH)
+                continue;
+            if (!first && prev_order[order] < last_order)
+                full_redraw = true;
+            last_order = prev_order[order];
+            first = false;
         }
-    }    
+        memory_arena_pop(&renderer->scratch_arena, damage->record_count*sizeof(u32));
+    }
+
+    DamageRecord* swap = damage->prev_records;
+    damage->prev_records = damage->records;
+    damage->records = swap;
+    damage->prev_record_count = damage->record_count;
+    damage->viewport = viewport;
+    damage->valid = !overflow;
+
+    if (full_redraw)
+    {
+        renderer->stats.damage_full_redraws = 1;
+        return viewport;
+    }
+
+    // NOTE(lucas): Snap outwards to whole pixels so the scissor and blit cover every touched pixel
+    dirty = rect_intersect(damage_flip_rect(viewport, dirty), viewport);
+    v2 min = v2((f32)floor_f32(dirty.x), (f32)floor_f32(dirty.y));
+    v2 max = v2((f32)ceil_f32(dirty.x + dirty.width), (f32)ceil_f32(dirty.y + dirty.height));
+    rect result = rect_min_max(min, max);
+    return result;
 }
 
 internal void path_from_install_dir(char* path, char* dest)
@@ -1235,7 +2870,39 @@ Renderer renderer_init(Window* window, int viewport_width, int viewport_height,
     renderer.clear_color = (v4){0.0f, 0.0f, 0.0f, 1.0f};
 
     renderer.config.circle_line_segments = 128;
+    renderer.config.circle_min_segments = 8;
+    renderer.config.circle_max_segments = 256;
+    renderer.config.circle_max_error = 0.25f;
     renderer.config.msaa_level = 16;
+    renderer.config.target_frame_ms = 1000.0f / 60.0f;
+    renderer.config.resolution_scale_min = 0.5f;
+    renderer.config.resolution_scale_max = 1.0f;
+
+    renderer.resolution.scale = 1.0f;
+    renderer.resolution.applied_scale = v2(1.0f, 1.0f);
+
+    // NOTE(lucas): Enough room for 16K quads per batch. The batch is flushed early if it fills up.
+    u32 batch_max_vertices = 4*16384;
+    u32 batch_max_indices = 6*16384;
+    u32 shape_batch_max_count = 16384;
+    u32 sprite_batch_max_count = 16384;
+    renderer.batch_arena = memory_arena_alloc(batch_max_vertices*RENDER_BATCH_VERTEX_FLOATS*sizeof(f32) +
+                                              batch_max_indices*sizeof(u32) +
+                                              shape_batch_max_count*sizeof(ShapeInstance) +
+                                              4*sprite_batch_max_count*SPRITE_BATCH_VERTEX_FLOATS*sizeof(f32));
+    renderer.batch = render_batch_alloc(&renderer.batch_arena, batch_max_vertices, batch_max_indices);
+    renderer.shape_batch = shape_batch_alloc(&renderer.batch_arena, shape_batch_max_count);
+    renderer.sprite_batch = sprite_batch_alloc(&renderer.batch_arena, sprite_batch_max_count);
+
+    // NOTE(lucas): The glyph atlas keeps a copy of every page
+    renderer.cache_arena = memory_arena_alloc(MEGABYTES(1) +
+                                              GLYPH_ATLAS_MAX_PAGES*GLYPH_ATLAS_PAGE_SIZE*GLYPH_ATLAS_PAGE_SIZE);
+    glyph_cache_init(&renderer.glyph_cache, &renderer.cache_arena);
+    renderer.pending_updates = push_array(&renderer.cache_arena, RENDERER_MAX_TEXTURE_UPDATES, TextureUpdate);
+
+    renderer.damage_arena = memory_arena_alloc(2*DAMAGE_MAX_RECORDS*sizeof(DamageRecord));
+    renderer.damage.records = push_array(&renderer.damage_arena, DAMAGE_MAX_RECORDS, DamageRecord);
+    renderer.damage.prev_records = push_array(&renderer.damage_arena, DAMAGE_MAX_RECORDS, DamageRecord);
 
     // Clamp MSAA samples to max samples supported by GPU
     GLint max_samples;
@@ -1252,9 +2919,15 @@ Renderer renderer_init(Window* window, int viewport_width, int viewport_height,
     char sprite_frag_shader_full_path[MAX_FILEPATH_LEN];
     char font_vert_shader_full_path[MAX_FILEPATH_LEN];
     char font_frag_shader_full_path[MAX_FILEPATH_LEN];
+    char font_sdf_frag_shader_full_path[MAX_FILEPATH_LEN];
     char ui_vert_shader_full_path[MAX_FILEPATH_LEN];
     char ui_frag_shader_full_path[MAX_FILEPATH_LEN];
     char border_frag_shader_full_path[MAX_FILEPATH_LEN];
+    char shape_vert_shader_full_path[MAX_FILEPATH_LEN];
+    char shape_frag_shader_full_path[MAX_FILEPATH_LEN];
+    char sprite_batch_vert_shader_full_path[MAX_FILEPATH_LEN];
+    char sprite_batch_frag_shader_full_path[MAX_FILEPATH_LEN];
+    char sprite_array_frag_shader_full_path[MAX_FILEPATH_LEN];
 
     path_from_install_dir("/res/shaders/framebuffer.vs", framebuffer_vert_shader_full_path);
     path_from_install_dir("/res/shaders/framebuffer.fs", framebuffer_frag_shader_full_path);
@@ -1264,37 +2937,74 @@ Renderer renderer_init(Window* window, int viewport_width, int viewport_height,
     path_from_install_dir("/res/shaders/sprite.fs", sprite_frag_shader_full_path);
     path_from_install_dir("/res/shaders/font.vs", font_vert_shader_full_path);
     path_from_install_dir("/res/shaders/font.fs", font_frag_shader_full_path);
+    path_from_install_dir("/res/shaders/font_sdf.fs", font_sdf_frag_shader_full_path);
     path_from_install_dir("/res/shaders/ui.vs", ui_vert_shader_full_path);
     path_from_install_dir("/res/shaders/ui.fs", ui_frag_shader_full_path);
     path_from_install_dir("/res/shaders/border.fs", border_frag_shader_full_path);
+    path_from_install_dir("/res/shaders/shape.vs", shape_vert_shader_full_path);
+    path_from_install_dir("/res/shaders/shape.fs", shape_frag_shader_full_path);
+    path_from_install_dir("/res/shaders/sprite_batch.vs", sprite_batch_vert_shader_full_path);
+    path_from_install_dir("/res/shaders/sprite_batch.fs", sprite_batch_frag_shader_full_path);
+    path_from_install_dir("/res/shaders/sprite_array.fs", sprite_array_frag_shader_full_path);
 
     u32 framebuffer_shader = shader_init(&renderer, framebuffer_vert_shader_full_path, framebuffer_frag_shader_full_path);
     u32 poly_shader        = shader_init(&renderer, poly_vert_shader_full_path, poly_frag_shader_full_path);
     u32 sprite_shader      = shader_init(&renderer, sprite_vert_shader_full_path, sprite_frag_shader_full_path);
     u32 font_shader        = shader_init(&renderer, font_vert_shader_full_path, font_frag_shader_full_path);
+    u32 font_sdf_shader    = shader_init(&renderer, font_vert_shader_full_path, font_sdf_frag_shader_full_path);
     u32 ui_shader          = shader_init(&renderer, ui_vert_shader_full_path, ui_frag_shader_full_path);
     u32 poly_border_shader = shader_init(&renderer, poly_vert_shader_full_path, border_frag_shader_full_path);
+    u32 shape_shader       = shader_init(&renderer, shape_vert_shader_full_path, shape_frag_shader_full_path);
+    u32 sprite_batch_shader = shader_init(&renderer, sprite_batch_vert_shader_full_path, sprite_batch_frag_shader_full_path);
+    u32 sprite_array_shader = shader_init(&renderer, sprite_batch_vert_shader_full_path, sprite_array_frag_shader_full_path);
+
+    // NOTE(lucas): Each region must hold a full render batch
+    renderer.vertex_stream = stream_buffer_init(MEGABYTES(4));
+    renderer.index_stream  = stream_buffer_init(MEGABYTES(1));
+    u32 vertex_stream = renderer.vertex_stream.id;
+    u32 index_stream = renderer.index_stream.id;
 
-    renderer.triangle_renderer    = triangle_renderer_init(poly_shader);
+    renderer.triangle_renderer    = triangle_renderer_init(poly_shader, vertex_stream);
     renderer.quad_renderer        = quad_renderer_init(poly_shader);
-    renderer.circle_renderer      = circle_renderer_init(poly_shader, renderer.config.circle_line_segments);
+    renderer.circle_renderer      = circle_renderer_init(poly_shader);
     renderer.sprite_renderer      = sprite_renderer_init(sprite_shader);
-    renderer.font_renderer        = font_renderer_init(font_shader);
+    renderer.font_renderer        = font_renderer_init(&renderer, font_shader, vertex_stream, TEXT_BATCH_MAX_GLYPHS);
     renderer.framebuffer_renderer = framebuffer_renderer_init(framebuffer_shader);
-    renderer.ui_renderer          = ui_renderer_init(ui_shader);
+    renderer.ui_renderer          = ui_renderer_init(ui_shader, vertex_stream, index_stream);
+    renderer.batch_renderer       = batch_renderer_init(poly_shader, vertex_stream, index_stream);
+    renderer.shape_renderer       = shape_renderer_init(shape_shader, vertex_stream);
+    renderer.sprite_batch_renderer = sprite_batch_renderer_init(&renderer, sprite_batch_shader, vertex_stream,
+                                                                sprite_batch_max_count);
+
+    glGenBuffers(1, &renderer.frame_ubo);
+    gl_bind_buffer(GL_UNIFORM_BUFFER, renderer.frame_ubo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), NULL, GL_DYNAMIC_DRAW);
+    gl_bind_buffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, SHADER_FRAME_BLOCK_BINDING, renderer.frame_ubo);
 
     renderer.poly_shader = poly_shader;
     renderer.poly_border_shader = poly_border_shader;
+    renderer.sprite_array_shader = sprite_array_shader;
+    renderer.font_sdf_shader = font_sdf_shader;
     
     renderer.framebuffer = framebuffer_init(framebuffer_shader, viewport_width, viewport_height,
                                             renderer.config.msaa_level, false);
     renderer.intermediate_framebuffer = framebuffer_init(framebuffer_shader, viewport_width, viewport_height, 0, true);
-
-    for (u32 i = 0; i < countof(renderer.tex_ids); ++i)
+    render_target_event(&renderer, RenderTargetEvent_Allocate, RenderTarget_Main, viewport_width, viewport_height,
+                        renderer.config.msaa_level);
+    render_target_event(&renderer, RenderTargetEvent_Allocate, RenderTarget_Intermediate, viewport_width,
+                        viewport_height, 0);
+
+    u32 texture_ids[RENDERER_MAX_TEXTURES];
+    glGenTextures(RENDERER_MAX_TEXTURES, texture_ids);
+    for (u32 i = 0; i < RENDERER_MAX_TEXTURES; ++i)
     {
-        RenderID* tex_id = renderer.tex_ids + i;
-        glGenTextures(1, &tex_id->id);
+        TextureSlot* slot = renderer.texture_slots + i;
+        slot->id = texture_ids[i];
+        slot->generation = 1;
+        slot->next_free = (i + 1 < RENDERER_MAX_TEXTURES) ? i + 1 : TEXTURE_SLOT_NONE;
     }
+    renderer.texture_free_head = 0;
 
     return renderer;
 }
@@ -1306,13 +3016,118 @@ void renderer_delete(Renderer* renderer)
     render_object_delete(&renderer->sprite_renderer);
     render_object_delete(&renderer->font_renderer);
     render_object_delete(&renderer->framebuffer_renderer);
+    render_object_delete(&renderer->batch_renderer);
+    render_object_delete(&renderer->triangle_renderer);
+    render_object_delete(&renderer->shape_renderer);
+    render_object_delete(&renderer->sprite_batch_renderer);
+    render_object_delete(&renderer->ui_renderer);
+
+    if (renderer->ui_cache_framebuffer.id)
+        framebuffer_delete(&renderer->ui_cache_framebuffer);
+
+    glyph_cache_delete(renderer, &renderer->glyph_cache);
+    text_layout_cache_delete(&renderer->text_layout_cache);
+
+    stream_buffer_delete(&renderer->vertex_stream);
+    stream_buffer_delete(&renderer->index_stream);
+    texture_loader_delete(renderer);
+    gpu_profiler_delete(&renderer->gpu_profiler);
+    render_capture_end(renderer);
+
+    u32 texture_ids[RENDERER_MAX_TEXTURES];
+    for (u32 i = 0; i < RENDERER_MAX_TEXTURES; ++i)
+    {
+        texture_ids[i] = renderer->texture_slots[i].id;
+        gl_forget_texture(texture_ids[i]);
+    }
+    glDeleteTextures(RENDERER_MAX_TEXTURES, texture_ids);
+
+    gl_forget_buffer(renderer->frame_ubo);
+    glDeleteBuffers(1, &renderer->frame_ubo);
 
     framebuffer_delete(&renderer->framebuffer);
     framebuffer_delete(&renderer->intermediate_framebuffer);
 }
 
+#define DYNAMIC_RESOLUTION_STEP 0.025f     // Scales are rounded to multiples of this
+#define DYNAMIC_RESOLUTION_MAX_STEP_UP 0.05f
+#define DYNAMIC_RESOLUTION_HEADROOM 0.8f   // Only scale up when frames average below this fraction of the target
+
+internal void dynamic_resolution_update(Renderer* renderer)
+{
+    DynamicResolution* resolution = &renderer->resolution;
+    RendererConfig* config = &renderer->config;
+    ++resolution->frame;
+
+    if (!config->dynamic_resolution || config->target_frame_ms <= 0.0f)
+    {
+        resolution->scale = 1.0f;
+        resolution->history_count = 0;
+        return;
+    }
+
+    // NOTE(lucas): The render targets are the size of the viewport, so the scale can't go above 1
+    f32 min_scale = clamp_f32(config->resolution_scale_min, DYNAMIC_RESOLUTION_STEP, 1.0f);
+    f32 max_scale = clamp_f32(config->resolution_scale_max, min_scale, 1.0f);
+
+    f32 frame_ms = (resolution->cpu_ms > resolution->gpu_ms) ? resolution->cpu_ms : resolution->gpu_ms;
+    if (frame_ms > 0.0f)
+        resolution->history[resolution->history_count++ % DYNAMIC_RESOLUTION_HISTORY] = frame_ms;
+
+    f32 old_scale = clamp_f32(resolution->scale, min_scale, max_scale);
+    resolution->scale = old_scale;
+    if (resolution->history_count < DYNAMIC_RESOLUTION_HISTORY)
+        return;
+
+    f32 average_ms = 0.0f;
+    for (u32 i = 0; i < DYNAMIC_RESOLUTION_HISTORY; ++i)
+        average_ms += resolution->history[i];
+    average_ms /= (f32)DYNAMIC_RESOLUTION_HISTORY;
+
+    f32 target_ms = config->target_frame_ms;
+    f32 new_scale = old_scale;
+    if (average_ms > target_ms)
+    {
+        new_scale = old_scale*sqrt_f32(target_ms / average_ms);
+        if (new_scale > old_scale - DYNAMIC_RESOLUTION_STEP)
+            new_scale = old_scale - DYNAMIC_RESOLUTION_STEP;
+    }
+    else if (average_ms < DYNAMIC_RESOLUTION_HEADROOM*target_ms)
+    {
+        new_scale = old_scale*sqrt_f32(DYNAMIC_RESOLUTION_HEADROOM*target_ms / average_ms);
+        if (new_scale > old_scale + DYNAMIC_RESOLUTION_MAX_STEP_UP)
+            new_scale = old_scale + DYNAMIC_RESOLUTION_MAX_STEP_UP;
+    }
+
+    new_scale = (f32)(i32)(new_scale/DYNAMIC_RESOLUTION_STEP + 0.5f)*DYNAMIC_RESOLUTION_STEP;
+    new_scale = clamp_f32(new_scale, min_scale, max_scale);
+    if (new_scale == old_scale)
+        return;
+
+    DynamicResolutionDecision* decision = resolution->decisions +
+                                          (resolution->decision_count % DYNAMIC_RESOLUTION_MAX_DECISIONS);
+    decision->frame = resolution->frame;
+    decision->average_ms = average_ms;
+    decision->target_ms = target_ms;
+    decision->old_scale = old_scale;
+    decision->new_scale = new_scale;
+    ++resolution->decision_count;
+    log_debug("Resolution scale %.3f -> %.3f (%.2f ms average, %.2f ms target)",
+              old_scale, new_scale, average_ms, target_ms);
+
+    resolution->scale = new_scale;
+    resolution->history_count = 0;
+}
+
 void renderer_new_frame(Renderer* renderer, Window* window)
 {
+    profile_frame_begin();
+    renderer->stats = (RendererStats){0};
+    gl_state_stats_reset();
+
+    dynamic_resolution_update(renderer);
+    renderer->resolution.frame_start = time_ticks();
+
     if (renderer->config.wireframe_mode)
         glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
@@ -1331,79 +3146,210 @@ void renderer_new_frame(Renderer* renderer, Window* window)
         renderer_viewport(renderer, viewport);
     }
 
-    fbo_bind(renderer->framebuffer.id);
-
     rect viewport = renderer->viewport;
     int msaa = renderer->config.msaa_level;
-    texture_fill_empty_data(&renderer->framebuffer.texture, (int)viewport.width, (int)viewport.height, msaa);
-    texture_fill_empty_data(&renderer->intermediate_framebuffer.texture, (int)viewport.width, (int)viewport.height, 0);
 
-    rbo_bind(renderer->framebuffer.rbo);
-    rbo_update((int)viewport.width, (int)viewport.height, msaa);
-    rbo_unbind();
+    // NOTE(lucas): The framebuffers are only reallocated when the viewport size or MSAA level changes.
+    // Damage tracking relies on them keeping last frame's contents otherwise.
+    ++renderer->render_targets.frame;
+    int width = (int)viewport.width;
+    int height = (int)viewport.height;
+    b32 reallocated = render_target_resize(renderer, &renderer->framebuffer, RenderTarget_Main, width, height, msaa);
+    reallocated |= render_target_resize(renderer, &renderer->intermediate_framebuffer, RenderTarget_Intermediate,
+                                        width, height, 0);
+
+    // NOTE(lucas): The targets keep their full size, and only the part of them that is drawn to shrinks
+    DynamicResolution* resolution = &renderer->resolution;
+    v2 applied_scale = v2(1.0f, 1.0f);
+    if (renderer->config.dynamic_resolution && width > 0 && height > 0)
+    {
+        i32 scaled_width = (i32)((f32)width*resolution->scale + 0.5f);
+        i32 scaled_height = (i32)((f32)height*resolution->scale + 0.5f);
+        applied_scale.x = (f32)(scaled_width > 0 ? scaled_width : 1) / (f32)width;
+        applied_scale.y = (f32)(scaled_height > 0 ? scaled_height : 1) / (f32)height;
+    }
+    if (applied_scale.x != resolution->applied_scale.x || applied_scale.y != resolution->applied_scale.y)
+        reallocated = true;
+    resolution->applied_scale = applied_scale;
+    renderer->stats.resolution_scale = applied_scale.x;
+
+    if (reallocated)
+        renderer->damage.valid = false;
+
+    fbo_bind(renderer->framebuffer.id);
+    b32 damage_tracking = renderer->config.damage_tracking;
 
     // NOTE(lucas): If the viewport does not start at (0, 0), offset the projection matrix by the viewport origin
     m4 projection = m4_ortho(renderer->viewport.x, renderer->viewport.x + renderer->viewport.width,
                              renderer->viewport.y + renderer->viewport.height, renderer->viewport.y,
                              -1.0f, 1.0f);
 
-    // NOTE(lucas): Most shapes use the same shader, so no need to set the uniform for each shape
-    shader_set_m4(renderer->triangle_renderer.shader, "projection", projection, false);
-    shader_set_m4(renderer->poly_border_shader,       "projection", projection, false);
-    shader_set_m4(renderer->sprite_renderer.shader,   "projection", projection, false);
-    shader_set_m4(renderer->font_renderer.shader,     "projection", projection, false);
-    shader_set_m4(renderer->ui_renderer.shader,       "projection", projection, false);
+    // NOTE(lucas): The poly, sprite, font, and shape shaders all read the projection from the frame uniform block.
+    // The UI shader sets its own projection when the UI is drawn.
+    FrameUniforms frame = {0};
+    frame.projection = projection;
+    gl_bind_buffer(GL_UNIFORM_BUFFER, renderer->frame_ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(frame), &frame);
+    gl_bind_buffer(GL_UNIFORM_BUFFER, 0);
 
     ui_new_frame(renderer, window->width, window->height);
 
-    renderer_clear(color_black());
+    // NOTE(lucas): With damage tracking, only the dirty region is cleared once the commands are known
+    if (!damage_tracking)
+        renderer_clear(color_black());
 }
 
 void renderer_render(Renderer* renderer)
 {
-    for (u32 i = 0; i < countof(renderer->tex_ids); ++i)
+    PROFILE_BEGIN("renderer_render");
+    GPUProfiler* profiler = &renderer->gpu_profiler;
+    gpu_profiler_begin_frame(profiler, renderer->config.gpu_profiling);
+    // NOTE(lucas): Without a fresh measurement, e.g. after profiling is turned off, dynamic resolution goes by the CPU
+    // time alone rather than a stale GPU time. Times reported with renderer_report_gpu_time are kept.
+    if (profiler->latest_updated)
     {
-        RenderID* tex_id = renderer->tex_ids + i;
-        if (tex_id->used)
-        {
-            Texture tex = renderer->textures_to_generate[i];
-            renderer_gen_texture(tex);
-            glGenTextures(1, &tex_id->id);
-        }
+        renderer->resolution.gpu_ms = profiler->latest.pass_ms[GPUPass_Frame];
+        renderer->resolution.gpu_ms_profiled = true;
+    }
+    else if (renderer->resolution.gpu_ms_profiled)
+    {
+        renderer->resolution.gpu_ms = 0.0f;
+        renderer->resolution.gpu_ms_profiled = false;
     }
+    u32 frame_scope = gpu_profiler_begin(profiler, GPUPass_Frame, GPU_SCOPE_NONE);
+
+    u32 upload_scope = gpu_profiler_begin(profiler, GPUPass_Uploads, GPU_SCOPE_NONE);
+    renderer_texture_process_queues(renderer);
+
+    texture_loader_upload(renderer);
+    renderer->stats.texture_upload_bytes = renderer->texture_loader.frame_bytes;
+    renderer->stats.textures_loaded = renderer->texture_loader.frame_completed;
+    gpu_profiler_end(profiler, upload_scope);
 
     rect viewport = renderer->viewport;
 
+    // NOTE(lucas): Commands from other threads go after the main thread's and before the UI's
+    PROFILE_SCOPE("render_thread_buffers_merge")
+        render_thread_buffers_merge(renderer);
+
+    // NOTE(lucas): A replayed frame already has its UI commands and buffers
     // TODO(lucas): Use renderer AA settings
-    ui_render(renderer, NK_ANTI_ALIASING_ON);
-    render_command_buffer_output(renderer);
+    if (!renderer->capture.replaying)
+    {
+        PROFILE_SCOPE("ui_render")
+            ui_render(renderer, NK_ANTI_ALIASING_ON);
+    }
+
+    // NOTE(lucas): Captured after the UI so the frame can be replayed without it
+    render_capture_frame(renderer);
+
+    DynamicResolution* resolution = &renderer->resolution;
+    resolution->active = (resolution->applied_scale.x != 1.0f || resolution->applied_scale.y != 1.0f);
+    resolution_viewport_set(renderer);
+
+    // NOTE(lucas): With damage tracking, the clear, every scissor test, and the resolve are limited to the region
+    // that changed. Nothing is drawn into the framebuffer at all if nothing changed.
+    b32 damage_tracking = renderer->config.damage_tracking;
+    rect resolve = rect_min_dim(viewport.position, viewport.size);
+    if (damage_tracking)
+    {
+        PROFILE_SCOPE("damage_compute")
+            resolve = damage_compute(renderer);
+        renderer->stats.damage_dirty_pixels = (u32)(resolve.width*resolve.height);
+
+        if (resolve.width > 0.0f && resolve.height > 0.0f)
+        {
+            renderer->damage.dirty = resolve;
+            renderer->damage.active = true;
+            scissor_set(renderer, viewport);
+
+            glClearColor(renderer->clear_color.r, renderer->clear_color.g, renderer->clear_color.b,
+                         renderer->clear_color.a);
+            renderer_clear(color_black());
+
+            render_command_buffer_output(renderer);
+
+            renderer->damage.active = false;
+        }
+        scissor_set(renderer, viewport);
+    }
+    else
+    {
+        renderer->damage.valid = false;
+        render_command_buffer_output(renderer);
+    }
+
+    if (resolution->active)
+        resolve = resolution_scale_rect(resolve, resolution->applied_scale);
 
     // NOTE(lucas): If MSAA is used, blit the multisampled framebuffer onto the
     // intermediate framebuffer
-    if (renderer->config.msaa_level > 0)
+    if (renderer->config.msaa_level > 0 && resolve.width > 0.0f && resolve.height > 0.0f)
     {
+        int x0 = (int)resolve.x;
+        int y0 = (int)resolve.y;
+        int x1 = damage_tracking ? (int)(resolve.x + resolve.width) : (int)resolve.width;
+        int y1 = damage_tracking ? (int)(resolve.y + resolve.height) : (int)resolve.height;
+        u32 resolve_scope = gpu_profiler_begin(profiler, GPUPass_Resolve, GPU_SCOPE_NONE);
         glBindFramebuffer(GL_READ_FRAMEBUFFER, renderer->framebuffer.id);
         glBindFramebuffer(GL_DRAW_FRAMEBUFFER, renderer->intermediate_framebuffer.id);
-        glBlitFramebuffer((int)viewport.x, (int)viewport.y, (int)viewport.width, (int)viewport.height,
-                        (int)viewport.x, (int)viewport.y, (int)viewport.width, (int)viewport.height,
-                        GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT, GL_NEAREST);
+        // NOTE(lucas): Only color is read after the resolve, and the intermediate framebuffer has no depth or stencil
+        glBlitFramebuffer(x0, y0, x1, y1, x0, y0, x1, y1, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        gpu_profiler_end(profiler, resolve_scope);
+    }
+
+    // NOTE(lucas): The final pass covers the whole viewport and stretches the drawn part of the texture over it
+    if (resolution->active)
+    {
+        resolution->active = false;
+        resolution_viewport_set(renderer);
+        scissor_set(renderer, viewport);
     }
 
+    u32 final_scope = gpu_profiler_begin(profiler, GPUPass_Final, GPU_SCOPE_NONE);
     fbo_unbind();
     renderer_clear(renderer->clear_color);
 
-    shader_bind(renderer->framebuffer_renderer.shader);
-    vao_bind(renderer->framebuffer_renderer.vao);
-
+    Texture* screen_texture = &renderer->framebuffer.texture;
     if (renderer->config.msaa_level > 0)
-        texture_bind(&renderer->intermediate_framebuffer.texture, 0);
-    else
-        texture_bind(&renderer->framebuffer.texture, renderer->config.msaa_level);
+        screen_texture = &renderer->intermediate_framebuffer.texture;
+
+    // NOTE(lucas): Keep bilinear samples inside the texels that were drawn this frame. Past the drawn part, the
+    // texture still holds whatever was drawn at a larger scale.
+    v2 tex_max = v2(resolution->applied_scale.x - 0.5f/screen_texture->size.x,
+                    resolution->applied_scale.y - 0.5f/screen_texture->size.y);
+    u32 framebuffer_shader = renderer->framebuffer_renderer.shader;
+    shader_bind(framebuffer_shader);
+    shader_set_v2(framebuffer_shader, "tex_scale", resolution->applied_scale);
+    shader_set_v2(framebuffer_shader, "tex_max", tex_max);
+    vao_bind(renderer->framebuffer_renderer.vao);
+    texture_bind(screen_texture, 0);
 
     // NOTE(lucas): Turn wireframe mode off before rendering the screen texture.
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
     vao_unbind();
+    gpu_profiler_end(profiler, final_scope);
+    gpu_profiler_end(profiler, frame_scope);
+
+    renderer->stats.gl_state = gl_state_stats();
+    renderer->stats.ui_text_width_hits = renderer->ui_state.text_width_cache.hits;
+    renderer->stats.ui_text_width_misses = renderer->ui_state.text_width_cache.misses;
+    renderer->stats.ui_cache_hits = renderer->ui_state.render_cache.hits;
+    renderer->stats.ui_cache_partial_redraws = renderer->ui_state.render_cache.partial_redraws;
+    renderer->stats.ui_cache_full_redraws = renderer->ui_state.render_cache.full_redraws;
+    renderer->stats.ui_cache_saved_ms = renderer->ui_state.render_cache.saved_ms;
+    renderer->stats.vertex_upload_bytes = renderer->vertex_stream.frame_bytes;
+    renderer->stats.index_upload_bytes = renderer->index_stream.frame_bytes;
+    stream_buffer_end_frame(&renderer->vertex_stream);
+    stream_buffer_end_frame(&renderer->index_stream);
+    if (renderer->upload_stream.id)
+        stream_buffer_end_frame(&renderer->upload_stream);
+
+    resolution->cpu_ms = (f32)time_ticks_to_ms(time_ticks() - resolution->frame_start);
+    renderer->stats.resolution_cpu_ms = resolution->cpu_ms;
+    renderer->stats.resolution_gpu_ms = resolution->gpu_ms;
+    render_capture_replay_end(renderer);
 
     // NOTE(lucas): Invalidate the viewport so that the new frame call will set it correctly to
     // window dimensions if the user does not resize the viewport themselves 
@@ -1411,9 +3357,16 @@ void renderer_render(Renderer* renderer)
     memory_arena_clear(&renderer->scratch_arena);
     memory_arena_clear(&renderer->command_buffer_arena);
     render_command_buffer_clear(&renderer->command_buffer);
+    for (u32 i = 0; i < renderer->thread_count; ++i)
+    {
+        RenderThreadBuffer* thread_buffer = renderer->thread_buffers + i;
+        render_command_buffer_clear(&thread_buffer->command_buffer);
+        memory_arena_clear(&thread_buffer->scratch_arena);
+        thread_buffer->segment_count = 0;
+    }
 
-    for (u32 i = 0; i < countof(renderer->tex_ids); ++i)
-        renderer->textures_to_generate[i] = (Texture){0};
+    PROFILE_END();
+    profile_frame_end();
 }
 
 void renderer_viewport(Renderer* renderer, rect viewport)
@@ -1428,9 +3381,119 @@ void renderer_clear(v4 color)
     glClearColor(color.r, color.g, color.b, color.a);
 }
 
+void renderer_threads_init(Renderer* renderer, u32 thread_count, size command_buffer_bytes)
+{
+    ASSERTF(thread_count <= RENDER_MAX_THREADS, "At most %d threads can record commands", RENDER_MAX_THREADS);
+    if (thread_count > RENDER_MAX_THREADS)
+        thread_count = RENDER_MAX_THREADS;
+
+    for (u32 i = renderer->thread_count; i < thread_count; ++i)
+    {
+        RenderThreadBuffer* thread_buffer = renderer->thread_buffers + i;
+        thread_buffer->arena = memory_arena_alloc(command_buffer_bytes +
+                                                  RENDER_THREAD_MAX_SEGMENTS*sizeof(RenderCommandSegment));
+        thread_buffer->command_buffer = render_command_buffer_alloc(&thread_buffer->arena, command_buffer_bytes);
+        thread_buffer->segments = push_array(&thread_buffer->arena, RENDER_THREAD_MAX_SEGMENTS, RenderCommandSegment);
+        thread_buffer->scratch_arena = memory_arena_alloc(MEGABYTES(1));
+    }
+    if (thread_count > renderer->thread_count)
+        renderer->thread_count = thread_count;
+}
+
+void renderer_thread_begin(Renderer* renderer, u32 thread_index, u64 sort_key)
+{
+    ASSERTF(thread_index < renderer->thread_count, "Thread index %u has no command buffer", thread_index);
+    ASSERT(!render_thread_buffer, "The calling thread is already recording commands");
+
+    RenderThreadBuffer* thread_buffer = renderer->thread_buffers + thread_index;
+    ASSERTF(!atomic_load_i64(&thread_buffer->recording), "Thread index %u is already recording on another thread",
+            thread_index);
+    if (thread_buffer->segment_count >= RENDER_THREAD_MAX_SEGMENTS)
+    {
+        INVALID_CODE_PATH();
+        return;
+    }
+
+    RenderCommandSegment* segment = thread_buffer->segments + thread_buffer->segment_count;
+    segment->key = sort_key;
+    segment->thread = thread_index;
+    segment->sequence = thread_buffer->segment_count;
+    segment->offset = thread_buffer->command_buffer.bytes;
+    segment->bytes = 0;
+
+    atomic_store_i64(&thread_buffer->recording, 1);
+    render_thread_buffer = thread_buffer;
+}
+
+void renderer_thread_end(Renderer* renderer)
+{
+    RenderThreadBuffer* thread_buffer = render_thread_buffer;
+    ASSERT(thread_buffer, "The calling thread is not recording commands");
+    if (!thread_buffer)
+        return;
+
+    RenderCommandSegment* segment = thread_buffer->segments + thread_buffer->segment_count++;
+    segment->bytes = thread_buffer->command_buffer.bytes - segment->offset;
+
+    // NOTE(lucas): Publishes the segment and its commands to the main thread
+    atomic_store_i64(&thread_buffer->recording, 0);
+    render_thread_buffer = 0;
+}
+
+GPUFrameTimes renderer_gpu_times(Renderer* renderer)
+{
+    GPUFrameTimes result = renderer->gpu_profiler.latest;
+    return result;
+}
+
+void renderer_report_gpu_time(Renderer* renderer, f32 gpu_ms)
+{
+    renderer->resolution.gpu_ms = gpu_ms;
+    renderer->resolution.gpu_ms_profiled = false;
+}
+
+u32 renderer_resolution_decisions(Renderer* renderer, DynamicResolutionDecision* decisions, u32 max_decisions)
+{
+    DynamicResolution* resolution = &renderer->resolution;
+    u64 available = resolution->decision_count;
+    if (available > DYNAMIC_RESOLUTION_MAX_DECISIONS)
+        available = DYNAMIC_RESOLUTION_MAX_DECISIONS;
+
+    u32 count = (available < max_decisions) ? (u32)available : max_decisions;
+    u64 first = resolution->decision_count - count;
+    for (u32 i = 0; i < count; ++i)
+        decisions[i] = resolution->decisions[(first + i) % DYNAMIC_RESOLUTION_MAX_DECISIONS];
+    return count;
+}
+
+void renderer_render_target_callback(Renderer* renderer, RenderTargetEventProc* callback, void* data)
+{
+    renderer->render_targets.callback = callback;
+    renderer->render_targets.callback_data = data;
+}
+
+u32 renderer_render_target_events(Renderer* renderer, RenderTargetEvent* events, u32 max_events)
+{
+    RenderTargetManager* manager = &renderer->render_targets;
+    u64 available = manager->event_count;
+    if (available > RENDER_TARGET_MAX_EVENTS)
+        available = RENDER_TARGET_MAX_EVENTS;
+
+    u32 count = (available < max_events) ? (u32)available : max_events;
+    u64 first = manager->event_count - count;
+    for (u32 i = 0; i < count; ++i)
+        events[i] = manager->events[(first + i) % RENDER_TARGET_MAX_EVENTS];
+    return count;
+}
+
+void renderer_invalidate_damage(Renderer* renderer)
+{
+    renderer->damage.valid = false;
+}
+
 void draw_line(Renderer* renderer, v2 start, v2 end, v4 color, f32 thickness, f32 rotation)
 {
-    RenderCommandLine* cmd = render_command_push(&renderer->command_buffer, RenderCommandLine);
+    RenderCommandLine* cmd = render_command_push(renderer_command_buffer(renderer), RenderCommandLine);
     if (!cmd)
         return;
     v2 origin = v2_scale(v2_add(start, end), 0.5f);
@@ -1444,7 +3507,7 @@ void draw_line(Renderer* renderer, v2 start, v2 end, v4 color, f32 thickness, f3
 
 void draw_triangle(Renderer* renderer, v2 a, v2 b, v2 c, v4 color, f32 rotation)
 {
-    RenderCommandTriangle* cmd = render_command_push(&renderer->command_buffer, RenderCommandTriangle);
+    RenderCommandTriangle* cmd = render_command_push(renderer_command_buffer(renderer), RenderCommandTriangle);
     if (!cmd)
         return;
     v2 origin = v2_scale(v2_add(v2_add(a, b), c), 1.0f/3.0f);
@@ -1458,7 +3521,7 @@ void draw_triangle(Renderer* renderer, v2 a, v2 b, v2 c, v4 color, f32 rotation)
 
 void draw_triangle_outline(Renderer* renderer, v2 a, v2 b, v2 c, v4 color, f32 rotation, f32 thickness)
 {
-    RenderCommandTriangleOutline* cmd = render_command_push(&renderer->command_buffer, RenderCommandTriangleOutline);
+    RenderCommandTriangleOutline* cmd = render_command_push(renderer_command_buffer(renderer), RenderCommandTriangleOutline);
     if (!cmd)
         return;
     v2 origin = v2_scale(v2_add(v2_add(a, b), c), 1.0f/3.0f);
@@ -1473,7 +3536,7 @@ void draw_triangle_outline(Renderer* renderer, v2 a, v2 b, v2 c, v4 color, f32 r
 
 void draw_triangle_gradient(Renderer* renderer, v2 a, v2 b, v2 c, v4 color_a, v4 color_b, v4 color_c, f32 rotation)
 {
-    RenderCommandTriangleGradient* cmd = render_command_push(&renderer->command_buffer, RenderCommandTriangleGradient);
+    RenderCommandTriangleGradient* cmd = render_command_push(renderer_command_buffer(renderer), RenderCommandTriangleGradient);
     if (!cmd)
         return;
     v2 origin = v2_scale(v2_add(v2_add(a, b), c), 1.0f/3.0f);
@@ -1489,7 +3552,7 @@ void draw_triangle_gradient(Renderer* renderer, v2 a, v2 b, v2 c, v4 color_a, v4
 
 void draw_quad(Renderer* renderer, v2 position, v2 size, v4 color, f32 rotation)
 {
-    RenderCommandQuad* cmd = render_command_push(&renderer->command_buffer, RenderCommandQuad);
+    RenderCommandQuad* cmd = render_command_push(renderer_command_buffer(renderer), RenderCommandQuad);
     if (!cmd)
         return;
     v2 origin = v2_add(position, v2_scale(size, 0.5f));
@@ -1502,7 +3565,7 @@ void draw_quad(Renderer* renderer, v2 position, v2 size, v4 color, f32 rotation)
 
 void draw_quad_outline(Renderer* renderer, v2 position, v2 size, v4 color, f32 thickness, f32 rotation)
 {
-    RenderCommandQuadOutline* cmd = render_command_push(&renderer->command_buffer, RenderCommandQuadOutline);
+    RenderCommandQuadOutline* cmd = render_command_push(renderer_command_buffer(renderer), RenderCommandQuadOutline);
     if (!cmd)
         return;
     v2 origin = v2_add(position, v2_scale(size, 0.5f));
@@ -1517,7 +3580,7 @@ void draw_quad_outline(Renderer* renderer, v2 position, v2 size, v4 color, f32 t
 void draw_quad_gradient(Renderer* renderer, v2 position, v2 size, v4 color_bl, v4 color_br, v4 color_tr, v4 color_tl,
                         f32 rotation)
 {
-    RenderCommandQuadGradient* cmd = render_command_push(&renderer->command_buffer, RenderCommandQuadGradient);
+    RenderCommandQuadGradient* cmd = render_command_push(renderer_command_buffer(renderer), RenderCommandQuadGradient);
     if (!cmd)
         return;
     v2 origin = v2_add(position, v2_scale(size, 0.5f));
@@ -1531,9 +3594,31 @@ void draw_quad_gradient(Renderer* renderer, v2 position, v2 size, v4 color_bl, v
     cmd->rotation = rotation;
 }
 
+void draw_quad_rounded(Renderer* renderer, v2 position, v2 size, v4 color, f32 radius, f32 rotation)
+{
+    draw_quad_rounded_outline(renderer, position, size, color, radius, rotation, 0.0f);
+}
+
+// NOTE(lucas): A thickness of 0 draws a filled quad
+void draw_quad_rounded_outline(Renderer* renderer, v2 position, v2 size, v4 color, f32 radius, f32 rotation,
+                               f32 thickness)
+{
+    RenderCommandQuadRounded* cmd = render_command_push(renderer_command_buffer(renderer), RenderCommandQuadRounded);
+    if (!cmd)
+        return;
+    v2 origin = v2_add(position, v2_scale(size, 0.5f));
+    cmd->position = position;
+    cmd->origin = origin;
+    cmd->size = size;
+    cmd->color = color;
+    cmd->radius = radius;
+    cmd->thickness = thickness;
+    cmd->rotation = rotation;
+}
+
 void draw_circle(Renderer* renderer, v2 center, f32 radius, v4 color)
 {
-    RenderCommandCircle* cmd = render_command_push(&renderer->command_buffer, RenderCommandCircle);
+    RenderCommandCircle* cmd = render_command_push(renderer_command_buffer(renderer), RenderCommandCircle);
     if (!cmd)
         return;
     cmd->center = center;
@@ -1543,7 +3628,7 @@ void draw_circle(Renderer* renderer, v2 center, f32 radius, v4 color)
 
 void draw_circle_outline(Renderer* renderer, v2 center, f32 radius, v4 color, f32 thickness)
 {
-    RenderCommandCircleOutline* cmd = render_command_push(&renderer->command_buffer, RenderCommandCircleOutline);
+    RenderCommandCircleOutline* cmd = render_command_push(renderer_command_buffer(renderer), RenderCommandCircleOutline);
     if (!cmd)
         return;
     cmd->center = center;
@@ -1554,7 +3639,7 @@ void draw_circle_outline(Renderer* renderer, v2 center, f32 radius, v4 color, f3
 
 void draw_circle_sector(Renderer* renderer, v2 center, f32 radius, f32 start_angle, f32 end_angle, v4 color, f32 rotation)
 {
-    RenderCommandCircleSector* cmd = render_command_push(&renderer->command_buffer, RenderCommandCircleSector);
+    RenderCommandCircleSector* cmd = render_command_push(renderer_command_buffer(renderer), RenderCommandCircleSector);
     if (!cmd)
         return;
     cmd->center = center;
@@ -1568,7 +3653,7 @@ void draw_circle_sector(Renderer* renderer, v2 center, f32 radius, f32 start_ang
 void draw_ring(Renderer* renderer, v2 center, f32 outer_radius, f32 inner_radius, f32 start_angle, f32 end_angle,
                v4 color, f32 rotation)
 {
-    RenderCommandRing* cmd = render_command_push(&renderer->command_buffer, RenderCommandRing);
+    RenderCommandRing* cmd = render_command_push(renderer_command_buffer(renderer), RenderCommandRing);
     if (!cmd)
         return;
     cmd->center = center;
@@ -1583,7 +3668,7 @@ void draw_ring(Renderer* renderer, v2 center, f32 outer_radius, f32 inner_radius
 void draw_ring_outline(Renderer* renderer, v2 center, f32 outer_radius, f32 inner_radius, f32 start_angle,
                        f32 end_angle, v4 color, f32 rotation, f32 thickness)
 {
-    RenderCommandRingOutline* cmd = render_command_push(&renderer->command_buffer, RenderCommandRingOutline);
+    RenderCommandRingOutline* cmd = render_command_push(renderer_command_buffer(renderer), RenderCommandRingOutline);
     if (!cmd)
         return;
     cmd->center = center;
@@ -1598,7 +3683,7 @@ void draw_ring_outline(Renderer* renderer, v2 center, f32 outer_radius, f32 inne
 
 void draw_sprite(Renderer* renderer, Sprite sprite)
 {
-    RenderCommandSprite* cmd = render_command_push(&renderer->command_buffer, RenderCommandSprite);
+    RenderCommandSprite* cmd = render_command_push(renderer_command_buffer(renderer), RenderCommandSprite);
     if (!cmd)
         return;
     cmd->sprite = sprite;
@@ -1606,40 +3691,178 @@ void draw_sprite(Renderer* renderer, Sprite sprite)
 
 void draw_text(Renderer* renderer, Text text)
 {
-    RenderCommandText* cmd = render_command_push(&renderer->command_buffer, RenderCommandText);
+    RenderCommandText* cmd = render_command_push(renderer_command_buffer(renderer), RenderCommandText);
     if (!cmd)
         return;
 
     cmd->text = text;
-    cmd->text.string = s8_copy(text.string, &renderer->scratch_arena);
+    cmd->text.string = s8_copy(text.string, renderer_command_arena(renderer));
 }
 
 void draw_scissor_test(Renderer* renderer, rect clip)
 {
-    RenderCommandScissorTest* cmd = render_command_push(&renderer->command_buffer, RenderCommandScissorTest);
+    RenderCommandScissorTest* cmd = render_command_push(renderer_command_buffer(renderer), RenderCommandScissorTest);
     if (!cmd)
         return;
     cmd->clip = clip;
 }
 
-u32 renderer_next_tex_id(Renderer* renderer)
+void draw_ui(Renderer* renderer, u32 vertex_bytes, u32 element_bytes)
 {
-    u32 id = 0;
-    
-    if (renderer->tex_index <= countof(renderer->tex_ids))
+    RenderCommandUI* cmd = render_command_push(renderer_command_buffer(renderer), RenderCommandUI);
+    if (!cmd)
+        return;
+    cmd->vertex_bytes = vertex_bytes;
+    cmd->element_bytes = element_bytes;
+}
+
+void draw_ui_cache_begin(Renderer* renderer, rect clip)
+{
+    RenderCommandUICacheBegin* cmd = render_command_push(renderer_command_buffer(renderer), RenderCommandUICacheBegin);
+    if (!cmd)
+        return;
+    cmd->clip = clip;
+}
+
+void draw_ui_cache_composite(Renderer* renderer)
+{
+    render_command_push(renderer_command_buffer(renderer), RenderCommandUICacheComposite);
+}
+
+internal TextureSlot* renderer_texture_slot(Renderer* renderer, TextureHandle handle)
+{
+    TextureSlot* result = NULL;
+    if (handle.index < RENDERER_MAX_TEXTURES)
+    {
+        TextureSlot* slot = renderer->texture_slots + handle.index;
+        if (slot->allocated && slot->generation == handle.generation)
+            result = slot;
+    }
+    return result;
+}
+
+TextureHandle renderer_texture_alloc(Renderer* renderer)
+{
+    TextureHandle result = {0};
+    u32 index = renderer->texture_free_head;
+    if (index == TEXTURE_SLOT_NONE)
+    {
+        log_error("Out of texture slots (%d)", RENDERER_MAX_TEXTURES);
+        return result;
+    }
+
+    TextureSlot* slot = renderer->texture_slots + index;
+    renderer->texture_free_head = slot->next_free;
+    slot->next_free = TEXTURE_SLOT_NONE;
+    slot->allocated = true;
+
+    result.index = index;
+    result.generation = slot->generation;
+    return result;
+}
+
+void renderer_texture_free(Renderer* renderer, TextureHandle handle)
+{
+    TextureSlot* slot = renderer_texture_slot(renderer, handle);
+    if (!slot)
+        return;
+
+    // NOTE(lucas): The slot only goes back on the free list once its GL texture has been replaced at the next render
+    slot->allocated = false;
+    slot->upload_pending = false;
+    slot->upload = (Texture){0};
+    slot->layers = 0;
+    ++slot->generation;
+    if (!slot->generation)
+        slot->generation = 1;
+    renderer->pending_frees[renderer->pending_free_count++] = handle.index;
+}
+
+b32 renderer_texture_valid(Renderer* renderer, TextureHandle handle)
+{
+    b32 result = (renderer_texture_slot(renderer, handle) != NULL);
+    return result;
+}
+
+u32 renderer_texture_id(Renderer* renderer, TextureHandle handle)
+{
+    TextureSlot* slot = renderer_texture_slot(renderer, handle);
+    u32 result = slot ? slot->id : 0;
+    return result;
+}
+
+void renderer_texture_upload(Renderer* renderer, TextureHandle handle, Texture texture)
+{
+    TextureSlot* slot = renderer_texture_slot(renderer, handle);
+    if (!slot)
+        return;
+
+    texture.id = slot->id;
+    slot->upload = texture;
+    if (!slot->upload_pending)
     {
-        id = renderer->tex_ids[renderer->tex_index].id;
-        renderer->tex_ids[renderer->tex_index].used = true;
+        slot->upload_pending = true;
+        renderer->pending_uploads[renderer->pending_upload_count++] = handle.index;
     }
+}
 
-    return id;
+void renderer_texture_storage(Renderer* renderer, TextureHandle handle, int width, int height, int layers,
+                              int channels)
+{
+    ASSERTF(channels == 1 || channels == 4, "Texture storage must have 1 or 4 channels, not %d", channels);
+    TextureSlot* slot = renderer_texture_slot(renderer, handle);
+    if (!slot)
+        return;
+
+    Texture storage = {0};
+    storage.id = slot->id;
+    storage.size = v2((f32)width, (f32)height);
+    storage.channels = channels;
+    storage.layers = layers;
+    renderer_texture_upload(renderer, handle, storage);
+    slot->layers = layers;
 }
 
-void renderer_push_texture(Renderer* renderer, Texture tex)
+void renderer_texture_update(Renderer* renderer, TextureUpdate update)
 {
-    if (renderer->tex_index <= countof(renderer->tex_ids))
+    ASSERTF(update.x >= 0 && update.y >= 0 && update.x + update.width <= update.row_length,
+            "Texture update at (%d, %d) does not fit in an image %d pixels wide", update.x, update.y, update.row_length);
+    if (!renderer_texture_slot(renderer, update.handle) || update.width <= 0 || update.height <= 0)
+        return;
+
+    // NOTE(lucas): Only the newest update of the layer can be merged, otherwise an older image could end up being
+    // uploaded over a newer one
+    for (u32 i = renderer->pending_update_count; i-- > 0;)
+    {
+        TextureUpdate* pending = renderer->pending_updates + i;
+        if (pending->handle.index != update.handle.index || pending->handle.generation != update.handle.generation ||
+            pending->layer != update.layer)
+            continue;
+
+        if (pending->pixels == update.pixels && pending->row_length == update.row_length &&
+            pending->channels == update.channels)
+        {
+            i32 x1 = pending->x + pending->width;
+            i32 y1 = pending->y + pending->height;
+            if (update.x + update.width > x1)
+                x1 = update.x + update.width;
+            if (update.y + update.height > y1)
+                y1 = update.y + update.height;
+            if (update.x < pending->x)
+                pending->x = update.x;
+            if (update.y < pending->y)
+                pending->y = update.y;
+            pending->width = x1 - pending->x;
+            pending->height = y1 - pending->y;
+            return;
+        }
+        break;
+    }
+
+    if (renderer->pending_update_count >= RENDERER_MAX_TEXTURE_UPDATES)
     {
-        renderer->textures_to_generate[renderer->tex_index] = tex;
-        ++renderer->tex_index;
+        log_error("Too many texture updates queued (%d), dropping one", RENDERER_MAX_TEXTURE_UPDATES);
+        return;
     }
+    renderer->pending_updates[renderer->pending_update_count++] = update;
 }
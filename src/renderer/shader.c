@@ -2,12 +2,285 @@
 #include "alchemy/renderer/renderer.h"
 #include "alchemy/util/log.h"
 #include "alchemy/util/memory.h"
+#include "alchemy/util/profile.h"
 #include "alchemy/util/str.h"
 #include "alchemy/util/types.h"
 
 #include <glad/glad.h>
 
 #include <stdio.h> // File I/O
+#include <string.h> // memset, strncpy
+
+// NOTE(lucas): A binding of GL_STATE_UNKNOWN is never skipped
+#define GL_STATE_UNKNOWN 0xFFFFFFFF
+#define GL_STATE_MAX_TEXTURE_UNITS 8
+
+typedef struct GLState
+{
+    u32 program;
+    u32 vao;
+
+    u32 array_buffer;
+    u32 copy_write_buffer;
+    u32 uniform_buffer;
+    u32 pixel_unpack_buffer;
+
+    u32 active_texture;
+    u32 texture_2d[GL_STATE_MAX_TEXTURE_UNITS];
+    u32 texture_2d_multisample[GL_STATE_MAX_TEXTURE_UNITS];
+    u32 texture_2d_array[GL_STATE_MAX_TEXTURE_UNITS];
+
+    GLStateStats stats;
+} GLState;
+
+global GLState gl_state;
+global b32 gl_state_initialized;
+
+global ShaderUniformTable shader_uniform_tables[SHADER_MAX_PROGRAMS];
+global u32 shader_uniform_table_count;
+
+void gl_state_reset(void)
+{
+    GLStateStats stats = gl_state.stats;
+    memset(&gl_state, 0xFF, sizeof(gl_state));
+    gl_state.stats = stats;
+    gl_state_initialized = true;
+}
+
+GLStateStats gl_state_stats(void)
+{
+    return gl_state.stats;
+}
+
+void gl_state_stats_reset(void)
+{
+    gl_state.stats = (GLStateStats){0};
+}
+
+// Returns true if the binding changed and the bind must be issued
+internal b32 gl_state_update(u32* binding, u32 value)
+{
+    if (!gl_state_initialized)
+        gl_state_reset();
+
+    if (binding && *binding == value && value != GL_STATE_UNKNOWN)
+    {
+        ++gl_state.stats.binds_skipped;
+        return false;
+    }
+
+    if (binding)
+        *binding = value;
+    ++gl_state.stats.binds_issued;
+    return true;
+}
+
+internal u32* gl_buffer_binding(u32 target)
+{
+    u32* result = NULL;
+    switch (target)
+    {
+        case GL_ARRAY_BUFFER:        result = &gl_state.array_buffer; break;
+        case GL_COPY_WRITE_BUFFER:   result = &gl_state.copy_write_buffer; break;
+        case GL_UNIFORM_BUFFER:      result = &gl_state.uniform_buffer; break;
+        case GL_PIXEL_UNPACK_BUFFER: result = &gl_state.pixel_unpack_buffer; break;
+
+        // NOTE(lucas): The element array buffer binding belongs to the bound VAO, so it is not tracked
+        default: break;
+    }
+    return result;
+}
+
+internal u32* gl_texture_binding(u32 target)
+{
+    if (!gl_state_initialized)
+        gl_state_reset();
+
+    u32 unit = gl_state.active_texture - GL_TEXTURE0;
+    if (unit >= GL_STATE_MAX_TEXTURE_UNITS)
+        return NULL;
+
+    u32* result = NULL;
+    switch (target)
+    {
+        case GL_TEXTURE_2D:             result = gl_state.texture_2d + unit; break;
+        case GL_TEXTURE_2D_MULTISAMPLE: result = gl_state.texture_2d_multisample + unit; break;
+        case GL_TEXTURE_2D_ARRAY:       result = gl_state.texture_2d_array + unit; break;
+        default: break;
+    }
+    return result;
+}
+
+void gl_use_program(u32 program)
+{
+    if (gl_state_update(&gl_state.program, program))
+        glUseProgram(program);
+}
+
+void gl_bind_vertex_array(u32 vao)
+{
+    if (gl_state_update(&gl_state.vao, vao))
+        glBindVertexArray(vao);
+}
+
+void gl_bind_buffer(u32 target, u32 buffer)
+{
+    if (gl_state_update(gl_buffer_binding(target), buffer))
+        glBindBuffer(target, buffer);
+}
+
+void gl_active_texture(u32 unit)
+{
+    if (gl_state_update(&gl_state.active_texture, unit))
+        glActiveTexture(unit);
+}
+
+void gl_bind_texture(u32 target, u32 texture)
+{
+    if (gl_state_update(gl_texture_binding(target), texture))
+        glBindTexture(target, texture);
+}
+
+internal void gl_forget(u32* binding, u32 count, u32 id)
+{
+    for (u32 i = 0; i < count; ++i)
+    {
+        if (binding[i] == id)
+            binding[i] = GL_STATE_UNKNOWN;
+    }
+}
+
+void gl_forget_program(u32 program)
+{
+    gl_forget(&gl_state.program, 1, program);
+}
+
+void gl_forget_vertex_array(u32 vao)
+{
+    gl_forget(&gl_state.vao, 1, vao);
+}
+
+void gl_forget_buffer(u32 buffer)
+{
+    gl_forget(&gl_state.array_buffer, 1, buffer);
+    gl_forget(&gl_state.copy_write_buffer, 1, buffer);
+    gl_forget(&gl_state.uniform_buffer, 1, buffer);
+    gl_forget(&gl_state.pixel_unpack_buffer, 1, buffer);
+}
+
+void gl_forget_texture(u32 texture)
+{
+    gl_forget(gl_state.texture_2d, GL_STATE_MAX_TEXTURE_UNITS, texture);
+    gl_forget(gl_state.texture_2d_multisample, GL_STATE_MAX_TEXTURE_UNITS, texture);
+    gl_forget(gl_state.texture_2d_array, GL_STATE_MAX_TEXTURE_UNITS, texture);
+}
+
+internal u32 shader_hash_name(const char* name)
+{
+    // NOTE(lucas): FNV-1a
+    u32 hash = 2166136261u;
+    for (const char* c = name; *c; ++c)
+    {
+        hash ^= (u8)*c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+internal ShaderUniformTable* shader_uniform_table_find(u32 program)
+{
+    persist u32 last = 0;
+    if (last < shader_uniform_table_count && shader_uniform_tables[last].program == program)
+        return shader_uniform_tables + last;
+
+    for (u32 i = 0; i < shader_uniform_table_count; ++i)
+    {
+        if (shader_uniform_tables[i].program == program)
+        {
+            last = i;
+            return shader_uniform_tables + i;
+        }
+    }
+    return NULL;
+}
+
+internal void shader_uniform_table_insert(ShaderUniformTable* table, const char* name, i32 location)
+{
+    ASSERTF(table->count < SHADER_MAX_UNIFORMS/2, "Too many uniforms in shader program %u", table->program);
+
+    u32 hash = shader_hash_name(name);
+    u32 mask = SHADER_MAX_UNIFORMS - 1;
+    u32 slot = hash & mask;
+    while (table->uniforms[slot].location >= 0)
+        slot = (slot + 1) & mask;
+
+    ShaderUniform* uniform = table->uniforms + slot;
+    uniform->hash = hash;
+    uniform->location = location;
+    strncpy(uniform->name, name, SHADER_MAX_UNIFORM_NAME_LEN - 1);
+    uniform->name[SHADER_MAX_UNIFORM_NAME_LEN - 1] = '\0';
+    ++table->count;
+}
+
+// Query all active uniforms of a linked program and store their locations
+internal void shader_uniform_table_build(u32 program)
+{
+    ASSERT(shader_uniform_table_count < SHADER_MAX_PROGRAMS, "Too many shader programs");
+    ShaderUniformTable* table = shader_uniform_tables + shader_uniform_table_count++;
+    table->program = program;
+    table->count = 0;
+    for (u32 i = 0; i < SHADER_MAX_UNIFORMS; ++i)
+        table->uniforms[i].location = -1;
+
+    GLint uniform_count = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &uniform_count);
+    for (GLint i = 0; i < uniform_count; ++i)
+    {
+        char name[SHADER_MAX_UNIFORM_NAME_LEN];
+        GLsizei len = 0;
+        GLint array_size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(program, i, sizeof(name), &len, &array_size, &type, name);
+
+        // NOTE(lucas): Arrays are reported as name[0], but should be looked up by their plain name
+        if (len > 3 && str_eq(name + len - 3, "[0]"))
+            name[len - 3] = '\0';
+
+        // NOTE(lucas): Uniform block members do not have locations
+        GLint location = glGetUniformLocation(program, name);
+        if (location >= 0)
+            shader_uniform_table_insert(table, name, location);
+    }
+}
+
+internal void shader_uniform_table_remove(u32 program)
+{
+    ShaderUniformTable* table = shader_uniform_table_find(program);
+    if (table)
+        *table = shader_uniform_tables[--shader_uniform_table_count];
+}
+
+i32 shader_uniform_location(u32 shader, const char* name)
+{
+    ShaderUniformTable* table = shader_uniform_table_find(shader);
+    if (table)
+    {
+        u32 hash = shader_hash_name(name);
+        u32 mask = SHADER_MAX_UNIFORMS - 1;
+        for (u32 slot = hash & mask; table->uniforms[slot].location >= 0; slot = (slot + 1) & mask)
+        {
+            ShaderUniform* uniform = table->uniforms + slot;
+            if (uniform->hash == hash && str_eq(uniform->name, (char*)name))
+            {
+                ++gl_state.stats.uniform_cache_hits;
+                return uniform->location;
+            }
+        }
+    }
+
+    ++gl_state.stats.uniform_cache_misses;
+    return glGetUniformLocation(shader, name);
+}
 
 internal char* file_to_string(const char* path, MemoryArena* arena)
 {
@@ -43,7 +316,7 @@ internal void shader_error_check(GLuint shader, const char* filename)
     else if (glIsProgram(shader))
         glGetProgramiv(shader, GL_LINK_STATUS, &success);
     else
-        ASSERT(0, "Shader error (%s): Object is not a shader or shader program.", filename);
+        ASSERTF(0, "Shader error (%s): Object is not a shader or shader program.", filename);
 
     if (!success)
     {
@@ -51,7 +324,7 @@ internal void shader_error_check(GLuint shader, const char* filename)
         {
             glGetShaderInfoLog(shader, sizeof(info_log), NULL, info_log);
             log_error(info_log);
-            ASSERT(0, "Shader error (%s): Compilation failed", filename);
+            ASSERTF(0, "Shader error (%s): Compilation failed", filename);
         }
         else if (glIsProgram(shader))
         {
@@ -65,6 +338,7 @@ internal void shader_error_check(GLuint shader, const char* filename)
 
 u32 shader_init(Renderer* renderer, const char* vert_shader_path, const char* frag_shader_path)
 {
+    PROFILE_BEGIN("shader_init");
     // Read shaders from files
     char* vert_shader_source = file_to_string(vert_shader_path, &renderer->scratch_arena);
     char* frag_shader_source = file_to_string(frag_shader_path, &renderer->scratch_arena);
@@ -100,86 +374,95 @@ u32 shader_init(Renderer* renderer, const char* vert_shader_path, const char* fr
     glDeleteShader(vert_shader);
     glDeleteShader(frag_shader);
 
+    shader_uniform_table_build(shader);
+
+    GLuint frame_block = glGetUniformBlockIndex(shader, "Frame");
+    if (frame_block != GL_INVALID_INDEX)
+        glUniformBlockBinding(shader, frame_block, SHADER_FRAME_BLOCK_BINDING);
+
+    PROFILE_END();
     return shader;
 }
 
 void shader_bind(u32 id)
 {
-    glUseProgram(id);
+    gl_use_program(id);
 }
 
 void shader_unbind()
 {
-    glUseProgram(0);
+    gl_use_program(0);
 }
 
 void shader_delete(u32 id)
 {
+    shader_uniform_table_remove(id);
+    gl_forget_program(id);
     glDeleteProgram(id);
 }
 
 void shader_set_i32(u32 shader, const char* name, i32 value)
 {
     shader_bind(shader);
-    glUniform1i(glGetUniformLocation(shader, name), value);
+    glUniform1i(shader_uniform_location(shader, name), value);
 }
 
 void shader_set_iv2(u32 shader, const char* name, iv2 value)
 {
     shader_bind(shader);
-    glUniform2i(glGetUniformLocation(shader, name), value.x, value.y);
+    glUniform2i(shader_uniform_location(shader, name), value.x, value.y);
 }
 
 void shader_set_iv3(u32 shader, const char* name, iv3 value)
 {
     shader_bind(shader);
-    glUniform3i(glGetUniformLocation(shader, name), value.x, value.y, value.z);
+    glUniform3i(shader_uniform_location(shader, name), value.x, value.y, value.z);
 }
 
 void shader_set_iv4(u32 shader, const char* name, iv4 value)
 {
     shader_bind(shader);
-    glUniform4i(glGetUniformLocation(shader, name), value.x, value.y, value.z, value.w);
+    glUniform4i(shader_uniform_location(shader, name), value.x, value.y, value.z, value.w);
 }
 
 void shader_set_f32(u32 shader, const char* name, f32 value)
 {
     shader_bind(shader);
-    glUniform1f(glGetUniformLocation(shader, name), value);
+    glUniform1f(shader_uniform_location(shader, name), value);
 }
 
 void shader_set_v2(u32 shader, const char* name, v2 value)
 {
     shader_bind(shader);
-    glUniform2f(glGetUniformLocation(shader, name), value.x, value.y);
+    glUniform2f(shader_uniform_location(shader, name), value.x, value.y);
 }
 
 void shader_set_v3(u32 shader, const char* name, v3 value)
 {
     shader_bind(shader);
-    glUniform3f(glGetUniformLocation(shader, name), value.x, value.y, value.z);
+    glUniform3f(shader_uniform_location(shader, name), value.x, value.y, value.z);
 }
 
 void shader_set_v4(u32 shader, const char* name, v4 value)
 {
     shader_bind(shader);
-    glUniform4f(glGetUniformLocation(shader, name), value.x, value.y, value.z, value.w);
+    glUniform4f(shader_uniform_location(shader, name), value.x, value.y, value.z, value.w);
 }
 
 void shader_set_m2(u32 shader, const char* name, m2 value, b32 transpose)
 {
     shader_bind(shader);
-    glUniformMatrix2fv(glGetUniformLocation(shader, name), 1, (GLboolean)transpose, value.raw[0]);
+    glUniformMatrix2fv(shader_uniform_location(shader, name), 1, (GLboolean)transpose, value.raw[0]);
 }
 
 void shader_set_m3(u32 shader, const char* name, m3 value, b32 transpose)
 {
     shader_bind(shader);
-    glUniformMatrix3fv(glGetUniformLocation(shader, name), 1, (GLboolean)transpose, value.raw[0]);
+    glUniformMatrix3fv(shader_uniform_location(shader, name), 1, (GLboolean)transpose, value.raw[0]);
 }
 
 void shader_set_m4(u32 shader, const char* name, m4 value, b32 transpose)
 {
     shader_bind(shader);
-    glUniformMatrix4fv(glGetUniformLocation(shader, name), 1, (GLboolean)transpose, value.raw[0]);
+    glUniformMatrix4fv(shader_uniform_location(shader, name), 1, (GLboolean)transpose, value.raw[0]);
 }
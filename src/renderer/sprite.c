@@ -14,6 +14,7 @@ Sprite sprite_init(Texture* tex)
     sprite.rotation = 0.0f;
     sprite.position = v2_zero();
     sprite.color = v4_one();
+    sprite.uv = rect_min_dim(v2_zero(), v2_one());
 
     return sprite;
 }
@@ -21,6 +22,15 @@ Sprite sprite_init(Texture* tex)
 void output_sprite(Renderer* renderer, RenderCommandSprite* cmd)
 {
     Sprite sprite = cmd->sprite;
+
+    // NOTE(lucas): The single sprite shader only samples 2D textures, so texture arrays always go through the batch
+    if (sprite.texture->layers)
+    {
+        sprite_batch_push(renderer, &sprite);
+        sprite_batch_flush(renderer);
+        return;
+    }
+
     m4 model = m4_identity();
     model = m4_translate(model, (v3){sprite.position.x, sprite.position.y, 0.0f});
 
@@ -37,10 +47,98 @@ void output_sprite(Renderer* renderer, RenderCommandSprite* cmd)
     // Set model matrix and color shader values
     shader_set_m4(renderer->sprite_renderer.shader, "model", model, 0);
     shader_set_v4(renderer->sprite_renderer.shader, "color", sprite.color);
+    shader_set_v4(renderer->sprite_renderer.shader, "uv_rect", v4(sprite.uv.x, sprite.uv.y, sprite.uv.width, sprite.uv.height));
 
     texture_bind(sprite.texture, 0);
 
-    glBindVertexArray(renderer->sprite_renderer.vao);
+    gl_bind_vertex_array(renderer->sprite_renderer.vao);
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+}
+
+void sprite_batch_flush(Renderer* renderer)
+{
+    SpriteBatch* batch = &renderer->sprite_batch;
+    if (!batch->sprite_count)
+        return;
+
+    size vertex_bytes = SPRITE_BATCH_VERTEX_FLOATS*sizeof(f32);
+    size bytes = 4*batch->sprite_count*vertex_bytes;
+    size offset = stream_buffer_push(&renderer->vertex_stream, batch->vertices, bytes, vertex_bytes);
+
+    if (batch->texture_is_array)
+    {
+        shader_bind(renderer->sprite_array_shader);
+        gl_active_texture(GL_TEXTURE0);
+        gl_bind_texture(GL_TEXTURE_2D_ARRAY, batch->texture);
+    }
+    else
+    {
+        shader_bind(renderer->sprite_batch_renderer.shader);
+        texture_bind_id(batch->texture, 0);
+    }
+
+    // NOTE(lucas): The index buffer holds the same quad pattern for every sprite, so only vertices are streamed
+    gl_bind_vertex_array(renderer->sprite_batch_renderer.vao);
+    glDrawElementsBaseVertex(GL_TRIANGLES, 6*batch->sprite_count, GL_UNSIGNED_INT, 0, (GLint)(offset / vertex_bytes));
+
+    ++renderer->stats.sprite_draw_calls;
+    renderer->stats.sprites_batched += batch->sprite_count;
+
+    batch->sprite_count = 0;
+}
+
+internal void sprite_batch_push_vertex(f32* v, v2 pos, v2 uv, v4 color, f32 layer)
+{
+    v[0] = pos.x;
+    v[1] = pos.y;
+    v[2] = uv.x;
+    v[3] = uv.y;
+    v[4] = color.r;
+    v[5] = color.g;
+    v[6] = color.b;
+    v[7] = color.a;
+    v[8] = layer;
+}
+
+void sprite_batch_push(Renderer* renderer, Sprite* sprite)
+{
+    SpriteBatch* batch = &renderer->sprite_batch;
+    Texture* texture = sprite->texture;
+    b32 is_array = (texture->layers > 0);
+
+    if (batch->sprite_count && (batch->texture != texture->id || batch->texture_is_array != is_array))
+        sprite_batch_flush(renderer);
+    if (batch->sprite_count >= batch->max_sprites)
+        sprite_batch_flush(renderer);
+
+    batch->texture = texture->id;
+    batch->texture_is_array = is_array;
+
+    // NOTE(lucas): Same transform as output_sprite: rotate about the center of the quad, then move into place
+    v2 half_size = v2_scale(sprite->size, 0.5f);
+    v2 center = v2_add(sprite->position, half_size);
+    f32 angle = glm_rad(sprite->rotation);
+    f32 c = cos_f32(angle);
+    f32 s = sin_f32(angle);
+    v2 x_axis = v2(c*half_size.x, s*half_size.x);
+    v2 y_axis = v2(-s*half_size.y, c*half_size.y);
+
+    // NOTE(lucas): Corners of the unit quad, matching the texture coordinates of the sprite renderer's vertices
+    v2 corner00 = v2_sub(center, v2_add(x_axis, y_axis));
+    v2 corner10 = v2_add(center, v2_sub(x_axis, y_axis));
+    v2 corner11 = v2_add(center, v2_add(x_axis, y_axis));
+    v2 corner01 = v2_sub(center, v2_sub(x_axis, y_axis));
+
+    rect uv = sprite->uv;
+    v2 uv_min = uv.position;
+    v2 uv_max = v2_add(uv.position, uv.size);
+
+    f32 layer = (f32)sprite->layer;
+    f32* v = batch->vertices + 4*batch->sprite_count*SPRITE_BATCH_VERTEX_FLOATS;
+    sprite_batch_push_vertex(v + 0*SPRITE_BATCH_VERTEX_FLOATS, corner00, v2(uv_min.x, uv_max.y), sprite->color, layer);
+    sprite_batch_push_vertex(v + 1*SPRITE_BATCH_VERTEX_FLOATS, corner10, v2(uv_max.x, uv_max.y), sprite->color, layer);
+    sprite_batch_push_vertex(v + 2*SPRITE_BATCH_VERTEX_FLOATS, corner11, v2(uv_max.x, uv_min.y), sprite->color, layer);
+    sprite_batch_push_vertex(v + 3*SPRITE_BATCH_VERTEX_FLOATS, corner01, v2(uv_min.x, uv_min.y), sprite->color, layer);
+
+    ++batch->sprite_count;
 }
@@ -3,10 +3,14 @@
 #include "alchemy/util/file.h"
 #include "alchemy/util/intrin.h"
 #include "alchemy/util/log.h"
+#include "alchemy/util/profile.h"
 
 #include <glad/glad.h>
 #include <stb_image/stb_image.h>
 
+#include <stdlib.h> // malloc, free
+#include <string.h> // memcpy
+
 // TODO(lucas): Full bitmap support should separate the BMP header from the DIB header
 // and allow using different versions of the DIB header.
 #pragma pack(push, 1)
@@ -170,7 +174,7 @@ Texture texture_generate(int samples)
     // Generate texture
     Texture texture = {0};
     glGenTextures(1, &texture.id);
-    glBindTexture(target, texture.id);
+    gl_bind_texture(target, texture.id);
 
     // Texture options
     if (samples <= 0)
@@ -199,6 +203,7 @@ void texture_fill_empty_data(Texture* texture, int width, int height, int sample
 
 Texture texture_load_from_file(const char* filename, Renderer* renderer, MemoryArena* arena)
 {
+    PROFILE_BEGIN("texture_load_from_file");
     size file_size = file_get_size(filename);
     void* file = file_open(filename, FileMode_Read);
     u16 signature = 0;
@@ -221,29 +226,62 @@ Texture texture_load_from_file(const char* filename, Renderer* renderer, MemoryA
     }
     ASSERT(tex.data, "Failed to load texture");
 
-    tex.id = renderer_next_tex_id(renderer);
-    renderer_push_texture(renderer, tex);
+    tex.handle = renderer_texture_alloc(renderer);
+    tex.id = renderer_texture_id(renderer, tex.handle);
+    renderer_texture_upload(renderer, tex.handle, tex);
+    PROFILE_END();
     return tex;
 }
 
 Texture texture_load_from_memory(Renderer* renderer, int width, int height, int channels, ubyte* memory)
 {
     Texture tex = {0};
-    tex.id = renderer_next_tex_id(renderer);
+    tex.handle = renderer_texture_alloc(renderer);
+    tex.id = renderer_texture_id(renderer, tex.handle);
     tex.data = memory;
     tex.size = v2((f32)width, (f32)height);
     tex.channels = channels;
 
-    renderer_push_texture(renderer, tex);
+    renderer_texture_upload(renderer, tex.handle, tex);
     return tex;
 }
 
+Texture texture_array_init(Renderer* renderer, int width, int height, int layers)
+{
+    Texture array = {0};
+    array.handle = renderer_texture_alloc(renderer);
+    array.id = renderer_texture_id(renderer, array.handle);
+    array.size = v2((f32)width, (f32)height);
+    array.channels = 4;
+    array.layers = layers;
+
+    renderer_texture_storage(renderer, array.handle, width, height, layers, 4);
+    return array;
+}
+
+// Upload pixel data with the array's dimensions into one layer
+void texture_array_set_layer(Renderer* renderer, Texture* array, int layer, int channels, ubyte* data)
+{
+    ASSERTF(layer >= 0 && layer < array->layers, "Texture array layer %d out of range", layer);
+    ASSERTF(channels >= 1 && channels <= 4, "Unsupported number of channels (%d)", channels);
+
+    TextureUpdate update = {0};
+    update.handle = array->handle;
+    update.layer = layer;
+    update.width = (i32)array->size.x;
+    update.height = (i32)array->size.y;
+    update.channels = channels;
+    update.row_length = update.width;
+    update.pixels = data;
+    renderer_texture_update(renderer, update);
+}
+
 void texture_bind_id(u32 id, int samples)
 {
     GLenum target = (samples > 0) ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
     // TODO(lucas): Use slots?
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(target, id);
+    gl_active_texture(GL_TEXTURE0);
+    gl_bind_texture(target, id);
 }
 
 void texture_bind(Texture* tex, int samples)
@@ -254,12 +292,358 @@ void texture_bind(Texture* tex, int samples)
 void texture_unbind(int samples)
 {
     GLenum target = (samples > 0) ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
-    glBindTexture(target, 0);
+    gl_bind_texture(target, 0);
 }
 
 void texture_delete(Texture* tex)
 {
+    // NOTE(lucas): The slot's GL name would be deleted again when the slot is freed or the renderer is deleted
+    ASSERT(!tex->handle.generation, "Pooled textures must be freed with texture_free");
+    if (tex->handle.generation)
+        return;
+
+    gl_forget_texture(tex->id);
     glDeleteTextures(1, &tex->id);
     if (tex->data)
         stbi_image_free(tex->data);
 }
+
+void texture_free(Renderer* renderer, Texture* tex)
+{
+    renderer_texture_free(renderer, tex->handle);
+    tex->handle = (TextureHandle){0};
+    tex->id = 0;
+}
+
+internal GLenum texture_format(int channels)
+{
+    GLenum result = 0;
+    switch(channels)
+    {
+        case 1: result = GL_RED;  break;
+        case 2: result = GL_RG;   break;
+        case 3: result = GL_RGB;  break;
+        case 4: result = GL_RGBA; break;
+        default: break;
+    }
+    return result;
+}
+
+internal GLenum texture_internal_format(int channels)
+{
+    GLenum result = 0;
+    switch(channels)
+    {
+        case 1: result = GL_R8;    break;
+        case 2: result = GL_RG8;   break;
+        case 3: result = GL_RGB8;  break;
+        case 4: result = GL_RGBA8; break;
+        default: break;
+    }
+    return result;
+}
+
+internal void texture_load_free_pixels(TextureLoad* load)
+{
+    if (load->file_data)
+        free(load->file_data);
+    else if (load->pixels)
+        stbi_image_free(load->pixels);
+    load->file_data = NULL;
+    load->pixels = NULL;
+}
+
+// NOTE(lucas): Runs on a job worker. Only touches its own load until the status is published.
+internal void texture_load_decode(void* data)
+{
+    PROFILE_BEGIN("texture_load_decode");
+    TextureLoad* load = (TextureLoad*)data;
+    char* filename = load->filename;
+    stbi_set_flip_vertically_on_load_thread(true);
+
+    Texture tex = {0};
+    if (file_exists(filename))
+    {
+        size file_size = file_get_size(filename);
+        void* file = file_open(filename, FileMode_Read);
+        u16 signature = 0;
+        file_read(file, &signature, sizeof(signature));
+        b32 is_bmp = (signature == 0x4D42);
+
+        if (is_bmp && file_size >= (size)sizeof(BitmapHeader))
+        {
+            u8* file_data = (u8*)malloc(file_size);
+            file_seek(file, 0, FileSeek_Begin);
+            file_read(file, file_data, file_size);
+            file_close(file);
+
+            // NOTE(lucas): Unsupported compression asserts in load_bmp_from_memory, so it is rejected here instead
+            BitmapHeader* header = (BitmapHeader*)file_data;
+            if (header->compression == 0 || header->compression == 3)
+            {
+                tex = load_bmp_from_memory(file_data, file_size);
+                load->file_data = file_data;
+                load->row_bytes = ((i32)tex.size.x*tex.channels + 3) & ~3;
+                load->unpack_alignment = 4;
+            }
+            else
+            {
+                free(file_data);
+            }
+        }
+        else
+        {
+            file_close(file);
+
+            int width, height;
+            tex.data = stbi_load(filename, &width, &height, &tex.channels, 0);
+            tex.size = v2((f32)width, (f32)height);
+            load->row_bytes = width*tex.channels;
+            load->unpack_alignment = 1;
+        }
+    }
+
+    if (!tex.data || !texture_internal_format(tex.channels))
+    {
+        log_error("Failed to load texture %s", filename);
+        load->pixels = tex.data;
+        texture_load_free_pixels(load);
+        atomic_store_i64(&load->status, TEXTURE_LOAD_FAILED);
+        PROFILE_END();
+        return;
+    }
+
+    load->pixels = tex.data;
+    load->texture = tex;
+    load->texture.data = NULL;
+    load->rows_uploaded = 0;
+    atomic_store_i64(&load->status, TEXTURE_LOAD_DECODED);
+    PROFILE_END();
+}
+
+void texture_loader_init(Renderer* renderer, JobSystem* jobs, size frame_budget)
+{
+    TextureLoader* loader = &renderer->texture_loader;
+    loader->jobs = jobs;
+    loader->frame_budget = frame_budget ? frame_budget : MEGABYTES(4);
+    loader->decodes.value = 0;
+
+    // NOTE(lucas): The table is only needed by renderers that load asynchronously, so it is not part of the Renderer.
+    // Like the thread command buffers, it is kept if the loader is initialized again.
+    if (!loader->loads)
+    {
+        loader->arena = memory_arena_alloc(TEXTURE_LOADER_MAX_LOADS*sizeof(TextureLoad));
+        loader->loads = push_array(&loader->arena, TEXTURE_LOADER_MAX_LOADS, TextureLoad);
+    }
+    for (u32 i = 0; i < TEXTURE_LOADER_MAX_LOADS; ++i)
+    {
+        loader->loads[i].status = TEXTURE_LOAD_INVALID;
+        loader->loads[i].generation = 1;
+    }
+
+    // NOTE(lucas): One frame's uploads always fit in one region of the stream
+    size region_bytes = (loader->frame_budget > KILOBYTES(256)) ? loader->frame_budget : KILOBYTES(256);
+    renderer->upload_stream = stream_buffer_init(region_bytes);
+}
+
+void texture_loader_delete(Renderer* renderer)
+{
+    TextureLoader* loader = &renderer->texture_loader;
+    if (!loader->jobs)
+        return;
+
+    job_wait(loader->jobs, &loader->decodes);
+    for (u32 i = 0; i < TEXTURE_LOADER_MAX_LOADS; ++i)
+        texture_load_free_pixels(loader->loads + i);
+
+    stream_buffer_delete(&renderer->upload_stream);
+    loader->jobs = NULL;
+}
+
+TextureLoadHandle texture_load_async(Renderer* renderer, const char* filename)
+{
+    TextureLoader* loader = &renderer->texture_loader;
+    ASSERT(loader->jobs, "texture_loader_init must be called before loading textures asynchronously");
+
+    TextureLoadHandle result = {0};
+    size filename_len = str_len((char*)filename);
+    if (filename_len >= TEXTURE_LOADER_MAX_FILENAME_LEN)
+    {
+        log_error("Texture filename is too long: %s", filename);
+        return result;
+    }
+
+    for (u32 i = 0; i < TEXTURE_LOADER_MAX_LOADS; ++i)
+    {
+        TextureLoad* load = loader->loads + i;
+        if (atomic_load_i64(&load->status) != TEXTURE_LOAD_INVALID)
+            continue;
+
+        memcpy(load->filename, filename, filename_len + 1);
+        load->texture = (Texture){0};
+        load->file_data = NULL;
+        load->pixels = NULL;
+        atomic_store_i64(&load->status, TEXTURE_LOAD_QUEUED);
+
+        result.index = i;
+        result.generation = load->generation;
+        return result;
+    }
+
+    log_error("Too many texture loads in flight to load %s", filename);
+    return result;
+}
+
+internal TextureLoad* texture_load_from_handle(Renderer* renderer, TextureLoadHandle handle)
+{
+    TextureLoad* result = NULL;
+    if (renderer->texture_loader.loads && handle.index < TEXTURE_LOADER_MAX_LOADS &&
+        renderer->texture_loader.loads[handle.index].generation == handle.generation)
+    {
+        result = renderer->texture_loader.loads + handle.index;
+    }
+    return result;
+}
+
+TextureLoadStatus texture_load_status(Renderer* renderer, TextureLoadHandle handle)
+{
+    TextureLoad* load = texture_load_from_handle(renderer, handle);
+    TextureLoadStatus result = load ? (TextureLoadStatus)atomic_load_i64(&load->status) : TEXTURE_LOAD_INVALID;
+    return result;
+}
+
+Texture* texture_load_get(Renderer* renderer, TextureLoadHandle handle)
+{
+    Texture* result = NULL;
+    TextureLoad* load = texture_load_from_handle(renderer, handle);
+    if (load && atomic_load_i64(&load->status) == TEXTURE_LOAD_COMPLETE)
+        result = &load->texture;
+    return result;
+}
+
+void texture_load_release(Renderer* renderer, TextureLoadHandle handle)
+{
+    TextureLoad* load = texture_load_from_handle(renderer, handle);
+    if (!load)
+        return;
+
+    i64 status = atomic_load_i64(&load->status);
+    ASSERT(status == TEXTURE_LOAD_COMPLETE || status == TEXTURE_LOAD_FAILED, "Texture load released while in flight");
+    if (status != TEXTURE_LOAD_COMPLETE && status != TEXTURE_LOAD_FAILED)
+        return;
+
+    ++load->generation;
+    if (!load->generation)
+        load->generation = 1;
+    atomic_store_i64(&load->status, TEXTURE_LOAD_INVALID);
+}
+
+// NOTE(lucas): Immutable storage with a single level. Textures are minified with GL_LINEAR like the ones loaded
+// synchronously, so mips would never be sampled. The texture lives in a slot of the texture pool, so texture_free deletes it like any other loaded texture. Runs on the
+// render thread, so the storage is created right away rather than queued.
+internal b32 texture_load_create_storage(Renderer* renderer, TextureLoad* load)
+{
+    Texture* tex = &load->texture;
+    tex->handle = renderer_texture_alloc(renderer);
+    if (!tex->handle.generation)
+        return false;
+    tex->id = renderer_texture_id(renderer, tex->handle);
+
+    int width = (int)tex->size.x;
+    int height = (int)tex->size.y;
+
+    gl_bind_texture(GL_TEXTURE_2D, tex->id);
+    glTexStorage2D(GL_TEXTURE_2D, 1, texture_internal_format(tex->channels), width, height);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return true;
+}
+
+void texture_loader_upload(Renderer* renderer)
+{
+    TextureLoader* loader = &renderer->texture_loader;
+    loader->frame_bytes = 0;
+    loader->frame_completed = 0;
+    if (!loader->jobs)
+        return;
+
+    // NOTE(lucas): Loads are queued by texture_load_async, which may run in the game DLL, and submitted here on the
+    // thread that owns the job system
+    for (u32 i = 0; i < TEXTURE_LOADER_MAX_LOADS; ++i)
+    {
+        TextureLoad* load = loader->loads + i;
+        if (atomic_load_i64(&load->status) != TEXTURE_LOAD_QUEUED)
+            continue;
+
+        atomic_store_i64(&load->status, TEXTURE_LOAD_DECODING);
+        job_run(loader->jobs, texture_load_decode, load, &loader->decodes);
+    }
+
+    StreamBuffer* stream = &renderer->upload_stream;
+    size budget = loader->frame_budget;
+    for (u32 i = 0; i < TEXTURE_LOADER_MAX_LOADS && budget > 0; ++i)
+    {
+        TextureLoad* load = loader->loads + i;
+        i64 status = atomic_load_i64(&load->status);
+        if (status == TEXTURE_LOAD_DECODED)
+        {
+            if (load->row_bytes > stream->region_bytes)
+            {
+                log_error("Rows of texture %s are too large to upload", load->filename);
+                texture_load_free_pixels(load);
+                atomic_store_i64(&load->status, TEXTURE_LOAD_FAILED);
+                continue;
+            }
+
+            if (!texture_load_create_storage(renderer, load))
+            {
+                log_error("No texture slot left for %s", load->filename);
+                texture_load_free_pixels(load);
+                atomic_store_i64(&load->status, TEXTURE_LOAD_FAILED);
+                continue;
+            }
+            status = TEXTURE_LOAD_UPLOADING;
+            atomic_store_i64(&load->status, status);
+        }
+        if (status != TEXTURE_LOAD_UPLOADING)
+            continue;
+
+        Texture* tex = &load->texture;
+        int width = (int)tex->size.x;
+        int height = (int)tex->size.y;
+
+        int rows = (int)(budget / load->row_bytes);
+        if (rows < 1)
+            rows = 1;
+        if (rows > (int)(stream->region_bytes / load->row_bytes))
+            rows = (int)(stream->region_bytes / load->row_bytes);
+        if (rows > height - load->rows_uploaded)
+            rows = height - load->rows_uploaded;
+
+        size bytes = rows*load->row_bytes;
+        ubyte* src = load->pixels + load->rows_uploaded*load->row_bytes;
+        size offset = stream_buffer_push(stream, src, bytes, 4);
+
+        gl_bind_buffer(GL_PIXEL_UNPACK_BUFFER, stream->id);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, load->unpack_alignment);
+        gl_bind_texture(GL_TEXTURE_2D, tex->id);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, load->rows_uploaded, width, rows, texture_format(tex->channels),
+                        GL_UNSIGNED_BYTE, (void*)offset);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        gl_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        load->rows_uploaded += rows;
+        loader->frame_bytes += bytes;
+        budget = (bytes < budget) ? budget - bytes : 0;
+
+        if (load->rows_uploaded == height)
+        {
+            texture_load_free_pixels(load);
+            atomic_store_i64(&load->status, TEXTURE_LOAD_COMPLETE);
+            ++loader->frame_completed;
+        }
+    }
+}
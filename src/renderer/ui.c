@@ -2,16 +2,19 @@
 #include "alchemy/renderer/renderer.h"
 #include "alchemy/util/types.h"
 #include "alchemy/util/str.h"
+#include "alchemy/util/time.h"
 
 #include <glad/glad.h>
+#include <string.h> // memcmp, memcpy, memset
 
 #define MAX_VERTEX_BUFFER 512 * 1024
 #define MAX_ELEMENT_BUFFER 128 * 1024
 
+// NOTE(lucas): Must match the vertex layout of the UI renderer
 typedef struct Vertex {
     f32 position[2];
     f32 uv[2];
-    nk_byte col[4];
+    f32 col[4];
 } Vertex;
 
 // NOTE(lucas): Parameter list must match nk_text_width_f
@@ -19,14 +22,198 @@ internal f32 nk_alchemy_font_get_text_width(nk_handle handle, f32 height, const
 {
     f32 result = 0.0f;
 
+    UIFont* ui_font = (UIFont*)handle.ptr;
+    Font* font = &ui_font->font;
+    UITextWidthCache* cache = ui_font->width_cache;
+
+    // FNV-1a
+    u32 hash = 2166136261u;
+    for (int i = 0; i < len; ++i)
+    {
+        hash ^= (u8)str[i];
+        hash *= 16777619u;
+    }
+
+    u32 mask = UI_TEXT_WIDTH_CACHE_SIZE - 1;
+    u32 index = (hash ^ (u32)len ^ (u32)height) & mask;
+    UITextWidth* entry = cache->entries + index;
+    while (entry->face)
+    {
+        if (entry->face == font->face && entry->sdf == font->sdf && entry->height == height &&
+            entry->hash == hash && entry->len == len && memcmp(cache->strings + entry->offset, str, len) == 0)
+        {
+            ++cache->hits;
+            return entry->width;
+        }
+        index = (index + 1) & mask;
+        entry = cache->entries + index;
+    }
+
+    ++cache->misses;
     s8 s = (s8){(u8*)str, len};
-    Font* font = (Font*)handle.ptr;
     Text text = text_init(s, font, v2_zero(), (u32)height);
-    result = text_get_width(&text);
+    result = text.string_width;
+
+    if (len > UI_TEXT_WIDTH_CACHE_STRING_BYTES)
+        return result;
+
+    // NOTE(lucas): Clear when 3/4 full so probe sequences stay short. Strings still in use are re-measured next frame.
+    if (cache->count >= UI_TEXT_WIDTH_CACHE_SIZE*3/4 || cache->strings_used + len > UI_TEXT_WIDTH_CACHE_STRING_BYTES)
+    {
+        memset(cache->entries, 0, UI_TEXT_WIDTH_CACHE_SIZE*sizeof(*cache->entries));
+        cache->count = 0;
+        cache->strings_used = 0;
+        index = (hash ^ (u32)len ^ (u32)height) & mask;
+        entry = cache->entries + index;
+    }
+
+    entry->face = font->face;
+    entry->sdf = font->sdf;
+    entry->height = height;
+    entry->hash = hash;
+    entry->len = len;
+    entry->offset = cache->strings_used;
+    entry->width = result;
+    memcpy(cache->strings + cache->strings_used, str, len);
+    cache->strings_used += len;
+    ++cache->count;
 
     return result;
 }
 
+// Forget every glyph after the atlas page was evicted, and put the white texels back
+internal void ui_font_atlas_reset(UIFontAtlas* font_atlas)
+{
+    zero_array(font_atlas->glyphs, UI_FONT_MAX_GLYPHS, UIGlyph);
+    font_atlas->glyph_count = 0;
+
+    ubyte white[4*4*4];
+    memset(white, 0xFF, sizeof(white));
+    font_atlas->white = atlas_insert(font_atlas->renderer, &font_atlas->atlas, 4, 4, 4, white);
+    font_atlas->evictions = font_atlas->atlas.evictions;
+}
+
+internal void ui_font_atlas_init(UIFontAtlas* font_atlas, Renderer* renderer, MemoryArena* arena)
+{
+    font_atlas->glyphs = push_array(arena, UI_FONT_MAX_GLYPHS, UIGlyph);
+    font_atlas->renderer = renderer;
+    atlas_init(&font_atlas->atlas, UI_FONT_ATLAS_PAGE_SIZE, 1, 4, arena);
+    ui_font_atlas_reset(font_atlas);
+}
+
+internal void ui_glyph_rasterize(UIFontAtlas* font_atlas, UIGlyph* glyph)
+{
+    FT_Face face = glyph->face;
+    FT_Set_Pixel_Sizes(face, 0, glyph->px);
+
+    u32 glyph_index = FT_Get_Char_Index(face, glyph->codepoint);
+    if (FT_Load_Glyph(face, glyph_index, FT_LOAD_RENDER))
+    {
+        log_error("FreeType2 error: Failed to load glyph for codepoint %u", glyph->codepoint);
+        return;
+    }
+
+    FT_GlyphSlot slot = face->glyph;
+    glyph->left = (f32)slot->bitmap_left;
+    glyph->top = (f32)slot->bitmap_top;
+
+    int width = (int)slot->bitmap.width;
+    int height = (int)slot->bitmap.rows;
+    if (!width || !height)
+        return;
+
+    // NOTE(lucas): White texels with the glyph's coverage in alpha, so glyphs can be tinted by the vertex color
+    MemoryArena* scratch_arena = &font_atlas->renderer->scratch_arena;
+    size bytes = 4*width*height;
+    ubyte* pixels = push_array(scratch_arena, bytes, ubyte);
+    for (int y = 0; y < height; ++y)
+    {
+        ubyte* src = slot->bitmap.buffer + y*slot->bitmap.pitch;
+        ubyte* dest = pixels + 4*y*width;
+        for (int x = 0; x < width; ++x)
+        {
+            dest[4*x + 0] = 0xFF;
+            dest[4*x + 1] = 0xFF;
+            dest[4*x + 2] = 0xFF;
+            dest[4*x + 3] = src[x];
+        }
+    }
+    glyph->region = atlas_insert(font_atlas->renderer, &font_atlas->atlas, width, height, 4, pixels);
+    memory_arena_pop(scratch_arena, bytes);
+}
+
+internal UIGlyph ui_font_atlas_get(UIFontAtlas* font_atlas, FT_Face face, u32 px, u32 codepoint)
+{
+    u32 mask = UI_FONT_MAX_GLYPHS - 1;
+    u32 hash = (codepoint*2654435761u) ^ (px*40503u);
+    u32 slot = hash & mask;
+    while (font_atlas->glyphs[slot].face)
+    {
+        UIGlyph* glyph = font_atlas->glyphs + slot;
+        if (glyph->face == face && glyph->px == px && glyph->codepoint == codepoint)
+            return *glyph;
+        slot = (slot + 1) & mask;
+    }
+
+    UIGlyph glyph = {0};
+    glyph.face = face;
+    glyph.px = px;
+    glyph.codepoint = codepoint;
+    ui_glyph_rasterize(font_atlas, &glyph);
+
+    // NOTE(lucas): If the page was evicted to make room, the new glyph is the only valid one left on it.
+    // The table is also cleared when 3/4 full so probes stay short. The page keeps its glyphs until it fills up.
+    if (font_atlas->atlas.evictions != font_atlas->evictions)
+        ui_font_atlas_reset(font_atlas);
+    else if (font_atlas->glyph_count >= 3*UI_FONT_MAX_GLYPHS/4)
+    {
+        zero_array(font_atlas->glyphs, UI_FONT_MAX_GLYPHS, UIGlyph);
+        font_atlas->glyph_count = 0;
+    }
+
+    slot = hash & mask;
+    while (font_atlas->glyphs[slot].face)
+        slot = (slot + 1) & mask;
+    font_atlas->glyphs[slot] = glyph;
+    ++font_atlas->glyph_count;
+
+    return glyph;
+}
+
+// NOTE(lucas): Parameter list must match nk_query_font_glyph_f
+internal void nk_alchemy_font_query_glyph(nk_handle handle, f32 height, struct nk_user_font_glyph* glyph,
+                                          nk_rune codepoint, nk_rune next_codepoint)
+{
+    UIFont* ui_font = (UIFont*)handle.ptr;
+    Font* font = &ui_font->font;
+    u32 px = (u32)height;
+
+    // NOTE(lucas): Advances are measured the same way as text_get_width so glyphs line up with the widths
+    // nuklear used for layout. SDF fonts are measured at their reference size and scaled.
+    u32 metrics_px = font->sdf ? font->sdf_px : px;
+    f32 scale = (f32)px / (f32)metrics_px;
+    FontSizeMetrics* size_metrics = font_metrics_get_size(font, metrics_px, 0);
+    GlyphMetrics* metrics = font_metrics_get_glyph(font, size_metrics, codepoint);
+    u32 glyph_index = metrics->glyph_index;
+    f32 advance = metrics->advance;
+    if (next_codepoint)
+    {
+        u32 next_glyph_index = font_metrics_get_glyph(font, size_metrics, next_codepoint)->glyph_index;
+        advance += font_metrics_get_kerning(font, size_metrics, glyph_index, next_glyph_index);
+    }
+    glyph->xadvance = advance*scale;
+
+    UIGlyph ui_glyph = ui_font_atlas_get(ui_font->font_atlas, font->face, px, codepoint);
+    AtlasRegion* region = &ui_glyph.region;
+    glyph->offset = nk_vec2(ui_glyph.left, height*0.75f - ui_glyph.top);
+    glyph->width = (f32)region->width;
+    glyph->height = (f32)region->height;
+
+    // NOTE(lucas): ui.fs flips v for textures loaded bottom-up. Glyph rows are stored top-down, so flip them back.
+    glyph->uv[0] = nk_vec2(region->uv.x, 1.0f - region->uv.y);
+    glyph->uv[1] = nk_vec2(region->uv.x + region->uv.width, 1.0f - (region->uv.y + region->uv.height));
+}
+
 internal v4 nk_color_to_v4(struct nk_color color)
 {
     struct nk_colorf cf = nk_color_cf(color);
@@ -77,7 +264,88 @@ void ui_draw_text_area(Renderer* renderer, TextArea* text_area, v2 offset)
     nk_push_custom(out, bounds, nk_draw_text_area, data);
 }
 
-void ui_render(Renderer* renderer, enum nk_anti_aliasing aa)
+struct nk_image ui_image_from_atlas(AtlasRegion* region)
+{
+    // NOTE(lucas): Nuklear regions are measured from the top of the image, but atlas pages are stored bottom-up like
+    // every other texture, so the region is flipped here.
+    Texture* page = region->texture;
+    f32 y = (f32)(page->size.y - region->y - region->height);
+    struct nk_rect sub_region = nk_rect((f32)region->x, y, (f32)region->width, (f32)region->height);
+    struct nk_image result = nk_subimage_ptr(page, (nk_ushort)page->size.x, (nk_ushort)page->size.y, sub_region);
+    return result;
+}
+
+internal void ui_render_vertex_buffer(Renderer* renderer, enum nk_anti_aliasing aa)
+{
+    UIState* state = &renderer->ui_state;
+    UIFontAtlas* font_atlas = &state->font_atlas;
+
+    persist const struct nk_draw_vertex_layout_element vertex_layout[] = {
+        {NK_VERTEX_POSITION, NK_FORMAT_FLOAT,              NK_OFFSETOF(Vertex, position)},
+        {NK_VERTEX_TEXCOORD, NK_FORMAT_FLOAT,              NK_OFFSETOF(Vertex, uv)},
+        {NK_VERTEX_COLOR,    NK_FORMAT_R32G32B32A32_FLOAT, NK_OFFSETOF(Vertex, col)},
+        {NK_VERTEX_LAYOUT_END}
+    };
+
+    // NOTE(lucas): Untextured shapes sample the center of the white texels. v is flipped for ui.fs like glyphs are.
+    AtlasRegion* white = &font_atlas->white;
+    struct nk_convert_config config = {0};
+    config.vertex_layout = vertex_layout;
+    config.vertex_size = sizeof(Vertex);
+    config.vertex_alignment = NK_ALIGNOF(Vertex);
+    config.tex_null.texture = nk_handle_ptr(white->texture);
+    config.tex_null.uv = nk_vec2(white->uv.x + 0.5f*white->uv.width, 1.0f - (white->uv.y + 0.5f*white->uv.height));
+    config.circle_segment_count = 22;
+    config.curve_segment_count = 22;
+    config.arc_segment_count = 22;
+    config.global_alpha = 1.0f;
+    config.shape_AA = aa;
+    config.line_AA = aa;
+
+    struct nk_buffer vertices;
+    struct nk_buffer elements;
+    nk_buffer_init_fixed(&vertices, state->vertices, MAX_VERTEX_BUFFER);
+    nk_buffer_init_fixed(&elements, state->elements, MAX_ELEMENT_BUFFER);
+    nk_buffer_clear(&state->draw_commands);
+
+    nk_flags result = nk_convert(&state->ctx, &state->draw_commands, &vertices, &elements, &config);
+    if (result != NK_CONVERT_SUCCESS)
+        log_warn("Failed to convert UI to vertices (%u). Some widgets will not be drawn.", result);
+
+    state->draw_count = 0;
+    const struct nk_draw_command* draw_cmd;
+    nk_draw_foreach(draw_cmd, &state->ctx, &state->draw_commands)
+    {
+        if (!draw_cmd->elem_count)
+            continue;
+        if (state->draw_count == UI_MAX_DRAW_COMMANDS)
+        {
+            log_warn("Too many UI draw commands. Increase UI_MAX_DRAW_COMMANDS.");
+            break;
+        }
+
+        UIDrawCommand* draw = state->draws + state->draw_count++;
+        draw->texture = (Texture*)draw_cmd->texture.ptr;
+        draw->clip = rect_min_dim(v2(draw_cmd->clip_rect.x, draw_cmd->clip_rect.y),
+                                  v2(draw_cmd->clip_rect.w, draw_cmd->clip_rect.h));
+        draw->element_count = draw_cmd->elem_count;
+    }
+
+    draw_ui(renderer, (u32)vertices.allocated, (u32)elements.allocated);
+
+    // NOTE(lucas): nk_convert skips custom commands (e.g. text areas), so they are drawn on top of the rest of the UI
+    const struct nk_command* cmd;
+    nk_foreach(cmd, &state->ctx)
+    {
+        if (cmd->type == NK_COMMAND_CUSTOM)
+        {
+            const struct nk_command_custom* c = (const struct nk_command_custom*)cmd;
+            c->callback(NULL, c->x, c->y, c->w, c->h, c->callback_data);
+        }
+    }
+}
+
+internal void ui_render_commands(Renderer* renderer)
 {
     UIState* state = &renderer->ui_state;
     u32 shader = renderer->ui_renderer.shader;
@@ -87,7 +355,6 @@ void ui_render(Renderer* renderer, enum nk_anti_aliasing aa)
     shader_bind(shader);
     shader_set_i32(shader, "tex", 0);
     shader_set_m4(shader, "projection", projection, false);
-    renderer_viewport(renderer, rect_min_dim(v2_zero(), v2((f32)renderer->window_width, (f32)renderer->window_height)));
 
     const struct nk_command* cmd;
     nk_foreach(cmd, &state->ctx)
@@ -214,10 +481,12 @@ void ui_render(Renderer* renderer, enum nk_anti_aliasing aa)
             {
                 const struct nk_command_text* t = (const struct nk_command_text*)cmd;
                 v4 color = nk_color_to_v4(t->foreground);
-                Font* font = (Font*)t->font->userdata.ptr;
+                UIFont* ui_font = (UIFont*)t->font->userdata.ptr;
                 v2 pos = {(f32)t->x, (f32)t->y + (f32)t->font->height*0.75f};
-                s8 s = {(u8*)t->string, (size)str_len(t->string)};
-                Text text = text_init(s, font, pos, (u32)t->font->height);
+                s8 s = {(u8*)t->string, (size)t->length};
+                // NOTE(lucas): The width was already measured (and cached) by nuklear during layout
+                f32 width = t->font->width(t->font->userdata, t->font->height, t->string, t->length);
+                Text text = text_init_with_width(s, &ui_font->font, pos, (u32)t->font->height, width);
                 text.color = color;
                 draw_text(renderer, text);
             } break;
@@ -233,6 +502,17 @@ void ui_render(Renderer* renderer, enum nk_anti_aliasing aa)
                 sprite.color = tint;
                 sprite.position = pos;
                 sprite.size = size;
+
+                // NOTE(lucas): Sub-images (e.g. from ui_image_from_atlas) store the full image size and a pixel region
+                const struct nk_image* img = &i->img;
+                if (img->w && img->h && (img->region[2] || img->region[3]))
+                {
+                    f32 inv_w = 1.0f / (f32)img->w;
+                    f32 inv_h = 1.0f / (f32)img->h;
+                    f32 v = 1.0f - (f32)(img->region[1] + img->region[3])*inv_h;
+                    sprite.uv = rect_min_dim(v2((f32)img->region[0]*inv_w, v),
+                                             v2((f32)img->region[2]*inv_w, (f32)img->region[3]*inv_h));
+                }
                 draw_sprite(renderer, sprite);
             } break;
 
@@ -245,10 +525,235 @@ void ui_render(Renderer* renderer, enum nk_anti_aliasing aa)
             default: break;
         }
     }
-    nk_clear(&state->ctx);
     shader_unbind();
 }
 
+// FNV-1a
+internal u64 ui_hash_bytes(u64 hash, void* data, size bytes)
+{
+    u8* at = (u8*)data;
+    for (size i = 0; i < bytes; ++i)
+    {
+        hash ^= at[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+internal rect ui_rect_from_nk(struct nk_rect r)
+{
+    rect result = rect_min_dim(v2(r.x, r.y), v2(r.w, r.h));
+    return result;
+}
+
+/* NOTE(lucas): Must be called before the command list is built (i.e. before nk_foreach), while each command's next
+ * offset still points right after it. The next offsets are absolute, so they are skipped to keep a window's hash from
+ * changing when a window before it in memory grows.
+ */
+internal u64 ui_hash_commands(struct nk_context* ctx, nk_size begin, nk_size end, b32* has_custom)
+{
+    u64 hash = 14695981039346656037ull;
+    u8* base = (u8*)ctx->memory.memory.ptr;
+    for (nk_size offset = begin; offset < end;)
+    {
+        struct nk_command* cmd = (struct nk_command*)(base + offset);
+        if (cmd->next <= offset || cmd->next > end)
+            break;
+
+        hash = ui_hash_bytes(hash, &cmd->type, sizeof(cmd->type));
+        hash = ui_hash_bytes(hash, cmd + 1, cmd->next - offset - sizeof(*cmd));
+        if (cmd->type == NK_COMMAND_CUSTOM)
+            *has_custom = true;
+
+        offset = cmd->next;
+    }
+    return hash;
+}
+
+// Returns false if there are too many windows to track
+internal b32 ui_cache_collect_windows(struct nk_context* ctx, UICacheWindow* windows, u32* window_count)
+{
+    u32 count = 0;
+    for (struct nk_window* win = ctx->begin; win; win = win->next)
+    {
+        // NOTE(lucas): Same windows nk_build draws
+        if (win->buffer.last == win->buffer.begin || (win->flags & NK_WINDOW_HIDDEN) || win->seq != ctx->seq)
+            continue;
+        if (count == UI_CACHE_MAX_WINDOWS)
+            return false;
+
+        UICacheWindow* window = windows + count++;
+        *window = (UICacheWindow){0};
+        window->name = win->name;
+        window->bounds = ui_rect_from_nk(win->bounds);
+        window->hash = ui_hash_commands(ctx, win->buffer.begin, win->buffer.end, &window->always_dirty);
+
+        // NOTE(lucas): Popup commands live in the parent's memory but are skipped by its command list
+        struct nk_popup_buffer* popup = &win->popup.buf;
+        if (popup->active && win->popup.win)
+        {
+            u64 popup_hash = ui_hash_commands(ctx, popup->begin, popup->end, &window->always_dirty);
+            window->hash = ui_hash_bytes(window->hash, &popup_hash, sizeof(popup_hash));
+            window->bounds = rect_union(window->bounds, ui_rect_from_nk(win->popup.win->bounds));
+        }
+    }
+
+    // NOTE(lucas): The cursor overlay is drawn by nk_build, so it is tracked from the input instead
+    const struct nk_cursor* cursor = ctx->style.cursor_active ? ctx->style.cursor_active : ctx->style.cursors[NK_CURSOR_ARROW];
+    if (cursor && !ctx->input.mouse.grabbed && ctx->style.cursor_visible)
+    {
+        if (count == UI_CACHE_MAX_WINDOWS)
+            return false;
+
+        UICacheWindow* window = windows + count++;
+        *window = (UICacheWindow){0};
+        window->bounds = rect_min_dim(v2(ctx->input.mouse.pos.x - cursor->offset.x, ctx->input.mouse.pos.y - cursor->offset.y),
+                                      v2(cursor->size.x, cursor->size.y));
+        window->hash = ui_hash_bytes(14695981039346656037ull, (void*)&cursor, sizeof(cursor));
+        window->hash = ui_hash_bytes(window->hash, &window->bounds, sizeof(window->bounds));
+    }
+
+    *window_count = count;
+    return true;
+}
+
+// Returns the region that has to be redrawn, top-left origin. The region is empty if nothing changed.
+internal rect ui_cache_damage(UIRenderCache* cache, UICacheWindow* windows, u32 window_count)
+{
+    rect dirty = {0};
+
+    for (u32 i = 0; i < window_count; ++i)
+    {
+        UICacheWindow* window = windows + i;
+        UICacheWindow* previous = NULL;
+        u32 previous_index = 0;
+        for (; previous_index < cache->window_count; ++previous_index)
+        {
+            if (cache->windows[previous_index].name == window->name)
+            {
+                previous = cache->windows + previous_index;
+                break;
+            }
+        }
+
+        // NOTE(lucas): A window that changed places in the draw order may now be covered by, or cover, another window
+        b32 changed = (!previous || previous_index != i || previous->hash != window->hash ||
+                       !rect_eq(previous->bounds, window->bounds) || window->always_dirty);
+        if (changed)
+        {
+            dirty = rect_union(dirty, window->bounds);
+            if (previous)
+                dirty = rect_union(dirty, previous->bounds);
+        }
+    }
+
+    for (u32 i = 0; i < cache->window_count; ++i)
+    {
+        UICacheWindow* previous = cache->windows + i;
+        b32 found = false;
+        for (u32 j = 0; j < window_count && !found; ++j)
+            found = (windows[j].name == previous->name);
+        if (!found)
+            dirty = rect_union(dirty, previous->bounds);
+    }
+
+    return dirty;
+}
+
+void ui_enable_render_cache(Renderer* renderer, b32 enabled)
+{
+    UIRenderCache* cache = &renderer->ui_state.render_cache;
+    cache->enabled = enabled;
+    ui_invalidate_render_cache(renderer);
+}
+
+void ui_invalidate_render_cache(Renderer* renderer)
+{
+    UIRenderCache* cache = &renderer->ui_state.render_cache;
+    cache->valid = false;
+    cache->window_count = 0;
+}
+
+internal void ui_render_backend(Renderer* renderer, enum nk_anti_aliasing aa)
+{
+    if (renderer->ui_state.backend == UI_BACKEND_VERTEX_BUFFER)
+        ui_render_vertex_buffer(renderer, aa);
+    else
+        ui_render_commands(renderer);
+}
+
+void ui_render(Renderer* renderer, enum nk_anti_aliasing aa)
+{
+    UIState* state = &renderer->ui_state;
+    UIRenderCache* cache = &state->render_cache;
+    rect window_bounds = rect_min_dim(v2_zero(), v2((f32)renderer->window_width, (f32)renderer->window_height));
+    renderer_viewport(renderer, window_bounds);
+
+    if (!cache->enabled)
+    {
+        ui_render_backend(renderer, aa);
+        nk_clear(&state->ctx);
+        return;
+    }
+
+    cache->hits = 0;
+    cache->partial_redraws = 0;
+    cache->full_redraws = 0;
+    cache->saved_ms = 0.0f;
+
+    UICacheWindow* windows = push_array(&renderer->scratch_arena, UI_CACHE_MAX_WINDOWS, UICacheWindow);
+    u32 window_count = 0;
+    b32 tracked = ui_cache_collect_windows(&state->ctx, windows, &window_count);
+
+    rect dirty = window_bounds;
+    b32 resized = (cache->width != renderer->window_width || cache->height != renderer->window_height);
+    if (cache->valid && tracked && !resized)
+    {
+        dirty = ui_cache_damage(cache, windows, window_count);
+        if (dirty.width > 0.0f && dirty.height > 0.0f)
+        {
+            // NOTE(lucas): Grow the region a little to cover anti-aliased edges drawn just outside of window bounds
+            dirty = rect_min_dim(v2_sub(dirty.position, v2_full(2.0f)), v2_add(dirty.size, v2_full(4.0f)));
+            dirty = rect_intersect(dirty, window_bounds);
+        }
+    }
+
+    if (tracked)
+        memcpy(cache->windows, windows, window_count*sizeof(*windows));
+    cache->window_count = tracked ? window_count : 0;
+    memory_arena_pop(&renderer->scratch_arena, UI_CACHE_MAX_WINDOWS*sizeof(UICacheWindow));
+
+    if (dirty.width <= 0.0f || dirty.height <= 0.0f)
+    {
+        ++cache->hits;
+        cache->saved_ms = cache->full_redraw_ms;
+        draw_ui_cache_composite(renderer);
+        nk_clear(&state->ctx);
+        return;
+    }
+
+    cache->full_redraw = rect_eq(dirty, window_bounds);
+    if (cache->full_redraw)
+        ++cache->full_redraws;
+    else
+        ++cache->partial_redraws;
+
+    // NOTE(lucas): The cache clip is given with a bottom-left origin like scissor tests
+    rect clip = dirty;
+    clip.y = (f32)renderer->window_height - (dirty.y + dirty.height);
+
+    u64 start = time_ticks();
+    draw_ui_cache_begin(renderer, clip);
+    ui_render_backend(renderer, aa);
+    draw_ui_cache_composite(renderer);
+    cache->translate_ms = (f32)time_ticks_to_ms(time_ticks() - start);
+
+    cache->valid = true;
+    cache->width = renderer->window_width;
+    cache->height = renderer->window_height;
+    nk_clear(&state->ctx);
+}
+
 internal void ui_enter_char(UIState* state, u64 code)
 {
     /* NOTE(lucas): Make sure character code is at least 32, which excludes the NULL character, backspace, and so on.
@@ -278,25 +783,60 @@ internal void ui_clipboard_copy(nk_handle usr, const char *text, int len)
     free(str);
 }
 
-void ui_state_init(Renderer* renderer, Font font, u32 font_size, MemoryArena* arena)
+void ui_set_font(Renderer* renderer, Font font, u32 font_size, MemoryArena* arena)
 {
-    UIState state = {0};
+    UIState* state = &renderer->ui_state;
 
-    Font* new_font = push_struct(arena, Font);
-    *new_font = font;
+    UIFont* new_font = push_struct(arena, UIFont);
+    new_font->font = font;
+    new_font->width_cache = &state->text_width_cache;
 
     struct nk_user_font user_font = {0};
     user_font.userdata = nk_handle_ptr(new_font);
     user_font.height = (f32)font_size;
     user_font.width = nk_alchemy_font_get_text_width;
-    nk_init_default(&state.ctx, &user_font);
-    state.user_font = user_font;
+    state->user_font = user_font;
+    nk_style_set_font(&state->ctx, &state->user_font);
+
+    if (state->backend == UI_BACKEND_VERTEX_BUFFER)
+    {
+        new_font->font_atlas = &state->font_atlas;
+        state->user_font.query = nk_alchemy_font_query_glyph;
+        state->user_font.texture = nk_handle_ptr(&state->font_atlas.atlas.pages[0].texture);
+    }
+
+    UITextWidthCache* cache = &state->text_width_cache;
+    memset(cache->entries, 0, UI_TEXT_WIDTH_CACHE_SIZE*sizeof(*cache->entries));
+    cache->count = 0;
+    cache->strings_used = 0;
+}
 
-    state.ctx.clip.copy = ui_clipboard_copy;
-    state.ctx.clip.paste = ui_clipboard_paste;
-    // state.ctx.clip.userdata = nk_handle_ptr(&state);
+void ui_state_init(Renderer* renderer, Font font, u32 font_size, UIBackend backend, MemoryArena* arena)
+{
+    UIState* state = &renderer->ui_state;
+    memset(state, 0, sizeof(*state));
+    state->backend = backend;
+
+    // NOTE(lucas): The context is initialized in place. It keeps a pointer to the user font, so initializing a local
+    // copy and assigning it to the renderer would leave the style font dangling.
+    nk_init_default(&state->ctx, 0);
+    state->text_width_cache.entries = push_array(arena, UI_TEXT_WIDTH_CACHE_SIZE, UITextWidth);
+    state->text_width_cache.strings = push_array(arena, UI_TEXT_WIDTH_CACHE_STRING_BYTES, u8);
+
+    if (backend == UI_BACKEND_VERTEX_BUFFER)
+    {
+        ui_font_atlas_init(&state->font_atlas, renderer, arena);
+        nk_buffer_init_default(&state->draw_commands);
+        state->vertices = push_size(arena, MAX_VERTEX_BUFFER);
+        state->elements = push_size(arena, MAX_ELEMENT_BUFFER);
+        state->draws = push_array(arena, UI_MAX_DRAW_COMMANDS, UIDrawCommand);
+    }
+
+    ui_set_font(renderer, font, font_size, arena);
 
-    renderer->ui_state = state;
+    state->ctx.clip.copy = ui_clipboard_copy;
+    state->ctx.clip.paste = ui_clipboard_paste;
+    // state->ctx.clip.userdata = nk_handle_ptr(state);
 }
 
 void ui_new_frame(Renderer* renderer, u32 window_width, u32 window_height)
@@ -308,6 +848,8 @@ void ui_new_frame(Renderer* renderer, u32 window_width, u32 window_height)
 
     state->width = window_width;
     state->height = window_height;
+    state->text_width_cache.hits = 0;
+    state->text_width_cache.misses = 0;
 
     nk_input_begin(ctx);
 
@@ -373,6 +915,11 @@ void ui_new_frame(Renderer* renderer, u32 window_width, u32 window_height)
 // TODO(lucas): Clear user font and user data
 void ui_state_delete(UIState* state)
 {
+    if (state->backend == UI_BACKEND_VERTEX_BUFFER)
+    {
+        nk_buffer_free(&state->draw_commands);
+        atlas_delete(state->font_atlas.renderer, &state->font_atlas.atlas);
+    }
     nk_free(&state->ctx);
     memset(state, 0, sizeof(*state));
 }
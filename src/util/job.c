@@ -0,0 +1,290 @@
+#include "alchemy/util/job.h"
+#include "alchemy/util/log.h"
+#include "alchemy/util/profile.h"
+
+// NOTE(lucas): Times an idle worker looks for work before going to sleep
+#define JOB_SPIN_COUNT 64
+
+// NOTE(lucas): Set on every worker thread and on the thread that initialized the job system
+thread_global JobWorker* job_current_worker;
+
+/* Chase-Lev deque. The owner pushes and pops at the bottom, thieves take from the top. The queue has a fixed size,
+ * so a slot can only be overwritten once top has moved past it, which means a thief that read a slot before winning
+ * the race on top always read a valid job.
+ */
+internal b32 job_queue_push(JobQueue* queue, Job* job)
+{
+    i64 bottom = atomic_load_i64(&queue->bottom);
+    i64 top = atomic_load_i64(&queue->top);
+    if (bottom - top >= JOB_QUEUE_SIZE)
+        return false;
+
+    queue->jobs[bottom & (JOB_QUEUE_SIZE - 1)] = *job;
+    atomic_store_i64(&queue->bottom, bottom + 1);
+    return true;
+}
+
+internal b32 job_queue_pop(JobQueue* queue, Job* job)
+{
+    i64 bottom = atomic_load_i64(&queue->bottom) - 1;
+    atomic_store_i64(&queue->bottom, bottom);
+    atomic_fence();
+    i64 top = atomic_load_i64(&queue->top);
+
+    b32 result = false;
+    if (top <= bottom)
+    {
+        *job = queue->jobs[bottom & (JOB_QUEUE_SIZE - 1)];
+        result = true;
+
+        // NOTE(lucas): The last job may be stolen at the same time, so the owner has to win the race on top too
+        if (top == bottom)
+        {
+            result = atomic_compare_exchange_i64(&queue->top, top, top + 1);
+            atomic_store_i64(&queue->bottom, bottom + 1);
+        }
+    }
+    else
+    {
+        atomic_store_i64(&queue->bottom, bottom + 1);
+    }
+    return result;
+}
+
+internal b32 job_queue_steal(JobQueue* queue, Job* job)
+{
+    i64 top = atomic_load_i64(&queue->top);
+    atomic_fence();
+    i64 bottom = atomic_load_i64(&queue->bottom);
+
+    b32 result = false;
+    if (top < bottom)
+    {
+        Job stolen = queue->jobs[top & (JOB_QUEUE_SIZE - 1)];
+        if (atomic_compare_exchange_i64(&queue->top, top, top + 1))
+        {
+            *job = stolen;
+            result = true;
+        }
+    }
+    return result;
+}
+
+internal u32 job_random(u32* state)
+{
+    u32 x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+internal b32 job_take(JobSystem* jobs, JobWorker* worker, Job* job)
+{
+    b32 result = job_queue_pop(&worker->queue, job);
+    if (!result)
+    {
+        u32 start = job_random(&worker->rng) % jobs->worker_count;
+        for (u32 i = 0; i < jobs->worker_count && !result; ++i)
+        {
+            u32 victim = (start + i) % jobs->worker_count;
+            if (victim != worker->index)
+                result = job_queue_steal(&jobs->workers[victim].queue, job);
+        }
+        if (result)
+            ++worker->jobs_stolen;
+    }
+
+    if (result)
+        atomic_add_i64(&jobs->queued, -1);
+    return result;
+}
+
+internal void job_execute(JobSystem* jobs, JobWorker* worker, Job* job);
+
+internal void job_push(JobSystem* jobs, JobWorker* worker, Job* job)
+{
+    if (job->counter)
+        atomic_add_i64(&job->counter->value, 1);
+
+    if (!worker || !job_queue_push(&worker->queue, job))
+    {
+        job_execute(jobs, worker, job);
+        return;
+    }
+
+    // NOTE(lucas): Sleeping workers check queued after announcing themselves, so one of the two sides always sees
+    // the other and no wake up is lost
+    atomic_add_i64(&jobs->queued, 1);
+    if (atomic_load_i64(&jobs->sleeping) > 0)
+        semaphore_signal(&jobs->wake, 1);
+}
+
+internal void job_execute(JobSystem* jobs, JobWorker* worker, Job* job)
+{
+    if (job->range_proc)
+    {
+        // NOTE(lucas): Split off the upper half until the range fits in one batch, so idle workers can steal the rest
+        while (job->end - job->start > job->batch_size)
+        {
+            u32 mid = job->start + (job->end - job->start)/2;
+            Job upper = *job;
+            upper.start = mid;
+            job->end = mid;
+            job_push(jobs, worker, &upper);
+        }
+        job->range_proc(job->data, job->start, job->end);
+    }
+    else
+    {
+        job->proc(job->data);
+    }
+
+    if (worker)
+        ++worker->jobs_run;
+    if (job->counter)
+        atomic_add_i64(&job->counter->value, -1);
+}
+
+internal void job_worker_proc(void* data)
+{
+    JobWorker* worker = (JobWorker*)data;
+    JobSystem* jobs = worker->system;
+    job_current_worker = worker;
+    profile_thread_name("Job worker");
+
+    u32 idle = 0;
+    while (atomic_load_i64(&jobs->running))
+    {
+        Job job;
+        if (job_take(jobs, worker, &job))
+        {
+            job_execute(jobs, worker, &job);
+            idle = 0;
+            continue;
+        }
+
+        if (++idle < JOB_SPIN_COUNT)
+        {
+            thread_yield();
+            continue;
+        }
+
+        atomic_add_i64(&jobs->sleeping, 1);
+        if (!atomic_load_i64(&jobs->queued) && atomic_load_i64(&jobs->running))
+            semaphore_wait(&jobs->wake);
+        atomic_add_i64(&jobs->sleeping, -1);
+        idle = 0;
+    }
+}
+
+void job_system_init(JobSystem* jobs, u32 worker_count, MemoryArena* arena)
+{
+    if (!worker_count)
+        worker_count = thread_hardware_count();
+    if (worker_count > JOB_MAX_WORKERS)
+        worker_count = JOB_MAX_WORKERS;
+    if (!worker_count)
+        worker_count = 1;
+
+    jobs->worker_count = worker_count;
+    jobs->queued = 0;
+    jobs->sleeping = 0;
+    jobs->running = 1;
+    semaphore_init(&jobs->wake, 0);
+
+    for (u32 i = 0; i < worker_count; ++i)
+    {
+        JobWorker* worker = jobs->workers + i;
+        worker->system = jobs;
+        worker->index = i;
+        worker->rng = 0x9E3779B9u*(i + 1);
+        worker->jobs_run = 0;
+        worker->jobs_stolen = 0;
+        worker->queue.top = 0;
+        worker->queue.bottom = 0;
+        worker->queue.jobs = push_array(arena, JOB_QUEUE_SIZE, Job);
+    }
+
+    job_current_worker = jobs->workers;
+    for (u32 i = 1; i < worker_count; ++i)
+    {
+        JobWorker* worker = jobs->workers + i;
+        if (!thread_create(&worker->thread, job_worker_proc, worker))
+            log_error("Failed to start job worker %u", i);
+    }
+}
+
+void job_system_shutdown(JobSystem* jobs)
+{
+    atomic_store_i64(&jobs->running, 0);
+    semaphore_signal(&jobs->wake, jobs->worker_count);
+    for (u32 i = 1; i < jobs->worker_count; ++i)
+        thread_join(&jobs->workers[i].thread);
+    semaphore_delete(&jobs->wake);
+
+    if (job_current_worker == jobs->workers)
+        job_current_worker = 0;
+}
+
+u32 job_worker_index(void)
+{
+    u32 result = job_current_worker ? job_current_worker->index : 0;
+    return result;
+}
+
+void job_run(JobSystem* jobs, JobProc* proc, void* data, JobCounter* counter)
+{
+    ASSERT(job_current_worker, "Jobs can only be submitted from job workers or the thread that started them");
+
+    Job job = {0};
+    job.proc = proc;
+    job.data = data;
+    job.counter = counter;
+    job_push(jobs, job_current_worker, &job);
+}
+
+b32 job_counter_done(JobCounter* counter)
+{
+    b32 result = (atomic_load_i64(&counter->value) <= 0);
+    return result;
+}
+
+void job_wait(JobSystem* jobs, JobCounter* counter)
+{
+    JobWorker* worker = job_current_worker;
+    while (!job_counter_done(counter))
+    {
+        Job job;
+        if (worker && job_take(jobs, worker, &job))
+            job_execute(jobs, worker, &job);
+        else
+            thread_yield();
+    }
+}
+
+void job_parallel_for(JobSystem* jobs, u32 count, u32 batch_size, JobRangeProc* proc, void* data)
+{
+    if (!count)
+        return;
+
+    if (!batch_size)
+    {
+        batch_size = count / (4*jobs->worker_count);
+        if (!batch_size)
+            batch_size = 1;
+    }
+
+    JobCounter counter = {0};
+    Job job = {0};
+    job.range_proc = proc;
+    job.data = data;
+    job.counter = &counter;
+    job.start = 0;
+    job.end = count;
+    job.batch_size = batch_size;
+    job_push(jobs, job_current_worker, &job);
+
+    job_wait(jobs, &counter);
+}
@@ -0,0 +1,271 @@
+#include "alchemy/util/profile.h"
+#include "alchemy/util/log.h"
+#include "alchemy/util/thread.h"
+#include "alchemy/util/time.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct Profiler
+{
+    ProfileThread threads[PROFILE_MAX_THREADS];
+    volatile i64 thread_count;
+    volatile i64 dropped_threads; // Threads that tried to record after every slot was taken or without memory
+    volatile i64 generation;      // Incremented by profile_shutdown, so threads know their slot is gone
+
+    u32 events_per_thread;
+    volatile i64 enabled;
+    u64 start_ticks;
+
+    u64 frame_index;
+    u64 frame_start;
+    f64 last_frame_ms;
+} Profiler;
+
+global Profiler profiler;
+
+// NOTE(lucas): NULL until the thread first records. Threads that could not get a slot keep trying, which is cheap.
+// A slot claimed before the last profile_shutdown is from an older generation, so the thread claims a new one.
+thread_global ProfileThread* profile_current_thread;
+thread_global i64 profile_current_generation;
+thread_global const char* profile_current_thread_name;
+
+internal ProfileThread* profile_thread_get(void)
+{
+    // NOTE(lucas): Rings are sized by profile_init, so no slot is claimed before it runs or while disabled
+    if (!profiler.events_per_thread || !atomic_load_i64(&profiler.enabled))
+        return NULL;
+
+    i64 generation = atomic_load_i64(&profiler.generation);
+    ProfileThread* thread = profile_current_thread;
+    if (thread && profile_current_generation == generation)
+        return thread;
+
+    i64 index = atomic_add_i64(&profiler.thread_count, 1) - 1;
+    if (index >= PROFILE_MAX_THREADS)
+    {
+        atomic_add_i64(&profiler.thread_count, -1);
+        atomic_add_i64(&profiler.dropped_threads, 1);
+        return NULL;
+    }
+
+    thread = profiler.threads + index;
+    thread->events = (ProfileEvent*)malloc(profiler.events_per_thread*sizeof(ProfileEvent));
+    if (!thread->events)
+    {
+        // NOTE(lucas): The slot can only be handed back while it is still the last one claimed. Otherwise it stays
+        // empty, and export skips slots without events.
+        log_error("Failed to allocate profiler events for thread %d", (int)index);
+        atomic_compare_exchange_i64(&profiler.thread_count, index + 1, index);
+        atomic_add_i64(&profiler.dropped_threads, 1);
+        return NULL;
+    }
+    thread->event_count = 0;
+    thread->index = (u32)index;
+    thread->name = profile_current_thread_name ? profile_current_thread_name : "Thread";
+
+    profile_current_thread = thread;
+    profile_current_generation = generation;
+    return thread;
+}
+
+internal void profile_record(const char* name, ProfileEventType type)
+{
+    ProfileThread* thread = profile_thread_get();
+    if (!thread)
+        return;
+
+    i64 count = thread->event_count;
+    ProfileEvent* event = thread->events + (count & (profiler.events_per_thread - 1));
+    event->ticks = time_ticks();
+    event->name = name;
+    event->type = type;
+
+    // NOTE(lucas): Published after the event is written, so an export never reads a half written event
+    atomic_store_i64(&thread->event_count, count + 1);
+}
+
+void profile_init(u32 events_per_thread)
+{
+    if (!events_per_thread)
+        events_per_thread = PROFILE_DEFAULT_EVENTS_PER_THREAD;
+    ASSERT((events_per_thread & (events_per_thread - 1)) == 0, "Profiler event count must be a power of two");
+
+    profiler.events_per_thread = events_per_thread;
+    profiler.start_ticks = time_ticks();
+    profiler.frame_index = 0;
+    profiler.frame_start = 0;
+    profiler.last_frame_ms = 0.0;
+    atomic_store_i64(&profiler.enabled, 1);
+    profile_thread_name("Main");
+}
+
+void profile_shutdown(void)
+{
+    atomic_store_i64(&profiler.enabled, 0);
+    i64 thread_count = atomic_load_i64(&profiler.thread_count);
+    for (i64 i = 0; i < thread_count; ++i)
+    {
+        free(profiler.threads[i].events);
+        profiler.threads[i] = (ProfileThread){0};
+    }
+    atomic_store_i64(&profiler.thread_count, 0);
+    profiler.events_per_thread = 0;
+    atomic_add_i64(&profiler.generation, 1);
+    profile_current_thread = NULL;
+}
+
+void profile_set_enabled(b32 enabled)
+{
+    // NOTE(lucas): Enabling requires profile_init to have picked a ring size
+    if (enabled && !profiler.events_per_thread)
+        return;
+    atomic_store_i64(&profiler.enabled, enabled ? 1 : 0);
+}
+
+b32 profile_enabled(void)
+{
+    b32 result = (atomic_load_i64(&profiler.enabled) != 0);
+    return result;
+}
+
+void profile_begin(const char* name)
+{
+    if (profiler.enabled)
+        profile_record(name, ProfileEvent_Begin);
+}
+
+void profile_end(void)
+{
+    if (profiler.enabled)
+        profile_record(NULL, ProfileEvent_End);
+}
+
+void profile_frame_begin(void)
+{
+    profiler.frame_start = time_ticks();
+    profile_begin("Frame");
+}
+
+void profile_frame_end(void)
+{
+    profile_end();
+    if (profiler.frame_start)
+        profiler.last_frame_ms = time_ticks_to_ms(time_ticks() - profiler.frame_start);
+    ++profiler.frame_index;
+}
+
+u64 profile_frame_index(void)
+{
+    return profiler.frame_index;
+}
+
+f64 profile_last_frame_ms(void)
+{
+    return profiler.last_frame_ms;
+}
+
+void profile_thread_name(const char* name)
+{
+    profile_current_thread_name = name;
+    ProfileThread* thread = profile_current_thread;
+    if (thread && profile_current_generation == atomic_load_i64(&profiler.generation))
+        thread->name = name;
+}
+
+internal void profile_write_string(FILE* file, const char* string)
+{
+    fputc('"', file);
+    for (const char* at = string; at && *at; ++at)
+    {
+        char c = *at;
+        if (c == '"' || c == '\\')
+            fputc('\\', file);
+        if ((u8)c >= 0x20)
+            fputc(c, file);
+    }
+    fputc('"', file);
+}
+
+internal f64 profile_ticks_to_us(u64 ticks)
+{
+    f64 result = 1000.0*time_ticks_to_ms(ticks);
+    return result;
+}
+
+b32 profile_export_chrome_trace(const char* filename)
+{
+    FILE* file = fopen(filename, "wb");
+    if (!file)
+    {
+        log_error("Failed to open %s to export the profile", filename);
+        return false;
+    }
+
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file);
+    b32 first = true;
+    u64 zones = 0;
+
+    i64 thread_count = atomic_load_i64(&profiler.thread_count);
+    for (i64 thread_index = 0; thread_index < thread_count; ++thread_index)
+    {
+        ProfileThread* thread = profiler.threads + thread_index;
+        if (!thread->events)
+            continue;
+
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":",
+                first ? "" : ",\n", thread->index);
+        profile_write_string(file, thread->name);
+        fputs("}}", file);
+        first = false;
+
+        // NOTE(lucas): Begins are matched to ends with a stack. Ends whose begin was overwritten and begins that
+        // never ended are skipped.
+        u32 stack[PROFILE_MAX_DEPTH];
+        u32 depth = 0;
+        u32 dropped_depth = 0;
+
+        i64 event_count = atomic_load_i64(&thread->event_count);
+        i64 oldest = event_count - (i64)profiler.events_per_thread;
+        if (oldest < 0)
+            oldest = 0;
+
+        for (i64 i = oldest; i < event_count; ++i)
+        {
+            u32 slot = (u32)(i & (profiler.events_per_thread - 1));
+            ProfileEvent* event = thread->events + slot;
+            if (event->type == ProfileEvent_Begin)
+            {
+                if (depth < PROFILE_MAX_DEPTH)
+                    stack[depth++] = slot;
+                else
+                    ++dropped_depth;
+                continue;
+            }
+
+            if (dropped_depth)
+            {
+                --dropped_depth;
+                continue;
+            }
+            if (!depth)
+                continue;
+
+            ProfileEvent* begin = thread->events + stack[--depth];
+            u64 start = (begin->ticks > profiler.start_ticks) ? begin->ticks - profiler.start_ticks : 0;
+            u64 duration = (event->ticks > begin->ticks) ? event->ticks - begin->ticks : 0;
+
+            fputs(",\n{\"name\":", file);
+            profile_write_string(file, begin->name);
+            fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                    thread->index, profile_ticks_to_us(start), profile_ticks_to_us(duration));
+            ++zones;
+        }
+    }
+
+    fputs("\n]}\n", file);
+    fclose(file);
+
+    log_info("Exported %llu profile zones to %s", (unsigned long long)zones, filename);
+    return true;
+}
@@ -2,6 +2,8 @@
 
 #if _WIN32
     #include <windows.h>
+#else
+    #include <time.h>
 #endif
 
 void timer_init(Timer* timer, f32 start_seconds, b32 start_active)
@@ -103,3 +105,43 @@ LocalTime get_local_time(void)
 
     return result;
 }
+
+u64 time_ticks(void)
+{
+    u64 result = 0;
+
+#if _WIN32
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    result = (u64)counter.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    result = (u64)ts.tv_sec*1000000000ull + (u64)ts.tv_nsec;
+#endif
+
+    return result;
+}
+
+u64 time_ticks_per_second(void)
+{
+    persist u64 frequency = 0;
+    if (!frequency)
+    {
+#if _WIN32
+        LARGE_INTEGER counter_frequency;
+        QueryPerformanceFrequency(&counter_frequency);
+        frequency = (u64)counter_frequency.QuadPart;
+#else
+        frequency = 1000000000ull;
+#endif
+    }
+
+    return frequency;
+}
+
+f64 time_ticks_to_ms(u64 ticks)
+{
+    f64 result = 1000.0*(f64)ticks / (f64)time_ticks_per_second();
+    return result;
+}
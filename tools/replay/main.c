@@ -0,0 +1,245 @@
+#include "alchemy/window.h"
+#include "alchemy/input.h"
+#include "alchemy/renderer/renderer.h"
+#include "alchemy/util/log.h"
+#include "alchemy/util/time.h"
+
+#include <stdlib.h> // atoi, malloc, free
+
+/* NOTE(lucas): Replays a render capture without showing a window and reports how long the frames took to encode on
+ * the CPU and to draw on the GPU. Captured textures are replaced by checkerboards of the same size and captured fonts
+ * by the default font, so text and UI glyphs look wrong but cost about the same to draw.
+ *
+ *     replay <capture file> [iterations]
+ *
+ * Run from the res directory so the default font can be found.
+ */
+
+#define REPLAY_DEFAULT_ITERATIONS 100
+#define REPLAY_WARMUP_ITERATIONS 1 // Not measured. Fills glyph caches and uploads the stand-in textures.
+#define REPLAY_MAX_TEXTURES 1024
+#define REPLAY_MAX_TEXTURE_SIZE 4096
+#define REPLAY_FONT "fonts/matrix_book.ttf"
+
+typedef struct ReplayStats
+{
+    u64 encode_ticks;
+    u32 frames;
+    u64 draw_calls;
+    u32 gpu_frames;
+    f64 gpu_pass_ms[GPUPass_Count];
+} ReplayStats;
+
+internal void fill_checkerboard(ubyte* pixels, int width, int height)
+{
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            ubyte* p = pixels + 4*((size)y*width + x);
+            ubyte on = (((x / 8) + (y / 8)) & 1) ? 255 : 96;
+            p[0] = on;
+            p[1] = on;
+            p[2] = on;
+            p[3] = 255;
+        }
+    }
+}
+
+internal int replay_texture_dim(i32 dim)
+{
+    int result = dim;
+    if (result < 1)
+        result = 1;
+    if (result > REPLAY_MAX_TEXTURE_SIZE)
+        result = REPLAY_MAX_TEXTURE_SIZE;
+    return result;
+}
+
+// NOTE(lucas): The unbatched sprite path issues one draw per sprite, which is not counted in the renderer stats
+internal u32 replay_unbatched_sprites(RenderCaptureFrame* frame)
+{
+    u32 result = 0;
+    if (frame->header->flags & RenderCaptureFlag_Batching)
+        return result;
+
+    for (size at = 0; at < frame->header->command_bytes;)
+    {
+        RenderCommand* command = (RenderCommand*)(frame->commands + at);
+        if (command->type == RENDER_COMMAND_RenderCommandSprite)
+            ++result;
+        at += render_command_size(command->type);
+    }
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        log_error("Usage: replay <capture file> [iterations]");
+        return 1;
+    }
+
+    u32 iterations = (argc > 2) ? (u32)atoi(argv[2]) : REPLAY_DEFAULT_ITERATIONS;
+    if (!iterations)
+        iterations = REPLAY_DEFAULT_ITERATIONS;
+
+    RenderCaptureFile capture = {0};
+    if (!render_capture_load(&capture, argv[1]))
+        return 1;
+
+    RenderCaptureFrameHeader* first = capture.frames[0].header;
+    int window_width = first->window_width;
+    int window_height = first->window_height;
+
+    Window* window = window_create("Replay", window_width, window_height);
+    window_set_visible(window, false);
+
+    // NOTE(lucas): Room for the largest captured frame plus the strings copied by other draws
+    size command_buffer_bytes = MEGABYTES(4);
+    for (u32 i = 0; i < capture.frame_count; ++i)
+    {
+        size bytes = 2*(size)capture.frames[i].header->command_bytes;
+        if (bytes > command_buffer_bytes)
+            command_buffer_bytes = bytes;
+    }
+
+    Renderer renderer = renderer_init(window, window_width, window_height, command_buffer_bytes);
+    renderer.config.gpu_profiling = true;
+
+    persist RenderCaptureTexture captured_textures[REPLAY_MAX_TEXTURES];
+    persist u32 texture_ids[REPLAY_MAX_TEXTURES];
+    persist Texture textures[REPLAY_MAX_TEXTURES];
+    persist Texture* texture_pointers[REPLAY_MAX_TEXTURES];
+    persist ubyte* texture_pixels[REPLAY_MAX_TEXTURES];
+
+    u32 texture_count = render_capture_textures(&capture, captured_textures, REPLAY_MAX_TEXTURES);
+    if (texture_count > REPLAY_MAX_TEXTURES)
+    {
+        log_warn("The capture uses %u textures, only the first %u get stand-ins", texture_count, REPLAY_MAX_TEXTURES);
+        texture_count = REPLAY_MAX_TEXTURES;
+    }
+
+    // NOTE(lucas): Texture uploads are queued until the next render, so the pixels are kept until the first frame
+    // has been rendered
+    for (u32 i = 0; i < texture_count; ++i)
+    {
+        RenderCaptureTexture* captured = captured_textures + i;
+        int width = replay_texture_dim(captured->width);
+        int height = replay_texture_dim(captured->height);
+        ubyte* pixels = (ubyte*)malloc(4*(size)width*height);
+        fill_checkerboard(pixels, width, height);
+
+        if (captured->layers > 0)
+        {
+            textures[i] = texture_array_init(&renderer, width, height, captured->layers);
+            for (int layer = 0; layer < captured->layers; ++layer)
+                texture_array_set_layer(&renderer, &textures[i], layer, 4, pixels);
+        }
+        else
+        {
+            textures[i] = texture_load_from_memory(&renderer, width, height, 4, pixels);
+        }
+
+        texture_ids[i] = captured->id;
+        texture_pointers[i] = textures + i;
+        texture_pixels[i] = pixels;
+    }
+
+    persist ubyte missing_pixels[32*32*4];
+    fill_checkerboard(missing_pixels, 32, 32);
+    Texture missing_texture = texture_load_from_memory(&renderer, 32, 32, 4, missing_pixels);
+
+    Font font = font_load_from_file(REPLAY_FONT);
+    RenderCaptureFont* captured_font = first->font_count ? capture.frames[0].fonts : 0;
+    if (captured_font && captured_font->sdf)
+        font_enable_sdf(&font, captured_font->sdf_px);
+
+    RenderCaptureResources resources = {0};
+    resources.texture_ids = texture_ids;
+    resources.textures = texture_pointers;
+    resources.texture_count = texture_count;
+    resources.missing_texture = &missing_texture;
+    resources.font = &font;
+
+    log_info("Replaying %u frames %u times at %dx%d", capture.frame_count, iterations, window_width, window_height);
+
+    Input input = {0};
+    ReplayStats stats = {0};
+    for (u32 iteration = 0; iteration < REPLAY_WARMUP_ITERATIONS + iterations && window->open; ++iteration)
+    {
+        b32 measured = (iteration >= REPLAY_WARMUP_ITERATIONS);
+        for (u32 frame_index = 0; frame_index < capture.frame_count; ++frame_index)
+        {
+            RenderCaptureFrame* frame = capture.frames + frame_index;
+            RenderCaptureFrameHeader* header = frame->header;
+            input_process(window, &input);
+
+            renderer.config.batching = (header->flags & RenderCaptureFlag_Batching) != 0;
+            renderer.config.damage_tracking = (header->flags & RenderCaptureFlag_DamageTracking) != 0;
+            renderer.config.dynamic_resolution = (header->flags & RenderCaptureFlag_DynamicResolution) != 0;
+            renderer.config.msaa_level = header->msaa_level;
+
+            // NOTE(lucas): With damage tracking, the first frame of an iteration would otherwise be diffed against
+            // the last frame of the previous one, which the capture never drew it after
+            if (frame_index == 0)
+                renderer_invalidate_damage(&renderer);
+            renderer_viewport(&renderer, header->viewport);
+            renderer_new_frame(&renderer, window);
+
+            // NOTE(lucas): Frames are drawn at the scale they were captured at rather than one picked from the
+            // replay's own frame times
+            renderer.resolution.scale = header->resolution_scale;
+            render_capture_replay(&renderer, frame, &resources);
+
+            u64 start = time_ticks();
+            renderer_render(&renderer);
+            u64 encode_ticks = time_ticks() - start;
+
+            // NOTE(lucas): No swap, since the window is never shown. GPU times arrive a few frames late.
+            if (!measured)
+                continue;
+
+            stats.encode_ticks += encode_ticks;
+            ++stats.frames;
+            stats.draw_calls += renderer.stats.batch_draw_calls + renderer.stats.shape_draw_calls +
+                                renderer.stats.sprite_draw_calls + renderer.stats.text_draw_calls +
+                                renderer.stats.ui_draw_calls + replay_unbatched_sprites(frame);
+
+            if (renderer.gpu_profiler.latest_updated)
+            {
+                GPUFrameTimes gpu_times = renderer_gpu_times(&renderer);
+                for (u32 i = 0; i < GPUPass_Count; ++i)
+                    stats.gpu_pass_ms[i] += gpu_times.pass_ms[i];
+                ++stats.gpu_frames;
+            }
+        }
+
+        if (iteration == 0)
+        {
+            for (u32 i = 0; i < texture_count; ++i)
+            {
+                free(texture_pixels[i]);
+                texture_pixels[i] = 0;
+            }
+        }
+    }
+
+    if (stats.frames)
+    {
+        log_info("CPU encode %8.3f ms/frame", time_ticks_to_ms(stats.encode_ticks) / (f64)stats.frames);
+        log_info("Draw calls %8.1f /frame", (f64)stats.draw_calls / (f64)stats.frames);
+    }
+    if (stats.gpu_frames)
+    {
+        log_info("GPU        %8.3f ms/frame", stats.gpu_pass_ms[GPUPass_Frame] / (f64)stats.gpu_frames);
+        for (u32 i = 0; i < GPUPass_Count; ++i)
+            log_info("GPU %-10s %5.3f ms/frame", gpu_pass_name(i), stats.gpu_pass_ms[i] / (f64)stats.gpu_frames);
+    }
+
+    renderer_delete(&renderer);
+    render_capture_free(&capture);
+
+    return 0;
+}